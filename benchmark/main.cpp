@@ -28,6 +28,9 @@ uint32_t calculateNonzeroLocktimeSingleThreaded(BlockRange &chain);
 uint32_t calculateNonzeroLocktimeMultithreaded(BlockRange &chain);
 uint32_t calculateVersionGreaterOneSingleThreaded(BlockRange &chain);
 uint32_t calculateVersionGreaterOneMultithreaded(BlockRange &chain);
+int64_t calculateMaxFeeColumnar(BlockRange &chain);
+uint32_t calculateNonzeroLocktimeColumnar(BlockRange &chain);
+uint32_t calculateVersionGreaterOneColumnar(BlockRange &chain);
 uint32_t calculateUniqueLocktimeChangeSingleThreaded(BlockRange &chain);
 uint32_t calculateUniqueLocktimeChangeMultithreaded(BlockRange &chain);
 uint32_t calculateZeroConfOutputSingleThreaded(BlockRange &chain);
@@ -35,8 +38,12 @@ uint32_t calculateZeroConfOutputMultithreaded(BlockRange &chain);
 
 int64_t calculateSatoshiDiceTotalOutputValue(BlockRange &chain, uint32_t addressNum, AddressType::Enum type);
 
+uint64_t clusterChain(BlockRange &chain, const std::string &outputLocation, ClusteringStats &stats);
+
 uint32_t calculateNonzeroLocktimeRandom(Blockchain &chain, const std::vector<uint32_t> &indexes);
 int64_t calculateMaxFeeRandom(Blockchain &chain, const std::vector<uint32_t> &indexes);
+int64_t calculateBlockHeightSumSearchRandom(Blockchain &chain, const std::vector<uint32_t> &indexes);
+int64_t calculateBlockHeightSumRandom(Blockchain &chain, const std::vector<uint32_t> &indexes);
 
 template <typename Func, typename... Args>
 auto timeFunc(std::string name, Func func, uint32_t iterations, Args&& ...args) -> decltype(func(args...));
@@ -44,6 +51,8 @@ auto timeFunc(std::string name, Func func, uint32_t iterations, Args&& ...args)
 int main(int argc, char * argv[]) {
     bool includeRandom = false;
     bool includeTraversal = false;
+    std::string clusterLocation;
+    unsigned int threadCount = 0;
     std::string configLocation;
     int endBlock = 0;
     uint32_t iterations = 1;
@@ -52,6 +61,8 @@ int main(int argc, char * argv[]) {
         clipp::value("config file location", configLocation),
         clipp::option("-r", "--with-random").set(includeRandom).doc("Include random order benchmarks"),
         clipp::option("-t", "--with-traversal").set(includeTraversal).doc("Include graph traversal benchmarks"),
+        clipp::option("-c", "--with-clustering") & clipp::value("Cluster the chain into the given directory", clusterLocation),
+        clipp::option("--threads") & clipp::value("Number of threads for multithreaded benchmarks", threadCount),
         clipp::option("-m", "--max-block") & clipp::value("Run benchmark up to the given block", endBlock),
         clipp::option("-i", "--iterations") & clipp::value("Number of iterations for each benchmark", iterations)
     );
@@ -61,12 +72,18 @@ int main(int argc, char * argv[]) {
         return 0;
     }
 
+    if (threadCount > 0) {
+        ThreadPool::instance().setThreadCount(threadCount);
+    }
+
     Blockchain chain(configLocation, endBlock);
     
     std::cout << "Heating up cache." << std::endl;
 
     timeFunc("loadingTxData", calculateMaxFeeMultithreaded, 1, chain);
     timeFunc("loadingVersionNo", calculateVersionGreaterOneSingleThreaded, 1, chain);
+    timeFunc("loadingFeeColumn", calculateMaxFeeColumnar, 1, chain);
+    timeFunc("loadingLocktimeColumn", calculateNonzeroLocktimeColumnar, 1, chain);
 
     auto totalBlocks = timeFunc("countBlocks", countBlocks, 1, chain);
     std::cout << "Running benchmark over " << totalBlocks << " blocks." << std::endl;
@@ -76,15 +93,18 @@ int main(int argc, char * argv[]) {
     // Sequential transaction graph iteration
     auto locktime1 = timeFunc("nonzeroLocktimeSingleThreaded", calculateNonzeroLocktimeSingleThreaded, iterations, chain);
     auto locktime2 = timeFunc("nonzeroLocktimeMultithreaded", calculateNonzeroLocktimeMultithreaded, iterations, chain);
+    auto locktime3 = timeFunc("nonzeroLocktimeColumnar", calculateNonzeroLocktimeColumnar, iterations, chain);
     auto maxOutput1 = timeFunc("maxOutputSingleThreaded", calculateMaxOutputSingleThreaded, iterations, chain);
     auto maxOutput2 = timeFunc("maxOutputMultithreaded", calculateMaxOutputMultithreaded, iterations, chain);
     auto maxInput1 = timeFunc("maxInputSingleThreaded", calculateMaxInputSingleThreaded, iterations, chain);
     auto maxInput2 = timeFunc("maxInputMultithreaded", calculateMaxInputMultithreaded, iterations, chain);
     auto maxFee1 = timeFunc("maxFeeSingleThreaded", calculateMaxFeeSingleThreaded, iterations, chain);
     auto maxFee2 = timeFunc("maxFeeMultithreaded", calculateMaxFeeMultithreaded, iterations, chain);
+    auto maxFee3 = timeFunc("maxFeeColumnar", calculateMaxFeeColumnar, iterations, chain);
 
     auto version1 = timeFunc("versionGreaterOneSingleThreaded", calculateVersionGreaterOneSingleThreaded, iterations, chain);
     auto version2 = timeFunc("versionGreaterOneMultithreaded", calculateVersionGreaterOneMultithreaded, iterations, chain);
+    auto version3 = timeFunc("versionGreaterOneColumnar", calculateVersionGreaterOneColumnar, iterations, chain);
 
     // Graph traversal queries
     uint32_t uniqueLocktimeSingle = 0;
@@ -105,6 +125,11 @@ int main(int argc, char * argv[]) {
         maxSatoshiDiceOutput = timeFunc("satoshiDiceTotalOutputValueSingleThreaded", calculateSatoshiDiceTotalOutputValue, iterations, chain, satoshiDiceAddress->scriptNum, satoshiDiceAddress->type);
     }
 
+    ClusteringStats clusteringStats;
+    if (!clusterLocation.empty()) {
+        timeFunc("clustering", clusterChain, 1, chain, clusterLocation, clusteringStats);
+    }
+
     if (includeRandom) {
         uint32_t maxTxNum = chain[totalBlocks - 1].endTxIndex();
         std::vector<uint32_t> indexes(maxTxNum);
@@ -113,18 +138,26 @@ int main(int argc, char * argv[]) {
 
         timeFunc("maxFeeRandom", calculateMaxFeeRandom, iterations, chain, indexes);
         timeFunc("nonzeroLocktimeRandom", calculateNonzeroLocktimeRandom, iterations, chain, indexes);
+
+        // Resolving the block of a transaction happens on every hop of a graph traversal
+        auto heightSum1 = timeFunc("blockHeightSearchRandom", calculateBlockHeightSumSearchRandom, iterations, chain, indexes);
+        auto heightSum2 = timeFunc("blockHeightIndexedRandom", calculateBlockHeightSumRandom, iterations, chain, indexes);
+        std::cout << "Block height sum = (" << heightSum1 << ", " << heightSum2 << ")" << std::endl;
     }
 
     // Print results
     std::cout << std::endl << "Results:" << std::endl;;
-    std::cout << "Nonzero Locktime = (" << locktime1 << ", " << locktime2 << ")" << std::endl;
+    std::cout << "Nonzero Locktime = (" << locktime1 << ", " << locktime2 << ", " << locktime3 << ")" << std::endl;
     std::cout << "Max Output = (" << maxOutput1 << ", " << maxOutput2 << ")" << std::endl;
     std::cout << "Max Input = (" << maxInput1 << ", " << maxInput2 << ")" << std::endl;
-    std::cout << "Max Fee = (" << maxFee1 << ", " << maxFee2 << ")" << std::endl;
-    std::cout << "Version > 1 = (" << version1 << ", " << version2 << ")" << std::endl;
+    std::cout << "Max Fee = (" << maxFee1 << ", " << maxFee2 << ", " << maxFee3 << ")" << std::endl;
+    std::cout << "Version > 1 = (" << version1 << ", " << version2 << ", " << version3 << ")" << std::endl;
     if(maxSatoshiDiceOutput >= 0) {
         std::cout << "SatoshiDice Output Value = (" << maxSatoshiDiceOutput << ")" << std::endl;
     }
+    if (!clusterLocation.empty()) {
+        std::cout << "Clustering = (" << clusteringStats.linkCount << " links, " << clusteringStats.mergeCount << " merges, " << static_cast<uint64_t>(clusteringStats.linksPerSecond()) << " unions/s on " << clusteringStats.threadCount << " threads)" << std::endl;
+    }
     if(includeTraversal) {
         std::cout << "Zeroconf Outputs = (" << zeroconfSingle << ", " << zeroconfMulti << ")" << std::endl;
         std::cout << "Unique Change = (" << uniqueLocktimeSingle << ", " << uniqueLocktimeMulti << ")" << std::endl;
@@ -212,6 +245,14 @@ int64_t calculateMaxFeeMultithreaded(BlockRange &chain) {
     return chain.mapReduce<int64_t>(extract, combine);
 }
 
+int64_t calculateMaxFeeColumnar(BlockRange &chain) {
+    int64_t curMax = 0;
+    for (auto fee : chain.fees()) {
+        curMax = std::max(curMax, fee);
+    }
+    return curMax;
+}
+
 int64_t calculateMaxFeeRandom(Blockchain &chain, const std::vector<uint32_t> &indexes) {
     int64_t maxValue = 0;
     for (auto index : indexes) {
@@ -241,6 +282,14 @@ uint32_t calculateNonzeroLocktimeMultithreaded(BlockRange &chain) {
     return chain.mapReduce<uint32_t>(extract, combine);
 }
 
+uint32_t calculateNonzeroLocktimeColumnar(BlockRange &chain) {
+    uint32_t count = 0;
+    for (auto locktime : chain.locktimes()) {
+        count += locktime > 0;
+    }
+    return count;
+}
+
 uint32_t calculateVersionGreaterOneSingleThreaded(BlockRange &chain) {
     uint32_t count = 0;
     for (auto block : chain) {
@@ -261,6 +310,40 @@ uint32_t calculateVersionGreaterOneMultithreaded(BlockRange &chain) {
     return chain.mapReduce<uint32_t>(extract, combine);
 }
 
+uint32_t calculateVersionGreaterOneColumnar(BlockRange &chain) {
+    uint32_t count = 0;
+    for (auto version : chain.versions()) {
+        count += version > 1;
+    }
+    return count;
+}
+
+uint64_t clusterChain(BlockRange &chain, const std::string &outputLocation, ClusteringStats &stats) {
+    ClusterManager::createClustering(chain, heuristics::ChangeHeuristic{heuristics::NoChange{}}, outputLocation, true, true, &stats);
+    return stats.mergeCount;
+}
+
+int64_t calculateBlockHeightSumSearchRandom(Blockchain &chain, const std::vector<uint32_t> &indexes) {
+    // Binary search over the blocks, which is how heights were resolved before chain/tx_block_height.dat existed
+    int64_t heightSum = 0;
+    auto chainEnd = chain.end();
+    for (auto index : indexes) {
+        auto it = std::upper_bound(chain.begin(), chainEnd, index, [](uint32_t txNum, const Block &block) {
+            return txNum < block.firstTxIndex();
+        });
+        heightSum += (*(--it)).height();
+    }
+    return heightSum;
+}
+
+int64_t calculateBlockHeightSumRandom(Blockchain &chain, const std::vector<uint32_t> &indexes) {
+    int64_t heightSum = 0;
+    for (auto index : indexes) {
+        heightSum += Transaction(index, chain.getAccess()).getBlockHeight();
+    }
+    return heightSum;
+}
+
 uint32_t calculateNonzeroLocktimeRandom(Blockchain &chain, const std::vector<uint32_t> &indexes) {
     uint32_t nonzeroCount = 0;
     for (auto index : indexes) {
@@ -840,8 +840,9 @@ def get_miner(block) -> str:
         import json
         with open(loaderDirectory + "/Blockchain-Known-Pools/pools.json") as f:
             pool_data = json.load(f)
-        addresses = [block._access.address_from_string(addr_string) for addr_string in pool_data["payout_addresses"]]
-        tagged_addresses = {pointer: pool_data["payout_addresses"][address] for address in addresses if address in pool_data["payout_addresses"]}
+        strings = list(pool_data["payout_addresses"])
+        addresses = block._access.addresses_from_strings(strings)
+        tagged_addresses = {addr: pool_data["payout_addresses"][s] for s, addr in zip(strings, addresses) if addr is not None}
         coinbase_tag_re = re.compile('|'.join(map(re.escape, pool_data["coinbase_tags"])))
         first_miner_run = False
     coinbase = block.coinbase_param.decode("utf_8", "replace")
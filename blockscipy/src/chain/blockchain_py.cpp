@@ -8,6 +8,7 @@
 
 #include "blockchain_py.hpp"
 #include "caster_py.hpp"
+#include "python_range_conversion.hpp"
 #include "sequence.hpp"
 
 #include <blocksci/address/address.hpp>
@@ -93,6 +94,9 @@ void init_blockchain(py::class_<Blockchain> &cl) {
     .def("tx_with_hash", [](Blockchain &chain, const std::string &hash) {
         return Transaction{hash, chain.getAccess()};
     },"This functions gets the transaction with given hash.", pybind11::arg("tx_hash"))
+    .def("txes_with_hashes", [](Blockchain &chain, const std::vector<std::string> &hashes) {
+        return getTransactionsFromHashes(hashes, chain.getAccess());
+    }, "Get the transactions with the given hashes using a single index query. Hashes without a matching transaction give None.", pybind11::arg("tx_hashes"))
     .def("address_from_index", [](Blockchain &chain, uint32_t index, AddressType::Enum type) {
         return Address{index, type, chain.getAccess()};
     }, "Construct an address object from an address num and type", pybind11::arg("index"), pybind11::arg("type"))
@@ -104,6 +108,12 @@ void init_blockchain(py::class_<Blockchain> &cl) {
             return ranges::nullopt;
         }
     }, "Construct an address object from an address string", pybind11::arg("address_string"))
+    .def("addresses_from_strings", [](Blockchain &chain, const std::vector<std::string> &addressStrings) {
+        return getAddressesFromStrings(addressStrings, chain.getAccess());
+    }, "Construct address objects from a list of address strings using a single index query per address kind. Strings without a matching address give None.", pybind11::arg("address_strings"))
+    .def("address_strings", [](Blockchain &chain, const std::vector<Address> &addresses) {
+        return convertAddressStrings(addresses, chain.getAccess());
+    }, "Encode the address strings of a list of addresses in parallel, returned as a numpy array of fixed width byte strings. Addresses without an address string give an empty string.", pybind11::arg("addresses"))
     .def("addresses_with_prefix", [](Blockchain &chain, const std::string &addressPrefix) {
         pybind11::list pyAddresses;
         auto addresses = getAddressesWithPrefix(addressPrefix, chain.getAccess());
@@ -112,6 +122,9 @@ void init_blockchain(py::class_<Blockchain> &cl) {
         }
         return pyAddresses;
     }, "Find all addresses beginning with the given prefix", pybind11::arg("prefix"))
+    .def("update_address_prefix_index", [](Blockchain &chain) {
+        updateAddressPrefixIndex(chain.getAccess());
+    }, "Build or extend the index used by addresses_with_prefix. With the index, prefix queries take milliseconds and also find segwit addresses.")
     .def("_segment_indexes", [](Blockchain &chain, BlockHeight start, BlockHeight stop, unsigned int cpuCount) {
         auto segments = chain[{start, stop}].segment(cpuCount);
         std::vector<std::pair<BlockHeight, BlockHeight>> ret;
@@ -128,6 +141,7 @@ void init_data_access(py::module &m) {
     py::class_<Access> (m, "_DataAccess", "Private class for accessing blockchain data")
     .def("tx_with_index", &Access::txWithIndex, "This functions gets the transaction with given index.")
     .def("tx_with_hash", &Access::txWithHash, "This functions gets the transaction with given hash.")
+    .def("txes_with_hashes", &Access::txesWithHashes, "Get the transactions with the given hashes using a single index query.")
     .def("address_from_index", &Access::addressFromIndex, "Construct an address object from an address num and type")
     .def("address_from_string", [](Access &access, const std::string &addressString) -> ranges::optional<AnyScript> {
         auto address = access.addressFromString(addressString);
@@ -137,6 +151,17 @@ void init_data_access(py::module &m) {
             return ranges::nullopt;
         }
     }, "Construct an address object from an address string")
+    .def("addresses_from_strings", [](Access &access, const std::vector<std::string> &addressStrings) {
+        py::list pyAddresses;
+        for (auto &address : access.addressesFromStrings(addressStrings)) {
+            if (address) {
+                pyAddresses.append(address->getScript().wrapped);
+            } else {
+                pyAddresses.append(py::none());
+            }
+        }
+        return pyAddresses;
+    }, "Construct address objects from a list of address strings using a single index query per address kind")
     .def("addresses_with_prefix", [](Access &access, const std::string &addressPrefix) {
         py::list pyAddresses;
         auto addresses = access.addressesWithPrefix(addressPrefix);
@@ -145,5 +170,6 @@ void init_data_access(py::module &m) {
         }
         return pyAddresses;
     }, "Find all addresses beginning with the given prefix")
+    .def("update_address_prefix_index", &Access::updateAddressPrefixIndex, "Build or extend the index used by addresses_with_prefix")
     ;
 }
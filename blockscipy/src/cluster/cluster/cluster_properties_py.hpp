@@ -41,6 +41,13 @@ struct AddClusterMethods {
             return cluster.getInputTransactions().size();
         }, "Return the number of transactions where this cluster was an input");
 
+        func(property_tag, "output_count", &Cluster::getOutputCount, "The number of outputs sent to addresses in the cluster");
+        func(property_tag, "tx_count", &Cluster::getTransactionCount, "The number of transactions that send to or spend from the cluster");
+        func(property_tag, "total_received", &Cluster::getTotalReceived, "The total value sent to addresses in the cluster");
+        func(property_tag, "total_sent", &Cluster::getTotalSent, "The total value spent from addresses in the cluster");
+        func(property_tag, "first_tx_height", &Cluster::getFirstTxHeight, "The height of the first transaction that sends to or spends from the cluster");
+        func(property_tag, "last_tx_height", &Cluster::getLastTxHeight, "The height of the last transaction that sends to or spends from the cluster");
+
         func(method_tag, "count_of_type", &Cluster::countOfType, "Return the number of addresses of the given type in the cluster", pybind11::arg("address_type"));
     }
 };
@@ -11,6 +11,7 @@
 #include "ranges_py.hpp"
 #include "caster_py.hpp"
 #include "proxy_utils.hpp"
+#include "python_range_conversion.hpp"
 #include "self_apply_py.hpp"
 
 #include <blocksci/cluster/cluster_manager.hpp>
@@ -20,6 +21,7 @@
 #include <blocksci/chain/block.hpp>
 
 #include <range/v3/range_for.hpp>
+#include <range/v3/range/conversion.hpp>
 
 #include <pybind11/iostream.h>
 #include <pybind11/operators.h>
@@ -65,6 +67,21 @@ void init_cluster_manager(pybind11::module &s) {
         return ClusterManager::createClustering(range, heuristic, location, shouldOverwrite, ignoreCoinJoin);
     }, py::arg("location"), py::arg("chain"), py::arg("start") = 0, py::arg("stop") = -1,
     py::arg("heuristic") = heuristics::ChangeHeuristic{heuristics::NoChange{}}, py::arg("should_overwrite") = false, py::arg("ignore_coinjoin") = true)
+    .def_static("update_clustering", [](const std::string &location, Blockchain &chain, BlockHeight start, BlockHeight stop, heuristics::ChangeHeuristic &heuristic, bool ignoreCoinJoin) {
+        py::scoped_ostream_redirect stream(std::cout, py::module::import("sys").attr("stdout"));
+        if (stop == -1) {
+            stop = chain.size();
+        }
+        auto range = chain[{start, stop}];
+        return ClusterManager::updateClustering(range, heuristic, location, ignoreCoinJoin);
+    }, py::arg("location"), py::arg("chain"), py::arg("start") = 0, py::arg("stop") = -1,
+    py::arg("heuristic") = heuristics::ChangeHeuristic{heuristics::NoChange{}}, py::arg("ignore_coinjoin") = true,
+    "Extend the clustering at the given location with the blocks added since it was created. The heuristic and ignore_coinjoin must match the ones used to create it")
+    .def("create_summaries", [](ClusterManager &cm, Blockchain &chain) {
+        py::scoped_ostream_redirect stream(std::cout, py::module::import("sys").attr("stdout"));
+        cm.createSummaries(chain);
+    }, py::arg("chain"), "Precompute the balance, transaction count and first and last use of every cluster, which speeds up these queries until new blocks are added to the chain")
+    .def_property_readonly("has_current_summaries", &ClusterManager::hasCurrentSummaries, "Whether cluster summaries exist and cover the currently loaded chain")
     .def("cluster_with_address", [](const ClusterManager &cm, const Address &address) -> Cluster {
        return cm.getCluster(address);
     }, py::arg("address"), "Return the cluster containing the given address")
@@ -97,6 +114,13 @@ void init_cluster(py::class_<Cluster> &cl) {
         return cluster.getOutputTransactions();
     }, "Returns a list of all transaction where this cluster was an output")
     .def("output_txes", &Cluster::getOutputTransactions, "Returns a list of all transaction where this cluster was an output")
+    .def("address_strings", [](const Cluster &cluster) {
+        auto addresses = ranges::to_vector(cluster.getAddresses());
+        if (addresses.empty()) {
+            return pybind11::array(pybind11::dtype("S1"), std::vector<pybind11::ssize_t>{0});
+        }
+        return convertAddressStrings(addresses, addresses.front().getAccess());
+    }, "Returns the address strings of all addresses in this cluster as a numpy array of fixed width byte strings")
     ;
 }
 
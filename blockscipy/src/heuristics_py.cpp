@@ -61,6 +61,32 @@ void init_heuristics(py::module &m) {
     }, py::arg("min_base_fee"), py::arg("percentage_fee"), py::arg("max_depth") = 0, "This function uses subset matching in order to determine whether this transaction is a JoinMarket coinjoin. If maxDepth != 0, it limits the total number of possible subsets the algorithm will check.")
     ;
 
+    py::class_<CoinJoinClassifier, std::shared_ptr<CoinJoinClassifier>>(cl, "CoinJoinClassifier", "Class caching the results of is_possible_coinjoin and is_definite_coinjoin for one set of parameters per transaction")
+    .def(py::init([](Blockchain &chain, int64_t minBaseFee, double percentageFee, size_t maxDepth) {
+        return std::make_shared<CoinJoinClassifier>(chain, minBaseFee, percentageFee, maxDepth);
+    }), py::arg("chain"), py::arg("min_base_fee"), py::arg("percentage_fee"), py::arg("max_depth") = 0)
+    .def("classify", [](CoinJoinClassifier &classifier, Blockchain &chain, BlockHeight start, BlockHeight stop) {
+        if (stop == -1) {
+            stop = chain.size();
+        }
+        auto range = chain[{start, stop}];
+        py::gil_scoped_release release;
+        classifier.classify(range);
+    }, py::arg("chain"), py::arg("start") = 0, py::arg("stop") = -1, "Classify all transactions in the given blocks in parallel, so that later lookups are served from the cache")
+    .def_property_readonly("is_possible_coinjoin", [](std::shared_ptr<CoinJoinClassifier> &classifier) -> Proxy<int64_t> {
+        return lift(makeSimpleProxy<Transaction>(), [classifier](const Transaction &tx) -> int64_t {
+            py::gil_scoped_release release;
+            return static_cast<int64_t>(classifier->isPossibleCoinjoin(tx));
+        });
+    }, "Cached version of heuristics.is_possible_coinjoin")
+    .def_property_readonly("is_definite_coinjoin", [](std::shared_ptr<CoinJoinClassifier> &classifier) -> Proxy<int64_t> {
+        return lift(makeSimpleProxy<Transaction>(), [classifier](const Transaction &tx) -> int64_t {
+            py::gil_scoped_release release;
+            return static_cast<int64_t>(classifier->isCoinjoinExtra(tx));
+        });
+    }, "Cached version of heuristics.is_definite_coinjoin")
+    ;
+
     cl
     .def_static("poison_tainted_outputs", heuristics::getPoisonTainted, py::arg("outputs"), py::arg("max_block_height") = -1, py::arg("taint_fee") = true, "Returns the list of current UTXOs poison tainted by this output")
     .def_static("haircut_tainted_outputs", heuristics::getHaircutTainted, py::arg("outputs"), py::arg("max_block_height") = -1, py::arg("taint_fee") = true, "Returns the list of current UTXOs haircut tainted by this output")
@@ -83,7 +109,8 @@ void init_heuristics(py::module &m) {
             return ch(tx);
         });
     }, "Return all outputs matching the change heuristic")
-    .def_property_readonly("unique_change", &ChangeHeuristic::uniqueChange, "Return a new heuristic that will return a single output if it's the only candidate output, and no outputs otherwise.");
+    .def_property_readonly("unique_change", &ChangeHeuristic::uniqueChange, "Return a new heuristic that will return a single output if it's the only candidate output, and no outputs otherwise.")
+    .def_readonly("name", &ChangeHeuristic::name, "Name identifying the heuristic, stored with a clustering to check updates of it. Empty for heuristics created from a function")
     ;
 
     // Manual documentation is necessary for the following properties
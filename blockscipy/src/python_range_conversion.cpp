@@ -9,6 +9,7 @@
 #include "blocksci_type_converter.hpp"
 #include "sequence.hpp"
 
+#include <blocksci/address/address.hpp>
 #include <blocksci/chain/block.hpp>
 #include <blocksci/core/bitcoin_uint256.hpp>
 #include <blocksci/address/equiv_address.hpp>
@@ -142,3 +143,15 @@ pybind11::array_t<NumpyBool> PythonConversionTypeConverter::operator()(RawRange<
 pybind11::array_t<NumpyDatetime> PythonConversionTypeConverter::operator()(RawRange<std::chrono::system_clock::time_point> && t) { return convertInputNumpy(std::move(t)); }
 pybind11::array_t<std::array<char, 40>> PythonConversionTypeConverter::operator()(RawRange<uint160> && t) { return convertRandomSizedNumpy(std::move(t)); }
 pybind11::array_t<std::array<char, 64>> PythonConversionTypeConverter::operator()(RawRange<uint256> && t) { return convertRandomSizedNumpy(std::move(t)); }
+
+pybind11::array convertAddressStrings(const std::vector<Address> &addresses, DataAccess &access) {
+    auto width = addressStringWidth(access);
+    pybind11::array ret(pybind11::dtype("S" + std::to_string(width)), std::vector<pybind11::ssize_t>{static_cast<pybind11::ssize_t>(addresses.size())});
+    auto out = static_cast<char *>(ret.mutable_data());
+    {
+        // The encoding runs on the BlockSci thread pool and doesn't touch any Python objects
+        py::gil_scoped_release release;
+        getAddressStrings(addresses, out, width, access);
+    }
+    return ret;
+}
@@ -16,6 +16,7 @@
 #include <pybind11/numpy.h>
 
 #include <chrono>
+#include <vector>
 
 namespace pybind11 { namespace detail {
     template <>
@@ -81,6 +82,9 @@ struct PythonConversionTypeConverter {
 
 
 
+/** Address strings of the given addresses as a numpy array of fixed width byte strings */
+pybind11::array convertAddressStrings(const std::vector<blocksci::Address> &addresses, blocksci::DataAccess &access);
+
 template <typename T>
 auto convertPythonRange(T && t) {
     return PythonConversionTypeConverter{}(std::move(t));
@@ -113,8 +113,32 @@ namespace blocksci {
     
     ranges::optional<Address> BLOCKSCI_EXPORT getAddressFromString(const std::string &addressString, DataAccess &access);
     
+    /** Batch version of getAddressFromString, which looks up all addresses of the same kind with one index query */
+    std::vector<ranges::optional<Address>> BLOCKSCI_EXPORT getAddressesFromStrings(const std::vector<std::string> &addressStrings, DataAccess &access);
+    
+    /** Find all addresses whose string starts with prefix
+     *
+     * Uses the address prefix index if it was built with updateAddressPrefixIndex, which also finds segwit addresses.
+     * Otherwise all pay to pubkey hash or pay to script hash addresses are scanned for prefixes starting with 1 or 3.
+     * Only addresses that have been seen on chain with their type are returned. Throws for an empty prefix.
+     */
     std::vector<Address> BLOCKSCI_EXPORT getAddressesWithPrefix(const std::string &prefix, DataAccess &access);
     
+    /** Add the addresses created since the last update to the address prefix index, building it if it doesn't exist */
+    void BLOCKSCI_EXPORT updateAddressPrefixIndex(DataAccess &access);
+    
+    /** Number of characters that is enough for every address string of the chain, see getAddressStrings */
+    size_t BLOCKSCI_EXPORT addressStringWidth(DataAccess &access);
+    
+    /** Writes the address string of addresses[i] to out + i * width, padded with zero bytes
+     *
+     * The addresses are grouped by kind and encoded in parallel with batch base58 and bech32 encoders, so this is much
+     * faster than calling addressString for each of them. Addresses of types without an address string give an empty
+     * string. width must be at least addressStringWidth(access) and out must have room for addresses.size() * width
+     * characters, which matches the layout of a numpy fixed width string array.
+     */
+    void BLOCKSCI_EXPORT getAddressStrings(const std::vector<Address> &addresses, char *out, size_t width, DataAccess &access);
+    
     inline size_t hashAddress(uint32_t scriptNum, AddressType::Enum type) {
         return (static_cast<size_t>(scriptNum) << 32) + static_cast<size_t>(type);
     }
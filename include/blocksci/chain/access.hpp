@@ -31,6 +31,10 @@ namespace blocksci {
             return Transaction{hash, *access};
         }
 
+        std::vector<ranges::optional<Transaction>> txesWithHashes(const std::vector<std::string> &hashes) const {
+            return getTransactionsFromHashes(hashes, *access);
+        }
+
         Address addressFromIndex(uint32_t index, AddressType::Enum type) const {
             return Address{index, type, *access};
         }
@@ -39,9 +43,17 @@ namespace blocksci {
             return getAddressFromString(addressString, *access);
         }
 
+        std::vector<ranges::optional<Address>> addressesFromStrings(const std::vector<std::string> &addressStrings) const {
+            return getAddressesFromStrings(addressStrings, *access);
+        }
+
         std::vector<Address> addressesWithPrefix(const std::string &prefix) const {
             return getAddressesWithPrefix(prefix, *access);
         }
+
+        void updateAddressPrefixIndex() const {
+            blocksci::updateAddressPrefixIndex(*access);
+        }
     };
     
 } // namespace blocksci
@@ -11,10 +11,12 @@
 
 #include <blocksci/blocksci_export.h>
 #include <blocksci/chain/block.hpp>
+#include <blocksci/chain/column_span.hpp>
+#include <blocksci/core/thread_pool.hpp>
 
 #include <map>
 #include <type_traits>
-#include <future>
+#include <vector>
 
 namespace blocksci {
     struct DataConfiguration;
@@ -32,25 +34,21 @@ namespace blocksci {
             static constexpr bool value = decltype(test<F>(nullptr))::value;
         };
         
-        template <typename ResultType, typename It, typename MapFunc, typename ReduceFunc>
-        ResultType BLOCKSCI_EXPORT mapReduceBlocksImp(It begin, It end, MapFunc mapFunc, ReduceFunc reduceFunc, int segmentBeginNum) {
-            auto segmentCount = static_cast<int>(std::distance(begin, end));
-            if(segmentCount == 1) {
+        /** Maps every chunk on the shared ThreadPool and reduces the results in chunk order */
+        template <typename ResultType, typename Chunks, typename MapFunc, typename ReduceFunc>
+        ResultType BLOCKSCI_EXPORT mapReduceBlocksImp(const Chunks &chunks, MapFunc &mapFunc, ReduceFunc &reduceFunc) {
+            std::vector<ResultType> chunkResults(chunks.size());
+            ThreadPool::instance().parallelFor(chunks.size(), [&](size_t chunkIndex) {
                 ResultType res{};
-                auto ret = mapFunc(*begin, segmentBeginNum);
+                auto ret = mapFunc(chunks[chunkIndex], static_cast<int>(chunkIndex));
                 res = reduceFunc(res, ret);
-                return res;
-            } else {
-                auto mid = begin;
-                std::advance(mid, segmentCount / 2);
-                auto handle = std::async(std::launch::async, mapReduceBlocksImp<ResultType, It, MapFunc, ReduceFunc>, begin, mid, mapFunc, reduceFunc, segmentBeginNum);
-                ResultType res{};
-                auto ret2 = mapReduceBlocksImp<ResultType>(mid, end, mapFunc, reduceFunc, segmentBeginNum + segmentCount / 2);
-                auto ret1 = handle.get();
-                res = reduceFunc(res, ret1);
-                res = reduceFunc(res, ret2);
-                return res;
+                chunkResults[chunkIndex] = std::move(res);
+            });
+            ResultType res{};
+            for (auto &chunkResult : chunkResults) {
+                res = reduceFunc(res, chunkResult);
             }
+            return res;
         }
     }
 
@@ -128,18 +126,26 @@ namespace blocksci {
             return this->operator[](size() - 1).endTxIndex();
         }
         
+        /** Maps the chunks returned by parallelSegments() in parallel and reduces the results in chain order. The
+         *  second argument of mapFunc is the chunk index, the position of the chunk in parallelSegments().
+         *
+         *  The range used to be split into one segment per hardware thread, so the index was below
+         *  std::thread::hardware_concurrency(). There are now about one chunk per ThreadPool::getGrainSize()
+         *  transactions. The index can therefore exceed the thread count, and one thread runs many chunks. It can't be used
+         *  to pick per-thread state. */
         template <typename ResultType, typename MapFunc, typename ReduceFunc>
         std::enable_if_t<internal::is_callable<MapFunc, BlockRange, int>::value, ResultType>
         mapReduce(MapFunc mapFunc, ReduceFunc reduceFunc) {
-            auto segments = segment(std::thread::hardware_concurrency());
-            return internal::mapReduceBlocksImp<ResultType>(segments.begin(), segments.end(), mapFunc, reduceFunc, 0);
+            auto segments = parallelSegments();
+            return internal::mapReduceBlocksImp<ResultType>(segments, mapFunc, reduceFunc);
         }
         
         template <typename ResultType, typename MapFunc, typename ReduceFunc>
         std::enable_if_t<internal::is_callable<MapFunc, BlockRange>::value, ResultType>
         mapReduce(MapFunc mapFunc, ReduceFunc reduceFunc) {
-            auto segments = segment(std::thread::hardware_concurrency());
-            return internal::mapReduceBlocksImp<ResultType>(segments.begin(), segments.end(), [&](const BlockRange &blocks, int) { return mapFunc(blocks); }, reduceFunc, 0);
+            auto segments = parallelSegments();
+            auto segmentMapFunc = [&](const BlockRange &blocks, int) { return mapFunc(blocks); };
+            return internal::mapReduceBlocksImp<ResultType>(segments, segmentMapFunc, reduceFunc);
         }
         
         template <typename ResultType, typename MapFunc, typename ReduceFunc>
@@ -197,6 +203,20 @@ namespace blocksci {
         // Returns a vector of [start, stop) intervals splitting the chain into segments with approximately the same number of segments
         std::vector<BlockRange> segment(unsigned int segmentCount) const;
         
+        /** Splits the range into chunks of about ThreadPool::getGrainSize() transactions, but at least one per thread,
+         *  which the thread pool balances between its threads */
+        std::vector<BlockRange> parallelSegments() const;
+        
+        /** Per-transaction values of all transactions in the range, in chain order. Scanning these columns is much
+         *  cheaper than visiting every Transaction when only a single field is needed. The columns other than the
+         *  version are materialized in the chain directory on first use, which requires one pass over the chain. */
+        ColumnSpan<uint32_t> locktimes() const;
+        ColumnSpan<int32_t> versions() const;
+        ColumnSpan<uint16_t> inputCounts() const;
+        ColumnSpan<uint16_t> outputCounts() const;
+        ColumnSpan<uint32_t> totalSizes() const;
+        ColumnSpan<int64_t> fees() const;
+        
         Slice sl;
         
         DataAccess &getAccess() { return *access; }
@@ -0,0 +1,59 @@
+//
+//  column_span.hpp
+//  blocksci
+//
+
+#ifndef column_span_hpp
+#define column_span_hpp
+
+#include <blocksci/blocksci_export.h>
+
+#include <cstddef>
+
+namespace blocksci {
+    /** Read-only view of a contiguous run of per-transaction values, e.g. the locktimes of all transactions of a
+     * BlockRange. Index 0 refers to the first transaction of the range the span was created for.
+     *
+     * The values live in memory mapped column files, so loops over a span touch only the bytes of that column.
+     * A span stays valid as long as the DataAccess it was created from.
+     */
+    template <typename T>
+    class BLOCKSCI_EXPORT ColumnSpan {
+        const T *values = nullptr;
+        size_t count = 0;
+        
+    public:
+        using value_type = T;
+        using iterator = const T *;
+        using const_iterator = const T *;
+        
+        ColumnSpan() = default;
+        ColumnSpan(const T *values_, size_t count_) : values(values_), count(count_) {}
+        
+        const T *data() const {
+            return values;
+        }
+        
+        size_t size() const {
+            return count;
+        }
+        
+        bool empty() const {
+            return count == 0;
+        }
+        
+        const T *begin() const {
+            return values;
+        }
+        
+        const T *end() const {
+            return values + count;
+        }
+        
+        const T &operator[](size_t index) const {
+            return values[index];
+        }
+    };
+} // namespace blocksci
+
+#endif /* column_span_hpp */
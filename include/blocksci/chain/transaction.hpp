@@ -184,6 +184,9 @@ namespace blocksci {
     
     ranges::optional<Output> BLOCKSCI_EXPORT getOpReturn(const Transaction &tx);
 
+    /** Look up the transactions with the given hashes in one batch, hashes without a match give an empty result */
+    std::vector<ranges::optional<Transaction>> BLOCKSCI_EXPORT getTransactionsFromHashes(const std::vector<std::string> &hashes, DataAccess &access);
+
     std::ostream BLOCKSCI_EXPORT &operator<<(std::ostream &os, const Transaction &tx);
     
     bool BLOCKSCI_EXPORT isSegwitMarker(const Transaction &tx);
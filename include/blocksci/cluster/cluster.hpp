@@ -14,6 +14,7 @@
 #include <blocksci/address/address.hpp>
 #include <blocksci/chain/output_pointer.hpp>
 #include <blocksci/chain/range_util.hpp>
+#include <blocksci/cluster/cluster_summary.hpp>
 #include <blocksci/core/core_fwd.hpp>
 #include <blocksci/core/dedup_address.hpp>
 
@@ -87,6 +88,9 @@ namespace blocksci {
         // Only holds tags by reference so it must remain alive while this range exists
         ranges::any_view<TaggedAddress> taggedAddressesUnsafe(const std::unordered_map<blocksci::Address, std::string> &tags) const;
         
+        // Summary of the cluster if the summaries cover the currently loaded chain
+        const ClusterSummary *currentSummary() const;
+        
     public:
         uint32_t clusterNum;
         
@@ -112,6 +116,17 @@ namespace blocksci {
         ranges::any_view<OutputPointer> getOutputPointers() const;
         
         int64_t calculateBalance(BlockHeight height) const;
+        
+        /** Precomputed totals of the cluster, if ClusterManager::createSummaries has been run for the loaded chain.
+         *  The methods below use them when available and otherwise go through all outputs of the cluster. */
+        ranges::optional<ClusterSummary> getSummary() const;
+        
+        uint32_t getOutputCount() const;
+        uint32_t getTransactionCount() const;
+        int64_t getTotalReceived() const;
+        int64_t getTotalSent() const;
+        BlockHeight getFirstTxHeight() const;
+        BlockHeight getLastTxHeight() const;
 
         ranges::any_view<Output> getOutputs() const;
         ranges::any_view<Input> getInputs() const;
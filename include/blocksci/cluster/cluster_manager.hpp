@@ -21,6 +21,24 @@ namespace blocksci {
     
     class ClusterAccess;
 
+    /** Counters of a clustering run, filled in by ClusterManager::createClustering and updateClustering if requested */
+    struct BLOCKSCI_EXPORT ClusteringStats {
+        /** Number of address pairs passed to the union-find, including pairs that were in the same cluster already */
+        uint64_t linkCount = 0;
+        
+        /** Number of links that merged two different clusters */
+        uint64_t mergeCount = 0;
+        
+        /** Wall clock time spent linking addresses */
+        double linkSeconds = 0;
+        
+        unsigned int threadCount = 0;
+        
+        double linksPerSecond() const {
+            return linkSeconds > 0 ? static_cast<double>(linkCount) / linkSeconds : 0;
+        }
+    };
+
     class BLOCKSCI_EXPORT ClusterManager {
         std::unique_ptr<ClusterAccess> access;
         uint32_t clusterCount;
@@ -33,8 +51,25 @@ namespace blocksci {
         ClusterManager &operator=(ClusterManager && other);
         ~ClusterManager();
         
-        static ClusterManager createClustering(BlockRange &chain, const heuristics::ChangeHeuristic &heuristic, const std::string &outputPath, bool overwrite = false, bool ignoreCoinJoin = true);
-        static ClusterManager createClustering(BlockRange &chain, const std::function<ranges::any_view<Output>(const Transaction &tx)> &changeHeuristic, const std::string &outputPath, bool overwrite, bool ignoreCoinJoin);
+        /** Clusters all addresses of the chain and writes the clusters to outputPath. Linking runs on the shared
+         *  ThreadPool, whose thread count can be changed with ThreadPool::setThreadCount. */
+        static ClusterManager createClustering(BlockRange &chain, const heuristics::ChangeHeuristic &heuristic, const std::string &outputPath, bool overwrite = false, bool ignoreCoinJoin = true, ClusteringStats *stats = nullptr);
+        static ClusterManager createClustering(BlockRange &chain, const std::function<ranges::any_view<Output>(const Transaction &tx)> &changeHeuristic, const std::string &outputPath, bool overwrite, bool ignoreCoinJoin, ClusteringStats *stats = nullptr);
+        
+        /** Extends the clustering in outputPath with the blocks of chain that were added since it was created. Only the
+         *  new transactions are processed, the cluster files are then rewritten from the stored union-find state.
+         *  The change heuristic and ignoreCoinJoin must be the same as for the existing clustering, which is checked
+         *  through ChangeHeuristic::name. Heuristics built from arbitrary functions have no name and can't be checked. */
+        static ClusterManager updateClustering(BlockRange &chain, const heuristics::ChangeHeuristic &heuristic, const std::string &outputPath, bool ignoreCoinJoin = true, ClusteringStats *stats = nullptr);
+        static ClusterManager updateClustering(BlockRange &chain, const std::function<ranges::any_view<Output>(const Transaction &tx)> &changeHeuristic, const std::string &outputPath, bool ignoreCoinJoin, ClusteringStats *stats = nullptr);
+        
+        /** Computes the totals of every cluster over the given chain, which has to start at the first block, and writes
+         *  them next to the cluster files. Cluster queries use them for as long as the loaded chain has the same number
+         *  of blocks as chain. */
+        void createSummaries(BlockRange &chain);
+        
+        /** Whether the cluster summaries exist and cover the currently loaded chain */
+        bool hasCurrentSummaries() const;
         
         Cluster getCluster(const Address &address) const;
         
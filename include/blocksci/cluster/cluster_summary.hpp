@@ -0,0 +1,44 @@
+//
+//  cluster_summary.hpp
+//  blocksci
+//
+
+#ifndef blocksci_cluster_cluster_summary_hpp
+#define blocksci_cluster_cluster_summary_hpp
+
+#include <blocksci/blocksci_export.h>
+
+#include <blocksci/core/typedefs.hpp>
+
+#include <cstdint>
+
+namespace blocksci {
+    /** Precomputed totals of one cluster, written by ClusterManager::createSummaries
+     *
+     * File: clusterSummaries.dat, one entry per cluster implemented as FixedSizeFileMapper, together with
+     * clusterSummaryInfo.dat which stores the number of blocks the totals cover
+     */
+    struct BLOCKSCI_EXPORT ClusterSummary {
+        /** Sum of all outputs sent to addresses of the cluster */
+        int64_t totalReceived;
+        
+        /** Sum of all outputs of the cluster that have been spent */
+        int64_t totalSent;
+        
+        uint32_t addressCount;
+        uint32_t outputCount;
+        
+        /** Number of transactions that send to or spend from the cluster */
+        uint32_t txCount;
+        
+        /** Heights of the first and last of these transactions, -1 if there are none */
+        BlockHeight firstTxHeight;
+        BlockHeight lastTxHeight;
+        
+        int64_t balance() const {
+            return totalReceived - totalSent;
+        }
+    };
+} // namespace blocksci
+
+#endif /* blocksci_cluster_cluster_summary_hpp */
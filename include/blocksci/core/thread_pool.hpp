@@ -0,0 +1,78 @@
+//
+//  thread_pool.hpp
+//  blocksci
+//
+
+#ifndef blocksci_core_thread_pool_hpp
+#define blocksci_core_thread_pool_hpp
+
+#include <blocksci/blocksci_export.h>
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace blocksci {
+    /** Persistent pool of worker threads that runs parallel loops with work stealing
+     *
+     * Each participating thread starts with a contiguous share of the loop indexes. A thread that runs out of work
+     * steals the upper half of the remaining indexes of another thread, so that a few expensive indexes can't hold
+     * up the whole loop. The thread calling parallelFor participates as well. Loops started by different threads run
+     * at the same time and share the workers. A caller that is done with its own indexes helps with the other loops
+     * while it waits for the workers still busy with its loop. The shared instance is used by BlockRange::mapReduce,
+     * BlockRange::map, BlockRange::filter and the clustering code.
+     */
+    class BLOCKSCI_EXPORT ThreadPool {
+    public:
+        /** Default number of transactions per chunk when splitting a BlockRange for parallel processing */
+        static constexpr uint32_t defaultGrainSize = 100'000;
+
+        /** Pool used by all parallel algorithms of BlockSci, initially with std::thread::hardware_concurrency() threads */
+        static ThreadPool &instance();
+
+        explicit ThreadPool(unsigned int threadCount);
+        ThreadPool(const ThreadPool &) = delete;
+        ThreadPool &operator=(const ThreadPool &) = delete;
+        ~ThreadPool();
+
+        /** Number of threads running a parallel loop, including the calling thread */
+        unsigned int getThreadCount() const;
+        void setThreadCount(unsigned int threadCount);
+
+        /** Target number of transactions per chunk when a BlockRange is split for parallel processing */
+        uint32_t getGrainSize() const;
+        void setGrainSize(uint32_t grainSize);
+
+        /** Calls func for every index in [0, count) and returns once all calls are done. The first exception thrown by
+         *  func is rethrown after the remaining workers have stopped. Calls from the pool's workers or from inside a
+         *  running loop on the same thread are executed serially on the calling thread. Other threads, including ones
+         *  started by a loop body, get a loop of their own. */
+        void parallelFor(size_t count, const std::function<void(size_t index)> &func);
+
+    private:
+        struct Job;
+
+        mutable std::mutex mutex;
+        std::condition_variable workAvailable;
+        std::condition_variable workDone;
+
+        // Running loops that threads can still join, each one is owned by the parallelFor call that started it
+        std::vector<Job *> jobs;
+        // Workers exit once this no longer matches the value they were started with
+        uint64_t workerGeneration = 0;
+
+        unsigned int threadCount;
+        uint32_t grainSize = defaultGrainSize;
+        std::vector<std::thread> workers;
+
+        void retireWorkers();
+        void runWorker(uint64_t generation);
+        Job *joinJob(size_t &participant);
+    };
+} // namespace blocksci
+
+#endif /* blocksci_core_thread_pool_hpp */
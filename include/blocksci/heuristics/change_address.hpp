@@ -18,6 +18,7 @@
 #include <range/v3/view.hpp>
 #include <range/v3/view/set_algorithm.hpp>
 
+#include <string>
 #include <unordered_set>
 
 #define CHANGE_ADDRESS_TYPE_LIST VAL(PeelingChain), VAL(PowerOfTen), VAL(OptimalChange), VAL(AddressType), VAL(Locktime), VAL(AddressReuse), VAL(ClientChangeAddressBehavior), VAL(Legacy), VAL(FixedFee), VAL(None), VAL(Spent)
@@ -39,6 +40,8 @@ namespace heuristics {
         static constexpr size_t size = all.size();
     };
     
+    std::string BLOCKSCI_EXPORT changeTypeName(ChangeType::Enum type);
+    
     template <ChangeType::Enum heuristic>
     struct BLOCKSCI_EXPORT ChangeHeuristicImpl {
         ranges::any_view<Output> operator()(const Transaction &tx) const;
@@ -68,16 +71,20 @@ namespace heuristics {
         
         HeuristicFunc impl;
         
-        ChangeHeuristic(HeuristicFunc func) : impl(std::move(func)) {}
+        /** Identifies the heuristic, e.g. in the state of a clustering. Empty for heuristics built from arbitrary functions */
+        std::string name;
+        
+        ChangeHeuristic(HeuristicFunc func, std::string name_ = "") : impl(std::move(func)), name(std::move(name_)) {}
         
         template<typename T>
-        ChangeHeuristic(T func) : impl(std::move(func)) {}
+        ChangeHeuristic(T func) : impl(func), name(heuristicName(func)) {}
         
         ranges::any_view<Output> operator()(const Transaction &tx) const {
             return impl(tx);
         }
         
         static ChangeHeuristic uniqueChange(ChangeHeuristic ch) {
+            auto name = ch.name.empty() ? "" : "unique(" + ch.name + ")";
             return ChangeHeuristic{HeuristicFunc{[=](const Transaction &tx) {
                 auto c = ch(tx);
                 if (ranges::distance(c) == 1) {
@@ -86,31 +93,56 @@ namespace heuristics {
                     ranges::any_view<Output> empty = ranges::views::empty<Output>;
                     return empty;
                 }
-            }}};
+            }}, name};
         }
         
         static ChangeHeuristic setIntersection(ChangeHeuristic a, ChangeHeuristic b) {
+            auto name = combinedName(a, "&", b);
             return ChangeHeuristic{HeuristicFunc{[=](const Transaction &tx) {
                 auto first = a(tx);
                 auto second = b(tx);
                 return ranges::views::set_intersection(first, second);
-            }}};
+            }}, name};
         }
         
         static ChangeHeuristic setUnion(ChangeHeuristic a, ChangeHeuristic b) {
+            auto name = combinedName(a, "|", b);
             return ChangeHeuristic{HeuristicFunc{[=](const Transaction &tx) {
                 auto first = a(tx);
                 auto second = b(tx);
                 return ranges::views::set_union(first, second);
-            }}};
+            }}, name};
         }
         
         static ChangeHeuristic setDifference(ChangeHeuristic a, ChangeHeuristic b) {
+            auto name = combinedName(a, "-", b);
             return ChangeHeuristic{HeuristicFunc{[=](const Transaction &tx) {
                 auto first = a(tx);
                 auto second = b(tx);
                 return ranges::views::set_difference(first, second);
-            }}};
+            }}, name};
+        }
+        
+    private:
+        template <ChangeType::Enum type>
+        static std::string heuristicName(const ChangeHeuristicImpl<type> &) {
+            return changeTypeName(type);
+        }
+        
+        static std::string heuristicName(const PowerOfTenChange &heuristic) {
+            return changeTypeName(ChangeType::PowerOfTen) + "(" + std::to_string(heuristic.digits) + ")";
+        }
+        
+        template <typename T>
+        static std::string heuristicName(const T &) {
+            return "";
+        }
+        
+        static std::string combinedName(const ChangeHeuristic &a, const std::string &op, const ChangeHeuristic &b) {
+            if (a.name.empty() || b.name.empty()) {
+                return "";
+            }
+            return "(" + a.name + " " + op + " " + b.name + ")";
         }
     };
 }  // namespace heuristics
@@ -12,6 +12,10 @@
 #include <blocksci/chain/chain_fwd.hpp>
 #include <blocksci/scripts/scripts_fwd.hpp>
 
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
 namespace blocksci {
     class DataAccess;
     namespace heuristics {
@@ -27,6 +31,31 @@ namespace blocksci {
     bool BLOCKSCI_EXPORT isDeanonTx(const Transaction &tx);
     bool BLOCKSCI_EXPORT containsKeysetChange(const Transaction &tx);
     bool BLOCKSCI_EXPORT isChangeOverTx(const Transaction &tx);
+    
+    /** Caches the results of isPossibleCoinjoin and isCoinjoinExtra for one set of parameters per txNum
+     *
+     * Results are computed on first use, or for all transactions of a BlockRange in parallel with classify. Transactions
+     * added to the chain after the classifier was created are not cached. A classifier can be used by several threads.
+     */
+    class BLOCKSCI_EXPORT CoinJoinClassifier {
+        int64_t minBaseFee;
+        double percentageFee;
+        size_t maxDepth;
+        uint32_t txCount;
+        // Two bits per heuristic holding the result plus one, zero if it wasn't computed yet
+        std::unique_ptr<std::atomic<uint8_t>[]> results;
+        
+        CoinJoinResult cached(const Transaction &tx, unsigned int shift, CoinJoinResult (*heuristic)(const Transaction &, int64_t, double, size_t));
+        
+    public:
+        CoinJoinClassifier(BlockRange &chain, int64_t minBaseFee, double percentageFee, size_t maxDepth);
+        
+        CoinJoinResult isPossibleCoinjoin(const Transaction &tx);
+        CoinJoinResult isCoinjoinExtra(const Transaction &tx);
+        
+        /** Computes both heuristics for every transaction in blocks that isn't cached yet */
+        void classify(BlockRange &blocks);
+    };
 }}
 
 
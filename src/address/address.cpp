@@ -12,8 +12,12 @@
 #include <blocksci/address/equiv_address.hpp>
 #include <blocksci/chain/algorithms.hpp>
 #include <blocksci/chain/range_util.hpp>
+#include <blocksci/core/thread_pool.hpp>
 #include <blocksci/scripts/script_variant.hpp>
 
+#include "address_prefix_index.hpp"
+
+#include <scripts/address_encoding.hpp>
 #include <scripts/bitcoin_base58.hpp>
 #include <scripts/bitcoin_segwit_addr.hpp>
 
@@ -28,8 +32,11 @@
 #include <range/v3/view/unique.hpp>
 #include <range/v3/algorithm/min.hpp>
 
+#include <algorithm>
+#include <cstring>
 #include <iostream>
 #include <sstream>
+#include <stdexcept>
 
 namespace blocksci {
     
@@ -233,67 +240,252 @@ namespace blocksci {
         return ScriptBase(*this);
     }
     
-    ranges::optional<Address> getAddressFromString(const std::string &addressString, DataAccess &access) {
-        if (addressString.compare(0, access.config.chainConfig.segwitPrefix.size(), access.config.chainConfig.segwitPrefix) == 0) {
-            std::pair<int, std::vector<uint8_t> > decoded = segwit_addr::decode(access.config.chainConfig.segwitPrefix, addressString);
-            if (decoded.first == 0) {
-                if (decoded.second.size() == 20) {
-                    uint160 pubkeyHash(decoded.second.begin(), decoded.second.end());
-                    ranges::optional<uint32_t> addressNum = access.getHashIndex().getPubkeyHashIndex(pubkeyHash);
-                    if (addressNum) {
-                        return Address{*addressNum, AddressType::WITNESS_PUBKEYHASH, access};
-                    }
-                } else if (decoded.second.size() == 32) {
-                    uint256 scriptHash(decoded.second.begin(), decoded.second.end());
-                    ranges::optional<uint32_t> addressNum = access.getHashIndex().getScriptHashIndex(scriptHash);
-                    if (addressNum) {
-                        return Address{*addressNum, AddressType::WITNESS_SCRIPTHASH, access};
+    namespace {
+        /** Hash encoded in an address string, only one of hash160 and hash256 is set depending on the type */
+        struct DecodedAddress {
+            AddressType::Enum type;
+            uint160 hash160;
+            uint256 hash256;
+        };
+        
+        ranges::optional<DecodedAddress> decodeAddressString(const std::string &addressString, const ChainConfiguration &chainConfig) {
+            DecodedAddress decodedAddress{};
+            if (addressString.compare(0, chainConfig.segwitPrefix.size(), chainConfig.segwitPrefix) == 0) {
+                std::pair<int, std::vector<uint8_t> > decoded = segwit_addr::decode(chainConfig.segwitPrefix, addressString);
+                if (decoded.first == 0) {
+                    if (decoded.second.size() == 20) {
+                        decodedAddress.type = AddressType::WITNESS_PUBKEYHASH;
+                        decodedAddress.hash160 = uint160(decoded.second.begin(), decoded.second.end());
+                        return decodedAddress;
+                    } else if (decoded.second.size() == 32) {
+                        decodedAddress.type = AddressType::WITNESS_SCRIPTHASH;
+                        decodedAddress.hash256 = uint256(decoded.second.begin(), decoded.second.end());
+                        return decodedAddress;
                     }
                 }
+                return ranges::nullopt;
             }
+            unsigned int nVersionBytes = chainConfig.pubkeyPrefix.size();
+            CBitcoinAddress address{addressString, nVersionBytes};
+            std::tie(decodedAddress.hash160, decodedAddress.type) = address.Get(chainConfig);
+            if (decodedAddress.type == AddressType::Enum::PUBKEYHASH || decodedAddress.type == AddressType::Enum::SCRIPTHASH) {
+                return decodedAddress;
+            }
+            return ranges::nullopt;
+        }
+    }
+    
+    ranges::optional<Address> getAddressFromString(const std::string &addressString, DataAccess &access) {
+        auto decoded = decodeAddressString(addressString, access.config.chainConfig);
+        if (!decoded) {
             return ranges::nullopt;
         }
-        unsigned int nVersionBytes = access.config.chainConfig.pubkeyPrefix.size();
-        CBitcoinAddress address{addressString, nVersionBytes};
-        uint160 hash;
-        blocksci::AddressType::Enum type;
-        std::tie(hash, type) = address.Get(access.config.chainConfig);
         ranges::optional<uint32_t> addressNum = ranges::nullopt;
-        if (type == AddressType::Enum::PUBKEYHASH) {
-            addressNum = access.getHashIndex().getPubkeyHashIndex(hash);
-        } else if (type == AddressType::Enum::SCRIPTHASH) {
-            addressNum = access.getHashIndex().getScriptHashIndex(hash);
+        switch (decoded->type) {
+            case AddressType::PUBKEYHASH:
+            case AddressType::WITNESS_PUBKEYHASH:
+                addressNum = access.getHashIndex().getPubkeyHashIndex(decoded->hash160);
+                break;
+            case AddressType::SCRIPTHASH:
+                addressNum = access.getHashIndex().getScriptHashIndex(decoded->hash160);
+                break;
+            case AddressType::WITNESS_SCRIPTHASH:
+                addressNum = access.getHashIndex().getScriptHashIndex(decoded->hash256);
+                break;
+            default:
+                break;
         }
         if (addressNum) {
-            return Address{*addressNum, type, access};
+            return Address{*addressNum, decoded->type, access};
         } else {
             return ranges::nullopt;
         }
     }
     
-    template<AddressType::Enum type>
-    std::vector<Address> getAddressesWithPrefixImp(const std::string &prefix, DataAccess &access) {
+    std::vector<ranges::optional<Address>> getAddressesFromStrings(const std::vector<std::string> &addressStrings, DataAccess &access) {
+        std::vector<ranges::optional<DecodedAddress>> decodedAddresses;
+        decodedAddresses.reserve(addressStrings.size());
+        // Collect the hashes of every column so that each column is probed with a single batch
+        std::vector<uint160> pubkeyHashes;
+        std::vector<uint160> scriptHashes;
+        std::vector<uint256> witnessScriptHashes;
+        for (const auto &addressString : addressStrings) {
+            decodedAddresses.push_back(decodeAddressString(addressString, access.config.chainConfig));
+            auto &decoded = decodedAddresses.back();
+            if (decoded) {
+                switch (decoded->type) {
+                    case AddressType::PUBKEYHASH:
+                    case AddressType::WITNESS_PUBKEYHASH:
+                        pubkeyHashes.push_back(decoded->hash160);
+                        break;
+                    case AddressType::SCRIPTHASH:
+                        scriptHashes.push_back(decoded->hash160);
+                        break;
+                    case AddressType::WITNESS_SCRIPTHASH:
+                        witnessScriptHashes.push_back(decoded->hash256);
+                        break;
+                    default:
+                        break;
+                }
+            }
+        }
+        
+        auto &hashIndex = access.getHashIndex();
+        auto pubkeyNums = hashIndex.getPubkeyHashIndexes(pubkeyHashes);
+        auto scriptNums = hashIndex.getScriptHashIndexes(scriptHashes);
+        auto witnessScriptNums = hashIndex.getScriptHashIndexes(witnessScriptHashes);
+        
+        // Results of each column are consumed in the order the hashes were collected in
+        auto pubkeyIt = pubkeyNums.begin();
+        auto scriptIt = scriptNums.begin();
+        auto witnessScriptIt = witnessScriptNums.begin();
+        std::vector<ranges::optional<Address>> addresses;
+        addresses.reserve(addressStrings.size());
+        for (const auto &decoded : decodedAddresses) {
+            ranges::optional<uint32_t> addressNum = ranges::nullopt;
+            if (decoded) {
+                switch (decoded->type) {
+                    case AddressType::PUBKEYHASH:
+                    case AddressType::WITNESS_PUBKEYHASH:
+                        addressNum = *pubkeyIt++;
+                        break;
+                    case AddressType::SCRIPTHASH:
+                        addressNum = *scriptIt++;
+                        break;
+                    case AddressType::WITNESS_SCRIPTHASH:
+                        addressNum = *witnessScriptIt++;
+                        break;
+                    default:
+                        break;
+                }
+            }
+            if (addressNum) {
+                addresses.emplace_back(Address{*addressNum, decoded->type, access});
+            } else {
+                addresses.emplace_back(ranges::nullopt);
+            }
+        }
+        return addresses;
+    }
+    
+    namespace {
+        void addIfPrefixMatches(const std::string &prefix, AddressType::Enum type, uint32_t scriptNum, DataAccess &access, std::vector<Address> &addresses) {
+            if (isPrefixIndexed(type, scriptNum, access) && isSeenWithType(type, scriptNum, access) && prefixIndexAddressString(type, scriptNum, access).compare(0, prefix.length(), prefix) == 0) {
+                addresses.emplace_back(scriptNum, type, access);
+            }
+        }
+    }
+    
+    std::vector<Address> getAddressesWithPrefix(const std::string &prefix, DataAccess &access) {
+        if (prefix.empty()) {
+            throw std::runtime_error("Address prefix must not be empty");
+        }
         std::vector<Address> addresses;
-        auto count = access.getScripts().scriptCount(dedupType(type));
-        for (uint32_t scriptNum = 1; scriptNum <= count; scriptNum++) {
-            ScriptAddress<type> script(scriptNum, access);
-            if (script.addressString().compare(0, prefix.length(), prefix) == 0) {
+        auto directory = access.config.addressPrefixIndexDirectory();
+        for (auto type : AddressPrefixIndex::indexedTypes()) {
+            AddressPrefixIndex index{directory, type, access};
+            bool legacyPrefix = (type == AddressType::PUBKEYHASH && prefix.compare(0, 1, "1") == 0) || (type == AddressType::SCRIPTHASH && prefix.compare(0, 1, "3") == 0);
+            if (!index.exists() && !legacyPrefix) {
+                // Without an index only the legacy prefixes are searched, which needs a scan of all scripts of the type
+                continue;
+            }
+            for (auto scriptNum : index.findPrefix(prefix)) {
                 addresses.emplace_back(scriptNum, type, access);
             }
+            // Scripts that got their address or were created after the last index update are checked one by one
+            for (auto scriptNum : index.unindexedScripts()) {
+                addIfPrefixMatches(prefix, type, scriptNum, access, addresses);
+            }
+            auto count = access.getScripts().scriptCount(dedupType(type));
+            for (uint32_t scriptNum = index.scriptCount() + 1; scriptNum <= count; scriptNum++) {
+                addIfPrefixMatches(prefix, type, scriptNum, access, addresses);
+            }
         }
         return addresses;
     }
     
-    std::vector<Address> getAddressesWithPrefix(const std::string &prefix, DataAccess &access) {
-        if (prefix.compare(0, 1, "1") == 0) {
-            return getAddressesWithPrefixImp<AddressType::Enum::PUBKEYHASH>(prefix, access);
-        } else if (prefix.compare(0, 1, "3") == 0) {
-            return getAddressesWithPrefixImp<AddressType::Enum::SCRIPTHASH>(prefix, access);
-        } else {
-            return {};
+    void updateAddressPrefixIndex(DataAccess &access) {
+        for (auto type : AddressPrefixIndex::indexedTypes()) {
+            AddressPrefixIndex::update(access.config.addressPrefixIndexDirectory(), type, access);
         }
     }
     
+    size_t addressStringWidth(DataAccess &access) {
+        auto &config = access.config.chainConfig;
+        auto versionSize = std::max(config.pubkeyPrefix.size(), config.scriptPrefix.size());
+        return std::max(base58EncodedSize(versionSize + sizeof(uint160) + 4), Bech32Prefix{config.segwitPrefix}.encodedSize(sizeof(uint256)));
+    }
+    
+    namespace {
+        /** Encodes the addresses at the given positions with one batch encoder call and scatters them into out */
+        template <typename Hash, typename GetHash, typename Encode>
+        void encodeAddressGroup(const std::vector<Address> &addresses, const std::vector<size_t> &positions, char *out, size_t width, GetHash getHash, Encode encode) {
+            if (positions.empty()) {
+                return;
+            }
+            // Computing the hash may require hashing a pubkey, so this is spread over the thread pool as well
+            std::vector<Hash> hashes(positions.size());
+            ThreadPool::instance().parallelFor(positions.size(), [&](size_t i) {
+                hashes[i] = getHash(addresses[positions[i]]);
+            });
+            std::vector<char> encoded(positions.size() * width);
+            encode(hashes.data(), hashes.size(), encoded.data());
+            for (size_t i = 0; i < positions.size(); i++) {
+                memcpy(out + positions[i] * width, encoded.data() + i * width, width);
+            }
+        }
+    }
+    
+    void getAddressStrings(const std::vector<Address> &addresses, char *out, size_t width, DataAccess &access) {
+        memset(out, 0, addresses.size() * width);
+        std::vector<size_t> pubkeyPositions;
+        std::vector<size_t> scriptHashPositions;
+        std::vector<size_t> witnessPubkeyPositions;
+        std::vector<size_t> witnessScriptPositions;
+        for (size_t i = 0; i < addresses.size(); i++) {
+            switch (addresses[i].type) {
+                case AddressType::PUBKEY:
+                case AddressType::PUBKEYHASH:
+                case AddressType::MULTISIG_PUBKEY:
+                    pubkeyPositions.push_back(i);
+                    break;
+                case AddressType::SCRIPTHASH:
+                    scriptHashPositions.push_back(i);
+                    break;
+                case AddressType::WITNESS_PUBKEYHASH:
+                    witnessPubkeyPositions.push_back(i);
+                    break;
+                case AddressType::WITNESS_SCRIPTHASH:
+                    witnessScriptPositions.push_back(i);
+                    break;
+                default:
+                    break;
+            }
+        }
+        
+        auto &config = access.config.chainConfig;
+        Bech32Prefix segwitPrefix{config.segwitPrefix};
+        auto pubkeyHash = [&](const Address &address) {
+            return script::Pubkey(address.scriptNum, access).getPubkeyHash();
+        };
+        encodeAddressGroup<uint160>(addresses, pubkeyPositions, out, width, pubkeyHash, [&](const uint160 *hashes, size_t count, char *encoded) {
+            encodeBase58CheckHashes(config.pubkeyPrefix, hashes, count, encoded, width);
+        });
+        encodeAddressGroup<uint160>(addresses, scriptHashPositions, out, width, [&](const Address &address) {
+            return script::ScriptHash(address.scriptNum, access).getAddressHash();
+        }, [&](const uint160 *hashes, size_t count, char *encoded) {
+            encodeBase58CheckHashes(config.scriptPrefix, hashes, count, encoded, width);
+        });
+        encodeAddressGroup<uint160>(addresses, witnessPubkeyPositions, out, width, pubkeyHash, [&](const uint160 *hashes, size_t count, char *encoded) {
+            encodeSegwitHashes(segwitPrefix, hashes, count, encoded, width);
+        });
+        encodeAddressGroup<uint256>(addresses, witnessScriptPositions, out, width, [&](const Address &address) {
+            return script::WitnessScriptHash(address.scriptNum, access).getAddressHash();
+        }, [&](const uint256 *hashes, size_t count, char *encoded) {
+            encodeSegwitHashes(segwitPrefix, hashes, count, encoded, width);
+        });
+    }
+    
     std::string fullTypeImp(const Address &address, DataAccess &access) {
         std::stringstream ss;
         ss << addressName(address.type);
@@ -0,0 +1,282 @@
+//
+//  address_prefix_index.cpp
+//  blocksci
+//
+
+#include "address_prefix_index.hpp"
+
+#include <blocksci/core/thread_pool.hpp>
+#include <blocksci/scripts/pubkey_script.hpp>
+#include <blocksci/scripts/scripthash_script.hpp>
+
+#include <internal/address_info.hpp>
+#include <internal/data_access.hpp>
+#include <internal/script_access.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <queue>
+#include <stdexcept>
+
+namespace blocksci {
+    namespace {
+        // Scripts that are encoded and sorted by one task while building a run
+        constexpr uint32_t sortChunkSize = 1 << 20;
+
+        // Script numbers that are collected before they are written out
+        constexpr size_t runWriteBufferSize = 1 << 20;
+
+        filesystem::path stateFilePath(const filesystem::path &directory, AddressType::Enum type) {
+            return directory/(addressName(type) + "_state.dat");
+        }
+
+        filesystem::path runFilePath(const filesystem::path &directory, AddressType::Enum type, uint32_t generation, uint32_t runNum) {
+            return directory/(addressName(type) + "_" + std::to_string(generation) + "_run" + std::to_string(runNum));
+        }
+
+        AddressPrefixIndex::State loadState(const filesystem::path &directory, AddressType::Enum type) {
+            AddressPrefixIndex::State state{0, 0, 0, 0};
+            auto statePath = stateFilePath(directory, type);
+            if (statePath.exists()) {
+                std::ifstream file(statePath.str(), std::ios::binary);
+                file.read(reinterpret_cast<char *>(&state), sizeof(state));
+                if (!file) {
+                    throw std::runtime_error("Failed to read address prefix index state " + statePath.str());
+                }
+            }
+            return state;
+        }
+
+        void saveState(const filesystem::path &directory, AddressType::Enum type, const AddressPrefixIndex::State &state) {
+            auto statePath = stateFilePath(directory, type).str();
+            {
+                std::ofstream file(statePath + ".tmp", std::ios::binary);
+                file.write(reinterpret_cast<const char *>(&state), sizeof(state));
+                file.close();
+                if (file.fail()) {
+                    throw std::runtime_error("Failed to write address prefix index state " + statePath);
+                }
+            }
+            if (std::rename((statePath + ".tmp").c_str(), statePath.c_str()) != 0) {
+                throw std::runtime_error("Failed to replace address prefix index state " + statePath);
+            }
+        }
+
+        /** Distinct scripts up to scriptCount in the entries of the parser's segwit script hash log from firstEntry on */
+        std::vector<uint32_t> loggedSegwitScripts(DataAccess &access, uint32_t firstEntry, uint32_t scriptCount, uint32_t &entryCount) {
+            FixedSizeFileMapper<uint32_t> log{access.config.scriptHashSegwitFilePath()};
+            entryCount = static_cast<uint32_t>(log.size());
+            std::vector<uint32_t> scriptNums;
+            for (uint32_t entry = firstEntry; entry < entryCount; entry++) {
+                auto scriptNum = *log[entry];
+                // Later scripts are found by the scan of new scripts
+                if (scriptNum <= scriptCount) {
+                    scriptNums.push_back(scriptNum);
+                }
+            }
+            std::sort(scriptNums.begin(), scriptNums.end());
+            scriptNums.erase(std::unique(scriptNums.begin(), scriptNums.end()), scriptNums.end());
+            return scriptNums;
+        }
+
+        struct SortedScripts {
+            const uint32_t *begin;
+            const uint32_t *end;
+        };
+
+        /** Merges lists of scriptNums that are each sorted by address string into one run file */
+        void writeMergedRun(const std::vector<SortedScripts> &sources, AddressType::Enum type, DataAccess &access, const filesystem::path &path) {
+            struct Head {
+                std::string address;
+                size_t source;
+            };
+            auto later = [](const Head &a, const Head &b) {
+                return a.address > b.address;
+            };
+            std::priority_queue<Head, std::vector<Head>, decltype(later)> heap(later);
+            std::vector<const uint32_t *> positions;
+            for (size_t i = 0; i < sources.size(); i++) {
+                positions.push_back(sources[i].begin);
+                if (sources[i].begin != sources[i].end) {
+                    heap.push(Head{prefixIndexAddressString(type, *sources[i].begin, access), i});
+                }
+            }
+
+            std::ofstream file(path.str() + ".dat", std::ios::binary);
+            std::vector<uint32_t> buffer;
+            auto flush = [&]() {
+                file.write(reinterpret_cast<const char *>(buffer.data()), static_cast<std::streamsize>(buffer.size() * sizeof(uint32_t)));
+                buffer.clear();
+            };
+            while (!heap.empty()) {
+                auto source = heap.top().source;
+                heap.pop();
+                auto &pos = positions[source];
+                buffer.push_back(*pos);
+                ++pos;
+                if (pos != sources[source].end) {
+                    heap.push(Head{prefixIndexAddressString(type, *pos, access), source});
+                }
+                if (buffer.size() >= runWriteBufferSize) {
+                    flush();
+                }
+            }
+            flush();
+            file.close();
+            if (file.fail()) {
+                throw std::runtime_error("Failed to write address prefix index run " + path.str());
+            }
+        }
+    }
+
+    std::string prefixIndexAddressString(AddressType::Enum type, uint32_t scriptNum, DataAccess &access) {
+        switch (type) {
+            case AddressType::PUBKEYHASH:
+                return ScriptAddress<AddressType::PUBKEYHASH>(scriptNum, access).addressString();
+            case AddressType::SCRIPTHASH:
+                return ScriptAddress<AddressType::SCRIPTHASH>(scriptNum, access).addressString();
+            case AddressType::WITNESS_PUBKEYHASH:
+                return ScriptAddress<AddressType::WITNESS_PUBKEYHASH>(scriptNum, access).addressString();
+            case AddressType::WITNESS_SCRIPTHASH:
+                return ScriptAddress<AddressType::WITNESS_SCRIPTHASH>(scriptNum, access).addressString();
+            default:
+                throw std::runtime_error("Addresses of type " + addressName(type) + " have no address string");
+        }
+    }
+
+    bool isPrefixIndexed(AddressType::Enum type, uint32_t scriptNum, DataAccess &access) {
+        if (type == AddressType::WITNESS_SCRIPTHASH) {
+            // Only scripts seen as pay to witness script hash have the 256 bit hash that the address encodes
+            return access.getScripts().getScriptData<DedupAddressType::SCRIPTHASH>(scriptNum)->isSegwit;
+        }
+        return true;
+    }
+
+    bool isSeenWithType(AddressType::Enum type, uint32_t scriptNum, DataAccess &access) {
+        // A deduplicated script is shared by several address types, e.g. a pubkey hash only seen in P2PKH outputs has no P2WPKH address
+        return access.getScripts().getScriptHeader(scriptNum, dedupType(type))->seen(type);
+    }
+
+    AddressPrefixIndex::AddressPrefixIndex(const filesystem::path &directory, AddressType::Enum type_, DataAccess &access_) : type(type_), access(&access_), state(loadState(directory, type_)) {
+        for (uint32_t runNum = 0; runNum < state.runCount; runNum++) {
+            runs.push_back(std::make_unique<FixedSizeFileMapper<uint32_t>>(runFilePath(directory, type, state.generation, runNum)));
+        }
+    }
+
+    std::vector<uint32_t> AddressPrefixIndex::findPrefix(const std::string &prefix) const {
+        std::vector<uint32_t> scriptNums;
+        for (auto &run : runs) {
+            auto count = run->size();
+            if (count == 0) {
+                continue;
+            }
+            auto first = run->getDataAtIndex(0);
+            auto last = first + count;
+            // Matches are the addresses that are not less than the prefix and whose start is not greater than it
+            auto begin = std::partition_point(first, last, [&](uint32_t scriptNum) {
+                return prefixIndexAddressString(type, scriptNum, *access) < prefix;
+            });
+            auto end = std::partition_point(begin, last, [&](uint32_t scriptNum) {
+                return prefixIndexAddressString(type, scriptNum, *access).compare(0, prefix.size(), prefix) <= 0;
+            });
+            std::copy_if(begin, end, std::back_inserter(scriptNums), [&](uint32_t scriptNum) {
+                return isSeenWithType(type, scriptNum, *access);
+            });
+        }
+        return scriptNums;
+    }
+
+    std::vector<uint32_t> AddressPrefixIndex::unindexedScripts() const {
+        if (type != AddressType::WITNESS_SCRIPTHASH) {
+            return {};
+        }
+        uint32_t entryCount;
+        return loggedSegwitScripts(*access, state.segwitLogCount, state.scriptCount, entryCount);
+    }
+
+    void AddressPrefixIndex::update(const filesystem::path &directory, AddressType::Enum type, DataAccess &access) {
+        if (!directory.exists()) {
+            filesystem::create_directory(directory);
+        }
+        auto state = loadState(directory, type);
+        if (state.generation == 0) {
+            state.generation = 1;
+        }
+        auto scriptCount = access.getScripts().scriptCount(dedupType(type));
+        // Indexed scripts that got their P2WSH address since the last update
+        std::vector<uint32_t> segwitScripts;
+        auto segwitLogCount = state.segwitLogCount;
+        if (type == AddressType::WITNESS_SCRIPTHASH) {
+            segwitScripts = loggedSegwitScripts(access, state.segwitLogCount, state.scriptCount, segwitLogCount);
+        }
+        if (scriptCount > state.scriptCount || !segwitScripts.empty()) {
+            auto firstNew = state.scriptCount + 1;
+            auto chunkCount = (scriptCount - state.scriptCount + sortChunkSize - 1) / sortChunkSize;
+            std::vector<std::vector<uint32_t>> chunks(chunkCount);
+            ThreadPool::instance().parallelFor(chunkCount, [&](size_t chunk) {
+                auto chunkStart = firstNew + static_cast<uint32_t>(chunk) * sortChunkSize;
+                auto chunkEnd = std::min(chunkStart + sortChunkSize, scriptCount + 1);
+                std::vector<std::pair<std::string, uint32_t>> entries;
+                for (uint32_t scriptNum = chunkStart; scriptNum < chunkEnd; scriptNum++) {
+                    if (isPrefixIndexed(type, scriptNum, access)) {
+                        entries.emplace_back(prefixIndexAddressString(type, scriptNum, access), scriptNum);
+                    }
+                }
+                std::sort(entries.begin(), entries.end());
+                auto &sorted = chunks[chunk];
+                sorted.reserve(entries.size());
+                for (auto &entry : entries) {
+                    sorted.push_back(entry.second);
+                }
+            });
+            std::vector<std::pair<std::string, uint32_t>> segwitEntries;
+            for (auto scriptNum : segwitScripts) {
+                segwitEntries.emplace_back(prefixIndexAddressString(type, scriptNum, access), scriptNum);
+            }
+            std::sort(segwitEntries.begin(), segwitEntries.end());
+            std::vector<uint32_t> sortedSegwitScripts;
+            for (auto &entry : segwitEntries) {
+                sortedSegwitScripts.push_back(entry.second);
+            }
+            std::vector<SortedScripts> sources;
+            for (auto &chunk : chunks) {
+                sources.push_back({chunk.data(), chunk.data() + chunk.size()});
+            }
+            sources.push_back({sortedSegwitScripts.data(), sortedSegwitScripts.data() + sortedSegwitScripts.size()});
+            // A run file left over from an interrupted update has the same path and is overwritten here
+            writeMergedRun(sources, type, access, runFilePath(directory, type, state.generation, state.runCount));
+            state.scriptCount = scriptCount;
+            state.segwitLogCount = segwitLogCount;
+            state.runCount++;
+            saveState(directory, type, state);
+        } else if (segwitLogCount != state.segwitLogCount) {
+            state.segwitLogCount = segwitLogCount;
+            saveState(directory, type, state);
+        }
+
+        if (state.runCount > maxRuns) {
+            auto newState = state;
+            newState.runCount = 1;
+            newState.generation++;
+            {
+                std::vector<std::unique_ptr<FixedSizeFileMapper<uint32_t>>> runs;
+                std::vector<SortedScripts> sources;
+                for (uint32_t runNum = 0; runNum < state.runCount; runNum++) {
+                    runs.push_back(std::make_unique<FixedSizeFileMapper<uint32_t>>(runFilePath(directory, type, state.generation, runNum)));
+                    auto count = runs.back()->size();
+                    if (count > 0) {
+                        auto first = runs.back()->getDataAtIndex(0);
+                        sources.push_back({first, first + count});
+                    }
+                }
+                writeMergedRun(sources, type, access, runFilePath(directory, type, newState.generation, 0));
+            }
+            saveState(directory, type, newState);
+            for (uint32_t runNum = 0; runNum < state.runCount; runNum++) {
+                filesystem::path{runFilePath(directory, type, state.generation, runNum).str() + ".dat"}.remove_file();
+            }
+        }
+    }
+} // namespace blocksci
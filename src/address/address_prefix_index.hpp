@@ -0,0 +1,100 @@
+//
+//  address_prefix_index.hpp
+//  blocksci
+//
+
+#ifndef address_prefix_index_hpp
+#define address_prefix_index_hpp
+
+#include <blocksci/core/address_types.hpp>
+
+#include <internal/file_mapper.hpp>
+
+#include <wjfilesystem/path.h>
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace blocksci {
+    class DataAccess;
+
+    /** Index of the address strings of one address type, ordered so that all addresses with a given prefix are adjacent
+     *
+     * The index stores the scriptNums of the type sorted by their encoded address string. The strings themselves are
+     * not stored but encoded when needed, so a prefix query costs two binary searches that encode about 2 * log2(n)
+     * addresses per run, plus the encoding of the matches.
+     *
+     * The index holds every script of the dedup type, not only the ones seen with the indexed type, because a script
+     * can be seen with another type of its dedup type at any later time, e.g. a pubkey first seen in a multisig output
+     * that later receives a P2PKH output. Queries filter the matches by the types seen. The only address string that
+     * doesn't exist for every script is P2WSH, which needs the hash of a script seen as segwit. The parser logs the
+     * script hash scripts that become segwit after they were created, and updates add the logged scripts that the
+     * index already covers.
+     *
+     * Every update adds the scripts created since the last update as a new sorted run. Once there are more than
+     * maxRuns runs, all of them are merged into a single run of the next generation. The state file is replaced
+     * atomically after the run files it refers to have been written, so an interrupted update leaves the previous
+     * index intact.
+     *
+     * Files: - <name>_state.dat: AddressPrefixIndex::State
+     *        - <name>_<generation>_run<n>.dat: uint32_t scriptNums of run n, sorted by address string
+     */
+    class AddressPrefixIndex {
+    public:
+        struct State {
+            /** Scripts of the type that are covered by the index, all scriptNums in [1, scriptCount] */
+            uint32_t scriptCount;
+            uint32_t runCount;
+            uint32_t generation;
+            /** Entries of the parser's log of scripts that became segwit that are covered by the index */
+            uint32_t segwitLogCount;
+        };
+
+        /** Number of runs after which an update merges them */
+        static constexpr uint32_t maxRuns = 8;
+
+        AddressPrefixIndex(const filesystem::path &directory, AddressType::Enum type, DataAccess &access);
+
+        /** Address types whose strings can be indexed */
+        static std::array<AddressType::Enum, 4> indexedTypes() {
+            return {{AddressType::PUBKEYHASH, AddressType::SCRIPTHASH, AddressType::WITNESS_PUBKEYHASH, AddressType::WITNESS_SCRIPTHASH}};
+        }
+
+        /** Add the scripts created since the last update to the index of the given type, encoding them in parallel */
+        static void update(const filesystem::path &directory, AddressType::Enum type, DataAccess &access);
+
+        bool exists() const {
+            return state.generation > 0;
+        }
+
+        uint32_t scriptCount() const {
+            return state.scriptCount;
+        }
+
+        /** Script numbers of all indexed addresses seen with the type whose string starts with prefix */
+        std::vector<uint32_t> findPrefix(const std::string &prefix) const;
+
+        /** Scripts up to scriptCount that got an address of the type after the last update and are missing from the index */
+        std::vector<uint32_t> unindexedScripts() const;
+
+    private:
+        AddressType::Enum type;
+        DataAccess *access;
+        State state;
+        std::vector<std::unique_ptr<FixedSizeFileMapper<uint32_t>>> runs;
+    };
+
+    /** Encoded address string of the given script interpreted as an address of the given indexed type */
+    std::string prefixIndexAddressString(AddressType::Enum type, uint32_t scriptNum, DataAccess &access);
+
+    /** Whether the given script has an address string of the given indexed type, which all scripts but non-segwit script hashes have */
+    bool isPrefixIndexed(AddressType::Enum type, uint32_t scriptNum, DataAccess &access);
+
+    /** Whether the given script has been seen on chain as an address of the given indexed type */
+    bool isSeenWithType(AddressType::Enum type, uint32_t scriptNum, DataAccess &access);
+} // namespace blocksci
+
+#endif /* address_prefix_index_hpp */
@@ -8,6 +8,10 @@
 
 #include <blocksci/chain/blockchain.hpp>
 
+#include <internal/chain_access.hpp>
+#include <internal/data_access.hpp>
+#include <internal/tx_column_access.hpp>
+
 #include <range/v3/action/push_back.hpp>
 #include <range/v3/view/filter.hpp>
 
@@ -49,6 +53,56 @@ namespace blocksci {
         return segments;
     }
     
+    std::vector<BlockRange> BlockRange::parallelSegments() const {
+        auto &pool = ThreadPool::instance();
+        unsigned int segmentCount = pool.getThreadCount();
+        if (size() > 0) {
+            auto txCount = endTxIndex() - firstTxIndex();
+            segmentCount = std::max(segmentCount, txCount / pool.getGrainSize());
+            // segment() doesn't split ranges with fewer blocks than segments
+            segmentCount = std::min(segmentCount, static_cast<unsigned int>(size()));
+        }
+        return segment(std::max(segmentCount, 1u));
+    }
+    
+    namespace {
+        template <typename T>
+        ColumnSpan<T> txColumnSpan(const BlockRange &range, const T *column) {
+            if (range.size() == 0) {
+                return {};
+            }
+            auto firstTx = range.firstTxIndex();
+            return {column + firstTx, range.endTxIndex() - firstTx};
+        }
+    }
+    
+    ColumnSpan<uint32_t> BlockRange::locktimes() const {
+        return txColumnSpan(*this, access->getTxColumns().getLocktimes());
+    }
+    
+    ColumnSpan<int32_t> BlockRange::versions() const {
+        if (size() == 0) {
+            return {};
+        }
+        return txColumnSpan(*this, access->getChain().getTxVersion(0));
+    }
+    
+    ColumnSpan<uint16_t> BlockRange::inputCounts() const {
+        return txColumnSpan(*this, access->getTxColumns().getInputCounts());
+    }
+    
+    ColumnSpan<uint16_t> BlockRange::outputCounts() const {
+        return txColumnSpan(*this, access->getTxColumns().getOutputCounts());
+    }
+    
+    ColumnSpan<uint32_t> BlockRange::totalSizes() const {
+        return txColumnSpan(*this, access->getTxColumns().getTotalSizes());
+    }
+    
+    ColumnSpan<int64_t> BlockRange::fees() const {
+        return txColumnSpan(*this, access->getTxColumns().getFees());
+    }
+    
     std::vector<Block> BlockRange::filter(std::function<bool(const Block &block)> testFunc)  {
         auto mapFunc = [&testFunc](const BlockRange &segment) -> std::vector<Block> {
             return segment | ranges::views::filter(testFunc) | ranges::to_vector;
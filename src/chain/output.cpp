@@ -12,7 +12,6 @@
 
 #include <internal/chain_access.hpp>
 #include <internal/data_access.hpp>
-#include <range/v3/range_for.hpp>
 
 #include <sstream>
 
@@ -43,14 +42,9 @@ namespace blocksci {
 
     /** Get the Input that spends this Output, if it was spent yet */
     ranges::optional<Input> Output::getSpendingInput() const {
-        auto spendingTx = getSpendingTx();
-        if (spendingTx) {
-            RANGES_FOR(auto input, spendingTx->inputs()) {
-                if (input.getSpentOutputPointer() == pointer) {
-                    return input;
-                }
-            }
-            throw std::runtime_error("Whoopsie. Something went terribly wrong");
+        auto spendingPointer = getSpendingInputPointer();
+        if (spendingPointer) {
+            return Input(*spendingPointer, *access);
         } else {
             return ranges::nullopt;
         }
@@ -59,8 +53,19 @@ namespace blocksci {
     ranges::optional<InputPointer> Output::getSpendingInputPointer() const {
         auto index = getSpendingTxIndex();
         if (index) {
-            auto rawTx = access->getChain().getTx(*index);
-            auto spentOutNums = access->getChain().getSpentOutputNumbers(*index);
+            auto &chain = access->getChain();
+            auto rawTx = chain.getTx(*index);
+            auto spentOutNums = chain.getSpentOutputNumbers(*index);
+            
+            // The parser records the spending input of each output, check it before falling back to a scan
+            auto recordedNum = chain.getSpendingInputNum(pointer.txNum, pointer.inoutNum);
+            if (recordedNum != 0) {
+                uint16_t inputNum = recordedNum - 1;
+                if (inputNum < rawTx->inputCount && rawTx->getInput(inputNum).getLinkedTxNum() == pointer.txNum && spentOutNums[inputNum] == pointer.inoutNum) {
+                    return InputPointer{*index, inputNum};
+                }
+            }
+            
             for (uint16_t i = 0; i < rawTx->inputCount; i++) {
                 const auto &input = rawTx->getInput(i);
                 auto spentOutNum = spentOutNums[i];
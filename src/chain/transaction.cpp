@@ -49,6 +49,25 @@ namespace blocksci {
 
     Transaction::Transaction(const std::string &hash, DataAccess &access_) : Transaction(uint256S(hash), access_) {}
     
+    std::vector<ranges::optional<Transaction>> getTransactionsFromHashes(const std::vector<std::string> &hashes, DataAccess &access) {
+        std::vector<uint256> txHashes;
+        txHashes.reserve(hashes.size());
+        for (const auto &hash : hashes) {
+            txHashes.push_back(uint256S(hash));
+        }
+        auto txNums = access.getHashIndex().getTxIndexes(txHashes);
+        std::vector<ranges::optional<Transaction>> txes;
+        txes.reserve(txNums.size());
+        for (auto &txNum : txNums) {
+            if (txNum) {
+                txes.emplace_back(Transaction{*txNum, access});
+            } else {
+                txes.emplace_back(ranges::nullopt);
+            }
+        }
+        return txes;
+    }
+    
     std::string Transaction::toString() const {
         std::stringstream ss;
         ss << "Tx(len(txins)=" << inputCount() <<", len(txouts)=" << outputCount() <<", size_bytes=" << sizeBytes() << ", block_height=" << getBlockHeight() <<", tx_index=" << txNum << ")";
@@ -17,6 +17,7 @@
 #include <blocksci/core/dedup_address.hpp>
 
 #include <internal/address_info.hpp>
+#include <internal/chain_access.hpp>
 #include <internal/cluster_access.hpp>
 #include <internal/data_access.hpp>
 #include <internal/dedup_address_info.hpp>
@@ -25,6 +26,8 @@
 #include <range/v3/iterator/operations.hpp>
 #include <range/v3/view/join.hpp>
 
+#include <algorithm>
+
 namespace {
     using namespace blocksci;
     
@@ -113,7 +116,25 @@ namespace blocksci {
 //        });
 //    }
     
+    const ClusterSummary *Cluster::currentSummary() const {
+        auto blockCount = clusterAccess->getSummaryBlockCount();
+        if (blockCount == -1 || blockCount != clusterAccess->access.getChain().blockCount()) {
+            return nullptr;
+        }
+        return clusterAccess->getClusterSummary(clusterNum);
+    }
+    
+    ranges::optional<ClusterSummary> Cluster::getSummary() const {
+        if (auto summary = currentSummary()) {
+            return *summary;
+        }
+        return ranges::nullopt;
+    }
+    
     int64_t Cluster::getSize() const {
+        if (auto summary = currentSummary()) {
+            return summary->addressCount;
+        }
         return ranges::distance(getAddresses());
     }
     
@@ -222,6 +243,11 @@ namespace blocksci {
     }
     
     int64_t Cluster::calculateBalance(BlockHeight height) const {
+        if (auto summary = currentSummary()) {
+            if (height == -1 || height >= clusterAccess->getSummaryBlockCount() - 1) {
+                return summary->balance();
+            }
+        }
         auto access_ = &clusterAccess->access;
         auto balances = getDedupAddresses() | ranges::views::transform([access_, height](const DedupAddress &dedupAddress) {
             uint32_t scriptNum = dedupAddress.scriptNum;
@@ -233,6 +259,68 @@ namespace blocksci {
         return ranges::accumulate(balances, int64_t{0});
     }
     
+    uint32_t Cluster::getOutputCount() const {
+        if (auto summary = currentSummary()) {
+            return summary->outputCount;
+        }
+        return static_cast<uint32_t>(ranges::distance(getOutputPointers()));
+    }
+    
+    uint32_t Cluster::getTransactionCount() const {
+        if (auto summary = currentSummary()) {
+            return summary->txCount;
+        }
+        return static_cast<uint32_t>(getTransactions().size());
+    }
+    
+    int64_t Cluster::getTotalReceived() const {
+        if (auto summary = currentSummary()) {
+            return summary->totalReceived;
+        }
+        int64_t value = 0;
+        RANGES_FOR(auto output, getOutputs()) {
+            value += output.getValue();
+        }
+        return value;
+    }
+    
+    int64_t Cluster::getTotalSent() const {
+        if (auto summary = currentSummary()) {
+            return summary->totalSent;
+        }
+        int64_t value = 0;
+        RANGES_FOR(auto output, getOutputs()) {
+            if (output.isSpent()) {
+                value += output.getValue();
+            }
+        }
+        return value;
+    }
+    
+    BlockHeight Cluster::getFirstTxHeight() const {
+        if (auto summary = currentSummary()) {
+            return summary->firstTxHeight;
+        }
+        BlockHeight height = -1;
+        for (auto &tx : getTransactions()) {
+            if (height == -1 || tx.getBlockHeight() < height) {
+                height = tx.getBlockHeight();
+            }
+        }
+        return height;
+    }
+    
+    BlockHeight Cluster::getLastTxHeight() const {
+        if (auto summary = currentSummary()) {
+            return summary->lastTxHeight;
+        }
+        BlockHeight height = -1;
+        for (auto &tx : getTransactions()) {
+            height = std::max(height, tx.getBlockHeight());
+        }
+        return height;
+    }
+    
     ranges::any_view<TaggedAddress> TaggedCluster::getTaggedAddresses() const {
         return ranges::views::join(taggedAddresses);
     }
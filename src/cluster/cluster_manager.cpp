@@ -6,82 +6,167 @@
 //
 //
 
+#include "concurrent_disjoint_sets.hpp"
+
 #include <blocksci/cluster/cluster_manager.hpp>
 #include <blocksci/cluster/cluster.hpp>
 
 #include <blocksci/chain/blockchain.hpp>
 #include <blocksci/chain/input.hpp>
+#include <blocksci/chain/output.hpp>
 #include <blocksci/chain/range_util.hpp>
 #include <blocksci/core/dedup_address.hpp>
+#include <blocksci/core/thread_pool.hpp>
 #include <blocksci/heuristics/change_address.hpp>
 #include <blocksci/heuristics/tx_identification.hpp>
 #include <blocksci/scripts/scripthash_script.hpp>
 
 #include <internal/address_info.hpp>
+#include <internal/chain_access.hpp>
 #include <internal/cluster_access.hpp>
 #include <internal/data_access.hpp>
+#include <internal/file_mapper.hpp>
 #include <internal/progress_bar.hpp>
 #include <internal/script_access.hpp>
 
-#include <dset/dset.h>
-
 #include <wjfilesystem/path.h>
 
 #include <range/v3/view/iota.hpp>
 #include <range/v3/range_for.hpp>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
 #include <fstream>
 #include <future>
-#include <map>
+#include <limits>
+#include <mutex>
 
 namespace {
+    /** Runs job for every index in [start, end) on the shared thread pool, handing out chunkSize indexes at a time
+     *
+     * The third argument is a number of indexes per chunk. It used to be the number of segments the range was split
+     * into, so the number of chunks now depends on the size of the range and not on the number of threads.
+     */
     template <typename Job>
-    void segmentWork(uint32_t start, uint32_t end, uint32_t segmentCount, Job job) {
+    void segmentWork(uint32_t start, uint32_t end, uint32_t chunkSize, Job job) {
         uint32_t total = end - start;
-        
-        // Don't partition over threads if there are less items than segment count
-        if (total < segmentCount) {
-            for (uint32_t i = start; i < end; ++i) {
+        uint32_t chunkCount = (total + chunkSize - 1) / chunkSize;
+        blocksci::ThreadPool::instance().parallelFor(chunkCount, [&](size_t chunk) {
+            uint32_t chunkStart = start + static_cast<uint32_t>(chunk) * chunkSize;
+            uint32_t chunkEnd = std::min(end, chunkStart + chunkSize);
+            for (uint32_t i = chunkStart; i < chunkEnd; i++) {
                 job(i);
             }
-            return;
-        }
-        
-        auto segmentSize = total / segmentCount;
-        auto segmentsRemaining = total % segmentCount;
-        std::vector<std::pair<uint32_t, uint32_t>> segments;
-        uint32_t i = 0;
-        while(i < total) {
-            uint32_t startSegment = i;
-            i += segmentSize;
-            if (segmentsRemaining > 0) {
-                i += 1;
-                segmentsRemaining--;
-            }
-            uint32_t endSegment = i;
-            segments.emplace_back(startSegment + start, endSegment + start);
-        }
-        std::vector<std::thread> threads;
-        for (uint32_t i = 0; i < segmentCount - 1; i++) {
-            auto segment = segments[i];
-            threads.emplace_back([segment, &job](){
-                for (uint32_t i = segment.first; i < segment.second; i++) {
-                    job(i);
-                }
-            });
-        }
-        
-        auto segment = segments.back();
-        for (uint32_t i = segment.first; i < segment.second; i++) {
-            job(i);
-        }
-        
-        for (auto &thread : threads) {
-            thread.join();
-        }
+        });
+    }
+    
+    template <typename T>
+    void atomicMin(std::atomic<T> &value, T candidate) {
+        auto current = value.load(std::memory_order_relaxed);
+        while (candidate < current && !value.compare_exchange_weak(current, candidate, std::memory_order_relaxed)) {}
+    }
+    
+    template <typename T>
+    void atomicMax(std::atomic<T> &value, T candidate) {
+        auto current = value.load(std::memory_order_relaxed);
+        while (candidate > current && !value.compare_exchange_weak(current, candidate, std::memory_order_relaxed)) {}
     }
 }
 
 namespace blocksci {
+    using ScriptCounts = std::array<uint32_t, DedupAddressType::size>;
+    
+    ScriptCounts currentScriptCounts(const ScriptAccess &scripts) {
+        ScriptCounts counts;
+        for (size_t i = 0; i < DedupAddressType::size; i++) {
+            counts[i] = scripts.scriptCount(static_cast<DedupAddressType::Enum>(i));
+        }
+        return counts;
+    }
+    
+    /** Position of the first address of each type in the combined index over all addresses */
+    std::unordered_map<DedupAddressType::Enum, uint32_t> calculateScriptStarts(const ScriptCounts &counts) {
+        std::unordered_map<DedupAddressType::Enum, uint32_t> scriptStarts;
+        uint32_t start = 0;
+        for (size_t i = 0; i < DedupAddressType::size; i++) {
+            scriptStarts[static_cast<DedupAddressType::Enum>(i)] = start;
+            start += counts[i];
+        }
+        return scriptStarts;
+    }
+    
+    /** Progress of a clustering, stored with the cluster files so that the clustering can be extended with new blocks
+     *
+     * File: clusterState.dat, followed by the union-find root of every address in the same file, so that a single
+     * rename replaces the state and its roots together
+     */
+    struct ClusteringState {
+        uint32_t firstTxIndex = 0;
+        uint32_t endTxIndex = 0;
+        uint32_t ignoreCoinJoin = 0;
+        ScriptCounts scriptCounts{};
+        // ChangeHeuristic::name of the change heuristic, stored after the fields above with its length in front
+        std::string changeHeuristic;
+    };
+    
+    template <typename T>
+    void writeStateValue(std::ofstream &file, const T &value) {
+        file.write(reinterpret_cast<const char *>(&value), sizeof(value));
+    }
+    
+    template <typename T>
+    bool readStateValue(std::ifstream &file, T &value) {
+        return static_cast<bool>(file.read(reinterpret_cast<char *>(&value), sizeof(value)));
+    }
+    
+    std::string clusteringStatePath(const std::string &outputPath) {
+        return (filesystem::path{outputPath}/"clusterState.dat").str();
+    }
+    
+    /** Directory in which new cluster files are written before they are renamed into outputPath */
+    std::string pendingClusterDataPath(const std::string &outputPath) {
+        return (filesystem::path{outputPath}/"pending").str();
+    }
+    
+    void saveClusteringState(const std::string &outputPath, const ClusteringState &state, const std::vector<uint32_t> &roots) {
+        std::ofstream stateFile(clusteringStatePath(outputPath), std::ios::binary);
+        writeStateValue(stateFile, state.firstTxIndex);
+        writeStateValue(stateFile, state.endTxIndex);
+        writeStateValue(stateFile, state.ignoreCoinJoin);
+        writeStateValue(stateFile, state.scriptCounts);
+        writeStateValue(stateFile, static_cast<uint32_t>(state.changeHeuristic.size()));
+        stateFile.write(state.changeHeuristic.data(), static_cast<long>(state.changeHeuristic.size()));
+        stateFile.write(reinterpret_cast<const char *>(roots.data()), static_cast<long>(sizeof(uint32_t) * roots.size()));
+        stateFile.close();
+        if (stateFile.fail()) {
+            throw std::runtime_error("Could not write the clustering state to " + outputPath);
+        }
+    }
+    
+    /** Reads the state from the start of stateFile, leaving the file positioned at the roots */
+    ClusteringState readClusteringState(std::ifstream &stateFile, const std::string &outputPath) {
+        ClusteringState state;
+        uint32_t changeHeuristicLength = 0;
+        bool complete = readStateValue(stateFile, state.firstTxIndex) && readStateValue(stateFile, state.endTxIndex)
+            && readStateValue(stateFile, state.ignoreCoinJoin) && readStateValue(stateFile, state.scriptCounts)
+            && readStateValue(stateFile, changeHeuristicLength);
+        if (complete) {
+            state.changeHeuristic.resize(changeHeuristicLength);
+            complete = static_cast<bool>(stateFile.read(&state.changeHeuristic[0], static_cast<long>(changeHeuristicLength)));
+        }
+        if (!complete) {
+            throw std::runtime_error("No clustering state found in " + outputPath + ", the clustering has to be recreated from scratch once");
+        }
+        return state;
+    }
+    
+    ClusteringState loadClusteringState(const std::string &outputPath) {
+        std::ifstream stateFile(clusteringStatePath(outputPath), std::ios::binary);
+        return readClusteringState(stateFile, outputPath);
+    }
+    
     ClusterManager::ClusterManager(const std::string &baseDirectory, DataAccess &access_) : access(std::make_unique<ClusterAccess>(baseDirectory, access_)), clusterCount(access->clusterCount()) {}
     
     ClusterManager::ClusterManager(ClusterManager && other) = default;
@@ -90,6 +175,105 @@ namespace blocksci {
     
     ClusterManager::~ClusterManager() = default;
     
+    void ClusterManager::createSummaries(BlockRange &chain) {
+        if (chain.size() > 0 && chain.sl.start != 0) {
+            throw std::runtime_error("Cluster summaries have to start at the first block");
+        }
+        
+        // Addresses created after the clustered range have no entry in the cluster index files
+        if (chain.size() > 0 && chain.endTxIndex() > loadClusteringState(access->baseDirectory).endTxIndex) {
+            throw std::runtime_error("Chain extends beyond the clustered blocks, the clustering has to be extended with updateClustering first");
+        }
+        
+        // Drop the previous summaries so that nothing below is answered from them
+        for (auto &path : {ClusterAccess::summaryInfoFilePath(access->baseDirectory), ClusterAccess::summaryFilePath(access->baseDirectory)}) {
+            auto filePath = filesystem::path{path};
+            if (filePath.exists()) {
+                filePath.remove_file();
+            }
+        }
+        access->reloadSummaries();
+        
+        auto &clusterAccess = *access;
+        std::vector<uint32_t> addressCounts(clusterCount);
+        segmentWork(0, clusterCount, 1 << 12, [&](uint32_t clusterNum) {
+            addressCounts[clusterNum] = static_cast<uint32_t>(Cluster(clusterNum, clusterAccess).getSize());
+        });
+        
+        auto received = std::make_unique<std::atomic<int64_t>[]>(clusterCount);
+        auto sent = std::make_unique<std::atomic<int64_t>[]>(clusterCount);
+        auto outputCounts = std::make_unique<std::atomic<uint32_t>[]>(clusterCount);
+        auto txCounts = std::make_unique<std::atomic<uint32_t>[]>(clusterCount);
+        auto firstHeights = std::make_unique<std::atomic<BlockHeight>[]>(clusterCount);
+        auto lastHeights = std::make_unique<std::atomic<BlockHeight>[]>(clusterCount);
+        segmentWork(0, clusterCount, 1 << 16, [&](uint32_t clusterNum) {
+            received[clusterNum].store(0, std::memory_order_relaxed);
+            sent[clusterNum].store(0, std::memory_order_relaxed);
+            outputCounts[clusterNum].store(0, std::memory_order_relaxed);
+            txCounts[clusterNum].store(0, std::memory_order_relaxed);
+            firstHeights[clusterNum].store(std::numeric_limits<BlockHeight>::max(), std::memory_order_relaxed);
+            lastHeights[clusterNum].store(-1, std::memory_order_relaxed);
+        });
+        
+        if (chain.size() > 0) {
+            chain.mapReduce<int>([&](const BlockRange &blocks, int) {
+                std::vector<uint32_t> txClusters;
+                for (auto block : blocks) {
+                    auto height = block.height();
+                    for (auto tx : block) {
+                        txClusters.clear();
+                        RANGES_FOR(auto output, tx.outputs()) {
+                            auto clusterNum = clusterAccess.getClusterNum(RawAddress{output.getAddress().scriptNum, output.getType()});
+                            received[clusterNum].fetch_add(output.getValue(), std::memory_order_relaxed);
+                            outputCounts[clusterNum].fetch_add(1, std::memory_order_relaxed);
+                            txClusters.push_back(clusterNum);
+                        }
+                        RANGES_FOR(auto input, tx.inputs()) {
+                            auto clusterNum = clusterAccess.getClusterNum(RawAddress{input.getAddress().scriptNum, input.getType()});
+                            sent[clusterNum].fetch_add(input.getValue(), std::memory_order_relaxed);
+                            txClusters.push_back(clusterNum);
+                        }
+                        std::sort(txClusters.begin(), txClusters.end());
+                        txClusters.erase(std::unique(txClusters.begin(), txClusters.end()), txClusters.end());
+                        for (auto clusterNum : txClusters) {
+                            txCounts[clusterNum].fetch_add(1, std::memory_order_relaxed);
+                            atomicMin(firstHeights[clusterNum], height);
+                            atomicMax(lastHeights[clusterNum], height);
+                        }
+                    }
+                }
+                return 0;
+            }, [](int &a, int &) -> int & {return a;});
+        }
+        
+        {
+            std::ofstream summaryFile(ClusterAccess::summaryFilePath(access->baseDirectory), std::ios::binary);
+            for (uint32_t clusterNum = 0; clusterNum < clusterCount; clusterNum++) {
+                ClusterSummary summary{};
+                summary.totalReceived = received[clusterNum];
+                summary.totalSent = sent[clusterNum];
+                summary.addressCount = addressCounts[clusterNum];
+                summary.outputCount = outputCounts[clusterNum];
+                summary.txCount = txCounts[clusterNum];
+                summary.firstTxHeight = summary.txCount > 0 ? firstHeights[clusterNum].load() : -1;
+                summary.lastTxHeight = lastHeights[clusterNum];
+                summaryFile.write(reinterpret_cast<const char *>(&summary), sizeof(summary));
+            }
+        }
+        
+        // Written last, so that interrupted runs leave no summaries behind
+        BlockHeight blockCount = chain.size() > 0 ? chain.sl.stop : 0;
+        std::ofstream infoFile(ClusterAccess::summaryInfoFilePath(access->baseDirectory), std::ios::binary);
+        infoFile.write(reinterpret_cast<const char *>(&blockCount), sizeof(blockCount));
+        infoFile.close();
+        access->reloadSummaries();
+    }
+    
+    bool ClusterManager::hasCurrentSummaries() const {
+        auto blockCount = access->getSummaryBlockCount();
+        return blockCount != -1 && blockCount == access->access.getChain().blockCount();
+    }
+    
     Cluster ClusterManager::getCluster(const Address &address) const {
         return Cluster(access->getClusterNum(RawAddress{address.scriptNum, address.type}), *access);
     }
@@ -106,7 +290,7 @@ namespace blocksci {
     }
     
     struct AddressDisjointSets {
-        DisjointSets disjoinSets;
+        ConcurrentDisjointSets disjoinSets;
         std::unordered_map<DedupAddressType::Enum, uint32_t> addressStarts;
         
         AddressDisjointSets(uint32_t totalSize, std::unordered_map<DedupAddressType::Enum, uint32_t> addressStarts_) : disjoinSets{totalSize}, addressStarts{std::move(addressStarts_)} {}
@@ -115,16 +299,20 @@ namespace blocksci {
             return disjoinSets.size();
         }
         
-        void link_addresses(const Address &address1, const Address &address2) {
+        /** Returns whether the addresses were in different clusters before */
+        bool link_addresses(const Address &address1, const Address &address2) {
             auto firstAddressIndex = addressStarts.at(dedupType(address1.type)) + address1.scriptNum - 1;
             auto secondAddressIndex = addressStarts.at(dedupType(address2.type)) + address2.scriptNum - 1;
-            disjoinSets.unite(firstAddressIndex, secondAddressIndex);
+            return disjoinSets.unite(firstAddressIndex, secondAddressIndex);
         }
         
-        void resolveAll() {
-            segmentWork(0, disjoinSets.size(), 8, [&](uint32_t index) {
-                disjoinSets.find(index);
+        /** Root of every address, once all links are done */
+        std::vector<uint32_t> resolveAll() {
+            std::vector<uint32_t> roots(disjoinSets.size());
+            segmentWork(0, disjoinSets.size(), 1 << 16, [&](uint32_t index) {
+                roots[index] = disjoinSets.find(index);
             });
+            return roots;
         }
         
         uint32_t find(uint32_t index) {
@@ -151,58 +339,99 @@ namespace blocksci {
         return pairsToUnion;
     }
     
-    void linkScripthashNested(DataAccess &access, AddressDisjointSets &ds) {
+    /** Links every ScriptHash address with scriptNum in [firstScriptNum, scriptHashCount] to the address it wraps */
+    void linkScripthashNested(DataAccess &access, AddressDisjointSets &ds, uint32_t firstScriptNum, std::atomic<uint64_t> &linkCount, std::atomic<uint64_t> &mergeCount) {
         auto scriptHashCount = access.getScripts().scriptCount(DedupAddressType::SCRIPTHASH);
         
-        segmentWork(1, scriptHashCount + 1, 8, [&ds, &access](uint32_t index) {
+        segmentWork(firstScriptNum, scriptHashCount + 1, 1 << 12, [&](uint32_t index) {
             Address pointer(index, AddressType::SCRIPTHASH, access);
             script::ScriptHash scripthash{index, access};
             auto wrappedAddress = scripthash.getWrappedAddress();
             if (wrappedAddress) {
-                ds.link_addresses(pointer, *wrappedAddress);
+                linkCount.fetch_add(1, std::memory_order_relaxed);
+                if (ds.link_addresses(pointer, *wrappedAddress)) {
+                    mergeCount.fetch_add(1, std::memory_order_relaxed);
+                }
             }
         });
     }
     
+    /** Links the addresses of all transactions in chain and of all ScriptHash addresses starting at firstScriptHashNum
+     *
+     * The wrapped address of a ScriptHash address only becomes known once it is spent. When extending an existing
+     * clustering, linkSpentScripthashes links the ScriptHash addresses spent in chain to the addresses they wrap,
+     * since those may have been created before the previous clustering run.
+     */
     template <typename ChangeFunc>
-    std::vector<uint32_t> createClusters(BlockRange &chain, std::unordered_map<DedupAddressType::Enum, uint32_t> addressStarts, uint32_t totalScriptCount, ChangeFunc && changeHeuristic, bool ignoreCoinJoin) {
-        
-        AddressDisjointSets ds(totalScriptCount, std::move(addressStarts));
-        
+    void linkAddresses(BlockRange &chain, AddressDisjointSets &ds, uint32_t firstScriptHashNum, ChangeFunc && changeHeuristic, bool ignoreCoinJoin, bool linkSpentScripthashes, ClusteringStats *stats) {
         auto &access = chain.getAccess();
         
-        linkScripthashNested(access, ds);
-        
-        auto extract = [&](const BlockRange &blocks, int threadNum) {
-            auto progressThread = static_cast<int>(std::thread::hardware_concurrency()) - 1;
-            auto progressBar = makeProgressBar(blocks.endTxIndex() - blocks.firstTxIndex(), [=]() {});
-            if (threadNum != progressThread) {
-                progressBar.setSilent();
-            }
-            uint32_t txNum = 0;
-            for (auto block : blocks) {
-                for (auto tx : block) {
-                    auto pairs = processTransaction(tx, changeHeuristic, ignoreCoinJoin);
-                    for (auto &pair : pairs) {
-                        ds.link_addresses(pair.first, pair.second);
+        auto linkStart = std::chrono::steady_clock::now();
+        std::atomic<uint64_t> linkCount{0};
+        std::atomic<uint64_t> mergeCount{0};
+        linkScripthashNested(access, ds, firstScriptHashNum, linkCount, mergeCount);
+        
+        if (chain.size() > 0) {
+            // Segments are spread over the threads dynamically, so progress is counted across all of them
+            auto progressBar = makeProgressBar(chain.endTxIndex() - chain.firstTxIndex(), [=]() {});
+            std::mutex progressMutex;
+            std::atomic<uint32_t> processedTxCount{0};
+            auto extract = [&](const BlockRange &blocks, int) {
+                // Counted per segment to keep the shared counters out of the inner loop
+                uint64_t segmentLinkCount = 0;
+                uint64_t segmentMergeCount = 0;
+                for (auto block : blocks) {
+                    for (auto tx : block) {
+                        auto pairs = processTransaction(tx, changeHeuristic, ignoreCoinJoin);
+                        if (linkSpentScripthashes) {
+                            RANGES_FOR(auto input, tx.inputs()) {
+                                if (input.getType() == AddressType::SCRIPTHASH) {
+                                    auto address = input.getAddress();
+                                    auto wrappedAddress = script::ScriptHash{address.scriptNum, access}.getWrappedAddress();
+                                    if (wrappedAddress) {
+                                        pairs.emplace_back(address, *wrappedAddress);
+                                    }
+                                }
+                            }
+                        }
+                        for (auto &pair : pairs) {
+                            segmentMergeCount += ds.link_addresses(pair.first, pair.second);
+                        }
+                        segmentLinkCount += pairs.size();
+                    }
+                    auto txCount = static_cast<uint32_t>(block.size());
+                    auto processed = processedTxCount.fetch_add(txCount) + txCount;
+                    if (processed / 10000 != (processed - txCount) / 10000) {
+                        std::unique_lock<std::mutex> lock(progressMutex, std::try_to_lock);
+                        if (lock.owns_lock()) {
+                            progressBar.update(processed - processed % 10000);
+                        }
                     }
-                    progressBar.update(txNum);
-                    txNum++;
                 }
-            }
-            return 0;
-        };
-        
-        chain.mapReduce<int>(extract, [](int &a,int &) -> int & {return a;});
+                linkCount.fetch_add(segmentLinkCount, std::memory_order_relaxed);
+                mergeCount.fetch_add(segmentMergeCount, std::memory_order_relaxed);
+                return 0;
+            };
         
-        ds.resolveAll();
+            chain.mapReduce<int>(extract, [](int &a,int &) -> int & {return a;});
+        }
         
-        std::vector<uint32_t> parents;
-        parents.reserve(ds.size());
-        for (uint32_t i = 0; i < totalScriptCount; i++) {
-            parents.push_back(ds.find(i));
+        if (stats) {
+            stats->linkCount = linkCount;
+            stats->mergeCount = mergeCount;
+            stats->linkSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - linkStart).count();
+            stats->threadCount = ThreadPool::instance().getThreadCount();
         }
-        return parents;
+    }
+    
+    std::vector<uint32_t> loadClusterRoots(const std::string &outputPath, uint32_t addressCount) {
+        std::vector<uint32_t> roots(addressCount);
+        std::ifstream rootsFile(clusteringStatePath(outputPath), std::ios::binary);
+        readClusteringState(rootsFile, outputPath);
+        if (!rootsFile.read(reinterpret_cast<char *>(roots.data()), static_cast<long>(sizeof(uint32_t) * roots.size()))) {
+            throw std::runtime_error("Cluster roots in " + outputPath + " are incomplete, the clustering has to be recreated from scratch");
+        }
+        return roots;
     }
     
     uint32_t remapClusterIds(std::vector<uint32_t> &parents) {
@@ -221,49 +450,84 @@ namespace blocksci {
         return clusterCount;
     }
     
-    void recordOrderedAddresses(const std::vector<uint32_t> &parent, std::vector<uint32_t> &clusterPositions, const std::unordered_map<DedupAddressType::Enum, uint32_t> &scriptStarts, std::ofstream &clusterAddressesFile) {
-        
-        std::map<uint32_t, DedupAddressType::Enum> typeIndexes;
-        for (auto &pair : scriptStarts) {
-            auto it = typeIndexes.find(pair.second);
-            if(it != typeIndexes.end()) {
-                // If an address type is not used, skip to the next one
-                it->second = std::max(it->second, pair.first);
-            } else {
-                typeIndexes[pair.second] = pair.first;
+    /** Decodes the address type and script number of positions in the combined index over all addresses */
+    class AddressTypeTable {
+        // Start of every address type in the combined index, in order, with empty types left out
+        std::vector<uint32_t> starts;
+        std::vector<DedupAddressType::Enum> types;
+        
+    public:
+        explicit AddressTypeTable(const std::unordered_map<DedupAddressType::Enum, uint32_t> &scriptStarts) {
+            std::vector<std::pair<uint32_t, DedupAddressType::Enum>> ordered;
+            for (auto &pair : scriptStarts) {
+                ordered.emplace_back(pair.second, pair.first);
+            }
+            std::sort(ordered.begin(), ordered.end());
+            for (auto &pair : ordered) {
+                if (!starts.empty() && starts.back() == pair.first) {
+                    // If an address type is not used, the following type starts at the same position
+                    types.back() = pair.second;
+                } else {
+                    starts.push_back(pair.first);
+                    types.push_back(pair.second);
+                }
             }
         }
         
-        std::vector<DedupAddress> orderedScripts;
-        orderedScripts.resize(parent.size());
+        DedupAddress decode(uint32_t index) const {
+            auto position = static_cast<size_t>(std::upper_bound(starts.begin(), starts.end(), index) - starts.begin()) - 1;
+            return DedupAddress(index - starts[position] + 1, types[position]);
+        }
+    };
         
-        for (uint32_t i = 0; i < parent.size(); i++) {
-            uint32_t &j = clusterPositions[parent[i]];
-            auto it = typeIndexes.upper_bound(i);
-            it--;
-            uint32_t addressNum = i - it->first + 1;
-            auto addressType = it->second;
-            orderedScripts[j] = DedupAddress(addressNum, addressType);
-            j++;
+    /** Replaces values[0, count) by their inclusive prefix sum, splitting the work into blocks of chunkSize values */
+    void parallelPrefixSum(std::atomic<uint32_t> *values, uint32_t count, uint32_t chunkSize) {
+        uint32_t chunkCount = (count + chunkSize - 1) / chunkSize;
+        std::vector<uint32_t> chunkTotals(chunkCount);
+        ThreadPool::instance().parallelFor(chunkCount, [&](size_t chunk) {
+            uint32_t end = std::min(count, static_cast<uint32_t>(chunk + 1) * chunkSize);
+            uint32_t total = 0;
+            for (uint32_t i = static_cast<uint32_t>(chunk) * chunkSize; i < end; i++) {
+                total += values[i].load(std::memory_order_relaxed);
+            }
+            chunkTotals[chunk] = total;
+        });
+        
+        uint32_t offset = 0;
+        for (auto &total : chunkTotals) {
+            auto chunkOffset = offset;
+            offset += total;
+            total = chunkOffset;
         }
         
-        clusterAddressesFile.write(reinterpret_cast<char *>(orderedScripts.data()), static_cast<long>(sizeof(DedupAddress) * orderedScripts.size()));
+        ThreadPool::instance().parallelFor(chunkCount, [&](size_t chunk) {
+            uint32_t end = std::min(count, static_cast<uint32_t>(chunk + 1) * chunkSize);
+            uint32_t sum = chunkTotals[chunk];
+            for (uint32_t i = static_cast<uint32_t>(chunk) * chunkSize; i < end; i++) {
+                sum += values[i].load(std::memory_order_relaxed);
+                values[i].store(sum, std::memory_order_relaxed);
+            }
+        });
     }
     
-    void prepareClusterDataLocation(const std::string &outputPath, bool overwrite) {
-        auto outputLocation = filesystem::path{outputPath};
-        
-        std::string offsetFile = ClusterAccess::offsetFilePath(outputPath);
-        std::string addressesFile = ClusterAccess::addressesFilePath(outputPath);
-        std::vector<std::string> clusterIndexPaths;
-        clusterIndexPaths.resize(DedupAddressType::size);
+    /** Files that make up the clusters themselves, without the clustering state and the summaries */
+    std::vector<std::string> clusterFilePaths(const std::string &outputPath) {
+        std::vector<std::string> paths;
         for (auto dedupType : DedupAddressType::allArray()) {
-            clusterIndexPaths[static_cast<size_t>(dedupType)] = ClusterAccess::typeIndexFilePath(outputPath, dedupType);
+            paths.push_back(ClusterAccess::typeIndexFilePath(outputPath, dedupType));
         }
+        paths.push_back(ClusterAccess::offsetFilePath(outputPath));
+        paths.push_back(ClusterAccess::addressesFilePath(outputPath));
+        return paths;
+    }
+    
+    void prepareClusterDataLocation(const std::string &outputPath, bool overwrite) {
+        auto outputLocation = filesystem::path{outputPath};
         
-        std::vector<std::string> allPaths = clusterIndexPaths;
-        allPaths.push_back(offsetFile);
-        allPaths.push_back(addressesFile);
+        std::vector<std::string> allPaths = clusterFilePaths(outputPath);
+        allPaths.push_back(clusteringStatePath(outputPath));
+        allPaths.push_back(ClusterAccess::summaryFilePath(outputPath));
+        allPaths.push_back(ClusterAccess::summaryInfoFilePath(outputPath));
         
         // Prepare cluster folder or fail
         auto outputLocationPath = filesystem::path{outputLocation};
@@ -308,69 +572,222 @@ namespace blocksci {
         }
 
         // Generate cluster files        
-        std::vector<uint32_t> clusterPositions;
-        clusterPositions.resize(clusterCount + 1);
-        for (auto parentId : parent) {
-            clusterPositions[parentId + 1]++;
-        }
+        // clusterPositions[c + 1] first counts the addresses of cluster c and then holds where the cluster starts
+        auto totalAddressCount = static_cast<uint32_t>(parent.size());
+        auto clusterPositions = std::make_unique<std::atomic<uint32_t>[]>(clusterCount + 1);
+        segmentWork(0, clusterCount + 1, 1 << 16, [&](uint32_t clusterNum) {
+            clusterPositions[clusterNum].store(0, std::memory_order_relaxed);
+        });
+        segmentWork(0, totalAddressCount, 1 << 16, [&](uint32_t index) {
+            clusterPositions[parent[index] + 1].fetch_add(1, std::memory_order_relaxed);
+        });
+        parallelPrefixSum(clusterPositions.get(), clusterCount + 1, 1 << 20);
+        
+        // The index files are plain copies of the cluster ids, written while the addresses are being scattered
+        auto indexFiles = std::async(std::launch::async, [&]() {
+            for (size_t index = 0; index < DedupAddressType::size; index++) {
+                auto type = static_cast<DedupAddressType::Enum>(index);
+                uint32_t startIndex = scriptStarts.at(type);
+                uint32_t totalCount = scripts.scriptCount(type);
+                std::ofstream file{clusterIndexPaths[index], std::ios::binary};
+                file.write(reinterpret_cast<const char *>(parent.data() + startIndex), sizeof(uint32_t) * totalCount);
+            }
+        });
         
-        for (size_t i = 1; i < clusterPositions.size(); i++) {
-            clusterPositions[i] += clusterPositions[i-1];
+        {
+            // Every thread scatters its addresses straight into the mapped output file. Claiming a slot moves the
+            // position of a cluster forward, so afterwards clusterPositions[c] holds where cluster c ends.
+            std::ofstream{addressesFile, std::ios::binary};
+            FixedSizeFileMapper<DedupAddress, mio::access_mode::write> clusterAddressesFile{(outputLocation/"clusterAddresses").str()};
+            clusterAddressesFile.truncate(totalAddressCount);
+            AddressTypeTable typeTable{scriptStarts};
+            segmentWork(0, totalAddressCount, 1 << 16, [&](uint32_t index) {
+                auto position = clusterPositions[parent[index]].fetch_add(1, std::memory_order_relaxed);
+                *clusterAddressesFile[position] = typeTable.decode(index);
+            });
+            
+            // Slots are claimed in no particular order, restore the address order within every cluster
+            std::array<uint32_t, DedupAddressType::size> typeStarts;
+            for (auto &pair : scriptStarts) {
+                typeStarts[static_cast<size_t>(pair.first)] = pair.second;
+            }
+            auto addressIndex = [&](const DedupAddress &address) {
+                return typeStarts[static_cast<size_t>(address.type)] + address.scriptNum;
+            };
+            segmentWork(0, clusterCount, 1 << 12, [&](uint32_t clusterNum) {
+                uint32_t begin = clusterNum == 0 ? 0 : clusterPositions[clusterNum - 1].load(std::memory_order_relaxed);
+                uint32_t end = clusterPositions[clusterNum].load(std::memory_order_relaxed);
+                if (end - begin > 1) {
+                    std::sort(clusterAddressesFile[begin], clusterAddressesFile[begin] + (end - begin), [&](const DedupAddress &a, const DedupAddress &b) {
+                        return addressIndex(a) < addressIndex(b);
+                    });
+                }
+            });
         }
-        std::ofstream clusterAddressesFile(addressesFile, std::ios::binary);
-        auto recordOrdered = std::async(std::launch::async, recordOrderedAddresses, parent, std::ref(clusterPositions), scriptStarts, std::ref(clusterAddressesFile));
-        
-        segmentWork(0, DedupAddressType::size, DedupAddressType::size, [&](uint32_t index) {
-            auto type = static_cast<DedupAddressType::Enum>(index);
-            uint32_t startIndex = scriptStarts.at(type);
-            uint32_t totalCount = scripts.scriptCount(type);
-            std::ofstream file{clusterIndexPaths[index], std::ios::binary};
-            file.write(reinterpret_cast<const char *>(parent.data() + startIndex), sizeof(uint32_t) * totalCount);
-        });
         
-        recordOrdered.get();
+        indexFiles.get();
         
+        static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "Cluster offsets are written directly from the atomic counters");
         std::ofstream clusterOffsetFile(offsetFile, std::ios::binary);
-        clusterOffsetFile.write(reinterpret_cast<char *>(clusterPositions.data()), static_cast<long>(sizeof(uint32_t) * clusterPositions.size()));
+        clusterOffsetFile.write(reinterpret_cast<const char *>(clusterPositions.get()), static_cast<long>(sizeof(uint32_t) * (clusterCount + 1)));
+    }
+    
+    void moveClusterDataFile(const std::string &from, const std::string &to) {
+        if (std::rename(from.c_str(), to.c_str()) != 0) {
+            throw std::runtime_error("Could not move " + from + " to " + to);
+        }
+    }
+    
+    /** Stores the clustering state and writes the cluster files for the given union-find roots
+     *
+     * Everything is written to the pending directory first and then renamed into outputPath. The state is renamed
+     * last, so until then an interrupted run leaves the previous state and roots in place and can simply be repeated.
+     * Readers which still have the previous cluster files mapped keep their view, since renaming doesn't touch them.
+     */
+    void finishClustering(const ScriptAccess &scripts, const std::string &outputPath, std::vector<uint32_t> &roots, const ScriptCounts &scriptCounts, const ClusteringState &state) {
+        auto pendingPath = pendingClusterDataPath(outputPath);
+        prepareClusterDataLocation(pendingPath, true);
+        saveClusteringState(pendingPath, state, roots);
+        auto scriptStarts = calculateScriptStarts(scriptCounts);
+        uint32_t clusterCount = remapClusterIds(roots);
+        serializeClusterData(scripts, pendingPath, roots, scriptStarts, clusterCount);
+        
+        // Summaries of the previous clusters don't match the new ones
+        for (auto &path : {ClusterAccess::summaryInfoFilePath(outputPath), ClusterAccess::summaryFilePath(outputPath)}) {
+            auto filePath = filesystem::path{path};
+            if (filePath.exists()) {
+                filePath.remove_file();
+            }
+        }
+        auto pendingFiles = clusterFilePaths(pendingPath);
+        auto outputFiles = clusterFilePaths(outputPath);
+        for (size_t i = 0; i < pendingFiles.size(); i++) {
+            moveClusterDataFile(pendingFiles[i], outputFiles[i]);
+        }
+        moveClusterDataFile(clusteringStatePath(pendingPath), clusteringStatePath(outputPath));
+        // Only removes the directory once it is empty
+        filesystem::path{pendingPath}.remove_file();
     }
     
     template <typename ChangeFunc>
-    ClusterManager createClusteringImpl(BlockRange &chain, ChangeFunc && changeHeuristic, const std::string &outputPath, bool overwrite, bool ignoreCoinJoin) {
+    ClusterManager createClusteringImpl(BlockRange &chain, ChangeFunc && changeHeuristic, const std::string &changeHeuristicName, const std::string &outputPath, bool overwrite, bool ignoreCoinJoin, ClusteringStats *stats) {
         prepareClusterDataLocation(outputPath, overwrite);
         
         // Perform clustering
         
         auto &scripts = chain.getAccess().getScripts();
         size_t totalScriptCount = scripts.totalAddressCount();
+        auto scriptCounts = currentScriptCounts(scripts);
+        
+        AddressDisjointSets ds(static_cast<uint32_t>(totalScriptCount), calculateScriptStarts(scriptCounts));
+        linkAddresses(chain, ds, 1, std::forward<ChangeFunc>(changeHeuristic), ignoreCoinJoin, false, stats);
+        auto roots = ds.resolveAll();
+        
+        ClusteringState state;
+        state.firstTxIndex = chain.size() > 0 ? chain.firstTxIndex() : 0;
+        state.endTxIndex = chain.size() > 0 ? chain.endTxIndex() : 0;
+        state.ignoreCoinJoin = ignoreCoinJoin;
+        state.scriptCounts = scriptCounts;
+        state.changeHeuristic = changeHeuristicName;
+        finishClustering(scripts, outputPath, roots, scriptCounts, state);
+        return {filesystem::path{outputPath}.str(), chain.getAccess()};
+    }
+    
+    template <typename ChangeFunc>
+    ClusterManager updateClusteringImpl(BlockRange &chain, ChangeFunc && changeHeuristic, const std::string &changeHeuristicName, const std::string &outputPath, bool ignoreCoinJoin, ClusteringStats *stats) {
+        auto state = loadClusteringState(outputPath);
+        if (static_cast<bool>(state.ignoreCoinJoin) != ignoreCoinJoin) {
+            throw std::runtime_error("Existing clustering was created with a different ignoreCoinJoin setting");
+        }
+        // Heuristics built from arbitrary functions have no name, so they can't be told apart
+        if (state.changeHeuristic != changeHeuristicName) {
+            auto describe = [](const std::string &name) { return name.empty() ? std::string{"a custom change heuristic"} : "the change heuristic " + name; };
+            throw std::runtime_error("Existing clustering was created with " + describe(state.changeHeuristic) + ", not with " + describe(changeHeuristicName));
+        }
         
-        std::unordered_map<DedupAddressType::Enum, uint32_t> scriptStarts;
-        {
-            std::vector<uint32_t> starts(DedupAddressType::size);
-            for (size_t i = 0; i < DedupAddressType::size; i++) {
-                if (i > 0) {
-                    starts[i] = scripts.scriptCount(static_cast<DedupAddressType::Enum>(i - 1)) + starts[i - 1];
-                }
-                scriptStarts[static_cast<DedupAddressType::Enum>(i)] = starts[i];
+        // Only the blocks after the ones that were clustered before are processed
+        auto newBlocksBegin = std::lower_bound(chain.begin(), chain.end(), state.endTxIndex, [](const Block &block, uint32_t txNum) {
+            return block.firstTxIndex() < txNum;
+        });
+        if (newBlocksBegin == chain.end()) {
+            if (chain.size() == 0 || chain.endTxIndex() != state.endTxIndex) {
+                throw std::runtime_error("Chain doesn't contain all blocks of the existing clustering");
+            }
+        } else if ((*newBlocksBegin).firstTxIndex() != state.endTxIndex) {
+            throw std::runtime_error("Chain doesn't continue where the existing clustering ends");
+        }
+        BlockRange newBlocks{BlockRange::Slice{newBlocksBegin == chain.end() ? chain.sl.stop : (*newBlocksBegin).height(), chain.sl.stop}, &chain.getAccess()};
+        
+        auto &scripts = chain.getAccess().getScripts();
+        auto scriptCounts = currentScriptCounts(scripts);
+        uint32_t oldScriptCount = 0;
+        for (size_t i = 0; i < DedupAddressType::size; i++) {
+            if (scriptCounts[i] < state.scriptCounts[i]) {
+                throw std::runtime_error("Chain has fewer addresses than the existing clustering");
+            }
+            oldScriptCount += state.scriptCounts[i];
+        }
+        auto oldRoots = loadClusterRoots(outputPath, oldScriptCount);
+        
+        // New addresses are appended to the addresses of their type, which shifts the position of every following type
+        auto oldStarts = calculateScriptStarts(state.scriptCounts);
+        auto newStarts = calculateScriptStarts(scriptCounts);
+        std::vector<std::pair<uint32_t, uint32_t>> typeShifts;
+        for (size_t i = 0; i < DedupAddressType::size; i++) {
+            auto type = static_cast<DedupAddressType::Enum>(i);
+            if (state.scriptCounts[i] > 0) {
+                typeShifts.emplace_back(oldStarts.at(type), newStarts.at(type));
             }
         }
+        auto newIndex = [&](uint32_t oldIndex) {
+            auto it = std::upper_bound(typeShifts.begin(), typeShifts.end(), oldIndex, [](uint32_t index, const std::pair<uint32_t, uint32_t> &shift) {
+                return index < shift.first;
+            });
+            --it;
+            return it->second + (oldIndex - it->first);
+        };
+        
+        AddressDisjointSets ds(static_cast<uint32_t>(scripts.totalAddressCount()), newStarts);
+        segmentWork(0, oldScriptCount, 1 << 16, [&](uint32_t oldIndex) {
+            ds.disjoinSets.setParent(newIndex(oldIndex), newIndex(oldRoots[oldIndex]));
+        });
+        oldRoots.clear();
+        oldRoots.shrink_to_fit();
+        
+        auto firstNewScriptHashNum = state.scriptCounts[static_cast<size_t>(DedupAddressType::SCRIPTHASH)] + 1;
+        linkAddresses(newBlocks, ds, firstNewScriptHashNum, std::forward<ChangeFunc>(changeHeuristic), ignoreCoinJoin, true, stats);
+        auto roots = ds.resolveAll();
         
-        auto parent = createClusters(chain, scriptStarts, static_cast<uint32_t>(totalScriptCount), std::forward<ChangeFunc>(changeHeuristic), ignoreCoinJoin);
-        uint32_t clusterCount = remapClusterIds(parent);
-        serializeClusterData(scripts, outputPath, parent, scriptStarts, clusterCount);
+        state.endTxIndex = chain.endTxIndex();
+        state.scriptCounts = scriptCounts;
+        finishClustering(scripts, outputPath, roots, scriptCounts, state);
         return {filesystem::path{outputPath}.str(), chain.getAccess()};
     }
     
-    ClusterManager ClusterManager::createClustering(BlockRange &chain, const heuristics::ChangeHeuristic &changeHeuristic, const std::string &outputPath, bool overwrite, bool ignoreCoinJoin) {
+    ClusterManager ClusterManager::createClustering(BlockRange &chain, const heuristics::ChangeHeuristic &changeHeuristic, const std::string &outputPath, bool overwrite, bool ignoreCoinJoin, ClusteringStats *stats) {
+        
+        auto changeHeuristicL = [&changeHeuristic](const Transaction &tx) -> ranges::any_view<Output> {
+            return changeHeuristic(tx);
+        };
+        
+        return createClusteringImpl(chain, changeHeuristicL, changeHeuristic.name, outputPath, overwrite, ignoreCoinJoin, stats);
+    }
+    
+    ClusterManager ClusterManager::createClustering(BlockRange &chain, const std::function<ranges::any_view<Output>(const Transaction &tx)> &changeHeuristic, const std::string &outputPath, bool overwrite, bool ignoreCoinJoin, ClusteringStats *stats) {
+        return createClusteringImpl(chain, changeHeuristic, "", outputPath, overwrite, ignoreCoinJoin, stats);
+    }
+    
+    ClusterManager ClusterManager::updateClustering(BlockRange &chain, const heuristics::ChangeHeuristic &changeHeuristic, const std::string &outputPath, bool ignoreCoinJoin, ClusteringStats *stats) {
         
         auto changeHeuristicL = [&changeHeuristic](const Transaction &tx) -> ranges::any_view<Output> {
             return changeHeuristic(tx);
         };
         
-        return createClusteringImpl(chain, changeHeuristicL, outputPath, overwrite, ignoreCoinJoin);
+        return updateClusteringImpl(chain, changeHeuristicL, changeHeuristic.name, outputPath, ignoreCoinJoin, stats);
     }
     
-    ClusterManager ClusterManager::createClustering(BlockRange &chain, const std::function<ranges::any_view<Output>(const Transaction &tx)> &changeHeuristic, const std::string &outputPath, bool overwrite, bool ignoreCoinJoin) {
-        return createClusteringImpl(chain, changeHeuristic, outputPath, overwrite, ignoreCoinJoin);
+    ClusterManager ClusterManager::updateClustering(BlockRange &chain, const std::function<ranges::any_view<Output>(const Transaction &tx)> &changeHeuristic, const std::string &outputPath, bool ignoreCoinJoin, ClusteringStats *stats) {
+        return updateClusteringImpl(chain, changeHeuristic, "", outputPath, ignoreCoinJoin, stats);
     }
 } // namespace blocksci
 
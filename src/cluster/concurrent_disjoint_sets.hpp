@@ -0,0 +1,94 @@
+//
+//  concurrent_disjoint_sets.hpp
+//  blocksci
+//
+
+#ifndef concurrent_disjoint_sets_hpp
+#define concurrent_disjoint_sets_hpp
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+namespace blocksci {
+    /** Lock-free union-find over the elements [0, size), safe to use from any number of threads at once
+     *
+     * No call ever waits for a lock, and a compare-and-swap only fails when another thread has changed the forest in
+     * the meantime, so some thread always makes progress. It is not wait-free, since a single unite() retries for as
+     * long as other threads keep linking the roots it has found below other roots.
+     *
+     * Every element holds the index of its parent, roots point to themselves. unite() links one root below the
+     * other with a single compare-and-swap, always linking the root with the lower priority below the one with the
+     * higher priority. The priorities are a fixed pseudo-random permutation of the indexes, which keeps trees
+     * shallow in expectation like union by rank does, but needs no extra state that would have to be updated
+     * atomically together with the parent. find() shortens the paths it walks by path splitting. Both only ever
+     * move a parent pointer closer to the root, so concurrent calls can't create cycles.
+     */
+    class ConcurrentDisjointSets {
+        std::unique_ptr<std::atomic<uint32_t>[]> parents;
+        uint32_t elementCount;
+        
+        static uint64_t priority(uint32_t index) {
+            uint64_t mixed = index;
+            mixed = ((mixed >> 16) ^ mixed) * 0x45d9f3bU;
+            mixed = ((mixed >> 16) ^ mixed) * 0x45d9f3bU;
+            mixed = (mixed >> 16) ^ mixed;
+            // Break ties by index so that the priorities are a total order
+            return ((mixed & 0xffffffffU) << 32) | index;
+        }
+        
+    public:
+        explicit ConcurrentDisjointSets(uint32_t size) : parents(std::make_unique<std::atomic<uint32_t>[]>(size)), elementCount(size) {
+            for (uint32_t i = 0; i < size; i++) {
+                parents[i].store(i, std::memory_order_relaxed);
+            }
+        }
+        
+        uint32_t size() const {
+            return elementCount;
+        }
+        
+        /** Restores a previously computed forest, parent must be the root of index or index itself. Only safe while no
+         *  other thread uses the index or its parent. */
+        void setParent(uint32_t index, uint32_t parent) {
+            parents[index].store(parent, std::memory_order_relaxed);
+        }
+        
+        uint32_t find(uint32_t index) {
+            while (true) {
+                auto parent = parents[index].load(std::memory_order_relaxed);
+                if (parent == index) {
+                    return index;
+                }
+                auto grandparent = parents[parent].load(std::memory_order_relaxed);
+                if (grandparent != parent) {
+                    // Failing is fine, another thread has moved the pointer closer to the root already
+                    parents[index].compare_exchange_weak(parent, grandparent, std::memory_order_relaxed);
+                }
+                index = parent;
+            }
+        }
+        
+        /** Merges the sets containing a and b, returns false if they were in the same set already */
+        bool unite(uint32_t a, uint32_t b) {
+            while (true) {
+                a = find(a);
+                b = find(b);
+                if (a == b) {
+                    return false;
+                }
+                if (priority(a) > priority(b)) {
+                    std::swap(a, b);
+                }
+                // Fails if another thread has linked a below some other root in the meantime
+                uint32_t expected = a;
+                if (parents[a].compare_exchange_strong(expected, b, std::memory_order_acq_rel)) {
+                    return true;
+                }
+            }
+        }
+    };
+} // namespace blocksci
+
+#endif /* concurrent_disjoint_sets_hpp */
@@ -0,0 +1,242 @@
+//
+//  thread_pool.cpp
+//  blocksci
+//
+
+#include <blocksci/core/thread_pool.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+
+namespace blocksci {
+    namespace {
+        // Set on the pool's worker threads and on a thread that is running a loop, used to detect nested loops
+        thread_local bool insideParallelLoop = false;
+
+        /** Indexes [begin, end) that are still to be processed by one participant */
+        struct WorkRange {
+            std::mutex mutex;
+            size_t begin = 0;
+            size_t end = 0;
+        };
+    }
+
+    struct ThreadPool::Job {
+        const std::function<void(size_t index)> &func;
+        std::vector<std::unique_ptr<WorkRange>> ranges;
+        std::atomic<bool> aborted{false};
+        std::mutex errorMutex;
+        std::exception_ptr error;
+
+        // Next free participant, participant 0 is the thread that started the loop. Guarded by the pool's mutex.
+        size_t nextParticipant = 1;
+        // Number of threads other than the one that started the loop currently in run(), guarded by the pool's mutex
+        size_t activeWorkers = 0;
+
+        Job(const std::function<void(size_t index)> &func_, size_t count, size_t participantCount) : func(func_) {
+            for (size_t i = 0; i < participantCount; i++) {
+                auto range = std::make_unique<WorkRange>();
+                range->begin = count * i / participantCount;
+                range->end = count * (i + 1) / participantCount;
+                ranges.push_back(std::move(range));
+            }
+        }
+
+        bool hasWork() {
+            if (aborted) {
+                return false;
+            }
+            for (auto &range : ranges) {
+                std::lock_guard<std::mutex> lock(range->mutex);
+                if (range->begin < range->end) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        bool takeOwn(size_t participant, size_t &index) {
+            auto &range = *ranges[participant];
+            std::lock_guard<std::mutex> lock(range.mutex);
+            if (range.begin < range.end) {
+                index = range.begin++;
+                return true;
+            }
+            return false;
+        }
+
+        bool steal(size_t participant, size_t &index) {
+            for (size_t i = 1; i < ranges.size(); i++) {
+                auto &victim = *ranges[(participant + i) % ranges.size()];
+                size_t stolenBegin;
+                size_t stolenEnd;
+                {
+                    std::lock_guard<std::mutex> lock(victim.mutex);
+                    if (victim.begin >= victim.end) {
+                        continue;
+                    }
+                    stolenBegin = victim.begin + (victim.end - victim.begin) / 2;
+                    stolenEnd = victim.end;
+                    victim.end = stolenBegin;
+                }
+                auto &range = *ranges[participant];
+                std::lock_guard<std::mutex> lock(range.mutex);
+                index = stolenBegin;
+                range.begin = stolenBegin + 1;
+                range.end = stolenEnd;
+                return true;
+            }
+            return false;
+        }
+
+        void run(size_t participant) {
+            size_t index;
+            while (!aborted && (takeOwn(participant, index) || steal(participant, index))) {
+                try {
+                    func(index);
+                } catch (...) {
+                    std::lock_guard<std::mutex> lock(errorMutex);
+                    if (!error) {
+                        error = std::current_exception();
+                    }
+                    aborted = true;
+                }
+            }
+        }
+    };
+
+    ThreadPool &ThreadPool::instance() {
+        static ThreadPool pool{std::max(std::thread::hardware_concurrency(), 1u)};
+        return pool;
+    }
+
+    ThreadPool::ThreadPool(unsigned int threadCount_) : threadCount(std::max(threadCount_, 1u)) {}
+
+    ThreadPool::~ThreadPool() {
+        retireWorkers();
+    }
+
+    unsigned int ThreadPool::getThreadCount() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return threadCount;
+    }
+
+    void ThreadPool::setThreadCount(unsigned int threadCount_) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            threadCount = std::max(threadCount_, 1u);
+        }
+        // Running loops keep the participants they started with, the next loop starts the new number of workers
+        retireWorkers();
+    }
+
+    uint32_t ThreadPool::getGrainSize() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return grainSize;
+    }
+
+    void ThreadPool::setGrainSize(uint32_t grainSize_) {
+        std::lock_guard<std::mutex> lock(mutex);
+        grainSize = std::max(grainSize_, 1u);
+    }
+
+    void ThreadPool::retireWorkers() {
+        std::vector<std::thread> retired;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            workerGeneration++;
+            retired.swap(workers);
+        }
+        workAvailable.notify_all();
+        for (auto &worker : retired) {
+            worker.join();
+        }
+    }
+
+    ThreadPool::Job *ThreadPool::joinJob(size_t &participant) {
+        for (auto job : jobs) {
+            if (job->nextParticipant < job->ranges.size() && job->hasWork()) {
+                participant = job->nextParticipant++;
+                job->activeWorkers++;
+                return job;
+            }
+        }
+        return nullptr;
+    }
+
+    void ThreadPool::runWorker(uint64_t generation) {
+        insideParallelLoop = true;
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            Job *job = nullptr;
+            size_t participant = 0;
+            workAvailable.wait(lock, [&]() {
+                return workerGeneration != generation || (job = joinJob(participant)) != nullptr;
+            });
+            if (job == nullptr) {
+                return;
+            }
+            lock.unlock();
+            job->run(participant);
+            lock.lock();
+            job->activeWorkers--;
+            workDone.notify_all();
+        }
+    }
+
+    void ThreadPool::parallelFor(size_t count, const std::function<void(size_t index)> &func) {
+        if (insideParallelLoop || count <= 1) {
+            for (size_t i = 0; i < count; i++) {
+                func(i);
+            }
+            return;
+        }
+
+        size_t participantCount;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto generation = workerGeneration;
+            while (workers.size() + 1 < threadCount) {
+                workers.emplace_back([this, generation]() { runWorker(generation); });
+            }
+            participantCount = threadCount;
+        }
+
+        Job job{func, count, participantCount};
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            jobs.push_back(&job);
+        }
+        workAvailable.notify_all();
+        // Callers waiting for the end of their own loop can help with this one
+        workDone.notify_all();
+
+        insideParallelLoop = true;
+        job.run(0);
+
+        {
+            // Once the job is removed no other thread joins it, wait for the ones that did and help with other loops meanwhile
+            std::unique_lock<std::mutex> lock(mutex);
+            jobs.erase(std::find(jobs.begin(), jobs.end(), &job));
+            while (job.activeWorkers > 0) {
+                size_t participant;
+                auto otherJob = joinJob(participant);
+                if (otherJob != nullptr) {
+                    lock.unlock();
+                    otherJob->run(participant);
+                    lock.lock();
+                    otherJob->activeWorkers--;
+                    workDone.notify_all();
+                } else {
+                    workDone.wait(lock);
+                }
+            }
+        }
+        insideParallelLoop = false;
+
+        if (job.error) {
+            std::rethrow_exception(job.error);
+        }
+    }
+} // namespace blocksci
@@ -16,8 +16,10 @@
 #include <range/v3/range_for.hpp>
 #include <range/v3/view/filter.hpp>
 
+#include <array>
 #include <unordered_set>
 #include <cmath>
+#include <string>
 
 
 /** Change address heuristics
@@ -26,6 +28,15 @@
  */
 namespace blocksci { namespace heuristics {
     
+    std::string changeTypeName(ChangeType::Enum type) {
+        static constexpr std::array<const char *, ChangeType::size> names = {{
+        #define VAL(x) #x
+            CHANGE_ADDRESS_TYPE_LIST
+        #undef VAL
+        }};
+        return names[static_cast<size_t>(type)];
+    }
+    
     /** Remove OP_RETURN outputs from candidate set */
     bool filterOpReturn(Output o) {
         return o.getAddress().isSpendable();
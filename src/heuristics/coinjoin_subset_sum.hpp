@@ -0,0 +1,25 @@
+//
+//  coinjoin_subset_sum.hpp
+//  blocksci
+//
+
+#ifndef coinjoin_subset_sum_hpp
+#define coinjoin_subset_sum_hpp
+
+#include <blocksci/blocksci_export.h>
+#include <blocksci/heuristics/tx_identification.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace blocksci { namespace heuristics {
+    /** Whether the values can be split into groups that reach every goal, values don't have to be used up
+     *
+     * Two buckets over many values are decided with subset sums where possible, everything else is decided by a
+     * memoized search. If maxDepth != 0, the search returns Timeout after visiting maxDepth states.
+     */
+    CoinJoinResult BLOCKSCI_EXPORT getSumCount(std::vector<int64_t> values, std::vector<int64_t> bucketGoals, size_t maxDepth);
+}}
+
+#endif /* coinjoin_subset_sum_hpp */
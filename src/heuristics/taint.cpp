@@ -5,18 +5,24 @@
 //  Created by Harry Kalodner on 3/20/18.
 //
 
+#include "taint_state.hpp"
+
 #include <blocksci/heuristics/taint.hpp>
 #include <blocksci/address/address.hpp>
 #include <blocksci/chain/algorithms.hpp>
 #include <blocksci/chain/block.hpp>
 #include <blocksci/chain/block_range.hpp>
+#include <blocksci/chain/input.hpp>
+#include <blocksci/chain/output.hpp>
+#include <blocksci/core/thread_pool.hpp>
 
 #include <internal/data_access.hpp>
 #include <internal/chain_access.hpp>
 
+#include <algorithm>
+#include <functional>
 #include <numeric>
-#include <map>
-#include <unordered_map>
+#include <queue>
 
 #include <iostream>
 
@@ -96,66 +102,103 @@ namespace blocksci { namespace heuristics {
         return taint;
     }
     
-    struct InoutInfo {
-        uint32_t txNum;
-        OutputPointer pointer;
+    /** Taint that is waiting to be propagated
+     *
+     * Spent tainted outputs are kept until their spending transaction is processed. The spending transactions are
+     * visited in chain order through a min-heap, which skips all blocks and transactions without tainted inputs.
+     */
+    template <typename Taint>
+    struct TaintFrontier {
+        TaintPool<Taint> pool;
         
-        bool operator<(const InoutInfo& other) const {
-            return std::tie(txNum, pointer) < std::tie(other.txNum, other.pointer);
-        }
+        // Spent outputs whose spending transaction hasn't been processed yet
+        OutputPointerMap<uint32_t> taintedInputs;
         
-        bool operator==(const InoutInfo& other) const {
-            return txNum == other.txNum && pointer == other.pointer;
-        }
-    };
-}}
+        // Tainted outputs that are unspent
+        OutputPointerMap<uint32_t> taintedOutputs;
 
-namespace std {
-    template<> struct BLOCKSCI_EXPORT hash<blocksci::heuristics::InoutInfo> {
-        size_t operator()(const blocksci::heuristics::InoutInfo &info) const {
-            std::size_t seed = 76547;
-            blocksci::hash_combine(seed, info.txNum);
-            blocksci::hash_combine(seed, info.pointer);
-            return seed;
-        }
-    };
-} // namespace std
+        // Spending transactions of taintedInputs, a transaction is contained once per tainted input
+        std::priority_queue<uint32_t, std::vector<uint32_t>, std::greater<uint32_t>> pendingTxes;
 
-namespace blocksci { namespace heuristics {
-    template <typename Taint>
-    using TaintMap = std::map<InoutInfo, Taint>;
+        // Process an output and its associated taint value
+        // If output has been spent, add the corresponding input to the list of tainted inputs
+        // If output is unspent, add it to the list of tainted outputs
+        void processOutput(const Output &spendingOut, Taint &newTaintedValue) {
+            // Ignore untainted outputs
+            if (hasTaint(newTaintedValue)) {
+                auto spendingTx = spendingOut.getSpendingTxIndex();
+                auto &outputs = spendingTx ? taintedInputs : taintedOutputs;
+                // Check if output was passed in originally as fully tainted
+                if (!outputs.find(spendingOut.pointer)) {
+                    outputs.insert(spendingOut.pointer, pool.add(std::move(newTaintedValue)));
+                    if (spendingTx) {
+                        pendingTxes.push(*spendingTx);
+                    }
+                }
+            }
+        }
     
-    // Process an output and its associated taint value
-    // If output has been spent, add the corresponding input to the list of tainted inputs
-    // If output is unspent, add it to the list of tainted outputs
-    template <typename Taint>
-    void processOutput(TaintMap<Taint> &taintedInputs, std::unordered_map<OutputPointer, Taint> &taintedOutputs, const Output &spendingOut, Taint &newTaintedValue) {
-        // Ignore untainted outputs
-        if (hasTaint(newTaintedValue)) {
-            auto spendingTx = spendingOut.getSpendingTxIndex();
-            if (spendingTx) {
-                InoutInfo info{*spendingTx, spendingOut.pointer};
-                auto it = taintedInputs.find(info);
-                if (it == taintedInputs.end()) { // check if output was passed in originally as fully tainted
-                    taintedInputs.insert(std::make_pair(info, std::move(newTaintedValue)));
+        // Pass all outputs of a transaction and the corresponding taint to processOutput()
+        void processTx(const Transaction &tx, std::vector<Taint> &outputTaint) {
+            assert(outputTaint.size() == tx.outputCount());
+            for (uint16_t i = 0; i < tx.outputCount(); i++) {
+                processOutput(tx.outputs()[i], outputTaint[i]);
+            }
+        }
+        
+        /** Removes all entries for txNum from the heap, returns false if txNum wasn't the next pending transaction */
+        bool popPending(uint32_t txNum) {
+            if (pendingTxes.empty() || pendingTxes.top() != txNum) {
+                return false;
+            }
+            while (!pendingTxes.empty() && pendingTxes.top() == txNum) {
+                pendingTxes.pop();
+            }
+            return true;
+        }
+        
+        /** Taint of the inputs of tx, removing its tainted inputs from the frontier */
+        std::vector<Taint> takeInputTaint(const Transaction &tx) {
+            std::vector<Taint> inputTaint;
+            inputTaint.reserve(tx.inputCount());
+            for (auto input : tx.inputs()) {
+                auto pointer = input.getSpentOutputPointer();
+                if (auto slot = taintedInputs.find(pointer)) {
+                    auto poolSlot = *slot;
+                    inputTaint.emplace_back(std::move(pool[poolSlot]));
+                    pool.release(poolSlot);
+                    taintedInputs.erase(pointer);
+                } else {
+                    inputTaint.emplace_back(UntaintedInputCreator<Taint>{}(input.getValue()));
                 }
-            } else {
-                auto it = taintedOutputs.find(spendingOut.pointer);
-                if (it == taintedOutputs.end()) { // check if output was passed in originally as fully tainted
-                    taintedOutputs.insert(std::make_pair(spendingOut.pointer, std::move(newTaintedValue)));
+            }
+            return inputTaint;
+        }
+        
+        /** Same as takeInputTaint but leaves the frontier untouched, so that it can run concurrently */
+        std::vector<Taint> copyInputTaint(const Transaction &tx) const {
+            std::vector<Taint> inputTaint;
+            inputTaint.reserve(tx.inputCount());
+            for (auto input : tx.inputs()) {
+                if (auto slot = taintedInputs.find(input.getSpentOutputPointer())) {
+                    inputTaint.emplace_back(pool[*slot]);
+                } else {
+                    inputTaint.emplace_back(UntaintedInputCreator<Taint>{}(input.getValue()));
                 }
             }
+            return inputTaint;
         }
-    }
-    
-    // Pass all outputs of a transaction and the corresponding taint to processOutput()
-    template <typename Taint>
-    void processTx(TaintMap<Taint> &taintedInputs, std::unordered_map<OutputPointer, Taint> &taintedOutputs, const Transaction &tx, std::vector<Taint> &outputTaint) {
-        assert(outputTaint.size() == tx.outputCount());
-        for (uint16_t i = 0; i < tx.outputCount(); i++) {
-            processOutput(taintedInputs, taintedOutputs, tx.outputs()[i], outputTaint[i]);
+        
+        void dropInputTaint(const Transaction &tx) {
+            for (auto input : tx.inputs()) {
+                auto pointer = input.getSpentOutputPointer();
+                if (auto slot = taintedInputs.find(pointer)) {
+                    pool.release(*slot);
+                    taintedInputs.erase(pointer);
+                }
+            }
         }
-    }
+    };
     
     void clearTaint(SimpleTaint &taint) {
         taint.first = 0;
@@ -191,6 +234,9 @@ namespace blocksci { namespace heuristics {
         return subsidy;
     }
     
+    // Transactions of a block whose taint is computed on the thread pool instead of serially once there are this many
+    constexpr size_t minParallelTaintTxes = 64;
+    
     // Propagate taint
     template <typename Func, typename Taint>
     std::vector<std::pair<Output, Taint>> getTaintedImpl(Func func, std::vector<std::pair<Output, Taint>> &taintedOutputsRaw, BlockHeight maxBlockHeight, bool taintFee) {
@@ -198,9 +244,7 @@ namespace blocksci { namespace heuristics {
         
         auto &access = taintedOutputsRaw[0].first.getAccess();
         
-        TaintMap<Taint> taintedInputs;
-        
-        std::unordered_map<OutputPointer, Taint> taintedOutputs;
+        TaintFrontier<Taint> frontier;
         
         if (maxBlockHeight == -1) {
             maxBlockHeight = access.getChain().blockCount();
@@ -211,82 +255,127 @@ namespace blocksci { namespace heuristics {
             maxBlockHeight = std::min(maxBlockHeight, access.getChain().blockCount());
         }
         
-        BlockHeight minHeight = std::numeric_limits<BlockHeight>::max();
         for(std::pair<Output, Taint> &taintedOutput : taintedOutputsRaw){
             // Add outputs to map of tainted outputs
-            processOutput(taintedInputs, taintedOutputs, taintedOutput.first, taintedOutput.second);
-            
-            minHeight = std::min(minHeight, taintedOutput.first.getBlockHeight());
+            frontier.processOutput(taintedOutput.first, taintedOutput.second);
         }
         
-        BlockRange blocks{{minHeight, maxBlockHeight}, &access};
-        std::vector<Taint> txOutputTaint;
-        std::vector<Taint> txInputTaint;
-        Taint coinbaseTaint;
-        clearTaint(coinbaseTaint);
-        for (auto block : blocks) {
-            if (taintedInputs.begin()->first.txNum >= block.endTxIndex()) {
-                continue;
-            }
-            std::vector<Taint> coinbaseTaintList;
-            coinbaseTaintList.reserve(block.size());
-            for (auto tx : block[{1, block.size()}]) {
-                txOutputTaint.clear();
-                txOutputTaint.reserve(tx.outputCount());
-                clearTaint(coinbaseTaint);
-                txInputTaint.clear();
-                txInputTaint.reserve(tx.inputCount());
+        // Transactions from this index on are beyond maxBlockHeight
+        uint32_t endTxNum = maxBlockHeight > 0 ? Block{maxBlockHeight - 1, access}.endTxIndex() : 0;
                 
-                // Transactions are processed in chronological order
-                // If any input has taint, it must be at the beginning of the ordered taint map
-                if (taintedInputs.begin()->first.txNum == tx.txNum) {
-                    // Find tainted outputs spent in this transaction
+        struct TxTaint {
+            uint32_t txNum;
+            std::vector<Taint> outputTaint;
+            Taint coinbaseTaint;
+        };
+        std::vector<uint32_t> parallelTxNums;
+        std::vector<TxTaint> blockTaint;
+        
+        while (!frontier.pendingTxes.empty() && frontier.pendingTxes.top() < endTxNum) {
+            // Jump straight to the next block that spends a tainted output
+            Block block{access.getChain().getBlockHeight(frontier.pendingTxes.top()), access};
+            auto blockStart = block.firstTxIndex();
+            auto blockEnd = block.endTxIndex();
+            blockTaint.clear();
+            
+            // Transactions that only spend outputs of earlier blocks don't depend on each other, since all taint
+            // reaching them is known already. Their taint is computed concurrently.
+            parallelTxNums.clear();
+            {
+                std::vector<uint32_t> deferredTxNums;
+                while (!frontier.pendingTxes.empty() && frontier.pendingTxes.top() < blockEnd) {
+                    auto txNum = frontier.pendingTxes.top();
+                    frontier.popPending(txNum);
+                    auto tx = block[txNum - blockStart];
+                    bool spendsEarlierBlocks = true;
                     for (auto input : tx.inputs()) {
-                        InoutInfo info{tx.txNum, input.getSpentOutputPointer()};
-                        auto it = taintedInputs.find(info);
-                        if (it != taintedInputs.end()) {
-                            txInputTaint.emplace_back(std::move(it->second));
-                            taintedInputs.erase(it);
-                        } else {
-                            txInputTaint.emplace_back(UntaintedInputCreator<Taint>{}(input.getValue()));
+                        if (input.spentTxIndex() >= blockStart) {
+                            spendsEarlierBlocks = false;
+                            break;
                         }
                     }
+                    (spendsEarlierBlocks ? parallelTxNums : deferredTxNums).push_back(txNum);
+                }
+                for (auto txNum : deferredTxNums) {
+                    frontier.pendingTxes.push(txNum);
+                }
+            }
                     
+            if (parallelTxNums.size() >= minParallelTaintTxes) {
+                blockTaint.resize(parallelTxNums.size());
+                ThreadPool::instance().parallelFor(parallelTxNums.size(), [&](size_t i) {
+                    auto tx = block[parallelTxNums[i] - blockStart];
+                    auto &txTaint = blockTaint[i];
+                    txTaint.txNum = tx.txNum;
+                    clearTaint(txTaint.coinbaseTaint);
                     // Compute new taint of outputs
-                    func(tx, txInputTaint, txOutputTaint, coinbaseTaint);
+                    func(tx, frontier.copyInputTaint(tx), txTaint.outputTaint, txTaint.coinbaseTaint);
+                });
+                for (auto &txTaint : blockTaint) {
+                    auto tx = block[txTaint.txNum - blockStart];
+                    frontier.dropInputTaint(tx);
                     // Add new taint to taintedInputs/taintedOutputs
-                    processTx(taintedInputs, taintedOutputs, tx, txOutputTaint);
-                } else {
-                    // No tainted inputs, thus fee is untainted
-                    coinbaseTaint = UntaintedInputCreator<Taint>{}(tx.fee());
+                    frontier.processTx(tx, txTaint.outputTaint);
                 }
-                
-                coinbaseTaintList.emplace_back(coinbaseTaint);
+            } else {
+                for (auto txNum : parallelTxNums) {
+                    frontier.pendingTxes.push(txNum);
+                }
+            }
+            
+            // Transactions are processed in chronological order, which includes the ones that spend taint created
+            // earlier in this block
+            while (!frontier.pendingTxes.empty() && frontier.pendingTxes.top() < blockEnd) {
+                auto txNum = frontier.pendingTxes.top();
+                frontier.popPending(txNum);
+                auto tx = block[txNum - blockStart];
+                blockTaint.emplace_back();
+                auto &txTaint = blockTaint.back();
+                txTaint.txNum = txNum;
+                clearTaint(txTaint.coinbaseTaint);
+                func(tx, frontier.takeInputTaint(tx), txTaint.outputTaint, txTaint.coinbaseTaint);
+                frontier.processTx(tx, txTaint.outputTaint);
             }
+            
             // If taintFee is false, all taint going into the coinbase transaction is discarded
             if (taintFee) {
-                txOutputTaint.clear();
+                std::sort(blockTaint.begin(), blockTaint.end(), [](const TxTaint &a, const TxTaint &b) {
+                    return a.txNum < b.txNum;
+                });
+                std::vector<Taint> coinbaseTaintList;
+                coinbaseTaintList.reserve(block.size());
+                coinbaseTaintList.emplace_back(UntaintedInputCreator<Taint>{}(getSubsidy(block)));
+                auto txTaintIt = blockTaint.begin();
+                for (auto tx : block[{1, block.size()}]) {
+                    if (txTaintIt != blockTaint.end() && txTaintIt->txNum == tx.txNum) {
+                        coinbaseTaintList.emplace_back(std::move(txTaintIt->coinbaseTaint));
+                        ++txTaintIt;
+                    } else {
+                        // No tainted inputs, thus fee is untainted
+                        coinbaseTaintList.emplace_back(UntaintedInputCreator<Taint>{}(tx.fee()));
+                    }
+                }
+                
+                std::vector<Taint> txOutputTaint;
                 txOutputTaint.reserve(block[0].outputCount());
+                Taint coinbaseTaint;
                 clearTaint(coinbaseTaint);
-                
-                int64_t subsidy = getSubsidy(block);
-                coinbaseTaintList.insert(coinbaseTaintList.begin(), UntaintedInputCreator<Taint>{}(subsidy));
                 func(block[0], coinbaseTaintList, txOutputTaint, coinbaseTaint);
-                processTx(taintedInputs, taintedOutputs, block[0], txOutputTaint);
+                frontier.processTx(block[0], txOutputTaint);
             }
         }
         
         std::vector<std::pair<Output, Taint>> ret;
-        ret.reserve(taintedOutputs.size() + taintedInputs.size());
+        ret.reserve(frontier.taintedOutputs.size() + frontier.taintedInputs.size());
         
         // Tainted unspent outputs
-        for (auto &item : taintedOutputs) {
-            ret.emplace_back(Output{item.first, access}, item.second);
-        }
+        frontier.taintedOutputs.forEach([&](const OutputPointer &pointer, uint32_t slot) {
+            ret.emplace_back(Output{pointer, access}, frontier.pool[slot]);
+        });
         // Tainted spent outputs, but unspent at maxBlockHeight
-        for (auto &item : taintedInputs) {
-            ret.emplace_back(Output{item.first.pointer, access}, item.second);
-        }
+        frontier.taintedInputs.forEach([&](const OutputPointer &pointer, uint32_t slot) {
+            ret.emplace_back(Output{pointer, access}, frontier.pool[slot]);
+        });
         return ret;
     }
     
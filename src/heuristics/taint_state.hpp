@@ -0,0 +1,162 @@
+//
+//  taint_state.hpp
+//  blocksci
+//
+
+#ifndef taint_state_hpp
+#define taint_state_hpp
+
+#include <blocksci/chain/output_pointer.hpp>
+
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
+
+namespace blocksci { namespace heuristics {
+    /** Hash map from outputs to small values with open addressing
+     *
+     * Keys and values are stored in flat arrays and collisions are resolved with linear probing, so lookups touch
+     * one or two cache lines and inserts don't allocate except when the table grows. Erasing shifts the following
+     * entries of the probe sequence back instead of leaving tombstones. Empty slots are marked with a sentinel
+     * pointer that no real output can have.
+     */
+    template <typename Value>
+    class OutputPointerMap {
+        std::vector<OutputPointer> keys;
+        std::vector<Value> values;
+        size_t count = 0;
+        
+        static OutputPointer emptyKey() {
+            return {std::numeric_limits<uint32_t>::max(), std::numeric_limits<uint16_t>::max()};
+        }
+        
+        size_t mask() const {
+            return keys.size() - 1;
+        }
+        
+        size_t idealSlot(const OutputPointer &key) const {
+            uint64_t mixed = (static_cast<uint64_t>(key.txNum) << 16) | key.inoutNum;
+            mixed *= 0x9e3779b97f4a7c15ULL;
+            return static_cast<size_t>(mixed >> 32) & mask();
+        }
+        
+        size_t findSlot(const OutputPointer &key) const {
+            auto slot = idealSlot(key);
+            while (keys[slot] != key && keys[slot] != emptyKey()) {
+                slot = (slot + 1) & mask();
+            }
+            return slot;
+        }
+        
+        void grow() {
+            auto oldKeys = std::move(keys);
+            auto oldValues = std::move(values);
+            keys.assign(oldKeys.size() * 2, emptyKey());
+            values.assign(oldValues.size() * 2, Value{});
+            for (size_t i = 0; i < oldKeys.size(); i++) {
+                if (oldKeys[i] != emptyKey()) {
+                    auto slot = findSlot(oldKeys[i]);
+                    keys[slot] = oldKeys[i];
+                    values[slot] = std::move(oldValues[i]);
+                }
+            }
+        }
+    
+    public:
+        OutputPointerMap() : keys(64, emptyKey()), values(64) {}
+        
+        size_t size() const {
+            return count;
+        }
+        
+        const Value *find(const OutputPointer &key) const {
+            auto slot = findSlot(key);
+            return keys[slot] == key ? &values[slot] : nullptr;
+        }
+        
+        /** Inserts the entry unless the key is present already, returns whether it was inserted */
+        bool insert(const OutputPointer &key, Value value) {
+            // Keep the load factor at or below one half so that probe sequences stay short
+            if ((count + 1) * 2 > keys.size()) {
+                grow();
+            }
+            auto slot = findSlot(key);
+            if (keys[slot] == key) {
+                return false;
+            }
+            keys[slot] = key;
+            values[slot] = std::move(value);
+            count++;
+            return true;
+        }
+        
+        bool erase(const OutputPointer &key) {
+            auto slot = findSlot(key);
+            if (keys[slot] != key) {
+                return false;
+            }
+            // Move later entries of the probe sequence into the gap if the gap lies between their ideal slot and them
+            auto next = (slot + 1) & mask();
+            while (keys[next] != emptyKey()) {
+                auto ideal = idealSlot(keys[next]);
+                if (((next - ideal) & mask()) >= ((next - slot) & mask())) {
+                    keys[slot] = keys[next];
+                    values[slot] = std::move(values[next]);
+                    slot = next;
+                }
+                next = (next + 1) & mask();
+            }
+            keys[slot] = emptyKey();
+            count--;
+            return true;
+        }
+        
+        template <typename Func>
+        void forEach(Func && func) const {
+            for (size_t i = 0; i < keys.size(); i++) {
+                if (keys[i] != emptyKey()) {
+                    func(keys[i], values[i]);
+                }
+            }
+        }
+    };
+    
+    /** Storage for the taint of pending outputs
+     *
+     * Taint values live in one contiguous array and are referred to by their slot number, which keeps the entries of
+     * the maps small. Released slots are cleared and reused for later values.
+     */
+    template <typename Taint>
+    class TaintPool {
+        std::vector<Taint> slots;
+        std::vector<uint32_t> freeSlots;
+    
+    public:
+        uint32_t add(Taint &&taint) {
+            if (freeSlots.empty()) {
+                slots.push_back(std::move(taint));
+                return static_cast<uint32_t>(slots.size() - 1);
+            }
+            auto slot = freeSlots.back();
+            freeSlots.pop_back();
+            slots[slot] = std::move(taint);
+            return slot;
+        }
+        
+        Taint &operator[](uint32_t slot) {
+            return slots[slot];
+        }
+        
+        const Taint &operator[](uint32_t slot) const {
+            return slots[slot];
+        }
+        
+        void release(uint32_t slot) {
+            slots[slot] = Taint{};
+            freeSlots.push_back(slot);
+        }
+    };
+}}
+
+#endif /* taint_state_hpp */
@@ -5,15 +5,20 @@
 //  Created by Harry Kalodner on 12/1/17.
 //
 
+#include "coinjoin_subset_sum.hpp"
+
 #include <blocksci/heuristics/tx_identification.hpp>
+#include <blocksci/chain/block_range.hpp>
 #include <blocksci/chain/transaction.hpp>
 #include <blocksci/chain/input.hpp>
 #include <blocksci/chain/output.hpp>
 #include <blocksci/scripts/script_variant.hpp>
 
 #include <range/v3/range_for.hpp>
+#include <range/v3/utility/optional.hpp>
 
 #include <algorithm>
+#include <limits>
 #include <unordered_set>
 #include <unordered_map>
 
@@ -89,102 +94,246 @@ namespace heuristics {
         return true;
     }
     
-    struct OutputBucket {
-        int64_t currentValue;
-        int64_t goalValue;
+    namespace {
+        // Largest scaled total for which the subset sums of two bucket searches are tracked in a bitset
+        constexpr int64_t maxBitsetSum = int64_t{1} << 22;
         
-        explicit OutputBucket(int64_t goal) : currentValue(0), goalValue(goal) {}
+        // Two bucket searches over at most this many values are cheaper than building the subset sums
+        constexpr size_t maxSmallSearchValues = 16;
         
-        bool isFull() const {
-            return currentValue >= goalValue;
-        }
+        // Failed search states remembered per transaction
+        constexpr size_t maxMemoizedStates = 1 << 18;
         
-        void addInput(int64_t val) {
-            currentValue += val;
+        /** Bitset of all subset sums of values divided by unit and rounded down, up to maxSum */
+        class SubsetSums {
+            std::vector<uint64_t> words;
+            int64_t maxSum;
+            
+        public:
+            SubsetSums(const std::vector<int64_t> &values, int64_t unit, int64_t maxSum_) : words(static_cast<size_t>(maxSum_ / 64 + 1)), maxSum(maxSum_) {
+                words[0] = 1;
+                int64_t reachable = 0;
+                for (auto value : values) {
+                    auto shift = value / unit;
+                    if (shift == 0) {
+                        continue;
+                    }
+                    reachable = std::min(reachable + shift, maxSum);
+                    auto wordShift = static_cast<size_t>(shift / 64);
+                    auto bitShift = static_cast<unsigned int>(shift % 64);
+                    // Going downwards every word is updated from words that weren't updated for this value yet
+                    for (auto i = static_cast<size_t>(reachable / 64) + 1; i-- > wordShift;) {
+                        auto shifted = words[i - wordShift] << bitShift;
+                        if (bitShift != 0 && i > wordShift) {
+                            shifted |= words[i - wordShift - 1] >> (64 - bitShift);
+                        }
+                        words[i] |= shifted;
+                    }
+                }
+            }
+            
+            /** Whether any subset sums to a value in [first, last] */
+            bool anyInRange(int64_t first, int64_t last) const {
+                first = std::max(first, int64_t{0});
+                last = std::min(last, maxSum);
+                for (auto sum = first; sum <= last;) {
+                    auto word = words[static_cast<size_t>(sum / 64)] >> (sum % 64);
+                    auto bitCount = std::min(64 - sum % 64, last - sum + 1);
+                    if (bitCount < 64) {
+                        word &= (uint64_t{1} << bitCount) - 1;
+                    }
+                    if (word != 0) {
+                        return true;
+                    }
+                    sum += bitCount;
+                }
+                return false;
+            }
+        };
+        
+        int64_t ceilDiv(int64_t a, int64_t b) {
+            return a >= 0 ? (a + b - 1) / b : -(-a / b);
         }
         
-        void removeInput(int64_t val) {
-            currentValue -= val;
+        int64_t floorDiv(int64_t a, int64_t b) {
+            return a >= 0 ? a / b : -ceilDiv(-a, b);
         }
         
-        int64_t remaining() const {
-            if (goalValue > currentValue) {
-                return goalValue - currentValue;
-            } else {
-                return 0;
+        int64_t gcd(int64_t a, int64_t b) {
+            while (b != 0) {
+                auto rest = a % b;
+                a = b;
+                b = rest;
+            }
+            return a;
+        }
+        
+        /** Decides whether values can fill two buckets using subset sums, if the rounding of large values allows it
+         *
+         * The first bucket is filled by a subset whose sum lies in [firstGoal, total - secondGoal], the remaining
+         * values then fill the second one. If all values fit into the bitset after dividing them by their greatest
+         * common divisor the answer is exact. Otherwise they are rounded down to multiples of a unit, so that a subset
+         * with the scaled sum s has a sum between s * unit and s * unit + count * (unit - 1).
+         */
+        ranges::optional<CoinJoinResult> twoBucketSubsetSums(const std::vector<int64_t> &values, int64_t total, int64_t firstGoal, int64_t secondGoal) {
+            auto low = firstGoal;
+            auto high = total - secondGoal;
+            int64_t divisor = 0;
+            for (auto value : values) {
+                divisor = gcd(divisor, value);
             }
+            if (total / divisor <= maxBitsetSum) {
+                SubsetSums sums(values, divisor, total / divisor);
+                return sums.anyInRange(ceilDiv(low, divisor), floorDiv(high, divisor)) ? CoinJoinResult::True : CoinJoinResult::False;
+            }
+            
+            int64_t unit = total / maxBitsetSum + 1;
+            int64_t slack = static_cast<int64_t>(values.size()) * (unit - 1);
+            SubsetSums sums(values, unit, total / unit);
+            if (sums.anyInRange(ceilDiv(low, unit), floorDiv(high - slack, unit))) {
+                return CoinJoinResult::True;
+            }
+            if (!sums.anyInRange(ceilDiv(low - slack, unit), floorDiv(high, unit))) {
+                return CoinJoinResult::False;
+            }
+            return ranges::nullopt;
         }
         
-        bool operator<(const OutputBucket &other) const {
-            return remaining() < other.remaining();
-        }
-    };
-    
-    CoinJoinResult _getSumCount(std::vector<int64_t> &values, std::vector<OutputBucket> buckets, int64_t totalRemaining, int64_t valueLeft, size_t maxDepth, size_t &depth);
-    CoinJoinResult getSumCount(std::vector<int64_t> &values, std::vector<int64_t> bucketGoals, size_t maxDepth);
-    
-    
-    CoinJoinResult _getSumCount(std::vector<int64_t> &values, std::vector<OutputBucket> buckets, int64_t totalRemaining, int64_t valueLeft, size_t maxDepth, size_t &depth) {
-        if (totalRemaining > valueLeft) {
-            return CoinJoinResult::False;
-        }
+        struct BucketStateHash {
+            size_t operator()(const std::vector<int64_t> &state) const {
+                size_t hash = state.size();
+                for (auto value : state) {
+                    hash ^= std::hash<int64_t>{}(value) + 0x9e3779b97f4a7c15ull + (hash << 6) + (hash >> 2);
+                }
+                return hash;
+            }
+        };
+        
+        /** Depth first search that assigns every value, largest first, to a bucket that isn't full yet
+         *
+         * The remaining goals of the buckets are updated in place instead of copying them for every level. Buckets are
+         * tried in order of decreasing remaining goal and buckets with the same remaining goal are interchangeable, so
+         * only one of them is tried. States that failed before are remembered by the index of the next value and the
+         * sorted remaining goals.
+         */
+        class BucketSearch {
+            std::vector<int64_t> values;
+            std::vector<int64_t> suffixSums;
+            std::vector<int64_t> remaining;
+            size_t maxDepth;
+            size_t depth = 0;
+            std::unordered_set<std::vector<int64_t>, BucketStateHash> failedStates;
+            std::vector<int64_t> stateKey;
+            
+            void makeStateKey(size_t index) {
+                stateKey.clear();
+                stateKey.push_back(static_cast<int64_t>(index));
+                for (auto goal : remaining) {
+                    if (goal > 0) {
+                        stateKey.push_back(goal);
+                    }
+                }
+                std::sort(stateKey.begin() + 1, stateKey.end());
+            }
+            
+            CoinJoinResult search(size_t index, int64_t totalRemaining) {
+                if (totalRemaining == 0) {
+                    return CoinJoinResult::True;
+                }
+                if (totalRemaining > suffixSums[index]) {
+                    return CoinJoinResult::False;
+                }
+                
+                depth++;
+                
+                if (maxDepth != 0 && depth > maxDepth) {
+                    return CoinJoinResult::Timeout;
+                }
+                
+                makeStateKey(index);
+                if (failedStates.find(stateKey) != failedStates.end()) {
+                    return CoinJoinResult::False;
+                }
+                
+                auto value = values[index];
+                auto lastTried = std::numeric_limits<int64_t>::max();
+                while (true) {
+                    // Bucket with the largest remaining goal below the one tried last
+                    size_t bucket = remaining.size();
+                    for (size_t i = 0; i < remaining.size(); i++) {
+                        if (remaining[i] > 0 && remaining[i] < lastTried && (bucket == remaining.size() || remaining[i] > remaining[bucket])) {
+                            bucket = i;
+                        }
+                    }
+                    if (bucket == remaining.size()) {
+                        break;
+                    }
+                    lastTried = remaining[bucket];
+                    auto filled = std::min(value, remaining[bucket]);
+                    remaining[bucket] -= filled;
+                    auto res = search(index + 1, totalRemaining - filled);
+                    remaining[bucket] += filled;
+                    if (res != CoinJoinResult::False) {
+                        return res;
+                    }
+                }
+                
+                if (failedStates.size() < maxMemoizedStates) {
+                    makeStateKey(index);
+                    failedStates.insert(stateKey);
+                }
+                return CoinJoinResult::False;
+            }
+            
+        public:
+            BucketSearch(std::vector<int64_t> values_, std::vector<int64_t> goals, size_t maxDepth_) : values(std::move(values_)), suffixSums(values.size() + 1, 0), remaining(std::move(goals)), maxDepth(maxDepth_) {
+                for (size_t i = values.size(); i-- > 0;) {
+                    suffixSums[i] = suffixSums[i + 1] + values[i];
+                }
+            }
+            
+            CoinJoinResult run() {
+                int64_t totalRemaining = 0;
+                for (auto goal : remaining) {
+                    totalRemaining += goal;
+                }
+                return search(0, totalRemaining);
+            }
+        };
+    }
         
-        buckets.erase(std::remove_if(buckets.begin(), buckets.end(), [&](auto &bucket) { return bucket.isFull(); }), buckets.end());
-        if (buckets.size() == 0) {
+    CoinJoinResult getSumCount(std::vector<int64_t> values, std::vector<int64_t> bucketGoals, size_t maxDepth) {
+        // Buckets with a goal of zero or less are full from the start
+        bucketGoals.erase(std::remove_if(bucketGoals.begin(), bucketGoals.end(), [](int64_t goal) { return goal <= 0; }), bucketGoals.end());
+        if (bucketGoals.size() == 0) {
             return CoinJoinResult::True;
         }
         
-        if (values.size() == 0) {
+        std::sort(values.rbegin(), values.rend());
+        int64_t total = 0;
+        for (auto value : values) {
+            total += value;
+        }
+        int64_t totalGoal = 0;
+        for (auto goal : bucketGoals) {
+            totalGoal += goal;
+        }
+        if (totalGoal > total) {
             return CoinJoinResult::False;
         }
         
-        depth++;
-        
-        if (maxDepth != 0 && depth > maxDepth) {
-            return CoinJoinResult::Timeout;
+        if (bucketGoals.size() == 1) {
+            return CoinJoinResult::True;
         }
-        
-        std::sort(buckets.rbegin(), buckets.rend());
-        
-        int64_t lastValue = values.back();
-        values.pop_back();
-        valueLeft -= lastValue;
-        for (auto &bucket : buckets) {
-            int64_t remaining = totalRemaining - bucket.remaining();
-            bucket.addInput(lastValue);
-            remaining += bucket.remaining();
-            auto res = _getSumCount(values, buckets, remaining, valueLeft, maxDepth, depth);
-            if (res != CoinJoinResult::False) {
-                return res;
+        if (bucketGoals.size() == 2 && values.size() > maxSmallSearchValues) {
+            auto res = twoBucketSubsetSums(values, total, bucketGoals[0], bucketGoals[1]);
+            if (res) {
+                return *res;
             }
-            bucket.removeInput(lastValue);
         }
-        values.push_back(lastValue);
-        return CoinJoinResult::False;
-    }
-    
-    
-    CoinJoinResult getSumCount(std::vector<int64_t> &values, std::vector<int64_t> bucketGoals, size_t maxDepth) {
-        std::sort(values.begin(), values.end());
+            
         std::sort(bucketGoals.rbegin(), bucketGoals.rend());
-        
-        int64_t valueLeft = 0;
-        for (auto value : values) {
-            valueLeft += value;
-        }
-        
-        int64_t totalRemaining = 0;
-        for (auto goal : bucketGoals) {
-            totalRemaining += goal;
-        }
-        
-        std::vector<OutputBucket> buckets;
-        buckets.reserve(bucketGoals.size());
-        for (auto goal : bucketGoals) {
-            buckets.emplace_back(goal);
-        }
-        size_t depth = 0;
-        return _getSumCount(values, buckets, totalRemaining, valueLeft, maxDepth, depth);
+        return BucketSearch(std::move(values), std::move(bucketGoals), maxDepth).run();
     }
     
     
@@ -260,7 +409,7 @@ namespace heuristics {
             }
         }
         
-        return getSumCount(values, bucketGoals, maxDepth);
+        return getSumCount(std::move(values), std::move(bucketGoals), maxDepth);
     }
     
     CoinJoinResult isPossibleCoinjoin(const Transaction &tx, int64_t minBaseFee, double percentageFee, size_t maxDepth) {
@@ -334,7 +483,48 @@ namespace heuristics {
         
         std::vector<int64_t> bucketGoals = {goalValue, goalValue};
         
-        return getSumCount(values, bucketGoals, maxDepth);
+        return getSumCount(std::move(values), std::move(bucketGoals), maxDepth);
+    }
+    
+    CoinJoinClassifier::CoinJoinClassifier(BlockRange &chain, int64_t minBaseFee_, double percentageFee_, size_t maxDepth_) : minBaseFee(minBaseFee_), percentageFee(percentageFee_), maxDepth(maxDepth_), txCount(chain.size() > 0 ? chain.endTxIndex() : 0), results(new std::atomic<uint8_t>[txCount]()) {}
+    
+    CoinJoinResult CoinJoinClassifier::cached(const Transaction &tx, unsigned int shift, CoinJoinResult (*heuristic)(const Transaction &, int64_t, double, size_t)) {
+        if (tx.txNum >= txCount) {
+            return heuristic(tx, minBaseFee, percentageFee, maxDepth);
+        }
+        auto &entry = results[tx.txNum];
+        auto stored = (entry.load(std::memory_order_relaxed) >> shift) & 3;
+        if (stored != 0) {
+            return static_cast<CoinJoinResult>(stored - 1);
+        }
+        auto result = heuristic(tx, minBaseFee, percentageFee, maxDepth);
+        // Threads racing on the same transaction store the same bits
+        entry.fetch_or(static_cast<uint8_t>((static_cast<unsigned int>(result) + 1) << shift), std::memory_order_relaxed);
+        return result;
+    }
+    
+    CoinJoinResult CoinJoinClassifier::isPossibleCoinjoin(const Transaction &tx) {
+        return cached(tx, 0, heuristics::isPossibleCoinjoin);
+    }
+    
+    CoinJoinResult CoinJoinClassifier::isCoinjoinExtra(const Transaction &tx) {
+        return cached(tx, 2, heuristics::isCoinjoinExtra);
+    }
+    
+    void CoinJoinClassifier::classify(BlockRange &blocks) {
+        auto mapFunc = [&](const BlockRange &segment) {
+            for (auto block : segment) {
+                for (auto tx : block) {
+                    isPossibleCoinjoin(tx);
+                    isCoinjoinExtra(tx);
+                }
+            }
+            return 0;
+        };
+        auto reduceFunc = [](int &a, int &) -> int & {
+            return a;
+        };
+        blocks.mapReduce<int>(mapFunc, reduceFunc);
     }
     
     bool isDeanonTx(const Transaction &tx) {
@@ -10,6 +10,7 @@
 
 #include "address_index.hpp"
 #include "address_info.hpp"
+#include "address_postings.hpp"
 #include "column_iterator.hpp"
 #include "dedup_address_info.hpp"
 #include "memory_view.hpp"
@@ -26,9 +27,15 @@
 #include <sstream>
 
 namespace blocksci {
+    namespace {
+        // Number of added outputs that are buffered in memory before they are written as posting runs
+        constexpr size_t maxPendingOutputs = 64'000'000;
 
-    AddressIndex::AddressIndex(const filesystem::path &path, bool readonly) {
-        rocksdb::Options options;
+        // Number of posting runs of one type after which they are merged into its base, each run adds a search to a lookup
+        constexpr size_t maxPostingRuns = 8;
+    }
+
+    AddressIndex::AddressIndex(const filesystem::path &path, bool readonly_) : postingsDirectory(path/"postings"), bulkLoadDirectory(path/"bulk_load"), readonly(readonly_) {
         // Optimize RocksDB. This is the easiest way to get RocksDB to perform well
         options.IncreaseParallelism();
         options.OptimizeLevelStyleCompaction();
@@ -68,16 +75,125 @@ namespace blocksci {
         for (auto handle : columnHandlePtrs) {
             columnHandles.emplace_back(std::unique_ptr<rocksdb::ColumnFamilyHandle>(handle));
         }
+        bulkLoaders.resize(columnHandles.size());
+
+        if (!readonly) {
+            if (!postingsDirectory.exists()) {
+                filesystem::create_directory(postingsDirectory);
+            }
+            for (size_t i = 0; i < AddressType::size; i++) {
+                recoverPostings(postingsDirectory, static_cast<AddressType::Enum>(i));
+            }
+            pendingOutputs.resize(AddressType::size);
+        }
+        for (size_t i = 0; i < AddressType::size; i++) {
+            postings.push_back(std::make_unique<AddressPostings>(postingsDirectory, static_cast<AddressType::Enum>(i)));
+        }
+        if (!readonly) {
+            convertOutputColumns();
+        }
     }
 
     AddressIndex::~AddressIndex() = default;
 
+    void AddressIndex::convertOutputColumns() {
+        for (size_t i = 0; i < AddressType::size; i++) {
+            auto type = static_cast<AddressType::Enum>(i);
+            if (postings[i]->exists()) {
+                continue;
+            }
+            // Keys of an address are contiguous and sorted by output, so they can be added like new outputs
+            auto it = getOutputIterator(type);
+            bool hasEntries = false;
+            for (it->SeekToFirst(); it->Valid(); it->Next()) {
+                auto key = it->key();
+                uint32_t scriptNum;
+                InoutPointer pointer;
+                uint8_t txNumData[4];
+                uint8_t outputNumData[2];
+                memcpy(&scriptNum, key.data(), sizeof(scriptNum));
+                memcpy(txNumData, key.data() + sizeof(scriptNum), 4);
+                memcpy(outputNumData, key.data() + sizeof(scriptNum) + 4, 2);
+                endian::big_endian::get(pointer.txNum, txNumData);
+                endian::big_endian::get(pointer.inoutNum, outputNumData);
+                pendingOutputs[i].emplace_back(scriptNum, pointer);
+                if (pendingOutputs[i].size() >= maxPendingOutputs) {
+                    writePostingRun(postingsDirectory, type, pendingOutputs[i]);
+                }
+                hasEntries = true;
+            }
+            writePostingRun(postingsDirectory, type, pendingOutputs[i]);
+            mergePostings(postingsDirectory, type);
+            postings[i] = std::make_unique<AddressPostings>(postingsDirectory, type);
+            
+            if (hasEntries) {
+                // All keys are 10 bytes long, so they sort before this one
+                std::string endKey(11, '\xff');
+                db->DeleteRange(rocksdb::WriteOptions{}, getOutputColumn(type).get(), rocksdb::Slice{}, endKey);
+                db->CompactRange(rocksdb::CompactRangeOptions{}, getOutputColumn(type).get(), nullptr, nullptr);
+            }
+        }
+    }
+
+    void AddressIndex::writePendingOutputs() {
+        for (size_t i = 0; i < AddressType::size; i++) {
+            if (!pendingOutputs[i].empty()) {
+                auto type = static_cast<AddressType::Enum>(i);
+                writePostingRun(postingsDirectory, type, pendingOutputs[i]);
+                postings[i] = std::make_unique<AddressPostings>(postingsDirectory, type);
+            }
+        }
+        pendingOutputCount = 0;
+    }
+
+    void AddressIndex::mergeOutputPostings(size_t minRuns) {
+        for (size_t i = 0; i < AddressType::size; i++) {
+            if (postings[i]->runCount() >= minRuns) {
+                auto type = static_cast<AddressType::Enum>(i);
+                mergePostings(postingsDirectory, type);
+                postings[i] = std::make_unique<AddressPostings>(postingsDirectory, type);
+            }
+        }
+    }
+
+    void AddressIndex::finish() {
+        if (!readonly) {
+            writePendingOutputs();
+            mergeOutputPostings(maxPostingRuns);
+        }
+    }
+
     void AddressIndex::compactDB() {
+        if (!readonly) {
+            writePendingOutputs();
+            mergeOutputPostings(1);
+        }
         for (auto &column : columnHandles) {
             db->CompactRange(rocksdb::CompactRangeOptions{}, column.get(), nullptr, nullptr);
         }
     }
 
+    void AddressIndex::startBulkLoad() {
+        if (!bulkLoadDirectory.exists()) {
+            filesystem::create_directory(bulkLoadDirectory);
+        }
+        for (size_t i = 0; i < AddressType::size; i++) {
+            auto type = static_cast<AddressType::Enum>(i);
+            bulkLoaders[AddressType::size + i] = std::make_unique<ColumnBulkLoader>(bulkLoadDirectory, addressName(type) + "_nested");
+        }
+    }
+
+    void AddressIndex::finishBulkLoad() {
+        std::vector<rocksdb::ColumnFamilyHandle *> columns;
+        for (auto &column : columnHandles) {
+            columns.push_back(column.get());
+        }
+        finishBulkLoaders(*db, bulkLoaders, columns, options);
+        for (auto &loader : bulkLoaders) {
+            loader.reset();
+        }
+    }
+
     const std::unique_ptr<rocksdb::ColumnFamilyHandle> &AddressIndex::getOutputColumn(AddressType::Enum type) const {
         return columnHandles[static_cast<size_t>(type)];
     }
@@ -87,6 +203,12 @@ namespace blocksci {
     }
 
     ranges::any_view<InoutPointer, ranges::category::forward> AddressIndex::getOutputPointers(const RawAddress &address) const {
+        auto &typePostings = *postings[static_cast<size_t>(address.type)];
+        if (typePostings.exists()) {
+            return PostingListRange{typePostings.getSpans(address.scriptNum)};
+        }
+        
+        // Indexes that haven't been converted to posting lists yet
         auto prefixData = reinterpret_cast<const char *>(&address.scriptNum);
         std::vector<char> prefix(prefixData, prefixData + sizeof(address.scriptNum));  // vector with scriptNum bytes
         auto rawOutputPointerRange = ColumnIterator(db.get(), getOutputColumn(address.type).get(), prefix);
@@ -134,32 +256,29 @@ namespace blocksci {
             }};
             std::string sliceStr;
             rocksdb::Slice key{rocksdb::SliceParts{keyParts.data(), keyParts.size()}, &sliceStr};
-            auto &nestedColumn = getNestedColumn(childAddress.type);
-            batch.Put(nestedColumn.get(), key, rocksdb::Slice{});
+            auto &loader = bulkLoaders[AddressType::size + static_cast<size_t>(childAddress.type)];
+            if (loader) {
+                loader->add(key, rocksdb::Slice{});
+            } else {
+                auto &nestedColumn = getNestedColumn(childAddress.type);
+                batch.Put(nestedColumn.get(), key, rocksdb::Slice{});
+            }
         }
         writeBatch(batch);
     }
 
     void AddressIndex::addOutputAddresses(std::vector<std::pair<RawAddress, InoutPointer>> outputCache) {
-        rocksdb::WriteBatch batch;
+        if (readonly) {
+            throw std::runtime_error("Cannot add outputs to an address index that was opened read-only");
+        }
         for (auto &pair : outputCache) {
-            const RawAddress &address = pair.first;
-            const InoutPointer &pointer = pair.second;
-            uint8_t txNumData[4];
-            uint8_t outputNumData[2];
-            endian::big_endian::put(pointer.txNum, txNumData);
-            endian::big_endian::put(pointer.inoutNum, outputNumData);
-            std::array<rocksdb::Slice, 3> keyParts = {{
-                rocksdb::Slice(reinterpret_cast<const char *>(&address.scriptNum), sizeof(address.scriptNum)),
-                rocksdb::Slice(reinterpret_cast<const char *>(&txNumData[0]), 4),
-                rocksdb::Slice(reinterpret_cast<const char *>(&outputNumData[0]), 2)
-            }};
-            std::string sliceStr;
-            rocksdb::Slice key{rocksdb::SliceParts{keyParts.data(), keyParts.size()}, &sliceStr};
-            auto &outputColumn = getOutputColumn(address.type);
-            batch.Put(outputColumn.get(), key, rocksdb::Slice{});
+            pendingOutputs[static_cast<size_t>(pair.first.type)].emplace_back(pair.first.scriptNum, pair.second);
+        }
+        pendingOutputCount += outputCache.size();
+        if (pendingOutputCount >= maxPendingOutputs) {
+            writePendingOutputs();
+            mergeOutputPostings(maxPostingRuns);
         }
-        writeBatch(batch);
     }
 
     /**
@@ -9,8 +9,11 @@
 #ifndef address_index_hpp
 #define address_index_hpp
 
+#include "column_bulk_loader.hpp"
+
 #include <blocksci/core/address_types.hpp>
 #include <blocksci/core/core_fwd.hpp>
+#include <blocksci/core/inout_pointer.hpp>
 
 #include <range/v3/view/any_view.hpp>
 #include <range/v3/utility/optional.hpp>
@@ -26,11 +29,12 @@
 
 namespace blocksci {
     struct DedupAddress;
+    class AddressPostings;
     class RawAddressOutputRange;
 
-    /** Provides access to address indexes (RocksDB database)
+    /** Provides access to address indexes (memory-mapped posting lists and a RocksDB database)
      *
-     * This RocksDB database stores information about which outputs a given address
+     * The index stores information about which outputs a given address
      * is used in as well as information about how different addresses relate to each other.
      *
      * Directory: addressesDb/
@@ -38,16 +42,16 @@ namespace blocksci {
      * The address index contains two sets of tables:
      *
      * 1) The first set of tables contains a mapping of addresses to outputs that are sent to those addresses.
-     *    The index is usually queried by scriptNum prefix to get all entries for one address.
-     *    This index makes it each to access all locations on the Blockchain where a particular address occurs
-     *    though this is significantly slower than operations that do not require access to the RocksDB database.
+     *    For every address type, the outputs of each address are stored as a sorted, delta and varint encoded posting list
+     *    that is found through an offsets array indexed by scriptNum, @see blocksci::AddressPostings.
+     *    This index makes it easy to access all locations on the Blockchain where a particular address occurs.
      *
-     *    ColumnDescriptors: Every AddressType as its name and "_output" as a suffix. @see blocksci::AddressType::all() @see blocksci::addressName()
-     *                       Eg. "pubkey_output", "pubkeyhash_output", "multisig_pubkey_output" etc.
+     *    Directory: addressesDb/postings/
      *
-     *    Key/value format:
-     *        - Key: uint32_t scriptNum, uint8_t[4] txNum, uint8_t[2] outputNumInTx
-     *        - Value: <empty>
+     *    Indexes created before the posting lists existed stored these links in RocksDB, in tables named after every AddressType
+     *    with "_output" as a suffix and keys made of uint32_t scriptNum, uint8_t[4] txNum, uint8_t[2] outputNumInTx.
+     *    They are still read from there for types that haven't been converted yet. The next update of the index moves them
+     *    into posting lists.
      *
      * 2) The second set of tables store information how certain address types are nested inside each other.
      *    The two places this occurs are with p2sh addresses wrapping other addresses and with multisig addresses containing pubkeys.
@@ -68,6 +72,22 @@ namespace blocksci {
         /** RocksDB column handles, one for every AddressType and the suffixes "_nested" and "_output", see above for details */
         std::vector<std::unique_ptr<rocksdb::ColumnFamilyHandle>> columnHandles;
 
+        rocksdb::Options options;
+
+        /** Loaders of the columns that are being bulk loaded, indexed like columnHandles, null for other columns */
+        std::vector<std::unique_ptr<ColumnBulkLoader>> bulkLoaders;
+
+        filesystem::path postingsDirectory;
+        filesystem::path bulkLoadDirectory;
+        bool readonly;
+
+        /** Posting lists of the outputs, one for every AddressType */
+        std::vector<std::unique_ptr<AddressPostings>> postings;
+
+        /** Outputs added since the last posting run was written, one list of (scriptNum, output) for every AddressType */
+        std::vector<std::vector<std::pair<uint32_t, InoutPointer>>> pendingOutputs;
+        size_t pendingOutputCount = 0;
+
         const std::unique_ptr<rocksdb::ColumnFamilyHandle> &getOutputColumn(AddressType::Enum type) const;
         const std::unique_ptr<rocksdb::ColumnFamilyHandle> &getNestedColumn(AddressType::Enum type) const;
         
@@ -85,6 +105,15 @@ namespace blocksci {
             db->Write(options, &batch);
         }
         
+        /** Moves the outputs of types that are still stored in RocksDB into posting lists */
+        void convertOutputColumns();
+        
+        /** Writes the pending outputs of every type as a new posting run */
+        void writePendingOutputs();
+        
+        /** Merges the posting runs of every type that has at least minRuns (at least 1) of them into its base */
+        void mergeOutputPostings(size_t minRuns);
+        
     public:
         
         AddressIndex(const filesystem::path &path, bool readonly);
@@ -99,15 +128,23 @@ namespace blocksci {
         
         void addNestedAddresses(std::vector<std::pair<RawAddress, DedupAddress>> nestedCache);
 
-        /** Add a link between the given address and the given output to the index
+        /** Add links between the given addresses and outputs to the index
          *
-         * Key format: scriptNum, txNum, outputNumInTx
-         * Value format: <empty>
+         * Outputs have to be added in ascending order. They are buffered and written as posting runs, which are merged
+         * into the posting lists once a type has too many runs or when the index is compacted. Outputs that are still
+         * buffered when the index is closed without calling finish() are lost.
          */
         void addOutputAddresses(std::vector<std::pair<RawAddress, InoutPointer>> outputCache);
+        
+        /** Write the buffered outputs as posting runs and merge the runs of types that have too many of them */
+        void finish();
 
-        /** Compact the underlying RocksDB database */
+        /** Merge all added outputs into the posting lists and compact the underlying RocksDB database */
         void compactDB();
+        
+        /** Buffer the nested address rows until finishBulkLoad() and ingest them as sorted SST files, @see blocksci::HashIndex::startBulkLoad() */
+        void startBulkLoad();
+        void finishBulkLoad();
     };
 }
 
@@ -8,17 +8,21 @@
 #ifndef address_output_range_h
 #define address_output_range_h
 
+#include "address_postings.hpp"
+
 #include <blocksci/core/core_fwd.hpp>
 
 #include <range/v3/view/facade.hpp>
 
-namespace rocksdb {
-    class Iterator;
-}
+#include <vector>
 
 namespace blocksci {
     class AddressIndex;
     
+    /** Range over all (address, output) links of the address index, ordered by address type, scriptNum and output
+     *
+     * Covers the address types whose outputs are stored in posting lists.
+     */
     class RawAddressOutputRange : public ranges::view_facade<RawAddressOutputRange> {
         friend ranges::range_access;
         AddressIndex *index;
@@ -27,18 +31,14 @@ namespace blocksci {
         private:
             AddressIndex *index;
             int rowNum = 0;
-            int currentTypeIndex = -1;
-            std::unique_ptr<rocksdb::Iterator> it;
+            int currentTypeIndex = 0;
+            uint32_t scriptNum = 0;
+            std::vector<PostingSpan> spans;
+            PostingListDecoder decoder;
         public:
             cursor();
             explicit cursor(AddressIndex &index_);
             
-            ~cursor();
-            
-            cursor(const cursor &other);
-            
-            cursor &operator=(const cursor &other);
-            
             std::pair<RawAddress, InoutPointer> read() const;
             
             bool equal(ranges::default_sentinel_t) const;
@@ -50,7 +50,6 @@ namespace blocksci {
             void next();
             
             void advanceToNext();
-            void prev();
         };
         
         cursor begin_cursor() const {
@@ -0,0 +1,256 @@
+//
+//  address_postings.cpp
+//  blocksci
+//
+
+#include "address_postings.hpp"
+#include "address_info.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+
+namespace blocksci {
+    namespace {
+        // Number of encoded bytes that are collected before they are written out
+        constexpr size_t postingWriteBufferSize = 1 << 24;
+
+        filesystem::path typeFilePath(const filesystem::path &directory, AddressType::Enum type, const std::string &suffix) {
+            return directory/(addressName(type) + suffix);
+        }
+
+        /** Appends the pointers of a sorted list, dropping the ones that don't come after the last appended pointer */
+        struct PostingListEncoder {
+            std::vector<uint8_t> &bytes;
+            uint64_t lastKey = 0;
+            bool empty = true;
+
+            explicit PostingListEncoder(std::vector<uint8_t> &bytes_) : bytes(bytes_) {}
+
+            void add(uint64_t key) {
+                if (!empty && key <= lastKey) {
+                    return;
+                }
+                appendVarint(bytes, key - lastKey);
+                lastKey = key;
+                empty = false;
+            }
+        };
+
+        void writeBytes(std::ofstream &file, std::vector<uint8_t> &bytes) {
+            file.write(reinterpret_cast<const char *>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+            bytes.clear();
+        }
+
+        void replaceFile(const std::string &tempPath, const std::string &path) {
+            if (std::rename(tempPath.c_str(), path.c_str()) != 0) {
+                std::remove(tempPath.c_str());
+                throw std::runtime_error("Failed to replace " + path);
+            }
+        }
+    }
+
+    AddressPostings::Run::Run(const filesystem::path &directory, AddressType::Enum type, size_t runNum) :
+    indexFile(runIndexFilePath(directory, type, runNum)),
+    postingsFile(runPostingsFilePath(directory, type, runNum)) {}
+
+    AddressPostings::AddressPostings(const filesystem::path &directory, AddressType::Enum type) :
+    offsetsFile(offsetsFilePath(directory, type)),
+    postingsFile(postingsFilePath(directory, type)),
+    hasBase(filesystem::path{offsetsFilePath(directory, type).str() + ".dat"}.exists()) {
+        for (size_t runNum = 0; filesystem::path{runIndexFilePath(directory, type, runNum).str() + ".dat"}.exists(); runNum++) {
+            runs.push_back(std::make_unique<Run>(directory, type, runNum));
+        }
+    }
+
+    filesystem::path AddressPostings::offsetsFilePath(const filesystem::path &directory, AddressType::Enum type) {
+        return typeFilePath(directory, type, "_offsets");
+    }
+
+    filesystem::path AddressPostings::postingsFilePath(const filesystem::path &directory, AddressType::Enum type) {
+        return typeFilePath(directory, type, "_postings");
+    }
+
+    filesystem::path AddressPostings::runIndexFilePath(const filesystem::path &directory, AddressType::Enum type, size_t runNum) {
+        return typeFilePath(directory, type, "_run" + std::to_string(runNum) + "_index");
+    }
+
+    filesystem::path AddressPostings::runPostingsFilePath(const filesystem::path &directory, AddressType::Enum type, size_t runNum) {
+        return typeFilePath(directory, type, "_run" + std::to_string(runNum) + "_postings");
+    }
+
+    uint32_t AddressPostings::maxScriptNum() const {
+        uint32_t maxNum = 0;
+        if (offsetsFile.size() > 1) {
+            maxNum = static_cast<uint32_t>(offsetsFile.size() - 2);
+        }
+        for (auto &run : runs) {
+            if (run->indexFile.size() > 0) {
+                maxNum = std::max(maxNum, run->indexFile[run->indexFile.size() - 1]->scriptNum);
+            }
+        }
+        return maxNum;
+    }
+
+    std::vector<PostingSpan> AddressPostings::getSpans(uint32_t scriptNum) const {
+        std::vector<PostingSpan> spans;
+        getSpans(scriptNum, spans);
+        return spans;
+    }
+
+    void AddressPostings::getSpans(uint32_t scriptNum, std::vector<PostingSpan> &spans) const {
+        spans.clear();
+        if (static_cast<OffsetType>(scriptNum) + 1 < offsetsFile.size()) {
+            auto begin = *offsetsFile[scriptNum];
+            auto end = *offsetsFile[static_cast<OffsetType>(scriptNum) + 1];
+            if (begin != end) {
+                auto data = reinterpret_cast<const uint8_t *>(postingsFile.getDataAtOffset(0));
+                spans.push_back({data + begin, data + end});
+            }
+        }
+        for (auto &run : runs) {
+            auto entryCount = run->indexFile.size();
+            if (entryCount == 0) {
+                continue;
+            }
+            auto firstEntry = run->indexFile[0];
+            auto lastEntry = firstEntry + entryCount;
+            auto it = std::lower_bound(firstEntry, lastEntry, scriptNum, [](const PostingRunEntry &entry, uint32_t num) {
+                return entry.scriptNum < num;
+            });
+            if (it != lastEntry && it->scriptNum == scriptNum) {
+                auto end = it + 1 != lastEntry ? (it + 1)->offset : static_cast<uint64_t>(run->postingsFile.size());
+                auto data = reinterpret_cast<const uint8_t *>(run->postingsFile.getDataAtOffset(0));
+                spans.push_back({data + it->offset, data + end});
+            }
+        }
+    }
+
+    void writePostingRun(const filesystem::path &directory, AddressType::Enum type, std::vector<std::pair<uint32_t, InoutPointer>> &entries) {
+        if (entries.empty()) {
+            return;
+        }
+        // Stable so that the outputs of each address stay in the order they were added in
+        std::stable_sort(entries.begin(), entries.end(), [](const auto &a, const auto &b) {
+            return a.first < b.first;
+        });
+
+        size_t runNum = 0;
+        while (filesystem::path{AddressPostings::runIndexFilePath(directory, type, runNum).str() + ".dat"}.exists()) {
+            runNum++;
+        }
+
+        std::ofstream postingsFile(AddressPostings::runPostingsFilePath(directory, type, runNum).str() + ".dat", std::ios::binary);
+        std::vector<PostingRunEntry> index;
+        std::vector<uint8_t> bytes;
+        uint64_t offset = 0;
+        auto it = entries.begin();
+        while (it != entries.end()) {
+            auto scriptNum = it->first;
+            PostingRunEntry entry{};
+            entry.scriptNum = scriptNum;
+            entry.offset = offset + bytes.size();
+            index.push_back(entry);
+            PostingListEncoder encoder{bytes};
+            for (; it != entries.end() && it->first == scriptNum; ++it) {
+                encoder.add(postingKey(it->second));
+            }
+            if (bytes.size() >= postingWriteBufferSize) {
+                offset += bytes.size();
+                writeBytes(postingsFile, bytes);
+            }
+        }
+        writeBytes(postingsFile, bytes);
+        postingsFile.close();
+
+        // The index file is written last since its presence marks the run as complete
+        auto indexPath = AddressPostings::runIndexFilePath(directory, type, runNum).str() + ".dat";
+        {
+            std::ofstream indexFile(indexPath + ".tmp", std::ios::binary);
+            indexFile.write(reinterpret_cast<const char *>(index.data()), static_cast<std::streamsize>(index.size() * sizeof(PostingRunEntry)));
+            indexFile.close();
+            if (postingsFile.fail() || indexFile.fail()) {
+                throw std::runtime_error("Failed to write posting run for " + addressName(type));
+            }
+        }
+        replaceFile(indexPath + ".tmp", indexPath);
+        entries.clear();
+    }
+
+    void mergePostings(const filesystem::path &directory, AddressType::Enum type) {
+        auto offsetsPath = AddressPostings::offsetsFilePath(directory, type).str() + ".dat";
+        auto postingsPath = AddressPostings::postingsFilePath(directory, type).str() + ".dat";
+        recoverPostings(directory, type);
+        size_t runCount;
+        {
+            AddressPostings postings{directory, type};
+            if (postings.exists() && postings.runCount() == 0) {
+                return;
+            }
+            runCount = postings.runCount();
+
+            std::ofstream offsetsFile(offsetsPath + ".tmp", std::ios::binary);
+            std::ofstream postingsFile(postingsPath + ".tmp", std::ios::binary);
+            auto maxScriptNum = postings.maxScriptNum();
+            std::vector<uint64_t> offsets;
+            std::vector<uint8_t> bytes;
+            std::vector<PostingSpan> spans;
+            uint64_t offset = 0;
+            for (uint64_t scriptNum = 0; scriptNum <= maxScriptNum; scriptNum++) {
+                offsets.push_back(offset + bytes.size());
+                PostingListEncoder encoder{bytes};
+                postings.getSpans(static_cast<uint32_t>(scriptNum), spans);
+                PostingListDecoder decoder;
+                while (decoder.next(spans)) {
+                    encoder.add(decoder.key);
+                }
+                if (bytes.size() >= postingWriteBufferSize) {
+                    offset += bytes.size();
+                    writeBytes(postingsFile, bytes);
+                }
+                if (offsets.size() * sizeof(uint64_t) >= postingWriteBufferSize) {
+                    offsetsFile.write(reinterpret_cast<const char *>(offsets.data()), static_cast<std::streamsize>(offsets.size() * sizeof(uint64_t)));
+                    offsets.clear();
+                }
+            }
+            offsets.push_back(offset + bytes.size());
+            writeBytes(postingsFile, bytes);
+            offsetsFile.write(reinterpret_cast<const char *>(offsets.data()), static_cast<std::streamsize>(offsets.size() * sizeof(uint64_t)));
+            offsetsFile.close();
+            postingsFile.close();
+            if (offsetsFile.fail() || postingsFile.fail()) {
+                std::remove((offsetsPath + ".tmp").c_str());
+                std::remove((postingsPath + ".tmp").c_str());
+                throw std::runtime_error("Failed to merge posting lists for " + addressName(type));
+            }
+        }
+
+        // A leftover offsets file without a postings file tells recoverPostings that the postings were replaced already
+        replaceFile(postingsPath + ".tmp", postingsPath);
+        replaceFile(offsetsPath + ".tmp", offsetsPath);
+        // Runs that survive an interruption here only repeat outputs of the new base, which readers and the next merge skip.
+        // They are removed from the last one down, since a gap in the run numbers would hide the runs after it.
+        for (size_t runNum = runCount; runNum-- > 0;) {
+            filesystem::path{AddressPostings::runIndexFilePath(directory, type, runNum).str() + ".dat"}.remove_file();
+            filesystem::path{AddressPostings::runPostingsFilePath(directory, type, runNum).str() + ".dat"}.remove_file();
+        }
+    }
+
+    void recoverPostings(const filesystem::path &directory, AddressType::Enum type) {
+        auto offsetsPath = AddressPostings::offsetsFilePath(directory, type).str() + ".dat";
+        auto postingsPath = AddressPostings::postingsFilePath(directory, type).str() + ".dat";
+        filesystem::path offsetsTemp{offsetsPath + ".tmp"};
+        filesystem::path postingsTemp{postingsPath + ".tmp"};
+        if (offsetsTemp.exists() && !postingsTemp.exists()) {
+            replaceFile(offsetsTemp.str(), offsetsPath);
+        } else {
+            if (offsetsTemp.exists()) {
+                offsetsTemp.remove_file();
+            }
+            if (postingsTemp.exists()) {
+                postingsTemp.remove_file();
+            }
+        }
+    }
+} // namespace blocksci
@@ -0,0 +1,214 @@
+//
+//  address_postings.hpp
+//  blocksci
+//
+
+#ifndef address_postings_hpp
+#define address_postings_hpp
+
+#include "file_mapper.hpp"
+
+#include <blocksci/core/address_types.hpp>
+#include <blocksci/core/inout_pointer.hpp>
+
+#include <range/v3/view/facade.hpp>
+
+#include <wjfilesystem/path.h>
+
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace blocksci {
+    /** Encoded output pointers of one address in one posting file, see AddressPostings for the format */
+    struct PostingSpan {
+        const uint8_t *begin;
+        const uint8_t *end;
+    };
+
+    /** Entry of the index of a posting run, the list of scriptNum ends where the list of the next entry begins */
+    struct PostingRunEntry {
+        uint32_t scriptNum;
+        uint64_t offset;
+    };
+
+    /** Sort key of an output pointer, which is also what the posting lists store the deltas of */
+    inline uint64_t postingKey(const InoutPointer &pointer) {
+        return (static_cast<uint64_t>(pointer.txNum) << 16) | pointer.inoutNum;
+    }
+
+    inline InoutPointer postingPointer(uint64_t key) {
+        return {static_cast<uint32_t>(key >> 16), static_cast<uint16_t>(key & 0xFFFF)};
+    }
+
+    /** Appends value as a little-endian base 128 varint */
+    inline void appendVarint(std::vector<uint8_t> &bytes, uint64_t value) {
+        while (value >= 0x80) {
+            bytes.push_back(static_cast<uint8_t>(value | 0x80));
+            value >>= 7;
+        }
+        bytes.push_back(static_cast<uint8_t>(value));
+    }
+
+    inline const uint8_t *readVarint(const uint8_t *pos, uint64_t &value) {
+        value = 0;
+        int shift = 0;
+        while (*pos & 0x80) {
+            value |= static_cast<uint64_t>(*pos & 0x7F) << shift;
+            shift += 7;
+            pos++;
+        }
+        value |= static_cast<uint64_t>(*pos) << shift;
+        return pos + 1;
+    }
+
+    /** Decodes the output pointers of one address stored in a sequence of posting spans
+     *
+     * A run written again by an update that was interrupted before it saved its progress repeats outputs of the spans
+     * before it. Since every list is ascending, only keys above the last decoded one are returned, which drops them.
+     */
+    struct PostingListDecoder {
+        size_t spanIndex = 0;
+        const uint8_t *pos = nullptr;
+        uint64_t spanKey = 0;
+        uint64_t key = 0;
+        bool hasKey = false;
+
+        /** Moves key to the next output of the list, returns false at its end */
+        bool next(const std::vector<PostingSpan> &spans) {
+            while (spanIndex < spans.size()) {
+                if (pos == nullptr) {
+                    // Every span starts its deltas from 0
+                    pos = spans[spanIndex].begin;
+                    spanKey = 0;
+                }
+                while (pos != spans[spanIndex].end) {
+                    uint64_t delta;
+                    pos = readVarint(pos, delta);
+                    spanKey += delta;
+                    if (!hasKey || spanKey > key) {
+                        key = spanKey;
+                        hasKey = true;
+                        return true;
+                    }
+                }
+                spanIndex++;
+                pos = nullptr;
+            }
+            return false;
+        }
+    };
+
+    /** Decodes the output pointers stored in a sequence of posting spans */
+    class PostingListRange : public ranges::view_facade<PostingListRange> {
+        friend ranges::range_access;
+        std::vector<PostingSpan> spans;
+
+        struct cursor {
+        private:
+            const std::vector<PostingSpan> *spans = nullptr;
+            PostingListDecoder decoder;
+        public:
+            cursor() = default;
+            explicit cursor(const std::vector<PostingSpan> &spans_) : spans(&spans_) {
+                decoder.next(*spans);
+            }
+
+            InoutPointer read() const {
+                return postingPointer(decoder.key);
+            }
+
+            bool equal(ranges::default_sentinel_t) const {
+                return decoder.spanIndex == spans->size();
+            }
+
+            bool equal(const cursor &other) const {
+                return decoder.spanIndex == other.decoder.spanIndex && decoder.pos == other.decoder.pos;
+            }
+
+            void next() {
+                decoder.next(*spans);
+            }
+        };
+
+        cursor begin_cursor() const {
+            return cursor{spans};
+        }
+
+        ranges::default_sentinel_t end_cursor() const {
+            return {};
+        }
+
+    public:
+        PostingListRange() = default;
+        explicit PostingListRange(std::vector<PostingSpan> spans_) : spans(std::move(spans_)) {}
+    };
+
+    /** Provides access to the lists of outputs sent to the addresses of one type
+     *
+     * Every list holds the output pointers of one address in ascending order, stored as the varint encoded difference
+     * to the previous pointer (the first one to 0), where a pointer is ordered by (txNum << 16 | outputNum).
+     *
+     * The outputs are kept in a compacted base and a number of runs. Each run holds the outputs added by one batch of
+     * updates, which come after all outputs of the base and of earlier runs unless an interrupted update wrote them
+     * again, and PostingListDecoder skips these. Runs are merged into the base by mergePostings, which the
+     * AddressIndex does once a type has too many runs or when it is compacted.
+     *
+     * Files: - <name>_offsets.dat: uint64_t offset of the list of every scriptNum in the base, followed by the end offset
+     *        - <name>_postings.dat: encoded lists of the base
+     *        - <name>_run<n>_index.dat: PostingRunEntry for every address with outputs in run n, sorted by scriptNum
+     *        - <name>_run<n>_postings.dat: encoded lists of run n
+     */
+    class AddressPostings {
+        struct Run {
+            FixedSizeFileMapper<PostingRunEntry> indexFile;
+            SimpleFileMapper<> postingsFile;
+
+            Run(const filesystem::path &directory, AddressType::Enum type, size_t runNum);
+        };
+
+        FixedSizeFileMapper<uint64_t> offsetsFile;
+        SimpleFileMapper<> postingsFile;
+        std::vector<std::unique_ptr<Run>> runs;
+        bool hasBase;
+
+    public:
+        AddressPostings(const filesystem::path &directory, AddressType::Enum type);
+
+        static filesystem::path offsetsFilePath(const filesystem::path &directory, AddressType::Enum type);
+        static filesystem::path postingsFilePath(const filesystem::path &directory, AddressType::Enum type);
+        static filesystem::path runIndexFilePath(const filesystem::path &directory, AddressType::Enum type, size_t runNum);
+        static filesystem::path runPostingsFilePath(const filesystem::path &directory, AddressType::Enum type, size_t runNum);
+
+        /** Whether the outputs of this type have been written to posting lists yet */
+        bool exists() const {
+            return hasBase;
+        }
+
+        size_t runCount() const {
+            return runs.size();
+        }
+
+        /** Highest scriptNum with a list in the base or any run */
+        uint32_t maxScriptNum() const;
+
+        /** Encoded lists of the given address, the one of the base followed by the ones of the runs */
+        std::vector<PostingSpan> getSpans(uint32_t scriptNum) const;
+        void getSpans(uint32_t scriptNum, std::vector<PostingSpan> &spans) const;
+    };
+
+    /** Writes the given (scriptNum, output) pairs as a new run of posting lists
+     *
+     * The pairs of each address have to be in ascending output order, which holds for outputs added in tx order.
+     */
+    void writePostingRun(const filesystem::path &directory, AddressType::Enum type, std::vector<std::pair<uint32_t, InoutPointer>> &entries);
+
+    /** Replaces the base and all runs of the given type by a new base holding all of their lists */
+    void mergePostings(const filesystem::path &directory, AddressType::Enum type);
+
+    /** Finishes or discards a merge of the given type that was interrupted, needs to be called before opening it for writing */
+    void recoverPostings(const filesystem::path &directory, AddressType::Enum type);
+} // namespace blocksci
+
+#endif /* address_postings_hpp */
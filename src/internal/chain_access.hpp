@@ -72,6 +72,16 @@ namespace blocksci {
          */
         FixedSizeFileMapper<int32_t> txVersionFile;
 
+        /** Stores the height of the block containing every transaction, indexed by tx number.
+         *
+         * Chains parsed before this file existed get it filled in by the next parser update that adds blocks. Until then, heights
+         * are resolved by a binary search over the blocks.
+         *
+         * File: chain/tx_block_height.dat
+         * Raw data format: [<int32_t blockHeightOfTx0>, <int32_t blockHeightOfTx1>, ...]
+         */
+        FixedSizeFileMapper<BlockHeight> txBlockHeightFile;
+
         /** Stores the blockchain-wide number of the first input for every transaction, indexed by tx number.
          *
          * File(s): - chain/firstInput.dat
@@ -93,6 +103,16 @@ namespace blocksci {
          */
         FixedSizeFileMapper<uint16_t> inputSpentOutputFile;
 
+        /** Stores the tx-internal number of the spending input plus one for every output, indexed by blockchain-wide output number.
+         *
+         * Lets the spending input of an output be found without scanning the inputs of the spending transaction. A value of 0 marks
+         * unspent outputs. Outputs beyond the end of the file are resolved by scanning the spending transaction.
+         *
+         * File: chain/output_spending_input.dat
+         * Raw data format: [<uint16_t spendingInputNumOfOutput0 + 1>, <uint16_t spendingInputNumOfOutput1 + 1>, ...]
+         */
+        FixedSizeFileMapper<uint16_t> outputSpendingInputFile;
+
         /** Stores the blockchain field sequence number for every input, indexed by blockchain-wide input number.
          *
          * File: chain/sequence.dat
@@ -159,9 +179,11 @@ namespace blocksci {
         blockCoinbaseFile(blockCoinbaseFilePath(baseDirectory)),
         txFile(txFilePath(baseDirectory)),
         txVersionFile(txVersionFilePath(baseDirectory)),
+        txBlockHeightFile(txBlockHeightFilePath(baseDirectory)),
         txFirstInputFile(firstInputFilePath(baseDirectory)),
         txFirstOutputFile(firstOutputFilePath(baseDirectory)),
         inputSpentOutputFile(inputSpentOutNumFilePath(baseDirectory)),
+        outputSpendingInputFile(outputSpendingInputFilePath(baseDirectory)),
         sequenceFile(sequenceFilePath(baseDirectory)),
         txHashesFile(txHashesFilePath(baseDirectory)),
         blocksIgnored(blocksIgnored),
@@ -189,6 +211,10 @@ namespace blocksci {
             return baseDirectory/"tx_version";
         }
 
+        static filesystem::path txBlockHeightFilePath(const filesystem::path &baseDirectory) {
+            return baseDirectory/"tx_block_height";
+        }
+
         static filesystem::path firstInputFilePath(const filesystem::path &baseDirectory) {
             return baseDirectory/"firstInput";
         }
@@ -205,11 +231,18 @@ namespace blocksci {
             return baseDirectory/"input_out_num";
         }
 
+        static filesystem::path outputSpendingInputFilePath(const filesystem::path &baseDirectory) {
+            return baseDirectory/"output_spending_input";
+        }
+
         BlockHeight getBlockHeight(uint32_t txIndex) const {
             reorgCheck();
             if (errorOnReorg && txIndex >= _maxLoadedTx) {
                 throw std::out_of_range("Transaction index out of range");
             }
+            if (txIndex < _maxLoadedTx && static_cast<OffsetType>(txIndex) < txBlockHeightFile.size()) {
+                return *txBlockHeightFile[txIndex];
+            }
             auto blockBegin = blockFile[0];
             auto blockEnd = blockFile[static_cast<OffsetType>(maxHeight) - 1] + 1;
             auto it = std::upper_bound(blockBegin, blockEnd, txIndex, [](uint32_t index, const RawBlock &b) {
@@ -249,6 +282,16 @@ namespace blocksci {
             return inputSpentOutputFile[static_cast<OffsetType>(*txFirstInputFile[index])];
         }
 
+        /** Get the tx-internal number of the input spending the given output plus one, or 0 if it isn't known */
+        uint16_t getSpendingInputNum(uint32_t txNum, uint16_t outputNum) const {
+            reorgCheck();
+            auto outputIndex = static_cast<OffsetType>(*txFirstOutputFile[txNum] + outputNum);
+            if (outputIndex < outputSpendingInputFile.size()) {
+                return *outputSpendingInputFile[outputIndex];
+            }
+            return 0;
+        }
+
         /** Get TxData object for given tx number */
         TxData getTxData(uint32_t index) const {
             reorgCheck();
@@ -312,7 +355,9 @@ namespace blocksci {
             txFirstInputFile.reload();
             txFirstOutputFile.reload();
             txVersionFile.reload();
+            txBlockHeightFile.reload();
             inputSpentOutputFile.reload();
+            outputSpendingInputFile.reload();
             txHashesFile.reload();
             sequenceFile.reload();
             setup();
@@ -12,6 +12,7 @@
 #include "dedup_address_info.hpp"
 #include "file_mapper.hpp"
 
+#include <blocksci/cluster/cluster_summary.hpp>
 #include <blocksci/core/raw_address.hpp>
 #include <blocksci/core/dedup_address.hpp>
 
@@ -19,6 +20,9 @@
 
 #include <wjfilesystem/path.h>
 
+#include <fstream>
+#include <memory>
+
 namespace blocksci {
     template<DedupAddressType::Enum type>
     struct ScriptClusterIndexFile : public FixedSizeFileMapper<uint32_t> {
@@ -41,6 +45,9 @@ namespace blocksci {
         
         ScriptClusterIndexTuple scriptClusterIndexFiles;
         
+        // Optional, recreated on reload since a rewritten file may have the same size as the mapped one
+        std::unique_ptr<FixedSizeFileMapper<ClusterSummary>> clusterSummaryFile;
+        BlockHeight summaryBlockCount = -1;
         
         friend class Cluster;
         
@@ -55,19 +62,54 @@ namespace blocksci {
         
     public:
         DataAccess &access;
+        std::string baseDirectory;
         
-        ClusterAccess(const std::string &baseDirectory, DataAccess &access_) :
-        clusterOffsetFile((filesystem::path{baseDirectory}/"clusterOffsets").str()),
-        clusterScriptsFile((filesystem::path{baseDirectory}/"clusterAddresses").str()),
+        ClusterAccess(const std::string &baseDirectory_, DataAccess &access_) :
+        clusterOffsetFile((filesystem::path{baseDirectory_}/"clusterOffsets").str()),
+        clusterScriptsFile((filesystem::path{baseDirectory_}/"clusterAddresses").str()),
         scriptClusterIndexFiles(blocksci::apply(DedupAddressType::all(), [&] (auto tag) {
             std::stringstream ss;
             ss << dedupAddressName(tag) << "_cluster_index";
-            return (filesystem::path{baseDirectory}/ss.str()).str();
+            return (filesystem::path{baseDirectory_}/ss.str()).str();
         })),
-        access(access_)  {
+        access(access_), baseDirectory(baseDirectory_)  {
             if (!(filesystem::path{baseDirectory}/"clusterAddresses.dat").exists()) {
                 throw std::runtime_error("Cluster data not found");
             }
+            reloadSummaries();
+        }
+        
+        static std::string summaryFilePath(const std::string &baseDirectory) {
+            return (filesystem::path{baseDirectory}/"clusterSummaries.dat").str();
+        }
+        
+        static std::string summaryInfoFilePath(const std::string &baseDirectory) {
+            return (filesystem::path{baseDirectory}/"clusterSummaryInfo.dat").str();
+        }
+        
+        void reloadSummaries() {
+            clusterSummaryFile.reset();
+            summaryBlockCount = -1;
+            std::ifstream infoFile(summaryInfoFilePath(baseDirectory), std::ios::binary);
+            BlockHeight blockCount;
+            if (infoFile.read(reinterpret_cast<char *>(&blockCount), sizeof(blockCount))) {
+                clusterSummaryFile = std::make_unique<FixedSizeFileMapper<ClusterSummary>>((filesystem::path{baseDirectory}/"clusterSummaries").str());
+                if (clusterSummaryFile->size() == clusterCount()) {
+                    summaryBlockCount = blockCount;
+                } else {
+                    clusterSummaryFile.reset();
+                }
+            }
+        }
+        
+        /** Number of blocks covered by the cluster summaries, -1 if there are none */
+        BlockHeight getSummaryBlockCount() const {
+            return summaryBlockCount;
+        }
+        
+        /** Summary of the given cluster, only valid if getSummaryBlockCount() isn't -1 */
+        const ClusterSummary *getClusterSummary(uint32_t clusterNum) const {
+            return (*clusterSummaryFile)[clusterNum];
         }
         
         static std::string offsetFilePath(const std::string &baseDirectory) {
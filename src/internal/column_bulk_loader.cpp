@@ -0,0 +1,176 @@
+//
+//  column_bulk_loader.cpp
+//  blocksci
+//
+
+#include "column_bulk_loader.hpp"
+
+#include <rocksdb/sst_file_writer.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <future>
+#include <numeric>
+#include <queue>
+#include <stdexcept>
+
+namespace blocksci {
+    namespace {
+        // Bytes of rows that are buffered before they are sorted and spilled to a run file
+        constexpr size_t maxBufferedBytes = 256 * 1024 * 1024;
+
+        // Rows read at once from every run file while merging
+        constexpr size_t mergeReadRows = 16384;
+
+        /** Reads the rows of one sorted run file in chunks */
+        struct RunReader {
+            std::ifstream file;
+            size_t rowSize;
+            std::vector<char> rows;
+            size_t rowCount = 0;
+            size_t pos = 0;
+
+            RunReader(const std::string &path, size_t rowSize_) : file(path, std::ios::binary), rowSize(rowSize_), rows(rowSize_ * mergeReadRows) {}
+
+            /** Moves to the next row, or the first one on a new reader. Returns false once all rows have been read */
+            bool next() {
+                pos++;
+                if (pos < rowCount) {
+                    return true;
+                }
+                file.read(rows.data(), static_cast<std::streamsize>(rows.size()));
+                rowCount = static_cast<size_t>(file.gcount()) / rowSize;
+                pos = 0;
+                return rowCount > 0;
+            }
+
+            const char *current() const {
+                return rows.data() + pos * rowSize;
+            }
+        };
+    }
+
+    ColumnBulkLoader::ColumnBulkLoader(filesystem::path directory_, std::string name_) : directory(std::move(directory_)), name(std::move(name_)) {}
+
+    ColumnBulkLoader::~ColumnBulkLoader() {
+        for (auto &runPath : runPaths) {
+            std::remove(runPath.c_str());
+        }
+    }
+
+    void ColumnBulkLoader::add(const rocksdb::Slice &key, const rocksdb::Slice &value) {
+        if (buffer.empty() && runPaths.empty()) {
+            keySize = key.size();
+            valueSize = value.size();
+        } else if (key.size() != keySize || value.size() != valueSize) {
+            throw std::runtime_error("Rows of bulk loaded column " + name + " must have a fixed size");
+        }
+        buffer.insert(buffer.end(), key.data(), key.data() + key.size());
+        buffer.insert(buffer.end(), value.data(), value.data() + value.size());
+        if (buffer.size() >= maxBufferedBytes) {
+            writeRun();
+        }
+    }
+
+    void ColumnBulkLoader::writeRun() {
+        auto rowCount = buffer.size() / rowSize();
+        std::vector<size_t> order(rowCount);
+        std::iota(order.begin(), order.end(), 0);
+        // Stable so that rows with the same key stay in the order they were added
+        std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+            return memcmp(buffer.data() + a * rowSize(), buffer.data() + b * rowSize(), keySize) < 0;
+        });
+
+        auto runPath = (directory/(name + "_run" + std::to_string(runPaths.size()) + ".tmp")).str();
+        std::ofstream file(runPath, std::ios::binary);
+        for (auto row : order) {
+            file.write(buffer.data() + row * rowSize(), static_cast<std::streamsize>(rowSize()));
+        }
+        file.close();
+        runPaths.push_back(runPath);
+        if (file.fail()) {
+            throw std::runtime_error("Failed to write sorted run " + runPath);
+        }
+        buffer.clear();
+    }
+
+    void ColumnBulkLoader::finish(rocksdb::DB &db, rocksdb::ColumnFamilyHandle *column, const rocksdb::Options &options) {
+        if (!buffer.empty()) {
+            writeRun();
+        }
+        if (runPaths.empty()) {
+            return;
+        }
+
+        std::vector<std::unique_ptr<RunReader>> readers;
+        for (auto &runPath : runPaths) {
+            readers.push_back(std::make_unique<RunReader>(runPath, rowSize()));
+        }
+        // Min-heap of runs by their current key, ties go to the earlier run
+        auto later = [&](size_t a, size_t b) {
+            auto cmp = memcmp(readers[a]->current(), readers[b]->current(), keySize);
+            return cmp > 0 || (cmp == 0 && a > b);
+        };
+        std::priority_queue<size_t, std::vector<size_t>, decltype(later)> heap(later);
+        for (size_t i = 0; i < readers.size(); i++) {
+            if (readers[i]->next()) {
+                heap.push(i);
+            }
+        }
+
+        auto sstPath = (directory/(name + ".sst")).str();
+        rocksdb::SstFileWriter writer{rocksdb::EnvOptions{}, options, column};
+        auto status = writer.Open(sstPath);
+        // Rows with the same key arrive in the order they were added, so each row is only written once the next key differs
+        std::vector<char> pendingRow;
+        while (status.ok() && !heap.empty()) {
+            auto runNum = heap.top();
+            heap.pop();
+            auto row = readers[runNum]->current();
+            if (!pendingRow.empty() && memcmp(row, pendingRow.data(), keySize) != 0) {
+                status = writer.Put(rocksdb::Slice{pendingRow.data(), keySize}, rocksdb::Slice{pendingRow.data() + keySize, valueSize});
+            }
+            pendingRow.assign(row, row + rowSize());
+            if (readers[runNum]->next()) {
+                heap.push(runNum);
+            }
+        }
+        if (status.ok() && !pendingRow.empty()) {
+            status = writer.Put(rocksdb::Slice{pendingRow.data(), keySize}, rocksdb::Slice{pendingRow.data() + keySize, valueSize});
+        }
+        if (status.ok()) {
+            status = writer.Finish();
+        }
+        if (status.ok()) {
+            rocksdb::IngestExternalFileOptions ingestOptions;
+            ingestOptions.move_files = true;
+            status = db.IngestExternalFile(column, {sstPath}, ingestOptions);
+        }
+        std::remove(sstPath.c_str());
+        if (!status.ok()) {
+            throw std::runtime_error("Could not bulk load column " + name + " with error: " + status.ToString());
+        }
+
+        readers.clear();
+        for (auto &runPath : runPaths) {
+            std::remove(runPath.c_str());
+        }
+        runPaths.clear();
+    }
+
+    void finishBulkLoaders(rocksdb::DB &db, const std::vector<std::unique_ptr<ColumnBulkLoader>> &loaders, const std::vector<rocksdb::ColumnFamilyHandle *> &columns, const rocksdb::Options &options) {
+        std::vector<std::future<void>> futures;
+        for (size_t i = 0; i < loaders.size(); i++) {
+            if (loaders[i]) {
+                futures.push_back(std::async(std::launch::async, [&, i]() {
+                    loaders[i]->finish(db, columns[i], options);
+                }));
+            }
+        }
+        for (auto &future : futures) {
+            future.get();
+        }
+    }
+} // namespace blocksci
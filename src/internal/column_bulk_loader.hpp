@@ -0,0 +1,57 @@
+//
+//  column_bulk_loader.hpp
+//  blocksci
+//
+
+#ifndef column_bulk_loader_hpp
+#define column_bulk_loader_hpp
+
+#include <rocksdb/db.h>
+
+#include <wjfilesystem/path.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace blocksci {
+    /** Collects the rows of one RocksDB column family and ingests them as a single sorted SST file
+     *
+     * Rows are buffered in memory and spilled to sorted run files when the buffer is full. finish() merges the runs
+     * into one SST file with rocksdb::SstFileWriter and ingests it with IngestExternalFile, so the rows never pass
+     * through the memtable and the column doesn't need to be compacted afterwards. All keys and all values of a
+     * column have to have the same size, and of several rows with the same key only the last one added is kept, as with WriteBatch::Put.
+     * Rows that are added aren't visible to reads from the database until finish() returns.
+     */
+    class ColumnBulkLoader {
+        filesystem::path directory;
+        std::string name;
+        size_t keySize = 0;
+        size_t valueSize = 0;
+        std::vector<char> buffer;
+        std::vector<std::string> runPaths;
+
+        size_t rowSize() const {
+            return keySize + valueSize;
+        }
+
+        void writeRun();
+
+    public:
+        /** Temporary files are created in directory with name as prefix */
+        ColumnBulkLoader(filesystem::path directory, std::string name);
+        ColumnBulkLoader(const ColumnBulkLoader &) = delete;
+        ColumnBulkLoader &operator=(const ColumnBulkLoader &) = delete;
+        ~ColumnBulkLoader();
+
+        void add(const rocksdb::Slice &key, const rocksdb::Slice &value);
+
+        /** Writes all added rows to an SST file and ingests it into the given column, does nothing if no rows were added */
+        void finish(rocksdb::DB &db, rocksdb::ColumnFamilyHandle *column, const rocksdb::Options &options);
+    };
+
+    /** Finishes the given loaders in parallel, one thread per loader. Loaders that are null are skipped */
+    void finishBulkLoaders(rocksdb::DB &db, const std::vector<std::unique_ptr<ColumnBulkLoader>> &loaders, const std::vector<rocksdb::ColumnFamilyHandle *> &columns, const rocksdb::Options &options);
+} // namespace blocksci
+
+#endif /* column_bulk_loader_hpp */
@@ -12,6 +12,7 @@
 #include "address_index.hpp"
 #include "hash_index.hpp"
 #include "mempool_index.hpp"
+#include "tx_column_access.hpp"
 
 namespace blocksci {
     
@@ -23,7 +24,8 @@ namespace blocksci {
     scripts{std::make_unique<ScriptAccess>(config.scriptsDirectory())},
     addressIndex{std::make_unique<AddressIndex>(config.addressDBFilePath(), true)},
     hashIndex{std::make_unique<HashIndex>(config.hashIndexFilePath(), true)},
-    mempoolIndex{std::make_unique<MempoolIndex>(config.mempoolDirectory())} {}
+    mempoolIndex{std::make_unique<MempoolIndex>(config.mempoolDirectory())},
+    txColumns{std::make_unique<TxColumnAccess>(config.chainDirectory(), *chain)} {}
     
     DataAccess::DataAccess(DataAccess &&) = default;
     DataAccess &DataAccess::operator=(DataAccess &&) = default;
@@ -19,13 +19,15 @@ namespace blocksci {
     class AddressIndex;
     class HashIndex;
     class MempoolIndex;
+    class TxColumnAccess;
 
     /** This class wraps and manages all data and index access classes
      *     - ChainAccess: Provides data access for blocks, transactions, inputs, and outputs
      *     - ScriptAccess: Provides data access for script data of all address types
-     *     - AddressIndex: Provides data access to address indexes (RocksDB database)
+     *     - AddressIndex: Provides data access to address indexes (posting lists and RocksDB database)
      *     - HashIndex: Provides data access to hash indexes (RocksDB database)
      *     - MempoolIndex: Provides data access to the mempool index (when a transaction has been first seen)
+     *     - TxColumnAccess: Provides per-transaction scalar values as contiguous columns
      *
      *     - DataConfiguration: Loads and holds blockchain configuration files, needed to load blockchains
      */
@@ -55,9 +57,9 @@ namespace blocksci {
          */
         std::unique_ptr<ScriptAccess> scripts;
 
-        /** Provides access to address indexes (RocksDB database)
+        /** Provides access to address indexes (posting lists and RocksDB database)
          *
-         * This RocksDB database stores information about which outputs a given address
+         * This index stores information about which outputs a given address
          * is used in as well as information about how different addresses relate to each other.
          *
          * Directory: addressesDb/
@@ -79,6 +81,13 @@ namespace blocksci {
          */
         std::unique_ptr<MempoolIndex> mempoolIndex;
         
+        /** Provides per-transaction scalar values like locktime and fee as contiguous columns, which are
+         * materialized from the chain data the first time they are used.
+         *
+         * Directory: chain/
+         */
+        std::unique_ptr<TxColumnAccess> txColumns;
+        
         DataAccess();
         explicit DataAccess(DataConfiguration config_);
         DataAccess(DataAccess &&);
@@ -105,6 +114,10 @@ namespace blocksci {
             return *hashIndex;
         }
         
+        TxColumnAccess &getTxColumns() {
+            return *txColumns;
+        }
+        
         operator DataConfiguration() const { return config; }
         
         void reload();
@@ -48,6 +48,11 @@ namespace blocksci {
             return chainConfig.dataDirectory/"scripts";
         }
         
+        /** scriptNums of pay to script hash scripts that were first seen as pay to witness script hash after they were created */
+        filesystem::path scriptHashSegwitFilePath() const {
+            return scriptsDirectory()/"scripthash_segwit";
+        }
+        
         filesystem::path chainDirectory() const {
             return chainConfig.dataDirectory/"chain";
         }
@@ -64,6 +69,14 @@ namespace blocksci {
             return chainConfig.dataDirectory/"hashIndex";
         }
         
+        filesystem::path addressPrefixIndexDirectory() const {
+            return chainConfig.dataDirectory/"addressPrefixIndex";
+        }
+        
+        filesystem::path integrityCheckDirectory() const {
+            return chainConfig.dataDirectory/"integrityCheck";
+        }
+        
         filesystem::path pidFilePath() const {
             return chainConfig.dataDirectory/"blocksci_parser.pid";
         }
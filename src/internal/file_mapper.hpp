@@ -19,6 +19,7 @@
 #include <cstring>
 #include <limits>
 #include <string>
+#include <system_error>
 #include <vector>
 #include <tuple>
 
@@ -312,6 +313,18 @@ namespace blocksci {
             }
         }
         
+        /** Moves any buffered data into the file and writes back the dirty pages of the mapping */
+        void sync() {
+            clearBuffer();
+            if (file.is_open()) {
+                std::error_code error;
+                file.sync(error);
+                if (error) {
+                    throw std::system_error(error, "Failed to sync " + fileInfo.path.str());
+                }
+            }
+        }
+        
         char *getDataAtOffset(OffsetType offset) {
             auto fileEnd = fileSize();
             assert(offset < fileEnd + bufferSize() || offset == InvalidFileIndex);
@@ -434,6 +447,10 @@ namespace blocksci {
             dataFile.clearBuffer();
         }
         
+        void sync() {
+            dataFile.sync();
+        }
+        
         bool write(const T &t) {
             return dataFile.write(t);
         }
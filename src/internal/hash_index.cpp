@@ -18,7 +18,9 @@
 #include <rocksdb/slice_transform.h>
 #include <rocksdb/table_properties.h>
 
+#include <algorithm>
 #include <array>
+#include <numeric>
 //
 //namespace {
 //    void OptimizeForPointLookup(rocksdb::ColumnFamilyOptions &options, std::shared_ptr<rocksdb::Cache> cache) {
@@ -34,8 +36,7 @@
 
 namespace blocksci {
     
-    HashIndex::HashIndex(const filesystem::path &path, bool readonly) {
-        rocksdb::Options options;
+    HashIndex::HashIndex(const filesystem::path &path, bool readonly) : bulkLoadDirectory(path/"bulk_load") {
         // Optimize RocksDB. This is the easiest way to get RocksDB to perform well
         options.IncreaseParallelism();
         options.OptimizeLevelStyleCompaction();
@@ -73,6 +74,7 @@ namespace blocksci {
         for (auto handle : columnHandlePtrs) {
             columnHandles.emplace_back(std::unique_ptr<rocksdb::ColumnFamilyHandle>(handle));
         }
+        bulkLoaders.resize(columnHandles.size());
     }
     
     HashIndex::~HashIndex() = default;
@@ -84,6 +86,13 @@ namespace blocksci {
     }
     
     void HashIndex::addTxes(std::vector<std::pair<uint256, uint32_t>> rows) {
+        auto &loader = bulkLoaders.back();
+        if (loader) {
+            for (const auto &pair : rows) {
+                loader->add(rocksdb::Slice(reinterpret_cast<const char *>(&pair.first), sizeof(pair.first)), rocksdb::Slice(reinterpret_cast<const char *>(&pair.second), sizeof(pair.second)));
+            }
+            return;
+        }
         rocksdb::WriteBatch batch;
         for (const auto &pair : rows) {
             rocksdb::Slice keySlice(reinterpret_cast<const char *>(&pair.first), sizeof(pair.first));
@@ -93,6 +102,29 @@ namespace blocksci {
         writeBatch(batch);
     }
     
+    void HashIndex::startBulkLoad(const std::vector<AddressType::Enum> &types, bool txes) {
+        if (!bulkLoadDirectory.exists()) {
+            filesystem::create_directory(bulkLoadDirectory);
+        }
+        for (auto type : types) {
+            bulkLoaders[static_cast<size_t>(type)] = std::make_unique<ColumnBulkLoader>(bulkLoadDirectory, addressName(type));
+        }
+        if (txes) {
+            bulkLoaders.back() = std::make_unique<ColumnBulkLoader>(bulkLoadDirectory, "T");
+        }
+    }
+    
+    void HashIndex::finishBulkLoad() {
+        std::vector<rocksdb::ColumnFamilyHandle *> columns;
+        for (auto &column : columnHandles) {
+            columns.push_back(column.get());
+        }
+        finishBulkLoaders(*db, bulkLoaders, columns, options);
+        for (auto &loader : bulkLoaders) {
+            loader.reset();
+        }
+    }
+    
     uint32_t HashIndex::countColumn(AddressType::Enum type) {
         uint32_t keyCount = 0;
         auto it = getIterator(type);
@@ -131,10 +163,60 @@ namespace blocksci {
         return getMatch(getTxColumn().get(), txHash);
     }
     
+    std::vector<ranges::optional<uint32_t>> HashIndex::getPubkeyHashIndexes(const std::vector<uint160> &pubkeyhashes) {
+        return lookupAddresses<AddressType::PUBKEYHASH>(pubkeyhashes);
+    }
+    
+    std::vector<ranges::optional<uint32_t>> HashIndex::getScriptHashIndexes(const std::vector<uint160> &scripthashes) {
+        return lookupAddresses<AddressType::SCRIPTHASH>(scripthashes);
+    }
+    
+    std::vector<ranges::optional<uint32_t>> HashIndex::getScriptHashIndexes(const std::vector<uint256> &scripthashes) {
+        return lookupAddresses<AddressType::WITNESS_SCRIPTHASH>(scripthashes);
+    }
+    
+    std::vector<ranges::optional<uint32_t>> HashIndex::getTxIndexes(const std::vector<uint256> &txHashes) {
+        return getMatches(getTxColumn().get(), txHashes);
+    }
+    
     ranges::optional<uint32_t> HashIndex::lookupAddressImpl(blocksci::AddressType::Enum type, const char *data, size_t size) {
         return getAddressMatch(type, data, size);
     }
 
+    std::vector<ranges::optional<uint32_t>> HashIndex::lookupAddressesImpl(AddressType::Enum type, const std::vector<MemoryView> &keys) {
+        return getMatches(getColumn(type).get(), keys);
+    }
+    
+    std::vector<ranges::optional<uint32_t>> HashIndex::getMatches(rocksdb::ColumnFamilyHandle *handle, const std::vector<MemoryView> &keys) {
+        // Sorted keys let MultiGet share index and data block reads between neighbouring keys
+        std::vector<size_t> order(keys.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+            return rocksdb::Slice(keys[a].data, keys[a].size).compare(rocksdb::Slice(keys[b].data, keys[b].size)) < 0;
+        });
+        std::vector<rocksdb::Slice> keySlices;
+        keySlices.reserve(keys.size());
+        for (auto i : order) {
+            keySlices.emplace_back(keys[i].data, keys[i].size);
+        }
+        std::vector<rocksdb::PinnableSlice> values(keys.size());
+        std::vector<rocksdb::Status> statuses(keys.size());
+        db->MultiGet(rocksdb::ReadOptions{}, handle, keySlices.size(), keySlices.data(), values.data(), statuses.data(), true);
+        
+        std::vector<ranges::optional<uint32_t>> results(keys.size());
+        for (size_t i = 0; i < order.size(); i++) {
+            if (statuses[i].ok()) {
+                uint32_t value;
+                memcpy(&value, values[i].data(), sizeof(value));
+                results[order[i]] = value;
+            } else if (!statuses[i].IsNotFound()) {
+                // Same as a single lookup, only a missing key means that there is no match
+                throw std::runtime_error{"Hash index lookup failed with error: " + statuses[i].ToString()};
+            }
+        }
+        return results;
+    }
+
     void HashIndex::addAddressesImpl(AddressType::Enum type, std::vector<std::pair<MemoryView, MemoryView>> dataViews) {
         addAddresses(type, dataViews);
     }
@@ -10,6 +10,7 @@
 #define blocksci_index_hash_index_hpp
 
 #include "address_info.hpp"
+#include "column_bulk_loader.hpp"
 #include "memory_view.hpp"
 
 #include <range/v3/view/any_view.hpp>
@@ -22,6 +23,7 @@
 #include <vector>
 #include <cstdint>
 #include <cstring>
+#include <stdexcept>
 
 namespace blocksci {
 
@@ -54,7 +56,29 @@ namespace blocksci {
         /** RocksDB column handles, one for each address type, @see blocksci::AddressType::Enum */
         std::vector<std::unique_ptr<rocksdb::ColumnFamilyHandle>> columnHandles;
         
+        rocksdb::Options options;
+
+        /** Directory for the temporary files of bulk loads */
+        filesystem::path bulkLoadDirectory;
+
+        /** Loaders of the columns that are being bulk loaded, indexed like columnHandles, null for other columns */
+        std::vector<std::unique_ptr<ColumnBulkLoader>> bulkLoaders;
+        
         ranges::optional<uint32_t> lookupAddressImpl(AddressType::Enum type, const char *data, size_t size);
+        std::vector<ranges::optional<uint32_t>> lookupAddressesImpl(AddressType::Enum type, const std::vector<MemoryView> &keys);
+        
+        /** Look up all keys in the given column with one MultiGet, results are in the order of keys */
+        std::vector<ranges::optional<uint32_t>> getMatches(rocksdb::ColumnFamilyHandle *handle, const std::vector<MemoryView> &keys);
+        
+        template <typename T>
+        std::vector<ranges::optional<uint32_t>> getMatches(rocksdb::ColumnFamilyHandle *handle, const std::vector<T> &hashes) {
+            std::vector<MemoryView> keys;
+            keys.reserve(hashes.size());
+            for (const auto &hash : hashes) {
+                keys.push_back(MemoryView{reinterpret_cast<const char *>(&hash), sizeof(hash)});
+            }
+            return getMatches(handle, keys);
+        }
         void addAddressesImpl(AddressType::Enum type, std::vector<std::pair<MemoryView, MemoryView>> dataViews);
         
         template <typename T>
@@ -66,8 +90,10 @@ namespace blocksci {
                 uint32_t value;
                 memcpy(&value, val.data(), sizeof(value));
                 return value;
-            } else {
+            } else if (getStatus.IsNotFound()) {
                 return ranges::nullopt;
+            } else {
+                throw std::runtime_error{"Hash index lookup failed with error: " + getStatus.ToString()};
             }
         }
 
@@ -80,12 +106,21 @@ namespace blocksci {
                 uint32_t value;
                 memcpy(&value, val.data(), sizeof(value));
                 return value;
-            } else {
+            } else if (getStatus.IsNotFound()) {
                 return ranges::nullopt;
+            } else {
+                throw std::runtime_error{"Hash index lookup failed with error: " + getStatus.ToString()};
             }
         }
         
         void addAddresses(AddressType::Enum type, std::vector<std::pair<MemoryView, MemoryView>> dataViews) {
+            auto &loader = bulkLoaders[static_cast<size_t>(type)];
+            if (loader) {
+                for (auto &pair : dataViews) {
+                    loader->add(rocksdb::Slice(pair.first.data, pair.first.size), rocksdb::Slice(pair.second.data, pair.second.size));
+                }
+                return;
+            }
             rocksdb::WriteBatch batch;
             for (auto &pair : dataViews) {
                 auto key = rocksdb::Slice(pair.first.data, pair.first.size);
@@ -149,6 +184,23 @@ namespace blocksci {
             return lookupAddressImpl(type, reinterpret_cast<const char *>(&hash), sizeof(hash));
         }
 
+        /** Look up many addresses of the same type with a single RocksDB MultiGet, results are in the order of hashes */
+        template<AddressType::Enum type>
+        std::vector<ranges::optional<uint32_t>> lookupAddresses(const std::vector<typename AddressInfo<type>::IDType> &hashes) {
+            std::vector<MemoryView> keys;
+            keys.reserve(hashes.size());
+            for (const auto &hash : hashes) {
+                keys.push_back(MemoryView{reinterpret_cast<const char *>(&hash), sizeof(hash)});
+            }
+            return lookupAddressesImpl(type, keys);
+        }
+
+        /** Batch versions of the lookups below, results are in the order of the given hashes */
+        std::vector<ranges::optional<uint32_t>> getPubkeyHashIndexes(const std::vector<uint160> &pubkeyhashes);
+        std::vector<ranges::optional<uint32_t>> getScriptHashIndexes(const std::vector<uint160> &scripthashes);
+        std::vector<ranges::optional<uint32_t>> getScriptHashIndexes(const std::vector<uint256> &scripthashes);
+        std::vector<ranges::optional<uint32_t>> getTxIndexes(const std::vector<uint256> &txHashes);
+
         /** Get the scriptNum for the given public key hash */
         ranges::optional<uint32_t> getPubkeyHashIndex(const uint160 &pubkeyhash);
       
@@ -176,6 +228,17 @@ namespace blocksci {
         /** Add a mapping from tx hash to tx number to the hash index for all given rows */
         void addTxes(std::vector<std::pair<uint256, uint32_t>> rows);
         
+        /** Buffer the rows added to the given address columns, and to the tx column if txes is set, until finishBulkLoad()
+         *
+         * The rows are written as sorted SST files that are ingested in one step, which avoids the write amplification of
+         * inserting them one by one and leaves the columns compacted. Lookups in these columns don't see the buffered rows
+         * before finishBulkLoad(), so this is only suited for columns that are written but not read during an update.
+         */
+        void startBulkLoad(const std::vector<AddressType::Enum> &types, bool txes);
+        
+        /** Ingest the rows buffered since startBulkLoad(), building the files of all columns in parallel */
+        void finishBulkLoad();
+        
         ranges::any_view<std::pair<MemoryView, MemoryView>> getRawAddressRange(AddressType::Enum type);
         
         template<AddressType::Enum type>
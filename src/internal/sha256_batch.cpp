@@ -0,0 +1,387 @@
+//
+//  sha256_batch.cpp
+//  blocksci
+//
+
+#include "sha256_batch.hpp"
+
+#include <blocksci/core/bitcoin_uint256.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define BLOCKSCI_SHA256_X86
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+namespace blocksci {
+    namespace {
+        // Most lanes of any implementation
+        constexpr size_t maxLanes = 8;
+
+        const uint32_t initialState[8] = {
+            0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+        };
+
+        const uint32_t roundConstants[64] = {
+            0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+            0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+            0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+            0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+            0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+            0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+            0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+            0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+        };
+
+        /** Compresses one 64 byte block into the 8 word state of every lane */
+        using TransformFunc = void (*)(uint32_t *states, const unsigned char *const *blocks);
+
+        struct Implementation {
+            const char *name;
+            size_t lanes;
+            TransformFunc transform;
+        };
+
+        uint32_t readBigEndian(const unsigned char *data) {
+            return (uint32_t{data[0]} << 24) | (uint32_t{data[1]} << 16) | (uint32_t{data[2]} << 8) | uint32_t{data[3]};
+        }
+
+        void writeBigEndian(unsigned char *data, uint32_t value) {
+            data[0] = static_cast<unsigned char>(value >> 24);
+            data[1] = static_cast<unsigned char>(value >> 16);
+            data[2] = static_cast<unsigned char>(value >> 8);
+            data[3] = static_cast<unsigned char>(value);
+        }
+
+        uint32_t rotr(uint32_t x, int n) {
+            return (x >> n) | (x << (32 - n));
+        }
+
+        void transformGeneric(uint32_t *state, const unsigned char *const *blocks) {
+            uint32_t w[64];
+            for (int t = 0; t < 16; t++) {
+                w[t] = readBigEndian(blocks[0] + 4 * t);
+            }
+            for (int t = 16; t < 64; t++) {
+                auto s0 = rotr(w[t - 15], 7) ^ rotr(w[t - 15], 18) ^ (w[t - 15] >> 3);
+                auto s1 = rotr(w[t - 2], 17) ^ rotr(w[t - 2], 19) ^ (w[t - 2] >> 10);
+                w[t] = w[t - 16] + s0 + w[t - 7] + s1;
+            }
+            auto a = state[0], b = state[1], c = state[2], d = state[3];
+            auto e = state[4], f = state[5], g = state[6], h = state[7];
+            for (int t = 0; t < 64; t++) {
+                auto t1 = h + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + roundConstants[t] + w[t];
+                auto t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+                h = g;
+                g = f;
+                f = e;
+                e = d + t1;
+                d = c;
+                c = b;
+                b = a;
+                a = t1 + t2;
+            }
+            state[0] += a;
+            state[1] += b;
+            state[2] += c;
+            state[3] += d;
+            state[4] += e;
+            state[5] += f;
+            state[6] += g;
+            state[7] += h;
+        }
+
+        #ifdef BLOCKSCI_SHA256_X86
+
+        #define BLOCKSCI_TARGET_AVX2 __attribute__((target("avx2")))
+        #define BLOCKSCI_TARGET_SHANI __attribute__((target("sha,sse4.1")))
+
+        template <int n>
+        BLOCKSCI_TARGET_AVX2 __m256i rotr8(__m256i x) {
+            return _mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - n));
+        }
+
+        BLOCKSCI_TARGET_AVX2 __m256i add8(__m256i a, __m256i b) {
+            return _mm256_add_epi32(a, b);
+        }
+
+        /** Eight lanes in parallel, lane i keeps its words in element i of each vector */
+        BLOCKSCI_TARGET_AVX2 void transformAvx2(uint32_t *states, const unsigned char *const *blocks) {
+            __m256i w[16];
+            for (int t = 0; t < 16; t++) {
+                w[t] = _mm256_setr_epi32(
+                    static_cast<int>(readBigEndian(blocks[0] + 4 * t)), static_cast<int>(readBigEndian(blocks[1] + 4 * t)),
+                    static_cast<int>(readBigEndian(blocks[2] + 4 * t)), static_cast<int>(readBigEndian(blocks[3] + 4 * t)),
+                    static_cast<int>(readBigEndian(blocks[4] + 4 * t)), static_cast<int>(readBigEndian(blocks[5] + 4 * t)),
+                    static_cast<int>(readBigEndian(blocks[6] + 4 * t)), static_cast<int>(readBigEndian(blocks[7] + 4 * t)));
+            }
+            // Transpose the lane states into one vector per state word
+            __m256i laneIndexes = _mm256_setr_epi32(0, 8, 16, 24, 32, 40, 48, 56);
+            __m256i s[8];
+            for (int i = 0; i < 8; i++) {
+                s[i] = _mm256_i32gather_epi32(reinterpret_cast<const int *>(states + i), laneIndexes, 4);
+            }
+            auto a = s[0], b = s[1], c = s[2], d = s[3], e = s[4], f = s[5], g = s[6], h = s[7];
+            for (int t = 0; t < 64; t++) {
+                if (t >= 16) {
+                    auto w15 = w[(t - 15) & 15];
+                    auto w2 = w[(t - 2) & 15];
+                    auto s0 = _mm256_xor_si256(_mm256_xor_si256(rotr8<7>(w15), rotr8<18>(w15)), _mm256_srli_epi32(w15, 3));
+                    auto s1 = _mm256_xor_si256(_mm256_xor_si256(rotr8<17>(w2), rotr8<19>(w2)), _mm256_srli_epi32(w2, 10));
+                    w[t & 15] = add8(add8(w[t & 15], s0), add8(w[(t - 7) & 15], s1));
+                }
+                auto sigma1 = _mm256_xor_si256(_mm256_xor_si256(rotr8<6>(e), rotr8<11>(e)), rotr8<25>(e));
+                auto ch = _mm256_xor_si256(_mm256_and_si256(e, f), _mm256_andnot_si256(e, g));
+                auto k = _mm256_set1_epi32(static_cast<int>(roundConstants[t]));
+                auto t1 = add8(add8(add8(h, sigma1), add8(ch, k)), w[t & 15]);
+                auto sigma0 = _mm256_xor_si256(_mm256_xor_si256(rotr8<2>(a), rotr8<13>(a)), rotr8<22>(a));
+                auto maj = _mm256_xor_si256(_mm256_xor_si256(_mm256_and_si256(a, b), _mm256_and_si256(a, c)), _mm256_and_si256(b, c));
+                auto t2 = add8(sigma0, maj);
+                h = g;
+                g = f;
+                f = e;
+                e = add8(d, t1);
+                d = c;
+                c = b;
+                b = a;
+                a = add8(t1, t2);
+            }
+            __m256i results[8] = {add8(s[0], a), add8(s[1], b), add8(s[2], c), add8(s[3], d), add8(s[4], e), add8(s[5], f), add8(s[6], g), add8(s[7], h)};
+            alignas(32) uint32_t words[8];
+            for (int i = 0; i < 8; i++) {
+                _mm256_store_si256(reinterpret_cast<__m256i *>(words), results[i]);
+                for (int lane = 0; lane < 8; lane++) {
+                    states[lane * 8 + i] = words[lane];
+                }
+            }
+        }
+
+        /** Two lanes with the SHA extensions, the rounds of both lanes are interleaved to hide instruction latency */
+        BLOCKSCI_TARGET_SHANI void transformShaNi(uint32_t *states, const unsigned char *const *blocks) {
+            constexpr int lanes = 2;
+            const __m128i byteSwap = _mm_set_epi64x(0x0c0d0e0f08090a0bll, 0x0405060700010203ll);
+            __m128i abef[lanes], cdgh[lanes], abefSaved[lanes], cdghSaved[lanes], msg[lanes][4];
+            for (int l = 0; l < lanes; l++) {
+                // Rearrange the state words into the ABEF and CDGH order that sha256rnds2 works on
+                auto cdab = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(states + 8 * l)), 0xB1);
+                auto efgh = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(states + 8 * l + 4)), 0x1B);
+                abef[l] = _mm_alignr_epi8(cdab, efgh, 8);
+                cdgh[l] = _mm_blend_epi16(efgh, cdab, 0xF0);
+                abefSaved[l] = abef[l];
+                cdghSaved[l] = cdgh[l];
+            }
+            for (int i = 0; i < 16; i++) {
+                auto k = _mm_loadu_si128(reinterpret_cast<const __m128i *>(roundConstants + 4 * i));
+                for (int l = 0; l < lanes; l++) {
+                    auto &current = msg[l][i & 3];
+                    if (i < 4) {
+                        current = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(blocks[l] + 16 * i)), byteSwap);
+                    } else {
+                        auto sum = _mm_add_epi32(_mm_sha256msg1_epu32(current, msg[l][(i - 3) & 3]), _mm_alignr_epi8(msg[l][(i - 1) & 3], msg[l][(i - 2) & 3], 4));
+                        current = _mm_sha256msg2_epu32(sum, msg[l][(i - 1) & 3]);
+                    }
+                    auto words = _mm_add_epi32(current, k);
+                    cdgh[l] = _mm_sha256rnds2_epu32(cdgh[l], abef[l], words);
+                    abef[l] = _mm_sha256rnds2_epu32(abef[l], cdgh[l], _mm_shuffle_epi32(words, 0x0E));
+                }
+            }
+            for (int l = 0; l < lanes; l++) {
+                abef[l] = _mm_add_epi32(abef[l], abefSaved[l]);
+                cdgh[l] = _mm_add_epi32(cdgh[l], cdghSaved[l]);
+                auto feba = _mm_shuffle_epi32(abef[l], 0x1B);
+                auto dchg = _mm_shuffle_epi32(cdgh[l], 0xB1);
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(states + 8 * l), _mm_blend_epi16(feba, dchg, 0xF0));
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(states + 8 * l + 4), _mm_alignr_epi8(dchg, feba, 8));
+            }
+        }
+
+        uint64_t readXcr0() {
+            uint32_t eax, edx;
+            __asm__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+            return (uint64_t{edx} << 32) | eax;
+        }
+
+        #endif
+
+        Implementation selectImplementation() {
+            #ifdef BLOCKSCI_SHA256_X86
+            unsigned int eax, ebx, ecx, edx;
+            if (__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+                bool ssse3 = ecx & bit_SSSE3;
+                bool sse41 = ecx & bit_SSE4_1;
+                // AVX registers are only usable if the operating system saves them on context switches
+                bool avxEnabled = (ecx & bit_OSXSAVE) && (ecx & bit_AVX) && (readXcr0() & 6) == 6;
+                if (__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) {
+                    if ((ebx & bit_SHA) && ssse3 && sse41) {
+                        return {"shani", 2, transformShaNi};
+                    }
+                    if ((ebx & bit_AVX2) && avxEnabled) {
+                        return {"avx2", 8, transformAvx2};
+                    }
+                }
+            }
+            #endif
+            return {"generic", 1, transformGeneric};
+        }
+
+        const Implementation &implementation() {
+            static const Implementation selected = selectImplementation();
+            return selected;
+        }
+
+        /** Produces the padded 64 byte blocks of one message, pointing into the message where a block is contiguous */
+        class MessageBlocks {
+            const HashInput *input = nullptr;
+            size_t part = 0;
+            size_t offset = 0;
+            uint64_t bitLength = 0;
+            // 0 while data is left, 1 if only the block with the length is left, 2 once all blocks have been produced
+            int stage = 2;
+            unsigned char buffer[64];
+
+            void writeLength() {
+                for (int i = 0; i < 8; i++) {
+                    buffer[56 + i] = static_cast<unsigned char>(bitLength >> (56 - 8 * i));
+                }
+            }
+
+        public:
+            void reset(const HashInput &input_) {
+                input = &input_;
+                part = 0;
+                offset = 0;
+                bitLength = 0;
+                for (auto size : input->sizes) {
+                    bitLength += size * 8;
+                }
+                stage = 0;
+            }
+
+            bool finished() const {
+                return stage == 2;
+            }
+
+            const unsigned char *next() {
+                if (stage == 1) {
+                    memset(buffer, 0, 56);
+                    writeLength();
+                    stage = 2;
+                    return buffer;
+                }
+                auto &data = input->data;
+                auto &sizes = input->sizes;
+                while (part < HashInput::maxParts && offset == sizes[part]) {
+                    part++;
+                    offset = 0;
+                }
+                if (part < HashInput::maxParts && sizes[part] - offset >= 64) {
+                    auto block = data[part] + offset;
+                    offset += 64;
+                    return block;
+                }
+                size_t filled = 0;
+                while (filled < 64 && part < HashInput::maxParts) {
+                    auto count = std::min(64 - filled, sizes[part] - offset);
+                    if (count > 0) {
+                        memcpy(buffer + filled, data[part] + offset, count);
+                    }
+                    filled += count;
+                    offset += count;
+                    if (offset == sizes[part]) {
+                        part++;
+                        offset = 0;
+                    }
+                }
+                if (filled < 64) {
+                    // The message ends in this block, the padding bit follows right after it
+                    buffer[filled] = 0x80;
+                    memset(buffer + filled + 1, 0, 63 - filled);
+                    if (filled < 56) {
+                        writeLength();
+                        stage = 2;
+                    } else {
+                        stage = 1;
+                    }
+                }
+                return buffer;
+            }
+        };
+
+        void hashBatch(const Implementation &impl, const HashInput *inputs, size_t count, uint256 *out) {
+            MessageBlocks messages[maxLanes];
+            size_t messageNums[maxLanes];
+            bool active[maxLanes] = {};
+            uint32_t states[maxLanes * 8];
+            const unsigned char *blocks[maxLanes];
+            // Idle lanes hash this block into a state that is thrown away
+            static const unsigned char idleBlock[64] = {};
+
+            size_t nextMessage = 0;
+            size_t activeCount = 0;
+            auto fillLane = [&](size_t lane) {
+                active[lane] = nextMessage < count;
+                if (active[lane]) {
+                    messages[lane].reset(inputs[nextMessage]);
+                    messageNums[lane] = nextMessage++;
+                    std::copy(initialState, initialState + 8, states + 8 * lane);
+                    activeCount++;
+                }
+            };
+            for (size_t lane = 0; lane < impl.lanes; lane++) {
+                fillLane(lane);
+            }
+            while (activeCount > 0) {
+                for (size_t lane = 0; lane < impl.lanes; lane++) {
+                    blocks[lane] = active[lane] ? messages[lane].next() : idleBlock;
+                }
+                impl.transform(states, blocks);
+                for (size_t lane = 0; lane < impl.lanes; lane++) {
+                    if (active[lane] && messages[lane].finished()) {
+                        auto digest = reinterpret_cast<unsigned char *>(&out[messageNums[lane]]);
+                        for (int i = 0; i < 8; i++) {
+                            writeBigEndian(digest + 4 * i, states[8 * lane + i]);
+                        }
+                        activeCount--;
+                        fillLane(lane);
+                    }
+                }
+            }
+        }
+    }
+
+    void HashInput::append(const void *data_, size_t size) {
+        for (size_t i = 0; i < maxParts; i++) {
+            if (data[i] == nullptr) {
+                data[i] = static_cast<const unsigned char *>(data_);
+                sizes[i] = size;
+                return;
+            }
+        }
+        throw std::runtime_error("Hash input can't have more than " + std::to_string(maxParts) + " parts");
+    }
+
+    const char *sha256Implementation() {
+        return implementation().name;
+    }
+
+    void sha256Batch(const HashInput *inputs, size_t count, uint256 *out) {
+        hashBatch(implementation(), inputs, count, out);
+    }
+
+    void doubleSha256Batch(const HashInput *inputs, size_t count, uint256 *out) {
+        hashBatch(implementation(), inputs, count, out);
+        std::vector<HashInput> digests;
+        digests.reserve(count);
+        for (size_t i = 0; i < count; i++) {
+            digests.emplace_back(&out[i], sizeof(uint256));
+        }
+        // Every digest is read into its own block before out[i] is overwritten
+        hashBatch(implementation(), digests.data(), count, out);
+    }
+} // namespace blocksci
@@ -0,0 +1,49 @@
+//
+//  sha256_batch.hpp
+//  blocksci
+//
+
+#ifndef sha256_batch_hpp
+#define sha256_batch_hpp
+
+#include <array>
+#include <cstddef>
+
+namespace blocksci {
+    class uint256;
+
+    /** Message made of up to maxParts byte ranges that are hashed as if they were one contiguous range */
+    struct HashInput {
+        static constexpr size_t maxParts = 6;
+
+        std::array<const unsigned char *, maxParts> data{};
+        std::array<size_t, maxParts> sizes{};
+
+        HashInput() = default;
+        HashInput(const void *data_, size_t size) {
+            append(data_, size);
+        }
+
+        /** Adds a range to the end of the message, at most maxParts ranges can be added */
+        void append(const void *data_, size_t size);
+    };
+
+    /** Name of the SHA-256 implementation selected for this CPU: "shani", "avx2" or "generic"
+     *
+     * The implementation is picked once at runtime. SHA-NI hashes two messages at a time with interleaved rounds, AVX2
+     * hashes eight messages in the lanes of 256 bit vectors and the generic implementation hashes one message at a time.
+     */
+    const char *sha256Implementation();
+
+    /** Writes the SHA-256 digest of inputs[i] to out[i]
+     *
+     * Whenever a message is done its lane is refilled with the next message, so messages of different lengths keep all
+     * lanes busy. The bytes of out are in the order SHA256_Final writes them.
+     */
+    void sha256Batch(const HashInput *inputs, size_t count, uint256 *out);
+
+    /** Writes the SHA-256 digest of the SHA-256 digest of inputs[i] to out[i], the hash used for transaction ids */
+    void doubleSha256Batch(const HashInput *inputs, size_t count, uint256 *out);
+} // namespace blocksci
+
+#endif /* sha256_batch_hpp */
@@ -0,0 +1,148 @@
+//
+//  tx_column_access.cpp
+//  blocksci
+//
+
+#include "tx_column_access.hpp"
+#include "chain_access.hpp"
+
+#include <blocksci/core/raw_transaction.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <random>
+
+namespace blocksci {
+    namespace {
+        // Number of values computed before they are written out while materializing a column
+        constexpr uint32_t materializeChunkSize = 1 << 20;
+        
+        template <typename T, typename Extract>
+        void computeValues(const ChainAccess &chain, uint32_t begin, uint32_t end, Extract &extract, std::vector<T> &values) {
+            for (uint32_t txNum = begin; txNum < end; txNum++) {
+                values.push_back(extract(*chain.getTx(txNum)));
+            }
+        }
+        
+        int64_t calculateFee(const RawTransaction &tx) {
+            if (tx.inputCount == 0) {
+                return 0;
+            }
+            int64_t total = 0;
+            for (auto input = tx.beginInputs(); input != tx.endInputs(); ++input) {
+                total += input->getValue();
+            }
+            for (auto output = tx.beginOutputs(); output != tx.endOutputs(); ++output) {
+                total -= output->getValue();
+            }
+            return total;
+        }
+    }
+    
+    TxColumnAccess::TxColumnAccess(const filesystem::path &baseDirectory, const ChainAccess &chain_) :
+    chain(chain_),
+    locktimes(txLocktimeFilePath(baseDirectory)),
+    inputCounts(txInputCountFilePath(baseDirectory)),
+    outputCounts(txOutputCountFilePath(baseDirectory)),
+    totalSizes(txSizeFilePath(baseDirectory)),
+    fees(txFeeFilePath(baseDirectory)) {}
+    
+    TxColumnAccess::~TxColumnAccess() = default;
+    
+    /** Writes the existing values followed by the values of the missing transactions to a temporary file which then
+     *  replaces the column file, so that readers never see a partially written column */
+    template <typename T, typename Extract>
+    bool TxColumnAccess::extendColumnFile(const Column<T> &column, const FixedSizeFileMapper<T> &existing, uint32_t txCount, Extract extract) const {
+        auto filePath = column.path.str() + ".dat";
+        auto tempPath = filePath + ".tmp" + std::to_string(std::random_device{}());
+        auto existingCount = static_cast<uint32_t>(existing.size());
+        bool good;
+        {
+            std::ofstream file(tempPath, std::ios::binary);
+            if (!file) {
+                return false;
+            }
+            if (existingCount > 0) {
+                file.write(reinterpret_cast<const char *>(existing[0]), static_cast<std::streamsize>(existingCount * sizeof(T)));
+            }
+            std::vector<T> values;
+            values.reserve(materializeChunkSize);
+            for (uint32_t begin = existingCount; begin < txCount && file; begin += std::min(materializeChunkSize, txCount - begin)) {
+                values.clear();
+                computeValues(chain, begin, begin + std::min(materializeChunkSize, txCount - begin), extract, values);
+                file.write(reinterpret_cast<const char *>(values.data()), static_cast<std::streamsize>(values.size() * sizeof(T)));
+            }
+            file.close();
+            good = !file.fail();
+        }
+        if (!good || std::rename(tempPath.c_str(), filePath.c_str()) != 0) {
+            std::remove(tempPath.c_str());
+            return false;
+        }
+        return true;
+    }
+    
+    template <typename T, typename Extract>
+    const T *TxColumnAccess::getColumn(Column<T> &column, Extract extract) {
+        auto txCount = static_cast<uint32_t>(chain.txCount());
+        if (txCount == 0) {
+            return nullptr;
+        }
+        
+        std::lock_guard<std::mutex> lock(mutex);
+        if (column.file && column.file->size() >= txCount) {
+            return (*column.file)[0];
+        }
+        if (column.values && column.values->size() >= txCount) {
+            return column.values->data();
+        }
+        
+        // Another process may have extended the file since it was mapped, so start from a fresh mapping
+        auto file = std::make_unique<FixedSizeFileMapper<T>>(column.path);
+        if (file->size() < txCount) {
+            if (extendColumnFile(column, *file, txCount, extract)) {
+                file = std::make_unique<FixedSizeFileMapper<T>>(column.path);
+            } else {
+                auto values = std::make_unique<std::vector<T>>();
+                values->reserve(txCount);
+                auto existingCount = static_cast<uint32_t>(std::min(file->size(), static_cast<OffsetType>(txCount)));
+                if (existingCount > 0) {
+                    values->insert(values->end(), (*file)[0], (*file)[0] + existingCount);
+                }
+                computeValues(chain, existingCount, txCount, extract, *values);
+                if (column.values) {
+                    column.retiredValues.push_back(std::move(column.values));
+                }
+                column.values = std::move(values);
+                return column.values->data();
+            }
+        }
+        
+        if (column.file) {
+            column.retiredFiles.push_back(std::move(column.file));
+        }
+        column.file = std::move(file);
+        return (*column.file)[0];
+    }
+    
+    const uint32_t *TxColumnAccess::getLocktimes() {
+        return getColumn(locktimes, [](const RawTransaction &tx) { return tx.locktime; });
+    }
+    
+    const uint16_t *TxColumnAccess::getInputCounts() {
+        return getColumn(inputCounts, [](const RawTransaction &tx) { return tx.inputCount; });
+    }
+    
+    const uint16_t *TxColumnAccess::getOutputCounts() {
+        return getColumn(outputCounts, [](const RawTransaction &tx) { return tx.outputCount; });
+    }
+    
+    const uint32_t *TxColumnAccess::getTotalSizes() {
+        return getColumn(totalSizes, [](const RawTransaction &tx) { return tx.realSize; });
+    }
+    
+    const int64_t *TxColumnAccess::getFees() {
+        return getColumn(fees, calculateFee);
+    }
+} // namespace blocksci
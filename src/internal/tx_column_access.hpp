@@ -0,0 +1,125 @@
+//
+//  tx_column_access.hpp
+//  blocksci
+//
+
+#ifndef tx_column_access_hpp
+#define tx_column_access_hpp
+
+#include "file_mapper.hpp"
+
+#include <wjfilesystem/path.h>
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace blocksci {
+    class ChainAccess;
+    struct RawTransaction;
+    
+    /** Provides per-transaction scalar values as contiguous columns, indexed by tx number.
+     *
+     * The values are copies of fields that are otherwise read from the RawTransaction in tx_data.dat. Scans over a
+     * column only touch the bytes of that column instead of pulling every transaction record into memory. The version
+     * column already exists as chain/tx_version.dat, see ChainAccess::getTxVersion.
+     *
+     * The column files are not written by the parser. A column is materialized the first time it is requested and
+     * extended when the chain has grown since. If the chain directory isn't writable, the column is kept in memory.
+     *
+     * Each getter returns a pointer to the value of tx 0 that is valid for all transactions in ChainAccess::txCount().
+     * Returned pointers stay valid for the lifetime of this object, even if the column is extended afterwards.
+     *
+     * Directory: chain/
+     */
+    class TxColumnAccess {
+    public:
+        TxColumnAccess(const filesystem::path &baseDirectory, const ChainAccess &chain);
+        TxColumnAccess(const TxColumnAccess &) = delete;
+        TxColumnAccess &operator=(const TxColumnAccess &) = delete;
+        ~TxColumnAccess();
+        
+        /** File: chain/tx_locktime.dat
+         * Raw data format: [<uint32_t locktimeOfTx0>, <uint32_t locktimeOfTx1>, ...]
+         */
+        const uint32_t *getLocktimes();
+        
+        /** File: chain/tx_input_count.dat
+         * Raw data format: [<uint16_t inputCountOfTx0>, <uint16_t inputCountOfTx1>, ...]
+         */
+        const uint16_t *getInputCounts();
+        
+        /** File: chain/tx_output_count.dat
+         * Raw data format: [<uint16_t outputCountOfTx0>, <uint16_t outputCountOfTx1>, ...]
+         */
+        const uint16_t *getOutputCounts();
+        
+        /** Serialized size of the transaction including witness data
+         *
+         * File: chain/tx_size.dat
+         * Raw data format: [<uint32_t totalSizeOfTx0>, <uint32_t totalSizeOfTx1>, ...]
+         */
+        const uint32_t *getTotalSizes();
+        
+        /** Input value minus output value, 0 for coinbase transactions
+         *
+         * File: chain/tx_fee.dat
+         * Raw data format: [<int64_t feeOfTx0>, <int64_t feeOfTx1>, ...]
+         */
+        const int64_t *getFees();
+        
+        static filesystem::path txLocktimeFilePath(const filesystem::path &baseDirectory) {
+            return baseDirectory/"tx_locktime";
+        }
+        
+        static filesystem::path txInputCountFilePath(const filesystem::path &baseDirectory) {
+            return baseDirectory/"tx_input_count";
+        }
+        
+        static filesystem::path txOutputCountFilePath(const filesystem::path &baseDirectory) {
+            return baseDirectory/"tx_output_count";
+        }
+        
+        static filesystem::path txSizeFilePath(const filesystem::path &baseDirectory) {
+            return baseDirectory/"tx_size";
+        }
+        
+        static filesystem::path txFeeFilePath(const filesystem::path &baseDirectory) {
+            return baseDirectory/"tx_fee";
+        }
+        
+    private:
+        template <typename T>
+        struct Column {
+            filesystem::path path;
+            std::unique_ptr<FixedSizeFileMapper<T>> file;
+            
+            // Used instead of the file if it can't be written
+            std::unique_ptr<std::vector<T>> values;
+            
+            // Shorter versions of the column that were replaced when the chain grew, kept alive for outstanding pointers
+            std::vector<std::unique_ptr<FixedSizeFileMapper<T>>> retiredFiles;
+            std::vector<std::unique_ptr<std::vector<T>>> retiredValues;
+            
+            explicit Column(filesystem::path path_) : path(std::move(path_)) {}
+        };
+        
+        const ChainAccess &chain;
+        std::mutex mutex;
+        
+        Column<uint32_t> locktimes;
+        Column<uint16_t> inputCounts;
+        Column<uint16_t> outputCounts;
+        Column<uint32_t> totalSizes;
+        Column<int64_t> fees;
+        
+        template <typename T, typename Extract>
+        const T *getColumn(Column<T> &column, Extract extract);
+        
+        template <typename T, typename Extract>
+        bool extendColumnFile(const Column<T> &column, const FixedSizeFileMapper<T> &existing, uint32_t txCount, Extract extract) const;
+    };
+} // namespace blocksci
+
+#endif /* tx_column_access_hpp */
@@ -0,0 +1,228 @@
+//
+//  address_encoding.cpp
+//  blocksci
+//
+
+#include "address_encoding.hpp"
+
+#include <blocksci/core/bitcoin_uint256.hpp>
+#include <blocksci/core/thread_pool.hpp>
+
+#include <internal/hash.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace blocksci {
+    namespace {
+        const char *base58Chars = "123456789ABCDEFGHJKLMNPQRSTUVWXYZabcdefghijkmnopqrstuvwxyz";
+        const char *bech32Chars = "qpzry9x8gf2tvdw0s3jn54khce6mua7l";
+
+        // Base of the limbs used by encodeBase58, 58^5 < 2^30 so that a limb times 2^32 plus a carry fits into 64 bits
+        constexpr uint64_t base58LimbBase = 58ull * 58 * 58 * 58 * 58;
+        constexpr int base58LimbDigits = 5;
+
+        // Limbs that fit on the stack, enough for inputs of up to 116 bytes
+        constexpr size_t stackLimbCount = 32;
+
+        // Largest version prefix plus hash that encodeBase58CheckHashes handles
+        constexpr size_t maxPayloadSize = 64;
+
+        // Addresses that are encoded by one task of a batch
+        constexpr size_t batchChunkSize = 1 << 14;
+
+        /** Multiplies the number in limbs[0, limbCount) by multiplier and adds value, returns the new number of limbs */
+        size_t base58MulAdd(uint32_t *limbs, size_t limbCount, uint64_t multiplier, uint64_t value) {
+            uint64_t carry = value;
+            for (size_t i = 0; i < limbCount; i++) {
+                uint64_t x = limbs[i] * multiplier + carry;
+                limbs[i] = static_cast<uint32_t>(x % base58LimbBase);
+                carry = x / base58LimbBase;
+            }
+            while (carry != 0) {
+                limbs[limbCount++] = static_cast<uint32_t>(carry % base58LimbBase);
+                carry /= base58LimbBase;
+            }
+            return limbCount;
+        }
+
+        uint32_t bech32PolymodStep(uint32_t c, uint8_t value) {
+            uint8_t c0 = static_cast<uint8_t>(c >> 25);
+            c = ((c & 0x1ffffff) << 5) ^ value;
+            if (c0 & 1) c ^= 0x3b6a57b2;
+            if (c0 & 2) c ^= 0x26508e6d;
+            if (c0 & 4) c ^= 0x1ea119fa;
+            if (c0 & 8) c ^= 0x3d4233dd;
+            if (c0 & 16) c ^= 0x2a1462b3;
+            return c;
+        }
+
+        /** Calls encode(i, out + i * width) for every hash after clearing its slot, in parallel for large batches */
+        template <typename Func>
+        void encodeBatch(size_t count, char *out, size_t width, Func encode) {
+            auto encodeChunk = [&](size_t chunk) {
+                auto begin = chunk * batchChunkSize;
+                auto end = std::min(begin + batchChunkSize, count);
+                memset(out + begin * width, 0, (end - begin) * width);
+                for (size_t i = begin; i < end; i++) {
+                    encode(i, out + i * width);
+                }
+            };
+            auto chunkCount = (count + batchChunkSize - 1) / batchChunkSize;
+            if (chunkCount == 1) {
+                encodeChunk(0);
+            } else if (chunkCount > 1) {
+                ThreadPool::instance().parallelFor(chunkCount, encodeChunk);
+            }
+        }
+
+        template <typename Hash>
+        void encodeSegwitBatch(const Bech32Prefix &prefix, const Hash *hashes, size_t count, char *out, size_t width) {
+            if (width < prefix.encodedSize(sizeof(Hash))) {
+                throw std::runtime_error("Width " + std::to_string(width) + " is too small for segwit addresses");
+            }
+            encodeBatch(count, out, width, [&](size_t i, char *address) {
+                prefix.encode(0, reinterpret_cast<const unsigned char *>(&hashes[i]), sizeof(Hash), address);
+            });
+        }
+    }
+
+    size_t encodeBase58(const unsigned char *data, size_t size, char *out) {
+        size_t zeroes = 0;
+        while (zeroes < size && data[zeroes] == 0) {
+            zeroes++;
+        }
+        data += zeroes;
+        size -= zeroes;
+
+        uint32_t stackLimbs[stackLimbCount];
+        std::vector<uint32_t> heapLimbs;
+        uint32_t *limbs = stackLimbs;
+        // Every limb holds more than 29 bits
+        auto maxLimbs = size * 8 / 29 + 1;
+        if (maxLimbs > stackLimbCount) {
+            heapLimbs.resize(maxLimbs);
+            limbs = heapLimbs.data();
+        }
+
+        // Consume the leading size % 4 bytes first so that the rest splits into whole big endian 32 bit words
+        size_t limbCount = 0;
+        size_t pos = size % 4;
+        if (pos > 0) {
+            uint64_t value = 0;
+            for (size_t i = 0; i < pos; i++) {
+                value = (value << 8) | data[i];
+            }
+            limbCount = base58MulAdd(limbs, limbCount, 1ull << (8 * pos), value);
+        }
+        for (; pos < size; pos += 4) {
+            uint64_t value = (uint64_t{data[pos]} << 24) | (uint64_t{data[pos + 1]} << 16) | (uint64_t{data[pos + 2]} << 8) | data[pos + 3];
+            limbCount = base58MulAdd(limbs, limbCount, 1ull << 32, value);
+        }
+
+        char *it = out;
+        it = std::fill_n(it, zeroes, '1');
+        if (limbCount > 0) {
+            // The most significant limb is written without leading zeroes, all others with exactly five digits
+            char digits[base58LimbDigits];
+            auto limb = limbs[limbCount - 1];
+            int digitCount = 0;
+            while (limb != 0) {
+                digits[digitCount++] = base58Chars[limb % 58];
+                limb /= 58;
+            }
+            it = std::reverse_copy(digits, digits + digitCount, it);
+            for (size_t i = limbCount - 1; i-- > 0;) {
+                limb = limbs[i];
+                for (int j = base58LimbDigits - 1; j >= 0; j--) {
+                    it[j] = base58Chars[limb % 58];
+                    limb /= 58;
+                }
+                it += base58LimbDigits;
+            }
+        }
+        return static_cast<size_t>(it - out);
+    }
+
+    size_t encodeBase58Check(const unsigned char *data, size_t size, char *out) {
+        unsigned char stackBuffer[128];
+        std::vector<unsigned char> heapBuffer;
+        unsigned char *buffer = stackBuffer;
+        if (size + 4 > sizeof(stackBuffer)) {
+            heapBuffer.resize(size + 4);
+            buffer = heapBuffer.data();
+        }
+        std::copy(data, data + size, buffer);
+        auto hash = doubleSha256(reinterpret_cast<const char *>(data), size);
+        memcpy(buffer + size, &hash, 4);
+        return encodeBase58(buffer, size + 4, out);
+    }
+
+    Bech32Prefix::Bech32Prefix(std::string hrp_) : hrp(std::move(hrp_)), checksumState(1) {
+        for (auto c : hrp) {
+            checksumState = bech32PolymodStep(checksumState, static_cast<uint8_t>(c) >> 5);
+        }
+        checksumState = bech32PolymodStep(checksumState, 0);
+        for (auto c : hrp) {
+            checksumState = bech32PolymodStep(checksumState, static_cast<uint8_t>(c) & 31);
+        }
+    }
+
+    size_t Bech32Prefix::encode(int witnessVersion, const unsigned char *program, size_t size, char *out) const {
+        char *it = std::copy(hrp.begin(), hrp.end(), out);
+        *it++ = '1';
+        auto c = checksumState;
+        auto append = [&](uint8_t value) {
+            c = bech32PolymodStep(c, value);
+            *it++ = bech32Chars[value];
+        };
+        append(static_cast<uint8_t>(witnessVersion));
+        // Regroup the program from 8 bit bytes into 5 bit values, padding the last one with zero bits
+        uint32_t acc = 0;
+        int bits = 0;
+        for (size_t i = 0; i < size; i++) {
+            acc = (acc << 8) | program[i];
+            bits += 8;
+            while (bits >= 5) {
+                bits -= 5;
+                append((acc >> bits) & 31);
+            }
+        }
+        if (bits > 0) {
+            append((acc << (5 - bits)) & 31);
+        }
+        for (int i = 0; i < 6; i++) {
+            c = bech32PolymodStep(c, 0);
+        }
+        c ^= 1;
+        for (int i = 0; i < 6; i++) {
+            *it++ = bech32Chars[(c >> (5 * (5 - i))) & 31];
+        }
+        return static_cast<size_t>(it - out);
+    }
+
+    void encodeBase58CheckHashes(const std::vector<unsigned char> &version, const uint160 *hashes, size_t count, char *out, size_t width) {
+        auto payloadSize = version.size() + sizeof(uint160);
+        if (payloadSize > maxPayloadSize) {
+            throw std::runtime_error("Version prefix of base58 addresses is too long");
+        }
+        if (width < base58EncodedSize(payloadSize + 4)) {
+            throw std::runtime_error("Width " + std::to_string(width) + " is too small for base58 addresses");
+        }
+        encodeBatch(count, out, width, [&](size_t i, char *address) {
+            unsigned char payload[maxPayloadSize];
+            std::copy(version.begin(), version.end(), payload);
+            memcpy(payload + version.size(), &hashes[i], sizeof(uint160));
+            encodeBase58Check(payload, payloadSize, address);
+        });
+    }
+
+    void encodeSegwitHashes(const Bech32Prefix &prefix, const uint160 *hashes, size_t count, char *out, size_t width) {
+        encodeSegwitBatch(prefix, hashes, count, out, width);
+    }
+
+    void encodeSegwitHashes(const Bech32Prefix &prefix, const uint256 *hashes, size_t count, char *out, size_t width) {
+        encodeSegwitBatch(prefix, hashes, count, out, width);
+    }
+} // namespace blocksci
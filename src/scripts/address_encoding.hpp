@@ -0,0 +1,72 @@
+//
+//  address_encoding.hpp
+//  blocksci
+//
+
+#ifndef address_encoding_hpp
+#define address_encoding_hpp
+
+#include <blocksci/blocksci_export.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace blocksci {
+    class uint160;
+    class uint256;
+
+    /** Upper bound of the length of the base58 encoding of size bytes */
+    inline size_t base58EncodedSize(size_t size) {
+        return size * 138 / 100 + 1;
+    }
+
+    /** Writes the base58 encoding of [data, data + size) to out and returns its length
+     *
+     * out must have room for base58EncodedSize(size) characters. Instead of dividing the number by 58 once per output
+     * digit, the input is consumed 32 bits at a time into limbs of five base58 digits each, so an address takes a few
+     * dozen 64 bit divisions by a constant instead of several hundred single digit steps.
+     */
+    size_t BLOCKSCI_EXPORT encodeBase58(const unsigned char *data, size_t size, char *out);
+
+    /** Writes the base58 encoding of [data, data + size) followed by its 4 byte checksum, returns its length
+     *
+     * out must have room for base58EncodedSize(size + 4) characters.
+     */
+    size_t BLOCKSCI_EXPORT encodeBase58Check(const unsigned char *data, size_t size, char *out);
+
+    /** Human readable part of bech32 addresses with its share of the checksum computed once */
+    class BLOCKSCI_EXPORT Bech32Prefix {
+        std::string hrp;
+        uint32_t checksumState;
+
+    public:
+        explicit Bech32Prefix(std::string hrp);
+
+        /** Length of the segwit address of a witness program of the given size */
+        size_t encodedSize(size_t programSize) const {
+            return hrp.size() + 1 + 1 + (programSize * 8 + 4) / 5 + 6;
+        }
+
+        /** Writes the segwit address of the given witness program to out and returns its length
+         *
+         * out must have room for encodedSize(size) characters. Unlike segwit_addr::encode this doesn't allocate and
+         * doesn't decode the result again to validate it.
+         */
+        size_t encode(int witnessVersion, const unsigned char *program, size_t size, char *out) const;
+    };
+
+    /** Writes the base58check addresses of the given hashes with the given version prefix to out
+     *
+     * Address i is written to out + i * width and padded with zero bytes, width must be at least
+     * base58EncodedSize(version.size() + 24). Large batches are encoded in parallel on the shared thread pool.
+     */
+    void BLOCKSCI_EXPORT encodeBase58CheckHashes(const std::vector<unsigned char> &version, const uint160 *hashes, size_t count, char *out, size_t width);
+
+    /** Writes the version 0 segwit addresses of the given hashes to out, laid out like encodeBase58CheckHashes */
+    void BLOCKSCI_EXPORT encodeSegwitHashes(const Bech32Prefix &prefix, const uint160 *hashes, size_t count, char *out, size_t width);
+    void BLOCKSCI_EXPORT encodeSegwitHashes(const Bech32Prefix &prefix, const uint256 *hashes, size_t count, char *out, size_t width);
+} // namespace blocksci
+
+#endif /* address_encoding_hpp */
@@ -3,6 +3,7 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "bitcoin_base58.hpp"
+#include "address_encoding.hpp"
 
 #include <blocksci/core/bitcoin_uint256.hpp>
 
@@ -71,42 +72,9 @@ namespace blocksci {
 
     std::string EncodeBase58(const unsigned char* pbegin, const unsigned char* pend)
     {
-        // Skip & count leading zeroes.
-        size_t zeroes = 0;
-        size_t length = 0;
-        while (pbegin != pend && *pbegin == 0) {
-            pbegin++;
-            zeroes++;
-        }
-        // Allocate enough space in big-endian base58 representation.
-        size_t size = static_cast<size_t>((pend - pbegin) * 138 / 100 + 1); // log(256) / log(58), rounded up.
-        std::vector<unsigned char> b58(size);
-        // Process the bytes.
-        while (pbegin != pend) {
-            int carry = *pbegin;
-            size_t i = 0;
-            // Apply "b58 = b58 * 256 + ch".
-            for (auto it = b58.rbegin(); (carry != 0 || i < length) && (it != b58.rend()); ++it, ++i) {
-                carry += 256 * (*it);
-                *it = carry % 58;
-                carry /= 58;
-            }
-
-            assert(carry == 0);
-            length = i;
-            pbegin++;
-        }
-        // Skip leading zeroes in base58 result.
-        auto it = b58.begin();
-        std::advance(it, static_cast<int64_t>(size - length));
-        while (it != b58.end() && *it == 0)
-            ++it;
-        // Translate the result into a string.
-        std::string str;
-        str.reserve(zeroes + static_cast<size_t>(std::distance(it, b58.end())));
-        str.assign(zeroes, '1');
-        while (it != b58.end())
-            str += pszBase58[*(it++)];
+        auto size = static_cast<size_t>(pend - pbegin);
+        std::string str(base58EncodedSize(size), '\0');
+        str.resize(encodeBase58(pbegin, size, &str[0]));
         return str;
     }
 
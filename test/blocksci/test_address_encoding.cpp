@@ -0,0 +1,197 @@
+//
+//  test_address_encoding.cpp
+//  blocksci_unittest
+//
+
+#include "unit_test.h"
+
+#include <blocksci/core/bitcoin_uint256.hpp>
+#include <scripts/address_encoding.hpp>
+
+#include <cstring>
+#include <random>
+#include <stdexcept>
+
+namespace blocksci {
+
+namespace {
+
+std::vector<unsigned char> fromHex(const std::string &hex) {
+    std::vector<unsigned char> bytes;
+    for (size_t i = 0; i + 1 < hex.size(); i += 2) {
+        bytes.push_back(static_cast<unsigned char>(std::stoi(hex.substr(i, 2), nullptr, 16)));
+    }
+    return bytes;
+}
+
+std::string base58(const std::vector<unsigned char> &data) {
+    std::string out(base58EncodedSize(data.size()), '\0');
+    out.resize(encodeBase58(data.data(), data.size(), &out[0]));
+    return out;
+}
+
+std::string base58Check(const std::vector<unsigned char> &data) {
+    std::string out(base58EncodedSize(data.size() + 4), '\0');
+    out.resize(encodeBase58Check(data.data(), data.size(), &out[0]));
+    return out;
+}
+
+/**
+ Base58 by repeated division of the whole number by 58, one digit at a time.
+ */
+std::string referenceBase58(std::vector<unsigned char> number) {
+    const char *digits = "123456789ABCDEFGHJKLMNPQRSTUVWXYZabcdefghijkmnopqrstuvwxyz";
+    size_t zeroes = 0;
+    while (zeroes < number.size() && number[zeroes] == 0) {
+        zeroes++;
+    }
+    std::string reversed;
+    size_t start = zeroes;
+    while (start < number.size()) {
+        int remainder = 0;
+        for (size_t i = start; i < number.size(); i++) {
+            int value = remainder * 256 + number[i];
+            number[i] = static_cast<unsigned char>(value / 58);
+            remainder = value % 58;
+        }
+        reversed.push_back(digits[remainder]);
+        while (start < number.size() && number[start] == 0) {
+            start++;
+        }
+    }
+    return std::string(zeroes, '1') + std::string(reversed.rbegin(), reversed.rend());
+}
+
+std::string segwit(const Bech32Prefix &prefix, int witnessVersion, const std::vector<unsigned char> &program) {
+    std::string out(prefix.encodedSize(program.size()), '\0');
+    auto size = prefix.encode(witnessVersion, program.data(), program.size(), &out[0]);
+    EXPECT_EQ(size, out.size());
+    return out;
+}
+
+template <typename Hash>
+std::vector<Hash> randomHashes(size_t count, std::mt19937 &rng) {
+    std::uniform_int_distribution<int> byte(0, 255);
+    std::vector<Hash> hashes(count);
+    for (auto &hash : hashes) {
+        for (auto &value : hash.data) {
+            value = static_cast<uint8_t>(byte(rng));
+        }
+    }
+    return hashes;
+}
+
+/**
+ Checks that slot i of a batch holds expected(i) followed by zero padding.
+ */
+template <typename Func>
+void expectBatch(const std::vector<char> &out, size_t count, size_t width, Func expected) {
+    for (size_t i = 0; i < count; i++) {
+        const char *slot = out.data() + i * width;
+        auto address = expected(i);
+        ASSERT_EQ(std::string(slot, strnlen(slot, width)), address) << "address " << i;
+        for (size_t j = address.size(); j < width; j++) {
+            ASSERT_EQ(slot[j], '\0');
+        }
+    }
+}
+
+}  // namespace
+
+TEST(AddressEncodingTest, Base58Vectors) {
+    std::vector<std::pair<std::string, std::string>> vectors = {
+        {"", ""},
+        {"61", "2g"},
+        {"626262", "a3gV"},
+        {"636363", "aPEr"},
+        {"73696d706c792061206c6f6e6720737472696e67", "2cFupjhnEsSn59qHXstmK2ffpLv2"},
+        {"00eb15231dfceb60925886b67d065299925915aeb172c06647", "1NS17iag9jJgTHD1VXjvLCEnZuQ3rJDE9L"},
+        {"516b6fcd0f", "ABnLTmg"},
+        {"bf4f89001e670274dd", "3SEo3LWLoPntC"},
+        {"572e4794", "3EFU7m"},
+        {"ecac89cad93923c02321", "EJDM8drfXA6uyA"},
+        {"10c8511e", "Rt5zm"},
+        {"00000000000000000000", "1111111111"},
+        {"000111d38e5fc9071ffcd20b4a763cc9ae4f252bb4e48fd66a835e252ada93ff480d6dd43dc62a641155a5", "123456789ABCDEFGHJKLMNPQRSTUVWXYZabcdefghijkmnopqrstuvwxyz"}
+    };
+    for (auto &vector : vectors) {
+        ASSERT_EQ(base58(fromHex(vector.first)), vector.second) << vector.first;
+    }
+}
+
+TEST(AddressEncodingTest, Base58MatchesDigitByDigitDivision) {
+    std::mt19937 rng(1);
+    std::uniform_int_distribution<int> byte(0, 255);
+    std::uniform_int_distribution<size_t> length(0, 160);
+    std::uniform_int_distribution<int> leadingZeroes(0, 3);
+    for (int i = 0; i < 2000; i++) {
+        // Lengths beyond the stack limbs too, and leading zero bytes that become '1's
+        std::vector<unsigned char> data(static_cast<size_t>(leadingZeroes(rng)), 0);
+        auto size = length(rng);
+        for (size_t j = 0; j < size; j++) {
+            data.push_back(static_cast<unsigned char>(byte(rng)));
+        }
+        ASSERT_EQ(base58(data), referenceBase58(data)) << "input " << i;
+    }
+}
+
+TEST(AddressEncodingTest, Base58CheckVectors) {
+    ASSERT_EQ(base58Check(fromHex("0062e907b15cbf27d5425399ebf6f0fb50ebb88f18")), "1A1zP1eP5QGefi2DMPTfTL5SLmv7DivfNa");
+    ASSERT_EQ(base58Check(fromHex("05b472a266d0bd89c13706a4132ccfb16f7c3b9fcb")), "3J98t1WpEZ73CNmQviecrnyiWrnqRhWNLy");
+    ASSERT_EQ(base58Check(fromHex("6f0000000000000000000000000000000000000000")), "mfWxJ45yp2SFn7UciZyNpvDKrzbhyfKrY8");
+}
+
+TEST(AddressEncodingTest, Bech32Bip173Vectors) {
+    Bech32Prefix mainnet("bc");
+    Bech32Prefix testnet("tb");
+    ASSERT_EQ(segwit(mainnet, 0, fromHex("751e76e8199196d454941c45d1b3a323f1433bd6")), "bc1qw508d6qejxtdg4y5r3zarvary0c5xw7kv8f3t4");
+    ASSERT_EQ(segwit(testnet, 0, fromHex("1863143c14c5166804bd19203356da136c985678cd4d27a1b8c6329604903262")), "tb1qrp33g0q5c5txsp9arysrx4k6zdkfs4nce4xj0gdcccefvpysxf3q0sl5k7");
+    ASSERT_EQ(segwit(testnet, 0, fromHex("000000c4a5cad46221b2a187905e5266362b99d5e91c6ce24d165dab93e86433")), "tb1qqqqqp399et2xygdj5xreqhjjvcmzhxw4aywxecjdzew6hylgvsesrxh6hy");
+    ASSERT_EQ(segwit(mainnet, 1, fromHex("751e76e8199196d454941c45d1b3a323f1433bd6751e76e8199196d454941c45d1b3a323f1433bd6")), "bc1pw508d6qejxtdg4y5r3zarvary0c5xw7kw508d6qejxtdg4y5r3zarvary0c5xw7k7grplx");
+    ASSERT_EQ(segwit(mainnet, 16, fromHex("751e")), "bc1sw50qa3jx3s");
+    ASSERT_EQ(segwit(mainnet, 2, fromHex("751e76e8199196d454941c45d1b3a323")), "bc1zw508d6qejxtdg4y5r3zarvaryvg6kdaj");
+}
+
+TEST(AddressEncodingTest, Base58CheckBatchMatchesSingleEncoding) {
+    std::mt19937 rng(2);
+    // More than one chunk so that the batch is encoded on the thread pool
+    size_t count = 40000;
+    auto hashes = randomHashes<uint160>(count, rng);
+    std::vector<unsigned char> version = {0x05};
+    size_t width = base58EncodedSize(version.size() + sizeof(uint160) + 4) + 3;
+    std::vector<char> out(count * width, 'x');
+    encodeBase58CheckHashes(version, hashes.data(), count, out.data(), width);
+    expectBatch(out, count, width, [&](size_t i) {
+        auto payload = version;
+        payload.insert(payload.end(), hashes[i].begin(), hashes[i].end());
+        return base58Check(payload);
+    });
+
+    ASSERT_THROW(encodeBase58CheckHashes(version, hashes.data(), count, out.data(), 20), std::runtime_error);
+}
+
+TEST(AddressEncodingTest, SegwitBatchMatchesSingleEncoding) {
+    std::mt19937 rng(3);
+    Bech32Prefix prefix("bc");
+    size_t count = 40000;
+
+    auto keyHashes = randomHashes<uint160>(count, rng);
+    size_t keyWidth = prefix.encodedSize(sizeof(uint160));
+    std::vector<char> keyOut(count * keyWidth, 'x');
+    encodeSegwitHashes(prefix, keyHashes.data(), count, keyOut.data(), keyWidth);
+    expectBatch(keyOut, count, keyWidth, [&](size_t i) {
+        return segwit(prefix, 0, std::vector<unsigned char>(keyHashes[i].begin(), keyHashes[i].end()));
+    });
+
+    auto scriptHashes = randomHashes<uint256>(count, rng);
+    size_t scriptWidth = prefix.encodedSize(sizeof(uint256)) + 1;
+    std::vector<char> scriptOut(count * scriptWidth, 'x');
+    encodeSegwitHashes(prefix, scriptHashes.data(), count, scriptOut.data(), scriptWidth);
+    expectBatch(scriptOut, count, scriptWidth, [&](size_t i) {
+        return segwit(prefix, 0, std::vector<unsigned char>(scriptHashes[i].begin(), scriptHashes[i].end()));
+    });
+
+    ASSERT_THROW(encodeSegwitHashes(prefix, scriptHashes.data(), count, scriptOut.data(), keyWidth), std::runtime_error);
+}
+
+}  // namespace blocksci
@@ -0,0 +1,195 @@
+//
+//  test_address_postings.cpp
+//  blocksci_unittest
+//
+
+#include "unit_test.h"
+
+#include <internal/address_postings.hpp>
+
+#include <cstdlib>
+#include <limits>
+#include <map>
+#include <random>
+
+namespace blocksci {
+
+namespace {
+
+constexpr auto postingType = AddressType::PUBKEYHASH;
+
+using ExpectedPostings = std::map<uint32_t, std::vector<uint64_t>>;
+
+std::vector<uint64_t> decodeKeys(const std::vector<PostingSpan> &spans) {
+    std::vector<uint64_t> keys;
+    for (auto pointer : PostingListRange{spans}) {
+        keys.push_back(postingKey(pointer));
+    }
+    return keys;
+}
+
+/**
+ Outputs of the transactions from txNum on, each sent to a random one of scriptCount addresses. Every address gets its
+ outputs in ascending order, like the outputs the parser adds in transaction order.
+ */
+std::vector<std::pair<uint32_t, InoutPointer>> randomOutputs(uint32_t &txNum, size_t txCount, uint32_t scriptCount, std::mt19937 &rng) {
+    // Large gaps between transactions so that deltas need several varint bytes
+    std::uniform_int_distribution<uint32_t> txGap(1, 100000);
+    std::uniform_int_distribution<uint16_t> outputCount(1, 3);
+    std::uniform_int_distribution<uint32_t> scriptNum(0, scriptCount - 1);
+    std::vector<std::pair<uint32_t, InoutPointer>> entries;
+    for (size_t i = 0; i < txCount; i++) {
+        txNum += txGap(rng);
+        auto count = outputCount(rng);
+        for (uint16_t outputNum = 0; outputNum < count; outputNum++) {
+            entries.emplace_back(scriptNum(rng), InoutPointer{txNum, outputNum});
+        }
+    }
+    return entries;
+}
+
+void addExpected(ExpectedPostings &expected, const std::vector<std::pair<uint32_t, InoutPointer>> &entries) {
+    for (auto &entry : entries) {
+        expected[entry.first].push_back(postingKey(entry.second));
+    }
+}
+
+void writeRun(const filesystem::path &directory, std::vector<std::pair<uint32_t, InoutPointer>> entries) {
+    writePostingRun(directory, postingType, entries);
+    ASSERT_TRUE(entries.empty());
+}
+
+void expectPostings(const filesystem::path &directory, const ExpectedPostings &expected, size_t runCount, bool hasBase) {
+    AddressPostings postings{directory, postingType};
+    ASSERT_EQ(postings.runCount(), runCount);
+    ASSERT_EQ(postings.exists(), hasBase);
+    ASSERT_EQ(postings.maxScriptNum(), expected.rbegin()->first);
+    for (uint32_t scriptNum = 0; scriptNum <= postings.maxScriptNum() + 5; scriptNum++) {
+        auto it = expected.find(scriptNum);
+        auto keys = decodeKeys(postings.getSpans(scriptNum));
+        if (it == expected.end()) {
+            ASSERT_TRUE(keys.empty()) << "scriptNum " << scriptNum;
+        } else {
+            ASSERT_EQ(keys, it->second) << "scriptNum " << scriptNum;
+        }
+    }
+}
+
+}  // namespace
+
+TEST(AddressPostingsTest, VarintRoundTrip) {
+    std::vector<std::pair<uint64_t, size_t>> values = {
+        {0, 1}, {1, 1}, {127, 1}, {128, 2}, {16383, 2}, {16384, 3},
+        {uint64_t{1} << 32, 5}, {std::numeric_limits<uint64_t>::max(), 10}
+    };
+    std::vector<uint8_t> bytes;
+    for (auto &value : values) {
+        auto sizeBefore = bytes.size();
+        appendVarint(bytes, value.first);
+        ASSERT_EQ(bytes.size() - sizeBefore, value.second) << value.first;
+    }
+    const uint8_t *pos = bytes.data();
+    for (auto &value : values) {
+        uint64_t decoded;
+        pos = readVarint(pos, decoded);
+        ASSERT_EQ(decoded, value.first);
+    }
+    ASSERT_EQ(pos, bytes.data() + bytes.size());
+}
+
+TEST(AddressPostingsTest, PostingKeysFollowPointerOrder) {
+    std::mt19937 rng(1);
+    std::uniform_int_distribution<uint32_t> txNum;
+    std::uniform_int_distribution<uint16_t> inoutNum;
+    for (int i = 0; i < 10000; i++) {
+        InoutPointer a{txNum(rng), inoutNum(rng)};
+        InoutPointer b{i % 2 == 0 ? a.txNum : txNum(rng), inoutNum(rng)};
+        ASSERT_EQ(postingPointer(postingKey(a)), a);
+        ASSERT_EQ(postingKey(a) < postingKey(b), a < b);
+    }
+}
+
+TEST(AddressPostingsTest, PostingListRangeSkipsEmptySpans) {
+    // Every span starts its deltas from 0
+    std::vector<uint8_t> first;
+    appendVarint(first, postingKey({5, 1}));
+    appendVarint(first, postingKey({300, 0}) - postingKey({5, 1}));
+    std::vector<uint8_t> second;
+    appendVarint(second, postingKey({70000, 2}));
+    std::vector<PostingSpan> spans = {
+        {first.data(), first.data()},
+        {first.data(), first.data() + first.size()},
+        {second.data(), second.data()},
+        {second.data(), second.data() + second.size()}
+    };
+    std::vector<uint64_t> expected = {postingKey({5, 1}), postingKey({300, 0}), postingKey({70000, 2})};
+    ASSERT_EQ(decodeKeys(spans), expected);
+    ASSERT_TRUE(decodeKeys({}).empty());
+}
+
+TEST(AddressPostingsTest, PostingListRangeSkipsRepeatedOutputs) {
+    // A run written again after an interrupted update repeats outputs of the spans before it
+    std::vector<uint8_t> first;
+    appendVarint(first, postingKey({0, 0}));
+    appendVarint(first, postingKey({300, 0}));
+    std::vector<uint8_t> second;
+    appendVarint(second, postingKey({300, 0}));
+    appendVarint(second, postingKey({70000, 2}) - postingKey({300, 0}));
+    std::vector<PostingSpan> spans = {
+        {first.data(), first.data() + first.size()},
+        {first.data(), first.data() + first.size()},
+        {second.data(), second.data() + second.size()}
+    };
+    std::vector<uint64_t> expected = {postingKey({0, 0}), postingKey({300, 0}), postingKey({70000, 2})};
+    ASSERT_EQ(decodeKeys(spans), expected);
+}
+
+TEST(AddressPostingsTest, RunsAndMergesKeepEveryOutputOnce) {
+    char directoryName[] = "/tmp/blocksci_postings_XXXXXX";
+    ASSERT_NE(mkdtemp(directoryName), nullptr);
+    filesystem::path directory{directoryName};
+
+    std::mt19937 rng(2);
+    uint32_t txNum = 0;
+    ExpectedPostings expected;
+
+    // Lists spread over two runs before there is a base
+    auto firstRun = randomOutputs(txNum, 3000, 200, rng);
+    auto secondRun = randomOutputs(txNum, 3000, 250, rng);
+    addExpected(expected, firstRun);
+    addExpected(expected, secondRun);
+    writeRun(directory, firstRun);
+    writeRun(directory, secondRun);
+    expectPostings(directory, expected, 2, false);
+
+    mergePostings(directory, postingType);
+    expectPostings(directory, expected, 0, true);
+
+    // A run on top of the base
+    auto thirdRun = randomOutputs(txNum, 3000, 300, rng);
+    addExpected(expected, thirdRun);
+    writeRun(directory, thirdRun);
+    expectPostings(directory, expected, 1, true);
+
+    // An update that wrote its run but was interrupted before saving its progress writes the run again
+    writeRun(directory, thirdRun);
+    expectPostings(directory, expected, 2, true);
+    mergePostings(directory, postingType);
+    expectPostings(directory, expected, 0, true);
+
+    // A merge interrupted after replacing the base leaves its first runs behind, followed by the runs of later updates
+    writeRun(directory, firstRun);
+    writeRun(directory, secondRun);
+    auto fourthRun = randomOutputs(txNum, 3000, 300, rng);
+    addExpected(expected, fourthRun);
+    writeRun(directory, fourthRun);
+    expectPostings(directory, expected, 3, true);
+    mergePostings(directory, postingType);
+    expectPostings(directory, expected, 0, true);
+
+    filesystem::path{AddressPostings::offsetsFilePath(directory, postingType).str() + ".dat"}.remove_file();
+    filesystem::path{AddressPostings::postingsFilePath(directory, postingType).str() + ".dat"}.remove_file();
+    directory.remove_file();
+}
+
+}  // namespace blocksci
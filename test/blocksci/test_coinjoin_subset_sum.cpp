@@ -0,0 +1,233 @@
+//
+//  test_coinjoin_subset_sum.cpp
+//  blocksci_unittest
+//
+
+#include "unit_test.h"
+
+#include <heuristics/coinjoin_subset_sum.hpp>
+
+#include <algorithm>
+#include <random>
+
+namespace blocksci {
+
+using heuristics::CoinJoinResult;
+using heuristics::getSumCount;
+
+namespace {
+
+/**
+ The search used by isPossibleCoinjoin and isCoinjoinExtra before the subset sums, kept as the reference. It copies
+ and sorts the buckets at every level.
+ */
+struct ReferenceBucket {
+    int64_t currentValue;
+    int64_t goalValue;
+
+    explicit ReferenceBucket(int64_t goal) : currentValue(0), goalValue(goal) {}
+
+    bool isFull() const {
+        return currentValue >= goalValue;
+    }
+
+    int64_t remaining() const {
+        return goalValue > currentValue ? goalValue - currentValue : 0;
+    }
+
+    bool operator<(const ReferenceBucket &other) const {
+        return remaining() < other.remaining();
+    }
+};
+
+CoinJoinResult referenceSearch(std::vector<int64_t> &values, std::vector<ReferenceBucket> buckets, int64_t totalRemaining, int64_t valueLeft) {
+    if (totalRemaining > valueLeft) {
+        return CoinJoinResult::False;
+    }
+
+    buckets.erase(std::remove_if(buckets.begin(), buckets.end(), [&](auto &bucket) { return bucket.isFull(); }), buckets.end());
+    if (buckets.size() == 0) {
+        return CoinJoinResult::True;
+    }
+
+    if (values.size() == 0) {
+        return CoinJoinResult::False;
+    }
+
+    std::sort(buckets.rbegin(), buckets.rend());
+
+    int64_t lastValue = values.back();
+    values.pop_back();
+    valueLeft -= lastValue;
+    for (auto &bucket : buckets) {
+        int64_t remaining = totalRemaining - bucket.remaining();
+        bucket.currentValue += lastValue;
+        remaining += bucket.remaining();
+        auto res = referenceSearch(values, buckets, remaining, valueLeft);
+        if (res != CoinJoinResult::False) {
+            return res;
+        }
+        bucket.currentValue -= lastValue;
+    }
+    values.push_back(lastValue);
+    return CoinJoinResult::False;
+}
+
+CoinJoinResult referenceSumCount(std::vector<int64_t> values, std::vector<int64_t> bucketGoals) {
+    std::sort(values.begin(), values.end());
+    std::sort(bucketGoals.rbegin(), bucketGoals.rend());
+
+    int64_t valueLeft = 0;
+    for (auto value : values) {
+        valueLeft += value;
+    }
+    int64_t totalRemaining = 0;
+    std::vector<ReferenceBucket> buckets;
+    for (auto goal : bucketGoals) {
+        totalRemaining += goal;
+        buckets.emplace_back(goal);
+    }
+    return referenceSearch(values, buckets, totalRemaining, valueLeft);
+}
+
+struct Instance {
+    std::vector<int64_t> values;
+    std::vector<int64_t> goals;
+};
+
+/**
+ Random values with the given number of buckets, whose goals add up to a random share of the total so that both
+ outcomes are common.
+ */
+Instance randomInstance(std::mt19937 &rng, size_t valueCount, size_t bucketCount, int64_t maxValue) {
+    std::uniform_int_distribution<int64_t> value(1, maxValue);
+    Instance instance;
+    int64_t total = 0;
+    for (size_t i = 0; i < valueCount; i++) {
+        instance.values.push_back(value(rng));
+        total += instance.values.back();
+    }
+    std::uniform_int_distribution<int64_t> goal(-maxValue / 10, total / static_cast<int64_t>(bucketCount) + maxValue / 10);
+    for (size_t i = 0; i < bucketCount; i++) {
+        instance.goals.push_back(goal(rng));
+    }
+    return instance;
+}
+
+/**
+ Random values with two goals around half of the total, which needs a subset with a sum in a window of at most
+ maxSlack around the middle. Subset sums are dense there, so only narrow windows make both outcomes common.
+ */
+Instance balancedInstance(std::mt19937 &rng, size_t valueCount, int64_t maxValue, int64_t maxSlack) {
+    std::uniform_int_distribution<int64_t> value(1, maxValue);
+    Instance instance;
+    int64_t total = 0;
+    for (size_t i = 0; i < valueCount; i++) {
+        instance.values.push_back(value(rng));
+        total += instance.values.back();
+    }
+    std::uniform_int_distribution<int64_t> offset(-maxValue / 4, maxValue / 4);
+    std::uniform_int_distribution<int64_t> slack(0, maxSlack);
+    auto first = total / 2 + offset(rng);
+    instance.goals = {first, total - first - slack(rng)};
+    return instance;
+}
+
+void expectBothOutcomes(int trueCount, int instanceCount) {
+    // Both outcomes have to be covered for the comparison to mean anything
+    ASSERT_GT(trueCount, instanceCount / 10);
+    ASSERT_LT(trueCount, instanceCount - instanceCount / 10);
+}
+
+void expectReferenceResults(std::mt19937 &rng, int instanceCount, size_t minValues, size_t maxValues, size_t minBuckets, size_t maxBuckets, int64_t maxValue) {
+    std::uniform_int_distribution<size_t> valueCount(minValues, maxValues);
+    std::uniform_int_distribution<size_t> bucketCount(minBuckets, maxBuckets);
+    int trueCount = 0;
+    for (int i = 0; i < instanceCount; i++) {
+        auto instance = randomInstance(rng, valueCount(rng), bucketCount(rng), maxValue);
+        auto expected = referenceSumCount(instance.values, instance.goals);
+        ASSERT_EQ(getSumCount(instance.values, instance.goals, 0), expected) << "instance " << i;
+        trueCount += expected == CoinJoinResult::True;
+    }
+    expectBothOutcomes(trueCount, instanceCount);
+}
+
+void expectBalancedReferenceResults(std::mt19937 &rng, int instanceCount, int64_t maxValue, int64_t maxSlack) {
+    std::uniform_int_distribution<size_t> valueCount(17, 19);
+    int trueCount = 0;
+    for (int i = 0; i < instanceCount; i++) {
+        auto instance = balancedInstance(rng, valueCount(rng), maxValue, maxSlack);
+        auto expected = referenceSumCount(instance.values, instance.goals);
+        ASSERT_EQ(getSumCount(instance.values, instance.goals, 0), expected) << "instance " << i;
+        trueCount += expected == CoinJoinResult::True;
+    }
+    expectBothOutcomes(trueCount, instanceCount);
+}
+
+}  // namespace
+
+TEST(CoinJoinSubsetSumTest, TrivialGoals) {
+    ASSERT_EQ(getSumCount({1, 2}, {}, 0), CoinJoinResult::True);
+    ASSERT_EQ(getSumCount({}, {0, -3}, 0), CoinJoinResult::True);
+    ASSERT_EQ(getSumCount({5, 5}, {11}, 0), CoinJoinResult::False);
+    ASSERT_EQ(getSumCount({5, 5}, {10}, 0), CoinJoinResult::True);
+    ASSERT_EQ(getSumCount({6, 4}, {5, 5}, 0), CoinJoinResult::False);
+    ASSERT_EQ(getSumCount({3, 3, 4}, {5, 5}, 0), CoinJoinResult::False);
+    ASSERT_EQ(getSumCount({3, 2, 4, 1}, {5, 5}, 0), CoinJoinResult::True);
+}
+
+TEST(CoinJoinSubsetSumTest, SearchMatchesReference) {
+    std::mt19937 rng(1);
+    expectReferenceResults(rng, 3000, 2, 10, 2, 4, 100);
+}
+
+TEST(CoinJoinSubsetSumTest, ExactSubsetSumsMatchReference) {
+    std::mt19937 rng(2);
+    // Two buckets over more than 16 values with a total that fits the bitset
+    expectBalancedReferenceResults(rng, 200, 200000, 4);
+}
+
+TEST(CoinJoinSubsetSumTest, RoundedSubsetSumsMatchReference) {
+    std::mt19937 rng(3);
+    // Totals far beyond the bitset, so that the values are rounded and the search decides the open cases
+    expectBalancedReferenceResults(rng, 200, 100000000, 4000);
+}
+
+TEST(CoinJoinSubsetSumTest, CommonDivisorIsExact) {
+    std::mt19937 rng(4);
+    std::uniform_int_distribution<int64_t> units(-50000, 50000);
+    int trueCount = 0;
+    for (int i = 0; i < 200; i++) {
+        // Large amounts with a common divisor, like round values of coinjoin inputs, and goals that aren't multiples of it
+        auto instance = balancedInstance(rng, 18, 20000, 2);
+        for (auto &value : instance.values) {
+            value *= 100000;
+        }
+        for (auto &goal : instance.goals) {
+            goal = goal * 100000 + units(rng);
+        }
+        auto expected = referenceSumCount(instance.values, instance.goals);
+        ASSERT_EQ(getSumCount(instance.values, instance.goals, 0), expected) << "instance " << i;
+        trueCount += expected == CoinJoinResult::True;
+    }
+    expectBothOutcomes(trueCount, 200);
+}
+
+TEST(CoinJoinSubsetSumTest, TimeoutOnlyWhenUndecided) {
+    std::mt19937 rng(5);
+    std::uniform_int_distribution<size_t> valueCount(6, 12);
+    std::uniform_int_distribution<size_t> bucketCount(3, 5);
+    int timeoutCount = 0;
+    for (int i = 0; i < 500; i++) {
+        auto instance = randomInstance(rng, valueCount(rng), bucketCount(rng), 1000);
+        auto result = getSumCount(instance.values, instance.goals, 20);
+        if (result == CoinJoinResult::Timeout) {
+            timeoutCount++;
+        } else {
+            ASSERT_EQ(result, referenceSumCount(instance.values, instance.goals)) << "instance " << i;
+        }
+    }
+    ASSERT_GT(timeoutCount, 0);
+}
+
+}  // namespace blocksci
@@ -0,0 +1,163 @@
+//
+//  test_disjoint_sets.cpp
+//  blocksci_unittest
+//
+
+#include "unit_test.h"
+
+#include <cluster/concurrent_disjoint_sets.hpp>
+
+#include <random>
+#include <thread>
+#include <vector>
+
+namespace blocksci {
+
+namespace {
+
+/**
+ Plain union-find used as the reference for ConcurrentDisjointSets.
+ */
+class ReferenceDisjointSets {
+    std::vector<uint32_t> parents;
+
+public:
+    explicit ReferenceDisjointSets(uint32_t size) : parents(size) {
+        for (uint32_t i = 0; i < size; i++) {
+            parents[i] = i;
+        }
+    }
+
+    uint32_t find(uint32_t index) {
+        while (parents[index] != index) {
+            parents[index] = parents[parents[index]];
+            index = parents[index];
+        }
+        return index;
+    }
+
+    bool unite(uint32_t a, uint32_t b) {
+        a = find(a);
+        b = find(b);
+        if (a == b) {
+            return false;
+        }
+        parents[a] = b;
+        return true;
+    }
+};
+
+std::vector<std::pair<uint32_t, uint32_t>> randomPairs(uint32_t size, size_t count, uint32_t seed) {
+    std::mt19937 rng(seed);
+    std::uniform_int_distribution<uint32_t> element(0, size - 1);
+    std::vector<std::pair<uint32_t, uint32_t>> pairs;
+    pairs.reserve(count);
+    for (size_t i = 0; i < count; i++) {
+        pairs.emplace_back(element(rng), element(rng));
+    }
+    return pairs;
+}
+
+/**
+ Checks that both structures partition the elements into the same sets, which doesn't depend on the chosen roots.
+ */
+void expectSamePartition(ConcurrentDisjointSets &sets, ReferenceDisjointSets &reference, uint32_t size) {
+    std::vector<uint32_t> referenceRootOfRoot(size, size);
+    std::vector<uint32_t> rootOfReferenceRoot(size, size);
+    for (uint32_t i = 0; i < size; i++) {
+        auto root = sets.find(i);
+        auto referenceRoot = reference.find(i);
+        if (referenceRootOfRoot[root] == size) {
+            referenceRootOfRoot[root] = referenceRoot;
+        }
+        if (rootOfReferenceRoot[referenceRoot] == size) {
+            rootOfReferenceRoot[referenceRoot] = root;
+        }
+        ASSERT_EQ(referenceRootOfRoot[root], referenceRoot) << "element " << i;
+        ASSERT_EQ(rootOfReferenceRoot[referenceRoot], root) << "element " << i;
+    }
+}
+
+}  // namespace
+
+TEST(DisjointSetsTest, SingletonsAtStart) {
+    ConcurrentDisjointSets sets(100);
+    ASSERT_EQ(sets.size(), 100u);
+    for (uint32_t i = 0; i < sets.size(); i++) {
+        ASSERT_EQ(sets.find(i), i);
+    }
+}
+
+TEST(DisjointSetsTest, UniteReportsMerges) {
+    ConcurrentDisjointSets sets(4);
+    ASSERT_TRUE(sets.unite(0, 1));
+    ASSERT_FALSE(sets.unite(1, 0));
+    ASSERT_FALSE(sets.unite(2, 2));
+    ASSERT_TRUE(sets.unite(2, 3));
+    ASSERT_NE(sets.find(0), sets.find(2));
+    ASSERT_TRUE(sets.unite(3, 0));
+    ASSERT_FALSE(sets.unite(1, 2));
+    ASSERT_EQ(sets.find(0), sets.find(3));
+}
+
+TEST(DisjointSetsTest, MatchesSequentialReference) {
+    uint32_t size = 20000;
+    ConcurrentDisjointSets sets(size);
+    ReferenceDisjointSets reference(size);
+    for (auto &pair : randomPairs(size, 15000, 1)) {
+        ASSERT_EQ(sets.unite(pair.first, pair.second), reference.unite(pair.first, pair.second));
+    }
+    expectSamePartition(sets, reference, size);
+}
+
+TEST(DisjointSetsTest, ConcurrentUnitesMatchReference) {
+    uint32_t size = 200000;
+    unsigned int threadCount = 8;
+    auto pairs = randomPairs(size, 400000, 2);
+
+    ConcurrentDisjointSets sets(size);
+    std::vector<uint64_t> mergeCounts(threadCount, 0);
+    std::vector<std::thread> threads;
+    for (unsigned int t = 0; t < threadCount; t++) {
+        threads.emplace_back([&, t]() {
+            for (size_t i = t; i < pairs.size(); i += threadCount) {
+                mergeCounts[t] += sets.unite(pairs[i].first, pairs[i].second);
+            }
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+
+    ReferenceDisjointSets reference(size);
+    uint64_t referenceMerges = 0;
+    for (auto &pair : pairs) {
+        referenceMerges += reference.unite(pair.first, pair.second);
+    }
+
+    // Every successful unite removes one set, no matter which thread won
+    uint64_t mergeCount = 0;
+    for (auto count : mergeCounts) {
+        mergeCount += count;
+    }
+    ASSERT_EQ(mergeCount, referenceMerges);
+    expectSamePartition(sets, reference, size);
+}
+
+TEST(DisjointSetsTest, SetParentRestoresForest) {
+    uint32_t size = 5000;
+    ConcurrentDisjointSets sets(size);
+    ReferenceDisjointSets reference(size);
+    for (auto &pair : randomPairs(size, 4000, 3)) {
+        sets.unite(pair.first, pair.second);
+        reference.unite(pair.first, pair.second);
+    }
+
+    ConcurrentDisjointSets restored(size);
+    for (uint32_t i = 0; i < size; i++) {
+        restored.setParent(i, sets.find(i));
+    }
+    expectSamePartition(restored, reference, size);
+}
+
+}  // namespace blocksci
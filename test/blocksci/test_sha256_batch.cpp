@@ -0,0 +1,149 @@
+//
+//  test_sha256_batch.cpp
+//  blocksci_unittest
+//
+
+#include "unit_test.h"
+
+#include <blocksci/core/bitcoin_uint256.hpp>
+#include <internal/sha256_batch.hpp>
+
+#include <openssl/sha.h>
+
+#include <cstring>
+#include <random>
+#include <stdexcept>
+
+namespace blocksci {
+
+namespace {
+
+std::vector<std::vector<unsigned char>> randomMessages(const std::vector<size_t> &sizes, std::mt19937 &rng) {
+    std::uniform_int_distribution<int> byte(0, 255);
+    std::vector<std::vector<unsigned char>> messages;
+    messages.reserve(sizes.size());
+    for (auto size : sizes) {
+        std::vector<unsigned char> message(size);
+        for (auto &value : message) {
+            value = static_cast<unsigned char>(byte(rng));
+        }
+        messages.push_back(std::move(message));
+    }
+    return messages;
+}
+
+/**
+ Every length up to four blocks, which covers the lengths around the 55 and 64 byte padding boundaries of each block.
+ */
+std::vector<size_t> boundarySizes() {
+    std::vector<size_t> sizes;
+    for (size_t size = 0; size <= 4 * 64 + 1; size++) {
+        sizes.push_back(size);
+    }
+    return sizes;
+}
+
+/**
+ Splits every message into up to HashInput::maxParts parts at random positions.
+ */
+std::vector<HashInput> splitInputs(const std::vector<std::vector<unsigned char>> &messages, std::mt19937 &rng) {
+    std::vector<HashInput> inputs;
+    inputs.reserve(messages.size());
+    for (auto &message : messages) {
+        std::uniform_int_distribution<size_t> position(0, message.size());
+        auto first = position(rng);
+        auto second = position(rng);
+        if (first > second) {
+            std::swap(first, second);
+        }
+        HashInput input;
+        input.append(message.data(), first);
+        input.append(message.data() + first, second - first);
+        input.append(message.data() + second, message.size() - second);
+        inputs.push_back(input);
+    }
+    return inputs;
+}
+
+void expectDigests(const std::vector<std::vector<unsigned char>> &messages, const std::vector<uint256> &digests, bool doubleHash) {
+    ASSERT_EQ(messages.size(), digests.size());
+    for (size_t i = 0; i < messages.size(); i++) {
+        unsigned char expected[SHA256_DIGEST_LENGTH];
+        SHA256(messages[i].data(), messages[i].size(), expected);
+        if (doubleHash) {
+            unsigned char single[SHA256_DIGEST_LENGTH];
+            memcpy(single, expected, sizeof(single));
+            SHA256(single, sizeof(single), expected);
+        }
+        ASSERT_EQ(memcmp(digests[i].begin(), expected, sizeof(expected)), 0) << "message " << i << " of " << messages[i].size() << " bytes with " << sha256Implementation();
+    }
+}
+
+std::vector<uint256> hashMessages(const std::vector<HashInput> &inputs, bool doubleHash) {
+    std::vector<uint256> digests(inputs.size());
+    if (doubleHash) {
+        doubleSha256Batch(inputs.data(), inputs.size(), digests.data());
+    } else {
+        sha256Batch(inputs.data(), inputs.size(), digests.data());
+    }
+    return digests;
+}
+
+std::vector<HashInput> wholeInputs(const std::vector<std::vector<unsigned char>> &messages) {
+    std::vector<HashInput> inputs;
+    inputs.reserve(messages.size());
+    for (auto &message : messages) {
+        inputs.emplace_back(message.data(), message.size());
+    }
+    return inputs;
+}
+
+}  // namespace
+
+TEST(Sha256BatchTest, KnownImplementation) {
+    std::string name = sha256Implementation();
+    ASSERT_TRUE(name == "shani" || name == "avx2" || name == "generic") << name;
+}
+
+TEST(Sha256BatchTest, EmptyMessage) {
+    HashInput input;
+    uint256 digest;
+    sha256Batch(&input, 1, &digest);
+    unsigned char expected[SHA256_DIGEST_LENGTH];
+    SHA256(nullptr, 0, expected);
+    ASSERT_EQ(memcmp(digest.begin(), expected, sizeof(expected)), 0);
+}
+
+TEST(Sha256BatchTest, MatchesOpenSSLAcrossBlockBoundaries) {
+    std::mt19937 rng(1);
+    auto messages = randomMessages(boundarySizes(), rng);
+    for (bool doubleHash : {false, true}) {
+        expectDigests(messages, hashMessages(wholeInputs(messages), doubleHash), doubleHash);
+        expectDigests(messages, hashMessages(splitInputs(messages, rng), doubleHash), doubleHash);
+    }
+}
+
+TEST(Sha256BatchTest, MatchesOpenSSLForMixedLengths) {
+    std::mt19937 rng(2);
+    std::uniform_int_distribution<size_t> size(0, 1000);
+    // Batch sizes that leave lanes of every implementation idle, with messages of very different lengths in one batch
+    for (size_t count : {1, 2, 3, 7, 9, 17, 1001}) {
+        std::vector<size_t> sizes;
+        for (size_t i = 0; i < count; i++) {
+            sizes.push_back(size(rng));
+        }
+        auto messages = randomMessages(sizes, rng);
+        expectDigests(messages, hashMessages(splitInputs(messages, rng), true), true);
+    }
+}
+
+TEST(Sha256BatchTest, RejectsTooManyParts) {
+    unsigned char data[4] = {};
+    HashInput input;
+    for (size_t i = 0; i < HashInput::maxParts; i++) {
+        input.append(data, sizeof(data));
+    }
+    ASSERT_THROW(input.append(data, sizeof(data)), std::runtime_error);
+}
+
+}  // namespace blocksci
@@ -0,0 +1,166 @@
+//
+//  test_taint.cpp
+//  blocksci_unittest
+//
+
+#include "unit_test.h"
+
+#include <heuristics/taint_state.hpp>
+
+#include <algorithm>
+#include <map>
+#include <random>
+#include <tuple>
+#include <unordered_set>
+
+namespace blocksci {
+
+using heuristics::SimpleTaint;
+
+namespace {
+
+using TaintEntry = std::tuple<uint32_t, uint16_t, int64_t, int64_t>;
+
+std::vector<TaintEntry> sortedTaint(const std::vector<std::pair<Output, SimpleTaint>> &taint) {
+    std::vector<TaintEntry> entries;
+    entries.reserve(taint.size());
+    for (auto &item : taint) {
+        entries.emplace_back(item.first.pointer.txNum, item.first.pointer.inoutNum, item.second.first, item.second.second);
+    }
+    std::sort(entries.begin(), entries.end());
+    return entries;
+}
+
+}  // namespace
+
+class TaintTest : public BlockSciTest {
+
+public:
+
+    /**
+     Poison taint without fee taint computed by following every tainted output to its spending transaction, without
+     the frontier, the heap or the parallel path of getPoisonTainted.
+     */
+    std::vector<TaintEntry> referencePoisonTaint(const std::vector<Output> &outputs, BlockHeight maxBlockHeight) {
+        BlockHeight endHeight = maxBlockHeight == -1 ? chain.size() : std::min(maxBlockHeight + 1, chain.size());
+        uint32_t endTxNum = chain[endHeight - 1].endTxIndex();
+
+        std::vector<TaintEntry> taint;
+        std::unordered_set<uint32_t> taintedTxes;
+        std::vector<Output> pending;
+        for (auto &output : outputs) {
+            if (output.getValue() > 0) {
+                pending.push_back(output);
+            }
+        }
+        while (!pending.empty()) {
+            auto output = pending.back();
+            pending.pop_back();
+            auto spendingTx = output.getSpendingTxIndex();
+            if (spendingTx && *spendingTx < endTxNum) {
+                if (taintedTxes.insert(*spendingTx).second) {
+                    for (auto spendingOut : Transaction(*spendingTx, chain.getAccess()).outputs()) {
+                        if (spendingOut.getValue() > 0) {
+                            pending.push_back(spendingOut);
+                        }
+                    }
+                }
+            } else {
+                taint.emplace_back(output.pointer.txNum, output.pointer.inoutNum, output.getValue(), 0);
+            }
+        }
+        std::sort(taint.begin(), taint.end());
+        return taint;
+    }
+
+    std::vector<std::vector<Output>> startingOutputs() {
+        return {
+            chain[123][1].outputs() | ranges::to_vector,
+            chain[101][0].outputs() | ranges::to_vector,
+            chain[chain.size() / 2][0].outputs() | ranges::to_vector
+        };
+    }
+};
+
+TEST(TaintStateTest, OutputPointerMapMatchesStdMap) {
+    heuristics::OutputPointerMap<uint32_t> map;
+    std::map<OutputPointer, uint32_t> reference;
+    std::mt19937 rng(1);
+    // Few distinct keys so that inserts hit present keys and erases shift long probe sequences
+    std::uniform_int_distribution<uint32_t> txNum(0, 3000);
+    std::uniform_int_distribution<uint16_t> outputNum(0, 3);
+    std::uniform_int_distribution<int> operation(0, 2);
+    for (uint32_t i = 0; i < 200000; i++) {
+        OutputPointer key{txNum(rng), outputNum(rng)};
+        switch (operation(rng)) {
+            case 0:
+            case 1:
+                ASSERT_EQ(map.insert(key, i), reference.emplace(key, i).second);
+                break;
+            default:
+                ASSERT_EQ(map.erase(key), reference.erase(key) == 1);
+                break;
+        }
+        ASSERT_EQ(map.size(), reference.size());
+        auto value = map.find(key);
+        auto it = reference.find(key);
+        ASSERT_EQ(value != nullptr, it != reference.end());
+        if (value) {
+            ASSERT_EQ(*value, it->second);
+        }
+    }
+
+    size_t visited = 0;
+    map.forEach([&](const OutputPointer &key, uint32_t value) {
+        auto it = reference.find(key);
+        ASSERT_TRUE(it != reference.end());
+        ASSERT_EQ(value, it->second);
+        visited++;
+    });
+    ASSERT_EQ(visited, reference.size());
+}
+
+TEST(TaintStateTest, TaintPoolReusesReleasedSlots) {
+    heuristics::TaintPool<SimpleTaint> pool;
+    auto first = pool.add(SimpleTaint{5, 1});
+    auto second = pool.add(SimpleTaint{7, 2});
+    ASSERT_NE(first, second);
+    pool.release(first);
+    auto third = pool.add(SimpleTaint{9, 3});
+    ASSERT_EQ(third, first);
+    ASSERT_EQ(pool[third], (SimpleTaint{9, 3}));
+    ASSERT_EQ(pool[second], (SimpleTaint{7, 2}));
+}
+
+TEST_F(TaintTest, PoisonTaintMatchesReference) {
+    for (auto &outputs : startingOutputs()) {
+        auto height = outputs[0].getBlockHeight();
+        for (BlockHeight maxBlockHeight : {height, height + 5, height + 50, BlockHeight{-1}}) {
+            auto taint = heuristics::getPoisonTainted(outputs, maxBlockHeight, false);
+            ASSERT_EQ(sortedTaint(taint), referencePoisonTaint(outputs, maxBlockHeight)) << "height " << height << ", max height " << maxBlockHeight;
+        }
+    }
+}
+
+TEST_F(TaintTest, HaircutTaintStaysWithinPoisonTaint) {
+    for (auto &outputs : startingOutputs()) {
+        int64_t initialTaint = 0;
+        for (auto &output : outputs) {
+            initialTaint += output.getValue();
+        }
+        auto poison = sortedTaint(heuristics::getPoisonTainted(outputs, -1, false));
+        auto haircut = sortedTaint(heuristics::getHaircutTainted(outputs, -1, false));
+        int64_t totalTaint = 0;
+        for (auto &entry : haircut) {
+            auto it = std::lower_bound(poison.begin(), poison.end(), entry, [](const TaintEntry &a, const TaintEntry &b) {
+                return std::tie(std::get<0>(a), std::get<1>(a)) < std::tie(std::get<0>(b), std::get<1>(b));
+            });
+            ASSERT_TRUE(it != poison.end() && std::get<0>(*it) == std::get<0>(entry) && std::get<1>(*it) == std::get<1>(entry));
+            ASSERT_EQ(std::get<2>(entry) + std::get<3>(entry), std::get<2>(*it));
+            totalTaint += std::get<2>(entry);
+        }
+        ASSERT_LE(totalTaint, initialTaint);
+    }
+}
+
+}  // namespace blocksci
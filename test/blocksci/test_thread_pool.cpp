@@ -0,0 +1,106 @@
+//
+//  test_thread_pool.cpp
+//  blocksci_unittest
+//
+
+#include "unit_test.h"
+
+#include <blocksci/core/thread_pool.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace blocksci {
+
+namespace {
+
+/** Spins until flag is set, gives up after a few seconds so that a broken pool fails instead of hanging */
+bool waitFor(const std::atomic<bool> &flag) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (!flag) {
+        if (std::chrono::steady_clock::now() > deadline) {
+            return false;
+        }
+        std::this_thread::yield();
+    }
+    return true;
+}
+
+}  // namespace
+
+TEST(ThreadPoolTest, VisitsEveryIndexOnce) {
+    ThreadPool pool{4};
+    std::vector<std::atomic<int>> visits(10000);
+    pool.parallelFor(visits.size(), [&](size_t index) {
+        visits[index]++;
+    });
+    for (auto &count : visits) {
+        ASSERT_EQ(count, 1);
+    }
+}
+
+TEST(ThreadPoolTest, RethrowsFirstException) {
+    ThreadPool pool{4};
+    ASSERT_THROW(pool.parallelFor(1000, [](size_t index) {
+        if (index == 500) {
+            throw std::runtime_error("failed");
+        }
+    }), std::runtime_error);
+
+    // The pool keeps working after a failed loop
+    std::atomic<size_t> sum{0};
+    pool.parallelFor(100, [&](size_t index) { sum += index; });
+    ASSERT_EQ(sum, 4950u);
+}
+
+TEST(ThreadPoolTest, LoopsFromDifferentThreadsRunTogether) {
+    ThreadPool pool{4};
+    std::atomic<bool> firstStarted{false};
+    std::atomic<bool> secondStarted{false};
+    std::atomic<bool> firstSawSecond{true};
+    std::atomic<bool> secondSawFirst{true};
+    std::thread other([&]() {
+        pool.parallelFor(8, [&](size_t) {
+            secondStarted = true;
+            if (!waitFor(firstStarted)) {
+                secondSawFirst = false;
+            }
+        });
+    });
+    pool.parallelFor(8, [&](size_t) {
+        firstStarted = true;
+        if (!waitFor(secondStarted)) {
+            firstSawSecond = false;
+        }
+    });
+    other.join();
+    ASSERT_TRUE(firstSawSecond);
+    ASSERT_TRUE(secondSawFirst);
+}
+
+TEST(ThreadPoolTest, ThreadStartedInsideLoopCanRunLoop) {
+    ThreadPool pool{4};
+    std::atomic<size_t> innerCalls{0};
+    pool.parallelFor(4, [&](size_t) {
+        std::thread inner([&]() {
+            pool.parallelFor(100, [&](size_t) { innerCalls++; });
+        });
+        inner.join();
+    });
+    ASSERT_EQ(innerCalls, 400u);
+}
+
+TEST(ThreadPoolTest, ChangesThreadCountBetweenLoops) {
+    ThreadPool pool{2};
+    std::atomic<size_t> calls{0};
+    pool.parallelFor(100, [&](size_t) { calls++; });
+    pool.setThreadCount(6);
+    ASSERT_EQ(pool.getThreadCount(), 6u);
+    pool.parallelFor(100, [&](size_t) { calls++; });
+    ASSERT_EQ(calls, 200u);
+}
+
+}  // namespace blocksci
@@ -8,20 +8,30 @@
 
 #include <blocksci/chain/blockchain.hpp>
 #include <blocksci/cluster/cluster_manager.hpp>
+#include <blocksci/core/thread_pool.hpp>
 #include <blocksci/heuristics/change_address.hpp>
 
 #include <clipp.h>
 
+#include <cstdlib>
 #include <iostream>
+#include <stdexcept>
+#include <thread>
 
 int main(int argc, char * argv[]) {
     std::string configLocation;
     std::string outputLocation;
-    bool overwrite;
+    bool overwrite = false;
+    bool update = false;
+    bool summaries = false;
+    unsigned int threadCount = std::thread::hardware_concurrency();
     auto cli = (
                 clipp::value("config file location", configLocation),
                 clipp::value("output location", outputLocation),
-                clipp::option("--overwrite").set(overwrite).doc("Overwrite existing cluster files if they exist")
+                clipp::option("--overwrite").set(overwrite).doc("Overwrite existing cluster files if they exist"),
+                clipp::option("--update").set(update).doc("Extend the existing clustering in the output location with the blocks added since it was created"),
+                clipp::option("--summaries").set(summaries).doc("Also store the balance, transaction count and first and last use of every cluster"),
+                (clipp::option("--threads") & clipp::value("thread count", threadCount)) % "Number of threads used for clustering, defaults to the number of cores"
     );
     auto res = parse(argc, argv, cli);
     if (res.any_error()) {
@@ -29,8 +39,24 @@ int main(int argc, char * argv[]) {
         return 0;
     }
     
+    blocksci::ThreadPool::instance().setThreadCount(threadCount);
     blocksci::Blockchain chain(configLocation);
     
-    blocksci::ClusterManager::createClustering(chain, blocksci::heuristics::NoChange{}, outputLocation, overwrite);
+    blocksci::ClusteringStats stats;
+    blocksci::heuristics::ChangeHeuristic changeHeuristic{blocksci::heuristics::NoChange{}};
+    auto manager = [&]() {
+        try {
+            return update
+                ? blocksci::ClusterManager::updateClustering(chain, changeHeuristic, outputLocation, true, &stats)
+                : blocksci::ClusterManager::createClustering(chain, changeHeuristic, outputLocation, overwrite, true, &stats);
+        } catch (const std::runtime_error &e) {
+            std::cout << e.what() << std::endl;
+            exit(1);
+        }
+    }();
+    std::cout << "\nLinked " << stats.linkCount << " address pairs (" << stats.mergeCount << " merges) in " << stats.linkSeconds << "s on " << stats.threadCount << " threads, " << static_cast<uint64_t>(stats.linksPerSecond()) << " unions/s\n";
+    if (summaries) {
+        manager.createSummaries(chain);
+    }
     return 0;
 }
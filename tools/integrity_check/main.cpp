@@ -9,6 +9,7 @@
 #include <blocksci/core/dedup_address.hpp>
 #include <blocksci/chain/blockchain.hpp>
 #include <blocksci/chain/block.hpp>
+#include <blocksci/core/thread_pool.hpp>
 #include <blocksci/script.hpp>
 
 
@@ -18,59 +19,270 @@
 #include <internal/dedup_address_info.hpp>
 #include <internal/hash_index.hpp>
 #include <internal/script_access.hpp>
+#include <internal/sha256_batch.hpp>
 
 #include <range/v3/utility/optional.hpp>
 
-#include <openssl/sha.h>
-
 #include <clipp.h>
 
+#include <cstdio>
+#include <functional>
 #include <iostream>
 #include <fstream>
+#include <stdexcept>
+#include <vector>
 
 using namespace blocksci;
 
+// Records per chunk of each dataset, chosen so that a chunk covers roughly a megabyte of data
+constexpr uint64_t blockChunkRecords = 1 << 14;
+constexpr uint64_t txChunkRecords = 1 << 12;
+constexpr uint64_t scriptChunkRecords = 1 << 14;
+constexpr uint64_t addressIndexChunkRecords = 1 << 15;
+constexpr uint64_t additionalChunkRecords = 1 << 14;
+constexpr uint64_t txBlockHeightChunkRecords = 1 << 18;
+constexpr uint64_t spendingInputChunkRecords = 1 << 19;
+
+// Chunks that are handed to sha256Batch together, enough to keep all lanes of every implementation busy
+constexpr size_t chunksPerBatch = 8;
+
+// Copy of the bytes of a chunk whose records aren't stored contiguously
+using ChunkBuffer = std::vector<unsigned char>;
+
+struct ChecksumOptions {
+    // Directory holding the chunk digests of the last check
+    filesystem::path directory;
+    // Rehash all chunks instead of reusing the digests of complete chunks of append-only data
+    bool verify;
+};
+
 /**
- Compute a checksum over block data.
+ Digests of the chunks of one dataset, chunk i covers the records [i * chunkRecords, (i + 1) * chunkRecords).
  */
-uint256 compute_block_hash(const ChainAccess &access) {
-    uint256 hash;
-    SHA256_CTX sha256;
-    SHA256_Init(&sha256);
-    for(int i = 0; i < access.blockCount(); i++) {
-        const RawBlock *block = access.getBlock(i);
-        SHA256_Update(&sha256, &block->baseSize, 4);
-        SHA256_Update(&sha256, &block->bits, 4);
-        SHA256_Update(&sha256, &block->coinbaseOffset, 8);
-        SHA256_Update(&sha256, &block->firstTxIndex, 4);
-        SHA256_Update(&sha256, &block->hash, 32);
-        SHA256_Update(&sha256, &block->height, 4);
-        SHA256_Update(&sha256, &block->inputCount, 4);
-        SHA256_Update(&sha256, &block->nonce, 4);
-        SHA256_Update(&sha256, &block->outputCount, 4);
-        SHA256_Update(&sha256, &block->realSize, 4);
-        SHA256_Update(&sha256, &block->timestamp, 4);
-        SHA256_Update(&sha256, &block->txCount, 4);
-        SHA256_Update(&sha256, &block->version, 4);
+struct ChunkDigests {
+    uint64_t chunkRecords = 0;
+    uint64_t recordCount = 0;
+    std::vector<uint256> digests;
+};
+
+/**
+ Dataset that is checksummed chunk by chunk.
+ */
+struct ChunkedData {
+    std::string name;
+    uint64_t recordCount;
+    uint64_t chunkRecords;
+    // Existing records never change, so the digests of complete chunks stay valid as records are appended
+    bool appendOnly;
+    // Computes the digests of all chunks starting at the given one
+    std::function<std::vector<uint256>(uint64_t firstChunk)> hashChunks;
+};
+
+uint64_t chunk_count(uint64_t recordCount, uint64_t chunkRecords) {
+    return (recordCount + chunkRecords - 1) / chunkRecords;
+}
+
+filesystem::path chunk_digests_path(const ChecksumOptions &options, const std::string &name) {
+    return options.directory/(name + "_chunks.dat");
+}
+
+ChunkDigests load_chunk_digests(const filesystem::path &path) {
+    ChunkDigests saved;
+    if (!path.exists()) {
+        return saved;
+    }
+    std::ifstream file(path.str(), std::ios::binary);
+    file.read(reinterpret_cast<char *>(&saved.chunkRecords), sizeof(saved.chunkRecords));
+    file.read(reinterpret_cast<char *>(&saved.recordCount), sizeof(saved.recordCount));
+    if (file && saved.chunkRecords > 0) {
+        saved.digests.resize(chunk_count(saved.recordCount, saved.chunkRecords));
+        file.read(reinterpret_cast<char *>(saved.digests.data()), static_cast<std::streamsize>(saved.digests.size() * sizeof(uint256)));
+    }
+    if (!file) {
+        std::cout << "Ignoring unreadable chunk digests " << path.str() << "." << std::endl;
+        return ChunkDigests{};
+    }
+    return saved;
+}
+
+void save_chunk_digests(const filesystem::path &path, const ChunkDigests &digests) {
+    auto pathString = path.str();
+    {
+        std::ofstream file(pathString + ".tmp", std::ios::binary);
+        file.write(reinterpret_cast<const char *>(&digests.chunkRecords), sizeof(digests.chunkRecords));
+        file.write(reinterpret_cast<const char *>(&digests.recordCount), sizeof(digests.recordCount));
+        file.write(reinterpret_cast<const char *>(digests.digests.data()), static_cast<std::streamsize>(digests.digests.size() * sizeof(uint256)));
+        file.close();
+        if (file.fail()) {
+            throw std::runtime_error("Failed to write chunk digests " + pathString);
+        }
+    }
+    if (std::rename((pathString + ".tmp").c_str(), pathString.c_str()) != 0) {
+        throw std::runtime_error("Failed to replace chunk digests " + pathString);
     }
-    SHA256_Final(reinterpret_cast<unsigned char *>(&hash), &sha256);
-    return hash;
 }
 
 /**
- Compute a checksum over core transaction data.
+ Combine digests into a Merkle root, pairing the last digest of a level with itself if the level has an odd size.
+ Every level is hashed as one batch. The root of no digests is the hash of the empty string.
+ */
+uint256 merkle_root(std::vector<uint256> level) {
+    if (level.empty()) {
+        uint256 hash;
+        HashInput empty;
+        sha256Batch(&empty, 1, &hash);
+        return hash;
+    }
+    while (level.size() > 1) {
+        if (level.size() % 2 == 1) {
+            level.push_back(level.back());
+        }
+        std::vector<HashInput> inputs;
+        inputs.reserve(level.size() / 2);
+        for (size_t i = 0; i < level.size(); i += 2) {
+            inputs.emplace_back(&level[i], 2 * sizeof(uint256));
+        }
+        std::vector<uint256> parents(inputs.size());
+        sha256Batch(inputs.data(), inputs.size(), parents.data());
+        level = std::move(parents);
+    }
+    return level.front();
+}
+
+/**
+ Compute the checksum of a dataset as the Merkle root of the digests of its chunks.
+
+ The chunk digests are saved for the next check. Complete chunks of append-only data are taken from the last check
+ unless options.verify is set, in which case they are rehashed. Every rehashed chunk that differs from the last check
+ is reported with its record range, for data that is updated in place these are the chunks that changed.
  */
-uint256 compute_txdata_hash(const ChainAccess &access) {
-    uint256 hash;
-    SHA256_CTX sha256;
-    SHA256_Init(&sha256);
-    for(size_t i = 0; i < access.txCount(); i++) {
-        // no additional padding in RawTransaction, can simply hash struct
-        const RawTransaction *tx = access.getTx(i);
-        SHA256_Update(&sha256, tx, tx->serializedSize());
+uint256 chunked_checksum(const ChunkedData &data, const ChecksumOptions &options) {
+    auto path = chunk_digests_path(options, data.name);
+    auto saved = load_chunk_digests(path);
+
+    // Chunks that were complete at the last check, records can only have been appended if the count didn't shrink
+    uint64_t savedChunks = 0;
+    if (saved.chunkRecords == data.chunkRecords && saved.recordCount <= data.recordCount) {
+        savedChunks = saved.recordCount / data.chunkRecords;
     }
-    SHA256_Final(reinterpret_cast<unsigned char *>(&hash), &sha256);
-    return hash;
+    uint64_t reusedChunks = (data.appendOnly && !options.verify) ? savedChunks : 0;
+
+    std::vector<uint256> digests(saved.digests.begin(), saved.digests.begin() + static_cast<std::ptrdiff_t>(reusedChunks));
+    auto newDigests = data.hashChunks(reusedChunks);
+    digests.insert(digests.end(), newDigests.begin(), newDigests.end());
+
+    uint64_t changedChunks = 0;
+    for (uint64_t chunk = reusedChunks; chunk < savedChunks; ++chunk) {
+        if (digests[chunk] != saved.digests[chunk]) {
+            changedChunks++;
+            std::cout << "Chunk " << chunk << " of " << data.name << " (records " << chunk * data.chunkRecords << " to " << (chunk + 1) * data.chunkRecords - 1 << ") " << (data.appendOnly ? "differs from" : "changed since") << " the last check." << std::endl;
+        }
+    }
+
+    if (data.appendOnly && changedChunks > 0) {
+        // Keep the digests of the last check so that the damaged chunks are reported again until the data is fixed
+        std::cout << changedChunks << " of " << savedChunks << " chunks of " << data.name << " differ from the last check, not saving new chunk digests." << std::endl;
+    } else {
+        if (!data.appendOnly && changedChunks > 0) {
+            std::cout << changedChunks << " of " << savedChunks << " chunks of " << data.name << " changed since the last check." << std::endl;
+        }
+        save_chunk_digests(path, ChunkDigests{data.chunkRecords, data.recordCount, digests});
+    }
+    return merkle_root(std::move(digests));
+}
+
+void append_bytes(ChunkBuffer &buffer, const void *data, size_t size) {
+    auto bytes = static_cast<const unsigned char *>(data);
+    buffer.insert(buffer.end(), bytes, bytes + size);
+}
+
+/**
+ Hash the chunks from firstChunk to chunkCount with sha256Batch, chunksPerBatch chunks at a time on each thread.
+ chunkInput returns the message of a chunk, either ranges of mapped files or a copy of its records in the given buffer.
+ */
+template <typename Func>
+std::vector<uint256> hash_chunks(uint64_t chunkCount, uint64_t firstChunk, Func chunkInput) {
+    std::vector<uint256> digests(chunkCount - firstChunk);
+    auto batchCount = (digests.size() + chunksPerBatch - 1) / chunksPerBatch;
+    ThreadPool::instance().parallelFor(batchCount, [&](size_t batch) {
+        auto begin = batch * chunksPerBatch;
+        auto end = std::min(begin + chunksPerBatch, digests.size());
+        std::vector<ChunkBuffer> buffers(end - begin);
+        std::vector<HashInput> inputs;
+        inputs.reserve(end - begin);
+        for (size_t i = begin; i < end; ++i) {
+            inputs.push_back(chunkInput(buffers[i - begin], firstChunk + i));
+        }
+        sha256Batch(inputs.data(), inputs.size(), &digests[begin]);
+    });
+    return digests;
+}
+
+/**
+ Hash the chunks of a dataset in parallel, each chunk as one message made of its records.
+ */
+template <typename Func>
+std::vector<uint256> hash_record_chunks(uint64_t recordCount, uint64_t chunkRecords, uint64_t firstChunk, Func hashRecord) {
+    return hash_chunks(chunk_count(recordCount, chunkRecords), firstChunk, [&](ChunkBuffer &buffer, uint64_t chunk) {
+        auto begin = chunk * chunkRecords;
+        auto end = std::min(begin + chunkRecords, recordCount);
+        for (uint64_t index = begin; index < end; ++index) {
+            hashRecord(buffer, index);
+        }
+        return HashInput{buffer.data(), buffer.size()};
+    });
+}
+
+/**
+ Add the records [begin, end) of a file of fixed size records to a message.
+ */
+template <typename T>
+void add_file_range(HashInput &input, const FixedSizeFileMapper<T> &file, uint64_t begin, uint64_t end) {
+    if (end > begin) {
+        input.append(file.getDataAtIndex(static_cast<OffsetType>(begin)), (end - begin) * sizeof(T));
+    }
+}
+
+/**
+ Compute a checksum over block data.
+ */
+uint256 compute_block_hash(const ChainAccess &access, const ChecksumOptions &options) {
+    uint64_t blockCount = static_cast<uint64_t>(access.blockCount());
+    ChunkedData data{"blocks", blockCount, blockChunkRecords, true, [&](uint64_t firstChunk) {
+        return hash_record_chunks(blockCount, blockChunkRecords, firstChunk, [&](ChunkBuffer &buffer, uint64_t i) {
+            const RawBlock *block = access.getBlock(static_cast<BlockHeight>(i));
+            append_bytes(buffer, &block->baseSize, 4);
+            append_bytes(buffer, &block->bits, 4);
+            append_bytes(buffer, &block->coinbaseOffset, 8);
+            append_bytes(buffer, &block->firstTxIndex, 4);
+            append_bytes(buffer, &block->hash, 32);
+            append_bytes(buffer, &block->height, 4);
+            append_bytes(buffer, &block->inputCount, 4);
+            append_bytes(buffer, &block->nonce, 4);
+            append_bytes(buffer, &block->outputCount, 4);
+            append_bytes(buffer, &block->realSize, 4);
+            append_bytes(buffer, &block->timestamp, 4);
+            append_bytes(buffer, &block->txCount, 4);
+            append_bytes(buffer, &block->version, 4);
+        });
+    }};
+    return chunked_checksum(data, options);
+}
+
+/**
+ Compute a checksum over core transaction data.
+ The parser links spent outputs to their spending transaction inside existing records, so all chunks are rehashed.
+ */
+uint256 compute_txdata_hash(const ChainAccess &access, const ChecksumOptions &options) {
+    uint64_t txCount = access.txCount();
+    ChunkedData data{"txes", txCount, txChunkRecords, false, [&](uint64_t firstChunk) {
+        return hash_record_chunks(txCount, txChunkRecords, firstChunk, [&](ChunkBuffer &buffer, uint64_t i) {
+            // no additional padding in RawTransaction, can simply hash struct
+            const RawTransaction *tx = access.getTx(static_cast<uint32_t>(i));
+            append_bytes(buffer, tx, tx->serializedSize());
+        });
+    }};
+    return chunked_checksum(data, options);
 }
 
 /**
@@ -81,236 +293,256 @@ uint256 compute_txdata_hash(const ChainAccess &access) {
  - Transaction hashes
  - Index of first input for each transaction
  - Index of first output for each transaction
+ Chunk i covers the transactions [i * additionalChunkRecords, (i + 1) * additionalChunkRecords) and their inputs,
+ hashed file by file in the order above. A chain that fits into one chunk has the checksum of one message over all
+ files, as computed by earlier versions.
  */
-uint256 compute_additional_data_hash(const DataAccess &access) {
-    uint256 hash;
-    SHA256_CTX sha256;
-    SHA256_Init(&sha256);
+uint256 compute_additional_data_hash(const DataAccess &access, const ChecksumOptions &options) {
     const ChainAccess &chainAccess = access.getChain();
     auto chainDirectory = access.config.chainDirectory();
 
     FixedSizeFileMapper<uint32_t> sequenceFile(chainAccess.sequenceFilePath(chainDirectory));
-    for(uint64_t i = 0; i < chainAccess.inputCount(); ++i) {
-        SHA256_Update(&sha256, sequenceFile[i], 4);
-    }
-
     FixedSizeFileMapper<uint16_t> spentOutNumFile(chainAccess.inputSpentOutNumFilePath(chainDirectory));
-    for(uint64_t i = 0; i < chainAccess.inputCount(); ++i) {
-        SHA256_Update(&sha256, spentOutNumFile[i], 2);
-    }
-
     FixedSizeFileMapper<int32_t> txVersionFile(chainAccess.txVersionFilePath(chainDirectory));
-    for(uint32_t i = 0; i < chainAccess.txCount(); ++i) {
-        SHA256_Update(&sha256, txVersionFile[i], 4);
-    }
-
     FixedSizeFileMapper<uint256> txHashesFile(chainAccess.txHashesFilePath(chainDirectory));
-    for(uint32_t i = 0; i < chainAccess.txCount(); ++i) {
-        SHA256_Update(&sha256, txHashesFile[i], 32);
-    }
-
     FixedSizeFileMapper<uint64_t> txFirstInputFile(chainAccess.firstInputFilePath(chainDirectory));
-    for(uint32_t i = 0; i < chainAccess.txCount(); ++i) {
-        SHA256_Update(&sha256, txFirstInputFile[i], 8);
-    }
-
     FixedSizeFileMapper<uint64_t> txFirstOutputFile(chainAccess.firstOutputFilePath(chainDirectory));
-    for(uint32_t i = 0; i < chainAccess.txCount(); ++i) {
-        SHA256_Update(&sha256, txFirstOutputFile[i], 8);
-    }
 
-    SHA256_Final(reinterpret_cast<unsigned char *>(&hash), &sha256);
-    return hash;
+    uint64_t txCount = chainAccess.txCount();
+    uint64_t inputCount = chainAccess.inputCount();
+    ChunkedData data{"additional", txCount, additionalChunkRecords, true, [&](uint64_t firstChunk) {
+        return hash_chunks(chunk_count(txCount, additionalChunkRecords), firstChunk, [&](ChunkBuffer &, uint64_t chunk) {
+            auto firstTx = chunk * additionalChunkRecords;
+            auto endTx = std::min(firstTx + additionalChunkRecords, txCount);
+            auto firstInput = *txFirstInputFile[static_cast<OffsetType>(firstTx)];
+            auto endInput = endTx < txCount ? *txFirstInputFile[static_cast<OffsetType>(endTx)] : inputCount;
+            HashInput input;
+            add_file_range(input, sequenceFile, firstInput, endInput);
+            add_file_range(input, spentOutNumFile, firstInput, endInput);
+            add_file_range(input, txVersionFile, firstTx, endTx);
+            add_file_range(input, txHashesFile, firstTx, endTx);
+            add_file_range(input, txFirstInputFile, firstTx, endTx);
+            add_file_range(input, txFirstOutputFile, firstTx, endTx);
+            return input;
+        });
+    }};
+    return chunked_checksum(data, options);
 }
 
-template<DedupAddressType::Enum dedupType>
-uint256 compute_scriptdata_hash(const DataAccess &access);
+/**
+ Compute a checksum over a file of fixed size records, chunk i covering the records [i * chunkRecords, (i + 1) * chunkRecords).
+ */
+template <typename T>
+uint256 compute_file_hash(const std::string &name, const FixedSizeFileMapper<T> &file, uint64_t chunkRecords, bool appendOnly, const ChecksumOptions &options) {
+    auto recordCount = static_cast<uint64_t>(file.size());
+    ChunkedData data{name, recordCount, chunkRecords, appendOnly, [&](uint64_t firstChunk) {
+        return hash_chunks(chunk_count(recordCount, chunkRecords), firstChunk, [&](ChunkBuffer &, uint64_t chunk) {
+            auto begin = chunk * chunkRecords;
+            HashInput input;
+            add_file_range(input, file, begin, std::min(begin + chunkRecords, recordCount));
+            return input;
+        });
+    }};
+    return chunked_checksum(data, options);
+}
 
 /**
- Compute a checksum over pubkey data.
+ Compute a checksum over the block height of every transaction.
  */
-template<>
-uint256 compute_scriptdata_hash<DedupAddressType::Enum::PUBKEY>(const DataAccess &access) {
-    uint256 hash;
-    SHA256_CTX sha256;
-    SHA256_Init(&sha256);
+uint256 compute_tx_block_height_hash(const DataAccess &access, const ChecksumOptions &options) {
+    FixedSizeFileMapper<BlockHeight> file(ChainAccess::txBlockHeightFilePath(access.config.chainDirectory()));
+    return compute_file_hash("tx_block_height", file, txBlockHeightChunkRecords, true, options);
+}
 
-    auto scripts = &access.getScripts();
-    constexpr DedupAddressType::Enum dedupType = DedupAddressType::PUBKEY;
-    auto scriptCount = scripts->scriptCount(dedupType);
+/**
+ Compute a checksum over the spending input of every output.
+ Outputs are marked when they are spent, so all chunks are rehashed.
+ */
+uint256 compute_output_spending_input_hash(const DataAccess &access, const ChecksumOptions &options) {
+    FixedSizeFileMapper<uint16_t> file(ChainAccess::outputSpendingInputFilePath(access.config.chainDirectory()));
+    return compute_file_hash("output_spending_input", file, spendingInputChunkRecords, false, options);
+}
 
-    for(uint32_t i = 1; i <= scriptCount; ++i) {
-        auto data = scripts->getScriptData<dedupType>(i);
-        SHA256_Update(&sha256, &data->address, sizeof(uint160));
-        SHA256_Update(&sha256, &data->pubkey, sizeof(RawPubkey));
-        SHA256_Update(&sha256, &data->hasPubkey, sizeof(bool));
-        SHA256_Update(&sha256, &data->txFirstSeen, 4);
-        SHA256_Update(&sha256, &data->txFirstSpent, 4);
-        SHA256_Update(&sha256, &data->typesSeen, 4);
-    }
+template<DedupAddressType::Enum dedupType>
+void hash_script(ChunkBuffer &buffer, const ScriptAccess &scripts, uint32_t scriptNum);
 
-    SHA256_Final(reinterpret_cast<unsigned char *>(&hash), &sha256);
-    return hash;
+/**
+ Hash the fields of a pubkey script.
+ */
+template<>
+void hash_script<DedupAddressType::Enum::PUBKEY>(ChunkBuffer &buffer, const ScriptAccess &scripts, uint32_t scriptNum) {
+    auto data = scripts.getScriptData<DedupAddressType::PUBKEY>(scriptNum);
+    append_bytes(buffer, &data->address, sizeof(uint160));
+    append_bytes(buffer, &data->pubkey, sizeof(RawPubkey));
+    append_bytes(buffer, &data->hasPubkey, sizeof(bool));
+    append_bytes(buffer, &data->txFirstSeen, 4);
+    append_bytes(buffer, &data->txFirstSpent, 4);
+    append_bytes(buffer, &data->typesSeen, 4);
 }
 
 /**
-Compute a checksum over scripthash data.
+Hash the fields of a scripthash script.
 */
 template<>
-uint256 compute_scriptdata_hash<DedupAddressType::Enum::SCRIPTHASH>(const DataAccess &access) {
-    uint256 hash;
-    SHA256_CTX sha256;
-    SHA256_Init(&sha256);
-
-    auto scripts = &access.getScripts();
-    constexpr DedupAddressType::Enum dedupType = DedupAddressType::SCRIPTHASH;
-    auto scriptCount = scripts->scriptCount(dedupType);
-
-    for(uint32_t i = 1; i <= scriptCount; ++i) {
-        auto data = scripts->getScriptData<dedupType>(i);
-        SHA256_Update(&sha256, &data->hash160, sizeof(uint160));
-        SHA256_Update(&sha256, &data->hash256, sizeof(uint256));
-        SHA256_Update(&sha256, &data->isSegwit, sizeof(bool));
-        SHA256_Update(&sha256, &data->txFirstSeen, 4);
-        SHA256_Update(&sha256, &data->txFirstSpent, 4);
-        SHA256_Update(&sha256, &data->typesSeen, 4);
-        SHA256_Update(&sha256, &data->wrappedAddress, sizeof(RawAddress));
-    }
-
-    SHA256_Final(reinterpret_cast<unsigned char *>(&hash), &sha256);
-    return hash;
+void hash_script<DedupAddressType::Enum::SCRIPTHASH>(ChunkBuffer &buffer, const ScriptAccess &scripts, uint32_t scriptNum) {
+    auto data = scripts.getScriptData<DedupAddressType::SCRIPTHASH>(scriptNum);
+    append_bytes(buffer, &data->hash160, sizeof(uint160));
+    append_bytes(buffer, &data->hash256, sizeof(uint256));
+    append_bytes(buffer, &data->isSegwit, sizeof(bool));
+    append_bytes(buffer, &data->txFirstSeen, 4);
+    append_bytes(buffer, &data->txFirstSpent, 4);
+    append_bytes(buffer, &data->typesSeen, 4);
+    append_bytes(buffer, &data->wrappedAddress, sizeof(RawAddress));
 }
 
 /**
-Compute a checksum over multisig data.
+Hash a multisig script.
 */
 template<>
-uint256 compute_scriptdata_hash<DedupAddressType::Enum::MULTISIG>(const DataAccess &access) {
-    uint256 hash;
-    SHA256_CTX sha256;
-    SHA256_Init(&sha256);
-
-    auto scripts = &access.getScripts();
-    constexpr DedupAddressType::Enum dedupType = DedupAddressType::MULTISIG;
-    auto scriptCount = scripts->scriptCount(dedupType);
-
-    for(uint32_t i = 1; i <= scriptCount; ++i) {
-        auto data = scripts->getScriptData<dedupType>(i);
-        SHA256_Update(&sha256, data, data->realSize());
-    }
-
-    SHA256_Final(reinterpret_cast<unsigned char *>(&hash), &sha256);
-    return hash;
+void hash_script<DedupAddressType::Enum::MULTISIG>(ChunkBuffer &buffer, const ScriptAccess &scripts, uint32_t scriptNum) {
+    auto data = scripts.getScriptData<DedupAddressType::MULTISIG>(scriptNum);
+    append_bytes(buffer, data, data->realSize());
 }
 
 /**
-Compute a checksum over OP_RETURN data.
+Hash an OP_RETURN script.
 */
 template<>
-uint256 compute_scriptdata_hash<DedupAddressType::Enum::NULL_DATA>(const DataAccess &access) {
-    uint256 hash;
-    SHA256_CTX sha256;
-    SHA256_Init(&sha256);
-
-    auto scripts = &access.getScripts();
-    constexpr DedupAddressType::Enum dedupType = DedupAddressType::NULL_DATA;
-    auto scriptCount = scripts->scriptCount(dedupType);
+void hash_script<DedupAddressType::Enum::NULL_DATA>(ChunkBuffer &buffer, const ScriptAccess &scripts, uint32_t scriptNum) {
+    auto data = scripts.getScriptData<DedupAddressType::NULL_DATA>(scriptNum);
+    append_bytes(buffer, data, data->realSize());
+}
 
-    for(uint32_t i = 1; i <= scriptCount; ++i) {
-        auto data = scripts->getScriptData<dedupType>(i);
-        SHA256_Update(&sha256, data, data->realSize());
+/**
+Hash a nonstandard script.
+*/
+template<>
+void hash_script<DedupAddressType::Enum::NONSTANDARD>(ChunkBuffer &buffer, const ScriptAccess &scripts, uint32_t scriptNum) {
+    auto data = scripts.getScriptData<DedupAddressType::NONSTANDARD>(scriptNum);
+    auto script_data = std::get<0>(data);
+    append_bytes(buffer, script_data, script_data->realSize());
+    auto spend_script_data = std::get<1>(data);
+    if(spend_script_data != nullptr) {
+        append_bytes(buffer, spend_script_data, spend_script_data->realSize());
     }
-
-    SHA256_Final(reinterpret_cast<unsigned char *>(&hash), &sha256);
-    return hash;
 }
 
 /**
-Compute a checksum over nonstandard data.
+Hash an unknown witness script.
 */
 template<>
-uint256 compute_scriptdata_hash<DedupAddressType::Enum::NONSTANDARD>(const DataAccess &access) {
-    uint256 hash;
-    SHA256_CTX sha256;
-    SHA256_Init(&sha256);
-
-    auto scripts = &access.getScripts();
-    constexpr DedupAddressType::Enum dedupType = DedupAddressType::NONSTANDARD;
-    auto scriptCount = scripts->scriptCount(dedupType);
-
-    for(uint32_t i = 1; i <= scriptCount; ++i) {
-        auto data = scripts->getScriptData<dedupType>(i);
-        auto script_data = std::get<0>(data);
-        SHA256_Update(&sha256, script_data, script_data->realSize());
-        auto spend_script_data = std::get<1>(data);
-        if(spend_script_data != nullptr) {
-            SHA256_Update(&sha256, spend_script_data, spend_script_data->realSize());
-        }
+void hash_script<DedupAddressType::Enum::WITNESS_UNKNOWN>(ChunkBuffer &buffer, const ScriptAccess &scripts, uint32_t scriptNum) {
+    auto data = scripts.getScriptData<DedupAddressType::WITNESS_UNKNOWN>(scriptNum);
+    auto script_data = std::get<0>(data);
+    append_bytes(buffer, &script_data->witnessVersion, sizeof(script_data->witnessVersion));
+    append_bytes(buffer, &script_data->scriptData, sizeof(script_data->scriptData) + script_data->scriptData.extraSize());
+    auto spend_script_data = std::get<1>(data);
+    if(spend_script_data != nullptr) {
+        append_bytes(buffer, spend_script_data, spend_script_data->realSize());
     }
+}
 
-    SHA256_Final(reinterpret_cast<unsigned char *>(&hash), &sha256);
-    return hash;
+/**
+ Compute a checksum over script data of the given type.
+ Scripts are updated when they are seen or spent again, so their chunks are always rehashed.
+ */
+template<DedupAddressType::Enum dedupType>
+uint256 compute_scriptdata_hash(const DataAccess &access, const ChecksumOptions &options) {
+    const ScriptAccess &scripts = access.getScripts();
+    uint64_t scriptCount = scripts.scriptCount(dedupType);
+    ChunkedData data{dedupAddressName(dedupType), scriptCount, scriptChunkRecords, false, [&](uint64_t firstChunk) {
+        return hash_record_chunks(scriptCount, scriptChunkRecords, firstChunk, [&](ChunkBuffer &buffer, uint64_t i) {
+            // script numbers start at 1
+            hash_script<dedupType>(buffer, scripts, static_cast<uint32_t>(i + 1));
+        });
+    }};
+    return chunked_checksum(data, options);
 }
 
 /**
-Compute a checksum over unknown witness data.
-*/
-template<>
-uint256 compute_scriptdata_hash<DedupAddressType::Enum::WITNESS_UNKNOWN>(const DataAccess &access) {
-    uint256 hash;
-    SHA256_CTX sha256;
-    SHA256_Init(&sha256);
+ Splits a sequential stream of records into chunks and hashes chunksPerBatch chunks at a time.
+ */
+class ChunkStream {
+    uint64_t chunkRecords;
+    uint64_t recordCount = 0;
+    // Chunks that haven't been hashed yet, the last one is being filled
+    std::vector<ChunkBuffer> pending;
+    std::vector<uint256> digests;
+
+    void hashPending() {
+        if (pending.empty()) {
+            return;
+        }
+        std::vector<HashInput> inputs;
+        inputs.reserve(pending.size());
+        for (auto &buffer : pending) {
+            inputs.emplace_back(buffer.data(), buffer.size());
+        }
+        digests.resize(digests.size() + pending.size());
+        sha256Batch(inputs.data(), inputs.size(), &digests[digests.size() - pending.size()]);
+        pending.clear();
+    }
 
-    auto scripts = &access.getScripts();
-    constexpr DedupAddressType::Enum dedupType = DedupAddressType::WITNESS_UNKNOWN;
-    auto scriptCount = scripts->scriptCount(dedupType);
+public:
+    explicit ChunkStream(uint64_t chunkRecords_) : chunkRecords(chunkRecords_) {}
 
-    for(uint32_t i = 1; i <= scriptCount; ++i) {
-        auto data = scripts->getScriptData<dedupType>(i);
-        auto script_data = std::get<0>(data);
-        SHA256_Update(&sha256, &script_data->witnessVersion, sizeof(script_data->witnessVersion));
-        SHA256_Update(&sha256, &script_data->scriptData, sizeof(script_data->scriptData) + script_data->scriptData.extraSize());
-        auto spend_script_data = std::get<1>(data);
-        if(spend_script_data != nullptr) {
-            SHA256_Update(&sha256, spend_script_data, spend_script_data->realSize());
+    /** Buffer that the next record is added to */
+    ChunkBuffer &nextRecord() {
+        if (recordCount % chunkRecords == 0) {
+            if (pending.size() == chunksPerBatch) {
+                hashPending();
+            }
+            pending.emplace_back();
         }
+        recordCount++;
+        return pending.back();
     }
 
-    SHA256_Final(reinterpret_cast<unsigned char *>(&hash), &sha256);
-    return hash;
-}
+    uint64_t getRecordCount() const {
+        return recordCount;
+    }
+
+    std::vector<uint256> finish() {
+        hashPending();
+        return std::move(digests);
+    }
+};
 
 /**
  Compute a checksum over address range in hash index
  */
 template<AddressType::Enum type>
-void hash_addressrange(SHA256_CTX &sha256, const DataAccess &access) {
+void hash_addressrange(ChunkStream &stream, const DataAccess &access) {
     auto &hashIndex = access.hashIndex;
     auto rng = hashIndex->getAddressRange<type>();
     RANGES_FOR(auto pair, rng) {
-        SHA256_Update(&sha256, &pair.first, sizeof(pair.first));
-        SHA256_Update(&sha256, &pair.second, sizeof(pair.second));
+        auto &buffer = stream.nextRecord();
+        append_bytes(buffer, &pair.first, sizeof(pair.first));
+        append_bytes(buffer, &pair.second, sizeof(pair.second));
     }
 }
 
 /**
  Compute a checksum over all addres ranges in hash index.
+ The index can only be read sequentially, so its chunks are hashed one after another and always rehashed.
  */
-uint256 compute_hashindex_addressrange_hash(const DataAccess &access) {
-    uint256 hash;
-    SHA256_CTX sha256;
-    SHA256_Init(&sha256);
-
-    hash_addressrange<AddressType::MULTISIG>(sha256, access);
-    hash_addressrange<AddressType::MULTISIG_PUBKEY>(sha256, access);
-    hash_addressrange<AddressType::PUBKEY>(sha256, access);
-    hash_addressrange<AddressType::PUBKEYHASH>(sha256, access);
-    hash_addressrange<AddressType::SCRIPTHASH>(sha256, access);
-    hash_addressrange<AddressType::WITNESS_PUBKEYHASH>(sha256, access);
-    hash_addressrange<AddressType::WITNESS_SCRIPTHASH>(sha256, access);
-
-    SHA256_Final(reinterpret_cast<unsigned char *>(&hash), &sha256);
-    return hash;
+uint256 compute_hashindex_addressrange_hash(const DataAccess &access, const ChecksumOptions &options) {
+    ChunkStream stream(addressIndexChunkRecords);
+
+    hash_addressrange<AddressType::MULTISIG>(stream, access);
+    hash_addressrange<AddressType::MULTISIG_PUBKEY>(stream, access);
+    hash_addressrange<AddressType::PUBKEY>(stream, access);
+    hash_addressrange<AddressType::PUBKEYHASH>(stream, access);
+    hash_addressrange<AddressType::SCRIPTHASH>(stream, access);
+    hash_addressrange<AddressType::WITNESS_PUBKEYHASH>(stream, access);
+    hash_addressrange<AddressType::WITNESS_SCRIPTHASH>(stream, access);
+
+    auto recordCount = stream.getRecordCount();
+    auto digests = stream.finish();
+    ChunkedData data{"hashindex_addressrange", recordCount, addressIndexChunkRecords, false, [&](uint64_t) {
+        return digests;
+    }};
+    return chunked_checksum(data, options);
 }
 
 /**
@@ -380,6 +612,8 @@ int main(int argc, char * argv[]) {
     std::ofstream out;
     bool runTxIndexCheck = false;
     bool runNestingIndexCheck = false;
+    std::string checksumDirectory;
+    bool verifyChunks = false;
     std::streambuf *coutbuf = nullptr;
     int endBlock = 0;
 
@@ -387,7 +621,9 @@ int main(int argc, char * argv[]) {
         clipp::value("config file location", configLocation) % "Path to config file",
         (clipp::option("--file", "-f") & clipp::value("output file", outputFile)) % "Write to file instead of std::cout",
         clipp::option("--txindex", "-t").set(runTxIndexCheck).doc("Run tx index check"),
-        clipp::option("--nestingindex", "-n").set(runNestingIndexCheck).doc("Run nesting address index check")
+        clipp::option("--nestingindex", "-n").set(runNestingIndexCheck).doc("Run nesting address index check"),
+        (clipp::option("--checksums", "-c") & clipp::value("checksum directory", checksumDirectory)) % "Directory of the chunk digests of the last check, defaults to integrityCheck in the data directory",
+        clipp::option("--verify", "-v").set(verifyChunks).doc("Rehash all chunks and report those that differ from the last check")
     );
 
     auto res = parse(argc, argv, cli);
@@ -408,42 +644,55 @@ int main(int argc, char * argv[]) {
     const DataAccess &dataAccess = chain.getAccess();
     const ChainAccess &chainAccess = dataAccess.getChain();
 
+    ChecksumOptions options{checksumDirectory.empty() ? dataAccess.config.integrityCheckDirectory() : filesystem::path{checksumDirectory}, verifyChunks};
+    if (!options.directory.exists()) {
+        filesystem::create_directory(options.directory);
+    }
+
     std::cout << "Chain contains " << chain.size() << " blocks, " << chain.getAccess().getChain().txCount() << " txes, " << chain.getAccess().getChain().inputCount() << " inputs, " << chain.getAccess().getChain().outputCount() << " outputs." << std::endl;
 
     std::cout << std::endl << "Blocks:" << std::endl;
-    auto block_hash = compute_block_hash(chainAccess);
+    auto block_hash = compute_block_hash(chainAccess, options);
     std::cout << block_hash.GetHex() << " (BLOCKS)" <<  std::endl;
 
     std::cout << std::endl << "Transactions:" << std::endl;
-    auto txdata_hash = compute_txdata_hash(chainAccess);
+    auto txdata_hash = compute_txdata_hash(chainAccess, options);
     std::cout << txdata_hash.GetHex() << " (TXES)" << std::endl;
 
     std::cout << std::endl << "Additional data:" << std::endl;
-    auto additional_data_hash = compute_additional_data_hash(dataAccess);
+    auto additional_data_hash = compute_additional_data_hash(dataAccess, options);
     std::cout << additional_data_hash.GetHex() << " (ADDITIONAL)" <<  std::endl;
 
+    std::cout << std::endl << "Transaction block heights:" << std::endl;
+    auto tx_block_height_hash = compute_tx_block_height_hash(dataAccess, options);
+    std::cout << tx_block_height_hash.GetHex() << " (TX_BLOCK_HEIGHT)" <<  std::endl;
+
+    std::cout << std::endl << "Output spending inputs:" << std::endl;
+    auto output_spending_input_hash = compute_output_spending_input_hash(dataAccess, options);
+    std::cout << output_spending_input_hash.GetHex() << " (OUTPUT_SPENDING_INPUT)" <<  std::endl;
+
     std::cout << std::endl << "Scripts:" << std::endl;
 
-    auto scripthash_hash = compute_scriptdata_hash<DedupAddressType::SCRIPTHASH>(dataAccess);
+    auto scripthash_hash = compute_scriptdata_hash<DedupAddressType::SCRIPTHASH>(dataAccess, options);
     std::cout << scripthash_hash.GetHex() <<  " (SCRIPTHASH)" << std::endl;
 
-    auto pubkey_hash = compute_scriptdata_hash<DedupAddressType::PUBKEY>(dataAccess);
+    auto pubkey_hash = compute_scriptdata_hash<DedupAddressType::PUBKEY>(dataAccess, options);
     std::cout << pubkey_hash.GetHex() <<  " (PUBKEY)" << std::endl;
 
-    auto multisig_hash = compute_scriptdata_hash<DedupAddressType::MULTISIG>(dataAccess);
+    auto multisig_hash = compute_scriptdata_hash<DedupAddressType::MULTISIG>(dataAccess, options);
     std::cout << multisig_hash.GetHex() <<  " (MULTISIG)" << std::endl;
 
-    auto nulldata_hash = compute_scriptdata_hash<DedupAddressType::NULL_DATA>(dataAccess);
+    auto nulldata_hash = compute_scriptdata_hash<DedupAddressType::NULL_DATA>(dataAccess, options);
     std::cout << nulldata_hash.GetHex() <<  " (NULL_DATA)" << std::endl;
 
-    auto witnessunknown_hash = compute_scriptdata_hash<DedupAddressType::WITNESS_UNKNOWN>(dataAccess);
+    auto witnessunknown_hash = compute_scriptdata_hash<DedupAddressType::WITNESS_UNKNOWN>(dataAccess, options);
     std::cout << witnessunknown_hash.GetHex() <<  " (WITNESS_UNKNOWN)" << std::endl;
 
-    auto nonstandard_hash = compute_scriptdata_hash<DedupAddressType::NONSTANDARD>(dataAccess);
+    auto nonstandard_hash = compute_scriptdata_hash<DedupAddressType::NONSTANDARD>(dataAccess, options);
     std::cout << nonstandard_hash.GetHex() <<  " (NONSTANDARD)" << std::endl;
 
     std::cout << std::endl << "Hash index:" << std::endl;
-    auto hashindex_addressrange_hash = compute_hashindex_addressrange_hash(dataAccess);
+    auto hashindex_addressrange_hash = compute_hashindex_addressrange_hash(dataAccess, options);
     std::cout << hashindex_addressrange_hash.GetHex() << " (ADDRESSINDEX)" <<  std::endl;
 
     if(runTxIndexCheck) {
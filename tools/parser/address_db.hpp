@@ -50,6 +50,22 @@ public:
     void compact() {
         db.compactDB();
     }
+    
+    void startBulkLoad() {
+        db.startBulkLoad();
+    }
+    
+    void finishBulkLoad() {
+        clearNestedCache();
+        clearOutputCache();
+        db.finishBulkLoad();
+    }
+    
+    void finishUpdate() {
+        clearNestedCache();
+        clearOutputCache();
+        db.finish();
+    }
 };
 
 template<>
@@ -13,6 +13,7 @@
 
 #include <internal/address_info.hpp>
 
+#include <array>
 #include <fstream>
 #include <string>
 #include <sstream>
@@ -21,15 +22,50 @@ namespace {
     static constexpr auto multiAddressFileName = "multi";
     static constexpr auto bloomFileName = "bloom_";
     static constexpr auto scriptCountsFileName = "scriptCounts.txt";
+    
+    std::string multiAddressFile(blocksci::DedupAddressType::Enum type, size_t shardNum) {
+        std::stringstream ss;
+        ss << multiAddressFileName << "_" << dedupAddressName(type) << "_" << shardNum << ".dat";
+        return ss.str();
+    }
 }
 
-AddressState::AddressState(filesystem::path path_, HashIndexCreator &hashDb) : path(std::move(path_)), db(hashDb), addressBloomFilters(blocksci::apply(blocksci::DedupAddressType::all(), [&] (auto tag) {
-    return std::make_unique<AddressBloomFilter<tag>>(path/std::string(bloomFileName));
-}))  {
-    blocksci::for_each(multiAddressMaps, [&](auto &multiAddressMap) {
+AddressState::AddressShard::AddressShard(const filesystem::path &bloomPath, size_t shardNum) : addressBloomFilters(blocksci::apply(blocksci::DedupAddressType::all(), [&] (auto tag) {
+    return std::make_unique<AddressBloomFilter<tag>>(bloomPath, shardNum);
+})) {}
+
+AddressState::AddressState(filesystem::path path_, HashIndexCreator &hashDb) : path(std::move(path_)), db(hashDb) {
+    auto bloomPath = path/std::string(bloomFileName);
+    std::array<bool, blocksci::DedupAddressType::size> missingBloomFilters{};
+    for (size_t i = 0; i < shardCount; i++) {
+        blocksci::for_each(blocksci::DedupAddressType::all(), [&](auto tag) {
+            auto filterPath = bloomPath.str() + dedupAddressName(tag) + "_" + std::to_string(i);
+            if (!filesystem::path{filterPath + "Layers.dat"}.exists()) {
+                missingBloomFilters[static_cast<size_t>(tag())] = true;
+            }
+            // Filters from before the switch to blocked layers use a different layout and are rebuilt
+            filesystem::path{filterPath + "Meta.dat"}.remove_file();
+            filesystem::path{filterPath + "Store.dat"}.remove_file();
+        });
+        shards.push_back(std::make_unique<AddressShard>(bloomPath, i));
+        blocksci::for_each(shards.back()->multiAddressMaps, [&](auto &multiAddressMap) {
+            multiAddressMap.unserialize((path/multiAddressFile(multiAddressMap.type, i)).str());
+        });
+    }
+    
+    // Distribute maps that were written before the state was sharded
+    blocksci::for_each(shards.front()->multiAddressMaps, [&](auto &multiAddressMap) {
         std::stringstream ss;
         ss << multiAddressFileName << "_" << dedupAddressName(multiAddressMap.type) << ".dat";
-        multiAddressMap.unserialize((path/ss.str()).str());
+        auto legacyPath = path/ss.str();
+        if (legacyPath.exists()) {
+            std::remove_reference_t<decltype(multiAddressMap)> legacyMap;
+            legacyMap.unserialize(legacyPath.str());
+            for (auto &entry : legacyMap) {
+                std::get<std::remove_reference_t<decltype(multiAddressMap)>>(shardFor(entry.first).multiAddressMaps).add(entry.first, entry.second);
+            }
+            legacyPath.remove_file();
+        }
     });
     
     std::ifstream inputFile((path/std::string(scriptCountsFileName)).str());
@@ -39,6 +75,21 @@ AddressState::AddressState(filesystem::path path_, HashIndexCreator &hashDb) : p
         while ( inputFile >> value ) {
             scriptIndexes.push_back(value);
         }
+        
+        // Bloom filters of an existing parse that are missing (or still unsharded) have to be rebuilt from the hash index
+        if (missingBloomFilters[blocksci::DedupAddressType::PUBKEY]) {
+            reloadBloomFilters<blocksci::DedupAddressType::PUBKEY>();
+        }
+        if (missingBloomFilters[blocksci::DedupAddressType::SCRIPTHASH]) {
+            reloadBloomFilters<blocksci::DedupAddressType::SCRIPTHASH>();
+        }
+        if (missingBloomFilters[blocksci::DedupAddressType::MULTISIG]) {
+            reloadBloomFilters<blocksci::DedupAddressType::MULTISIG>();
+        }
+        blocksci::for_each(blocksci::DedupAddressType::all(), [&](auto tag) {
+            filesystem::path{bloomPath.str() + dedupAddressName(tag) + "Meta.dat"}.remove_file();
+            filesystem::path{bloomPath.str() + dedupAddressName(tag) + "Store.dat"}.remove_file();
+        });
     } else {
         for (size_t i = 0; i < blocksci::DedupAddressType::size; i++) {
             scriptIndexes.push_back(1);
@@ -47,11 +98,11 @@ AddressState::AddressState(filesystem::path path_, HashIndexCreator &hashDb) : p
 }
 
 AddressState::~AddressState() {
-    blocksci::for_each(multiAddressMaps, [&](auto &multiAddressMap) {
-        std::stringstream ss;
-        ss << multiAddressFileName << "_" << dedupAddressName(multiAddressMap.type) << ".dat";
-        multiAddressMap.serialize((path/ss.str()).str());
-    });
+    for (size_t i = 0; i < shardCount; i++) {
+        blocksci::for_each(shards[i]->multiAddressMaps, [&](auto &multiAddressMap) {
+            multiAddressMap.serialize((path/multiAddressFile(multiAddressMap.type, i)).str());
+        });
+    }
     
     std::ofstream outputFile((path/std::string(scriptCountsFileName)).str());
     for (auto value : scriptIndexes) {
@@ -67,9 +118,9 @@ uint32_t AddressState::getNewAddressIndex(blocksci::DedupAddressType::Enum type)
 }
 
 void AddressState::reset(const blocksci::State &state) {
-    reloadBloomFilters();
     scriptIndexes.clear();
     for (auto size : state.scriptCounts) {
         scriptIndexes.push_back(size);
     }
+    reloadBloomFilters();
 }
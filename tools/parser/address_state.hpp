@@ -17,7 +17,12 @@
 #include <internal/dedup_address_info.hpp>
 #include <internal/bitcoin_uint256_hex.hpp>
 
+#include <algorithm>
+#include <array>
 #include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
 
 enum class AddressLocation {
     MultiUseMap,
@@ -32,6 +37,28 @@ struct RawAddressInfo {
     uint32_t addressNum;
 };
 
+/** Hash index lookup queued by AddressState::prefetchAddress, which AddressState::lookupBatch resolves together with
+ * the lookups of other transactions. location and addressNum point into the RawAddressInfo that receives the result */
+struct AddressLookupRequest {
+    blocksci::DedupAddressType::Enum type;
+    blocksci::uint160 hash;
+    AddressLocation *location;
+    uint32_t *addressNum;
+};
+
+/** Counts how lookups in AddressState were answered, so that the effect of prefetching and batching can be measured */
+struct AddressLookupStats {
+    long bloomNegativeCount = 0;
+    long multiCount = 0;
+    long dbCount = 0;
+    long bloomFPCount = 0;
+    
+    // Hash index lookups done ahead of time by lookupBatch, and how many of these found the address
+    long batchCount = 0;
+    long batchedLookupCount = 0;
+    long batchedHitCount = 0;
+};
+
 template<blocksci::AddressType::Enum type>
 struct NonDudupAddressInfo {
     uint32_t addressNum;
@@ -49,6 +76,11 @@ constexpr int startingCount<blocksci::DedupAddressType::MULTISIG> = 100'000'000;
 class AddressState {
     static constexpr auto AddressFalsePositiveRate = .05;
     
+public:
+    /** The deduplication state is split into this many shards by the first byte of the address hash */
+    static constexpr size_t shardCount = 16;
+    
+private:
     template<blocksci::DedupAddressType::Enum scriptType>
     class AddressMap : public SerializableMap<blocksci::uint160, uint32_t>  {
     public:
@@ -60,46 +92,131 @@ class AddressState {
     class AddressBloomFilter : public BloomFilter  {
     public:
         static constexpr auto type = scriptType;
-        AddressBloomFilter(const filesystem::path &path) : BloomFilter(filesystem::path(path.str() + dedupAddressName(type)).str(), startingCount<scriptType>, AddressFalsePositiveRate)  {}
+        AddressBloomFilter(const filesystem::path &path, size_t shardNum) : BloomFilter(filesystem::path(path.str() + dedupAddressName(type) + "_" + std::to_string(shardNum)).str(), startingCount<scriptType> / static_cast<int>(shardCount), AddressFalsePositiveRate)  {}
     };
 
     template<blocksci::DedupAddressType::Enum scriptType>
     using AddressBloomFilterPointer = std::unique_ptr<AddressBloomFilter<scriptType>>;
     
+    using AddressMapTuple = blocksci::to_dedup_address_tuple_t<AddressMap>;
+    using AddressBloomFilterTuple = blocksci::to_dedup_address_tuple_t<AddressBloomFilterPointer>;
+    
+    /** Bloom filters and multi-use maps of all addresses whose hash falls into one shard
+     *
+     * The mutex guards both. Lookups from prefetchAddress may run on any thread while the pipeline resolves earlier
+     * transactions, so every access to a shard holds its lock. Threads working on different shards never contend.
+     */
+    struct AddressShard {
+        std::mutex mutex;
+        AddressMapTuple multiAddressMaps;
+        AddressBloomFilterTuple addressBloomFilters;
+        
+        AddressShard(const filesystem::path &bloomPath, size_t shardNum);
+    };
+    
     filesystem::path path;
     
     HashIndexCreator &db;
     
-    using AddressMapTuple = blocksci::to_dedup_address_tuple_t<AddressMap>;
-    using AddressBloomFilterTuple = blocksci::to_dedup_address_tuple_t<AddressBloomFilterPointer>;
-    
-    AddressMapTuple multiAddressMaps;
-    AddressBloomFilterTuple addressBloomFilters;
+    std::vector<std::unique_ptr<AddressShard>> shards;
     
-    mutable long bloomNegativeCount = 0;
-    mutable long multiCount = 0;
-    mutable long dbCount = 0;
-    mutable long bloomFPCount = 0;
+    AddressLookupStats stats;
     
     
     std::vector<uint32_t> scriptIndexes;
     
-    template<blocksci::AddressType::Enum type>
-    void reloadBloomFilter(int sizeIncreaseRatio) {
-        auto &addressBloomFilter = std::get<AddressBloomFilterPointer<dedupType(type)>>(addressBloomFilters);
-        addressBloomFilter->reset(addressBloomFilter->getMaxItems() * sizeIncreaseRatio, addressBloomFilter->getFPRate());
+    static size_t shardNum(const blocksci::uint160 &hash) {
+        return hash.data[0] % shardCount;
+    }
         
-        db.clearAddressCache<blocksci::DedupAddressInfo<dedupType(type)>::reprType>();
+    AddressShard &shardFor(const blocksci::uint160 &hash) {
+        return *shards[shardNum(hash)];
+    }
+        
+    /** Rebuild the bloom filters of the selected shards from the hash index. The caller must hold the locks of these shards
+     *
+     * The filters grow by themselves as addresses are added, so this is only needed if they are missing or out of date.
+     * The rebuilt filters get room for twice the addresses seen so far, so that they start out with a single layer.
+     */
+    template<blocksci::DedupAddressType::Enum type>
+    void reloadBloomFilters(const std::array<bool, shardCount> &selectedShards) {
+        auto addressCount = static_cast<int64_t>(scriptIndexes[static_cast<size_t>(type)]);
+        auto shardItems = std::max(static_cast<int64_t>(startingCount<type>), 2 * addressCount) / static_cast<int64_t>(shardCount);
+        for (size_t i = 0; i < shardCount; i++) {
+            if (selectedShards[i]) {
+                auto &addressBloomFilter = std::get<AddressBloomFilterPointer<type>>(shards[i]->addressBloomFilters);
+                addressBloomFilter->reset(shardItems, addressBloomFilter->getFPRate());
+            }
+        }
+        
+        db.clearAddressCache<blocksci::DedupAddressInfo<type>::reprType>();
         
-        RANGES_FOR(auto item, db.db.getAddressRange<blocksci::DedupAddressInfo<dedupType(type)>::reprType>()) {
-            addressBloomFilter->add(item.second);
+        RANGES_FOR(auto item, db.db.getAddressRange<blocksci::DedupAddressInfo<type>::reprType>()) {
+            auto num = shardNum(item.second);
+            if (selectedShards[num]) {
+                std::get<AddressBloomFilterPointer<type>>(shards[num]->addressBloomFilters)->add(item.second);
+            }
         }
     }
     
+    template<blocksci::DedupAddressType::Enum type>
     void reloadBloomFilters() {
-        reloadBloomFilter<blocksci::AddressType::PUBKEYHASH>(1);
-        reloadBloomFilter<blocksci::AddressType::SCRIPTHASH>(1);
-        reloadBloomFilter<blocksci::AddressType::MULTISIG>(1);
+        std::array<bool, shardCount> allShards;
+        allShards.fill(true);
+        reloadBloomFilters<type>(allShards);
+    }
+    
+    void reloadBloomFilters() {
+        reloadBloomFilters<blocksci::DedupAddressType::PUBKEY>();
+        reloadBloomFilters<blocksci::DedupAddressType::SCRIPTHASH>();
+        reloadBloomFilters<blocksci::DedupAddressType::MULTISIG>();
+    }
+    
+    template<blocksci::DedupAddressType::Enum type>
+    void lookupBatch(const std::vector<AddressLookupRequest *> &requests) {
+        std::vector<AddressLookupRequest *> typeRequests;
+        std::vector<blocksci::uint160> hashes;
+        for (auto request : requests) {
+            if (request->type == type) {
+                typeRequests.push_back(request);
+                hashes.push_back(request->hash);
+            }
+        }
+        if (hashes.empty()) {
+            return;
+        }
+        
+        auto results = db.db.lookupAddresses<blocksci::DedupAddressInfo<type>::reprType>(hashes);
+        for (size_t i = 0; i < typeRequests.size(); i++) {
+            if (results[i]) {
+                *typeRequests[i]->location = AddressLocation::LevelDb;
+                *typeRequests[i]->addressNum = *results[i];
+                stats.batchedHitCount++;
+            }
+        }
+        stats.batchedLookupCount += static_cast<long>(hashes.size());
+    }
+    
+    /** Check the bloom filter and multi-use map of the address' shard. Returns false if the hash index has to be consulted */
+    template<blocksci::AddressType::Enum type>
+    bool findInShard(RawAddressInfo<type> &addressInfo) {
+        auto &shard = shardFor(addressInfo.hash);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto &addressBloomFilter = std::get<AddressBloomFilterPointer<dedupType(type)>>(shard.addressBloomFilters);
+        if (!addressBloomFilter->possiblyContains(addressInfo.hash)) {
+            // Address has definitely never been seen
+            addressInfo.location = AddressLocation::NotFound;
+            return true;
+        }
+        
+        auto &multiAddressMap = std::get<AddressMap<dedupType(type)>>(shard.multiAddressMaps);
+        auto it = multiAddressMap.find(addressInfo.hash);
+        if (it != multiAddressMap.end()) {
+            addressInfo.location = AddressLocation::MultiUseMap;
+            addressInfo.addressNum = it->second;
+            return true;
+        }
+        return false;
     }
     
 public:
@@ -123,31 +240,92 @@ public:
     
     template<blocksci::AddressType::Enum type, std::enable_if_t<blocksci::DedupAddressInfo<dedupType(type)>::equived, int> = 0>
     RawAddressInfo<type> findAddress(const ScriptOutputData<type> &data) {
-        auto hash = data.getHash();
-        auto &addressBloomFilter = std::get<AddressBloomFilterPointer<dedupType(type)>>(addressBloomFilters);
-        if (!addressBloomFilter->possiblyContains(hash)) {
-            // Address has definitely never been seen
-            bloomNegativeCount++;
-            return {hash, AddressLocation::NotFound, 0};
+        RawAddressInfo<type> addressInfo{data.getHash(), AddressLocation::NotFound, 0};
+        if (findInShard(addressInfo)) {
+            if (addressInfo.location == AddressLocation::NotFound) {
+                stats.bloomNegativeCount++;
+            } else {
+                stats.multiCount++;
+            }
+            return addressInfo;
+        }
+        
+        ranges::optional<uint32_t> destNum = db.lookupAddress<blocksci::DedupAddressInfo<dedupType(type)>::reprType>(addressInfo.hash);
+        if (destNum) {
+            stats.dbCount++;
+            return {addressInfo.hash, AddressLocation::LevelDb, *destNum};
+        } else {
+            stats.bloomFPCount++;
+            // We must have had a false positive
+            return {addressInfo.hash, AddressLocation::NotFound, 0};
+        }
+    }
+    
+    template<blocksci::AddressType::Enum type, std::enable_if_t<!blocksci::DedupAddressInfo<dedupType(type)>::equived, int> = 0>
+    bool prefetchAddress(const ScriptOutputData<type> &, RawAddressInfo<type> &, std::vector<AddressLookupRequest> &) {
+        return false;
+    }
+    
+    /** Thread safe version of findAddress that may run ahead of the transactions that are still being resolved.
+     *
+     * Addresses that pass the bloom filter but are not in the multi-use map are added to lookups, to be resolved
+     * with lookupBatch. That queries the hash index directly, bypassing the write cache of HashIndexCreator, and so
+     * it can't see addresses that were created after it ran. Found addresses are final since their scriptNum never
+     * changes, but a NotFound result has to be confirmed in tx order with confirmAddress.
+     */
+    template<blocksci::AddressType::Enum type, std::enable_if_t<blocksci::DedupAddressInfo<dedupType(type)>::equived, int> = 0>
+    bool prefetchAddress(const ScriptOutputData<type> &data, RawAddressInfo<type> &addressInfo, std::vector<AddressLookupRequest> &lookups) {
+        addressInfo = RawAddressInfo<type>{data.getHash(), AddressLocation::NotFound, 0};
+        if (!findInShard(addressInfo)) {
+            lookups.push_back(AddressLookupRequest{dedupType(type), addressInfo.hash, &addressInfo.location, &addressInfo.addressNum});
+        }
+        return true;
+    }
+    
+    /** Resolve lookups queued by prefetchAddress with one MultiGet per address type. May run concurrently with the
+     * resolution of earlier transactions, but only on a single thread */
+    void lookupBatch(const std::vector<AddressLookupRequest *> &requests) {
+        lookupBatch<blocksci::DedupAddressType::PUBKEY>(requests);
+        lookupBatch<blocksci::DedupAddressType::SCRIPTHASH>(requests);
+        lookupBatch<blocksci::DedupAddressType::MULTISIG>(requests);
+        stats.batchCount++;
+    }
+    
+    /** Completes a lookup started by prefetchAddress. Must be called in tx order like findAddress */
+    template<blocksci::AddressType::Enum type>
+    RawAddressInfo<type> confirmAddress(const RawAddressInfo<type> &prefetched) {
+        switch (prefetched.location) {
+            case AddressLocation::LevelDb: {
+                stats.dbCount++;
+                return prefetched;
+            }
+            case AddressLocation::MultiUseMap: {
+                stats.multiCount++;
+                return prefetched;
+            }
+            case AddressLocation::NotFound: {
+                break;
+            }
         }
         
-        {
-            auto &multiAddressMap = std::get<AddressMap<dedupType(type)>>(multiAddressMaps);
-            auto it = multiAddressMap.find(hash);
-            if (it != multiAddressMap.end()) {
-                multiCount++;
-                return {hash, AddressLocation::MultiUseMap, it->second};
+        RawAddressInfo<type> addressInfo{prefetched.hash, AddressLocation::NotFound, 0};
+        if (findInShard(addressInfo)) {
+            if (addressInfo.location == AddressLocation::NotFound) {
+                stats.bloomNegativeCount++;
+            } else {
+                stats.multiCount++;
             }
+            return addressInfo;
         }
         
-        ranges::optional<uint32_t> destNum = db.lookupAddress<blocksci::DedupAddressInfo<dedupType(type)>::reprType>(hash);
+        // Address may have been added to the write cache since it was prefetched
+        ranges::optional<uint32_t> destNum = db.lookupAddress<blocksci::DedupAddressInfo<dedupType(type)>::reprType>(addressInfo.hash);
         if (destNum) {
-            dbCount++;
-            return {hash, AddressLocation::LevelDb, *destNum};
+            stats.dbCount++;
+            return {addressInfo.hash, AddressLocation::LevelDb, *destNum};
         } else {
-            bloomFPCount++;
-            // We must have had a false positive
-            return {hash, AddressLocation::NotFound, 0};
+            stats.bloomFPCount++;
+            return addressInfo;
         }
     }
     
@@ -155,9 +333,11 @@ public:
     template<blocksci::AddressType::Enum type>
     std::pair<uint32_t, bool> resolveAddress(const RawAddressInfo<type> &addressInfo) {
         bool existingAddress = false;
+        auto &shard = shardFor(addressInfo.hash);
         switch (addressInfo.location) {
             case AddressLocation::LevelDb: {
-                auto &multiAddressMap = std::get<AddressMap<dedupType(type)>>(multiAddressMaps);
+                std::lock_guard<std::mutex> lock(shard.mutex);
+                auto &multiAddressMap = std::get<AddressMap<dedupType(type)>>(shard.multiAddressMaps);
                 multiAddressMap.add(addressInfo.hash, addressInfo.addressNum);
                 existingAddress = true;
                 break;
@@ -175,18 +355,25 @@ public:
         uint32_t addressNum = addressInfo.addressNum;
         if (!existingAddress) {
             addressNum = getNewAddressIndex(dedupType(type));
-            auto &addressBloomFilter = std::get<AddressBloomFilterPointer<dedupType(type)>>(addressBloomFilters);
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            auto &addressBloomFilter = std::get<AddressBloomFilterPointer<dedupType(type)>>(shard.addressBloomFilters);
             addressBloomFilter->add(addressInfo.hash);
             db.addAddress<blocksci::DedupAddressInfo<dedupType(type)>::reprType>(addressInfo.hash, addressNum);
-            if (addressBloomFilter->isFull()) {
-                reloadBloomFilter<type>(2);
-            }
         }
         return std::make_pair(addressNum, !existingAddress);
     }
     
     uint32_t getNewAddressIndex(blocksci::DedupAddressType::Enum type);
     
+    /** Lookup counters since the last call to clearLookupStats. Only read these while the pipeline isn't running */
+    const AddressLookupStats &lookupStats() const {
+        return stats;
+    }
+    
+    void clearLookupStats() {
+        stats = AddressLookupStats{};
+    }
+    
     // Called after resetting index
     void reset(const blocksci::State &state);
 };
@@ -16,7 +16,7 @@ using blocksci::DedupAddressType;
 AddressWriter::AddressWriter(const ParserConfigurationBase &config) :
 scriptFiles(blocksci::apply(blocksci::DedupAddressType::all(), [&] (auto tag) {
     return (filesystem::path{config.dataConfig.scriptsDirectory()}/std::string{dedupAddressName(tag)}).str();
-})) {
+})), segwitScriptHashes(config.dataConfig.scriptHashSegwitFilePath()) {
 }
 
 blocksci::OffsetType AddressWriter::serializeNewOutput(const AnyScriptOutput &output, uint32_t txNum, bool topLevel) {
@@ -51,6 +51,9 @@ void AddressWriter::serializeOutputImp(const ScriptOutput<AddressType::MULTISIG_
 
 void AddressWriter::serializeOutputImp(const ScriptOutput<AddressType::WITNESS_SCRIPTHASH> &output, ScriptFile<blocksci::DedupAddressType::SCRIPTHASH> &file, bool topLevel) {
     auto data = file[output.scriptNum - 1];
+    if (!data->isSegwit) {
+        segwitScriptHashes.write(output.scriptNum);
+    }
     data->hash256 = output.data.hash;
     data->isSegwit = true;
     data->saw(AddressType::WITNESS_SCRIPTHASH, topLevel);
@@ -39,6 +39,9 @@ class AddressWriter {
 
     ScriptFilesTuple scriptFiles;
 
+    // Pay to script hash scripts that become segwit after they were created, read by the address prefix index
+    blocksci::FixedSizeFileMapper<uint32_t, mio::access_mode::write> segwitScriptHashes;
+
     template<blocksci::AddressType::Enum type>
     void serializeInputImp(const ScriptInput<type> &, ScriptFile<dedupType(type)> &) {}
 
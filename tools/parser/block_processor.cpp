@@ -28,19 +28,25 @@
 
 #include <boost/lockfree/spsc_queue.hpp>
 
+#include <algorithm>
 #include <atomic>
+#include <chrono>
 #include <cmath>
+#include <condition_variable>
+#include <exception>
 #include <fstream>
 #include <future>
 #include <iostream>
 #include <thread>
 #include <list>
+#include <mutex>
 
-std::vector<unsigned char> ParseHex(const char* psz);
+#ifdef BLOCKSCI_FILE_PARSER
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
-BlockProcessor::BlockProcessor(uint32_t startingTxCount_, uint64_t startingInputCount, uint64_t startingOutputCount, uint32_t totalTxCount_, blocksci::BlockHeight maxBlockHeight_) : startingTxCount(startingTxCount_), currentTxNum(startingTxCount_), currentInputNum(startingInputCount), currentOutputNum(startingOutputCount), totalTxCount(totalTxCount_), maxBlockHeight(maxBlockHeight_) {
-    
-}
+std::vector<unsigned char> ParseHex(const char* psz);
 
 std::vector<unsigned char> ParseHex(const char* psz) {
     // convert hex dump to vector
@@ -71,6 +77,108 @@ class BlockFileReader;
 
 #ifdef BLOCKSCI_FILE_PARSER
 
+/** Reads the block files that the importer is about to parse on background threads, so that they are in the page
+ * cache by the time the importer maps them. Block files are read in the order in which the blocks reference them
+ * and at most readAheadFileCount files beyond the one that is currently parsed. */
+class BlockFilePrefetcher {
+    static constexpr size_t readAheadFileCount = 4;
+    static constexpr size_t readerThreadCount = 2;
+    static constexpr size_t readChunkSize = 8 * 1024 * 1024;
+    
+    /** Paths of the block files in the order in which they are first needed */
+    std::vector<std::string> filePaths;
+    
+    /** Map of (blkXXXXX.dat file number) -> (position in filePaths) */
+    std::unordered_map<int, size_t> fileIndexes;
+    
+    std::mutex mutex;
+    std::condition_variable windowMoved;
+    size_t currentFileIndex = 0;
+    size_t nextFileIndex = 0;
+    bool stopping = false;
+    
+    std::vector<std::thread> readers;
+    
+    void readFile(const std::string &path) {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            // Missing files are reported by the importer when it gets to them
+            return;
+        }
+        #ifdef POSIX_FADV_SEQUENTIAL
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+        #endif
+        std::vector<char> buffer(readChunkSize);
+        while (read(fd, buffer.data(), buffer.size()) > 0) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (stopping) {
+                break;
+            }
+        }
+        close(fd);
+    }
+    
+    void runReader() {
+        while (true) {
+            std::string path;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                windowMoved.wait(lock, [&]() {
+                    return stopping || nextFileIndex >= filePaths.size() || nextFileIndex <= currentFileIndex + readAheadFileCount;
+                });
+                if (stopping || nextFileIndex >= filePaths.size()) {
+                    return;
+                }
+                // Files the importer has already moved past are not worth reading anymore
+                nextFileIndex = std::max(nextFileIndex, currentFileIndex);
+                path = filePaths[nextFileIndex];
+                nextFileIndex++;
+            }
+            readFile(path);
+        }
+    }
+    
+public:
+    BlockFilePrefetcher(const ParserConfiguration<FileTag> &config, const std::vector<BlockInfo<FileTag>> &blocksToAdd) {
+        for (auto &block : blocksToAdd) {
+            if (fileIndexes.find(block.nFile) == fileIndexes.end()) {
+                fileIndexes[block.nFile] = filePaths.size();
+                filePaths.push_back(config.pathForBlockFile(block.nFile).str());
+            }
+        }
+        for (size_t i = 0; i < std::min(readerThreadCount, filePaths.size()); i++) {
+            readers.emplace_back([&]() { runReader(); });
+        }
+    }
+    
+    BlockFilePrefetcher(const BlockFilePrefetcher &) = delete;
+    BlockFilePrefetcher &operator=(const BlockFilePrefetcher &) = delete;
+    
+    ~BlockFilePrefetcher() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        windowMoved.notify_all();
+        for (auto &reader : readers) {
+            reader.join();
+        }
+    }
+    
+    /** Called by the importer whenever it starts parsing a block, which moves the read-ahead window forward */
+    void startedFile(int fileNum) {
+        auto index = fileIndexes.at(fileNum);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (index <= currentFileIndex) {
+                return;
+            }
+            currentFileIndex = index;
+        }
+        windowMoved.notify_all();
+    }
+};
+
 template <>
 class BlockFileReader<FileTag> : public BlockFileReaderBase {
     /** Map of (blkXXXXX.dat file number) -> pair(SafeMemReader for blkXXXXX.dat file, last tx number of this blkXXXXX.dat file) */
@@ -82,6 +190,8 @@ class BlockFileReader<FileTag> : public BlockFileReaderBase {
     const ParserConfiguration<FileTag> &config;
     SafeMemReader *reader = nullptr;
     
+    BlockFilePrefetcher prefetcher;
+    
     blocksci::BlockHeight currentHeight = 0;
     uint32_t currentTxNum = 0;
 
@@ -105,7 +215,7 @@ class BlockFileReader<FileTag> : public BlockFileReaderBase {
     }
     
 public:
-    BlockFileReader(const ParserConfiguration<FileTag> &config_, std::vector<BlockInfo<FileTag>> &blocksToAdd, uint32_t firstTxNum) : config(config_) {
+    BlockFileReader(const ParserConfiguration<FileTag> &config_, std::vector<BlockInfo<FileTag>> &blocksToAdd, uint32_t firstTxNum) : config(config_), prefetcher(config_, blocksToAdd) {
         for (auto &block : blocksToAdd) {
             firstTxNum += block.nTx;
             lastTxRequired[block.nFile] = firstTxNum;
@@ -113,6 +223,7 @@ public:
     }
     
     void nextBlock(BlockInfo<FileTag> &block, uint32_t firstTxNum) {
+        prefetcher.startedFile(block.nFile);
         auto fileIt = files.find(block.nFile);
         if (fileIt == files.end()) {
             auto blockPath = config.pathForBlockFile(block.nFile);
@@ -245,6 +356,9 @@ blocksci::RawBlock readNewBlock(uint32_t firstTxNum, uint64_t firstInputNum, uin
         // Write tx version to file (FixedSizeFileMapper<int32_t>)
         files.txVersionFile.write(tx->version);
 
+        // Write height of the block to file (FixedSizeFileMapper<int32_t>)
+        files.txBlockHeightFile.write(block.height);
+
         // If transaction is a coinbase transaction, extract and assign coinbase data
         if (tx->inputs.size() == 1 && tx->inputs[0].rawOutputPointer.hash == nullHash) {
             auto scriptView = tx->inputs[0].getScriptView();
@@ -283,10 +397,22 @@ blocksci::RawBlock readNewBlock(uint32_t firstTxNum, uint64_t firstInputNum, uin
 std::vector<std::function<void(RawTransaction &tx)>> CalculateTxHashStep::steps() {
     return {[&](RawTransaction &tx) {
         tx.calculateHash();
+    }, [&](RawTransaction &tx) {
         hashFile.write(tx.hash);
     }};
 }
 
+std::vector<size_t> CalculateTxHashStep::parallelSteps() {
+    return {0};
+}
+
+std::vector<std::function<void(std::vector<RawTransaction *> &txes)>> CalculateTxHashStep::batchSteps() {
+    // Hashes the transactions in the lanes of the multi-buffer SHA-256 implementation
+    return {[&](std::vector<RawTransaction *> &txes) {
+        calculateHashes(txes);
+    }};
+}
+
 /** 1. step of the processing pipeline
  * Parse the output scripts (into CScriptView) of the transaction in order to identify address types and extract relevant information. */
 std::vector<std::function<void(RawTransaction &tx)>> GenerateScriptOutputsStep::steps() {
@@ -301,6 +427,10 @@ std::vector<std::function<void(RawTransaction &tx)>> GenerateScriptOutputsStep::
     }};
 }
 
+std::vector<size_t> GenerateScriptOutputsStep::parallelSteps() {
+    return {0};
+}
+
 /** 2. step of the processing pipeline
  * Store information about the spent output with each input of the transaction. Then store information about each output for future lookup. */
 std::vector<std::function<void(RawTransaction &tx)>> ConnectUTXOsStep::steps() {
@@ -334,25 +464,47 @@ std::vector<std::function<void(RawTransaction &tx)>> GenerateScriptInputStep::st
             utxoAddressState.addOutput(AnySpendData{scriptOutput}, {tx.txNum, i});
             i++;
         }
+    }, [&](RawTransaction &tx) {
+        // Remove the data about each spent output from the UTXOAddressState, the input scripts are parsed in the next sub-step
+        tx.inputSpendData.clear();
+        tx.inputSpendData.reserve(tx.inputs.size());
+        for (auto &input : tx.inputs) {
+            tx.inputSpendData.push_back(utxoAddressState.spendOutput(input.getOutputPointer(), input.utxo.type));
+        }
     }, [&](RawTransaction &tx) {
         tx.scriptInputs.clear();
         tx.scriptInputs.reserve(tx.inputs.size());
         uint16_t i = 0;
         for (auto &input : tx.inputs) {
             InputView inputView(i, tx.txNum, input.getWitnessStack(), tx.isSegwit);
-            auto spendData = utxoAddressState.spendOutput(input.getOutputPointer(), input.utxo.type);
-            tx.scriptInputs.emplace_back(inputView, input.getScriptView(), tx, spendData);
+            tx.scriptInputs.emplace_back(inputView, input.getScriptView(), tx, tx.inputSpendData[i]);
             i++;
         }
     }};
 }
 
+std::vector<size_t> GenerateScriptInputStep::parallelSteps() {
+    return {2};
+}
+
 /** 4. step of the processing pipeline
  * Attach a scriptNum to each script in the transaction. For address types which are
  * deduplicated (Pubkey, ScriptHash, Multisig and their varients) use the previously allocated
- * scriptNum if the address was seen before. Increment the scriptNum counter for newly seen addresses. */
+ * scriptNum if the address was seen before. Increment the scriptNum counter for newly seen addresses.
+ *
+ * The lookup of previously seen addresses is done first on the worker threads, with the hash index queries
+ * of a whole batch of transactions issued together by a separate step. Assigning the scriptNums then happens
+ * in tx order, so that new addresses are numbered deterministically. */
 std::vector<std::function<void(RawTransaction &tx)>> ProcessAddressesStep::steps() {
     return {[&](RawTransaction &tx) {
+        tx.addressLookups.clear();
+        for (auto &scriptOutput : tx.scriptOutputs) {
+            scriptOutput.prefetch(addressState, tx.addressLookups);
+        }
+        for (auto &scriptInput : tx.scriptInputs) {
+            scriptInput.prefetch(addressState, tx.addressLookups);
+        }
+    }, [&](RawTransaction &tx) {
         for (auto &scriptOutput : tx.scriptOutputs) {
             scriptOutput.resolve(addressState);
         }
@@ -362,6 +514,10 @@ std::vector<std::function<void(RawTransaction &tx)>> ProcessAddressesStep::steps
     }};
 }
 
+std::vector<size_t> ProcessAddressesStep::parallelSteps() {
+    return {0};
+}
+
 /* 5. step of the processing pipeline
  * Record the scriptNum for each output for later reference. Assign each spent input with
  * the scriptNum of the output its spending. */
@@ -395,7 +551,7 @@ std::vector<std::function<void(RawTransaction &tx)>> SerializeTransactionStep::s
         for (size_t i = 0; i < tx.inputs.size(); i++) {
             auto &input = tx.inputs[i];
             auto &scriptInput = tx.scriptInputs[i];
-            linkDataFile.write({input.getOutputPointer(), tx.txNum});
+            linkDataFile.write({input.getOutputPointer(), tx.txNum, static_cast<uint16_t>(i)});
             auto address = scriptInput.address();
             blocksci::Inout blocksciInput{input.utxo.txNum, address.scriptNum, address.type, input.utxo.value};
             txFile.write(blocksciInput);
@@ -463,6 +619,16 @@ void backUpdateTxes(const ParserConfigurationBase &config) {
     
     {
         blocksci::IndexedFileMapper<mio::access_mode::write, blocksci::RawTransaction> txFile(blocksci::ChainAccess::txFilePath(config.dataConfig.chainDirectory()));
+        blocksci::FixedSizeFileMapper<uint64_t> firstOutputFile(blocksci::ChainAccess::firstOutputFilePath(config.dataConfig.chainDirectory()));
+        blocksci::FixedSizeFileMapper<uint16_t, mio::access_mode::write> spendingInputFile(blocksci::ChainAccess::outputSpendingInputFilePath(config.dataConfig.chainDirectory()));
+        
+        // Extend the spending input column to cover the new outputs, the added entries are zero which marks them as unspent
+        auto txCount = txFile.size();
+        if (txCount > 0) {
+            auto lastTx = txFile.getData(txCount - 1);
+            spendingInputFile.truncate(static_cast<blocksci::OffsetType>(*firstOutputFile[txCount - 1] + lastTx->outputCount));
+        }
+        
         auto progressBar = blocksci::makeProgressBar(updates.size(), [=]() {});
         
         uint32_t count = 0;
@@ -471,6 +637,8 @@ void backUpdateTxes(const ParserConfigurationBase &config) {
             auto &output = tx->getOutput(update.pointer.inoutNum);
             // Set the forward-reference to the tx number of the tx that contains the spending input
             output.setLinkedTxNum(update.txNum);
+            // Record which input of that tx spends the output, stored plus one so that 0 can mark unspent outputs
+            *spendingInputFile[static_cast<blocksci::OffsetType>(*firstOutputFile[update.pointer.txNum] + update.pointer.inoutNum)] = static_cast<uint16_t>(update.inputNum + 1);
             
             count++;
             progressBar.update(count);
@@ -480,16 +648,16 @@ void backUpdateTxes(const ParserConfigurationBase &config) {
 }
 
 struct CompletionGuard {
-    explicit CompletionGuard(std::atomic<bool> &isDone_) : isDone(isDone_) {}
+    explicit CompletionGuard(std::function<void()> onComplete_) : onComplete(std::move(onComplete_)) {}
     CompletionGuard(const CompletionGuard &) = delete;
     CompletionGuard &operator=(const CompletionGuard &) = delete;
     CompletionGuard(CompletionGuard &&) = delete;
     CompletionGuard &operator=(CompletionGuard &&) = delete;
     ~CompletionGuard() {
-        isDone = true;
+        onComplete();
     }
 private:
-    std::atomic<bool> &isDone;
+    std::function<void()> onComplete;
 };
 
 struct NextQueueFinishedEarlyException : public std::runtime_error {
@@ -503,6 +671,51 @@ using TxQueue = boost::lockfree::spsc_queue<RawTransaction *, boost::lockfree::c
 
 using DiscardCheckFunc = std::function<bool(RawTransaction &)>;
 
+using PipelineClock = std::chrono::steady_clock;
+
+/** Parks a pipeline thread while none of its stages can make progress.
+ *
+ * Every thread that changes a queue (or done flag) which the parked thread depends on calls notify(),
+ * which bumps the epoch. A thread reads the epoch before checking its queues and only parks if the epoch
+ * is still unchanged, so no wakeup can be lost. notify() only takes the mutex if the owner is actually parked,
+ * which keeps the cost on the hot path to two atomic operations. */
+class PipelineWaker {
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::atomic<uint64_t> epoch{0};
+    std::atomic<bool> sleeping{false};
+
+public:
+    uint64_t currentEpoch() const {
+        return epoch.load();
+    }
+
+    void notify() {
+        epoch.fetch_add(1);
+        if (sleeping.load()) {
+            std::lock_guard<std::mutex> lock(mutex);
+            cv.notify_one();
+        }
+    }
+
+    void waitPast(uint64_t seenEpoch) {
+        std::unique_lock<std::mutex> lock(mutex);
+        sleeping = true;
+        cv.wait(lock, [&]() { return epoch.load() != seenEpoch; });
+        sleeping = false;
+    }
+};
+
+void wake(PipelineWaker *waker) {
+    if (waker != nullptr) {
+        waker->notify();
+    }
+}
+
+double seconds(PipelineClock::duration duration) {
+    return std::chrono::duration<double>(duration).count();
+}
+
 struct StepNum {
     size_t threadNum;
     size_t subStepNum;
@@ -531,34 +744,71 @@ struct QueueStage {
     virtual void complete() = 0;
     virtual ~QueueStage() = default;
     
+    /** Whether the stage still holds transactions that it took from its input queue but has not passed on yet */
+    virtual bool hasPending() const {
+        return false;
+    }
+    
     std::atomic<bool> *prevDone = nullptr;
+    PipelineWaker *prevWaker = nullptr;
     
     std::atomic<bool> isDone{false};
     TxQueue inputQueue;
     
     TxQueue *nextQueue;
     std::atomic<bool> *nextDone = nullptr;
+    PipelineWaker *nextWaker = nullptr;
     
-    int64_t nextWaitCount;
+    /** Waker of the thread that runs this stage */
+    PipelineWaker *waker = nullptr;
+
+    /** Time spent running the sub-step and time spent blocked on a full next queue */
+    PipelineClock::duration busyTime{0};
+    PipelineClock::duration blockedTime{0};
+
     StepNum stepNum;
     
+    RawTransaction *pop() {
+        RawTransaction *tx = nullptr;
+        if (inputQueue.pop(tx)) {
+            // The previous stage may be parked waiting for space in our input queue
+            wake(prevWaker);
+        }
+        return tx;
+    }
+
     void push(RawTransaction *tx) {
-        using namespace std::chrono_literals;
-        while (!nextQueue->push(tx)) {
-            if (nextDone && *nextDone) {
-                // Error: next ProcessStep finished before all items were queued
-                throw NextQueueFinishedEarlyException();
+        if (!nextQueue->push(tx)) {
+            auto start = PipelineClock::now();
+            while (true) {
+                auto epoch = waker->currentEpoch();
+                if (nextQueue->push(tx)) {
+                    break;
+                }
+                if (nextDone && *nextDone) {
+                    // Error: next ProcessStep finished before all items were queued
+                    throw NextQueueFinishedEarlyException();
+                }
+                waker->waitPast(epoch);
             }
-            nextWaitCount++;
-            std::this_thread::sleep_for(5ms);
+            blockedTime += PipelineClock::now() - start;
         }
+        wake(nextWaker);
+    }
+
+    void markDone() {
+        isDone = true;
+        wake(nextWaker);
+        wake(prevWaker);
     }
     
     void linkBack(QueueStage &prevStage) {
         // Link the queue- and done-pointers for the previous queue to this object's variables
         prevStage.nextQueue = &inputQueue;
         prevStage.nextDone = &isDone;
+        prevStage.nextWaker = waker;
         prevDone = &prevStage.isDone;
+        prevWaker = prevStage.waker;
     }
     
     bool prevFinished() {
@@ -567,27 +817,31 @@ struct QueueStage {
     }
 };
 
+/** Upper bound on the number of transactions that are passed to the batch version of a sub-step at once */
+constexpr size_t subStepBatchSize = 64;
+
 class ProcessSubStep : public QueueStage {
 public:
     std::function<void(RawTransaction &)> func;
+    std::function<void(std::vector<RawTransaction *> &)> batchFunc;
     DiscardCheckFunc shouldDiscard;
     bool discardIfFull;
+    std::vector<RawTransaction *> batch;
     
-    ProcessSubStep(std::function<void(RawTransaction &)> func_, const DiscardCheckFunc &shouldDiscard_, bool discardIfFull_) : func(std::move(func_)), shouldDiscard(shouldDiscard_), discardIfFull(discardIfFull_) {}
+    ProcessSubStep(std::function<void(RawTransaction &)> func_, std::function<void(std::vector<RawTransaction *> &)> batchFunc_, const DiscardCheckFunc &shouldDiscard_, bool discardIfFull_) : func(std::move(func_)), batchFunc(std::move(batchFunc_)), shouldDiscard(shouldDiscard_), discardIfFull(discardIfFull_) {}
     
     // inputProcessingDone
     bool processNext() override {
+        if (batchFunc) {
+            return processNextBatch();
+        }
         if (inputQueue.read_available() && (discardIfFull || nextQueue->write_available() > 0)) {
-            RawTransaction *rawTx = nullptr;
-            inputQueue.pop(rawTx);
-//            {
-//                static std::mutex m;
-//                std::lock_guard<std::mutex> lock(m);
-//                std::cout << "Step: " << stepNum << " processing tx " << rawTx->txNum << "\n";
-//            }
+            RawTransaction *rawTx = pop();
             assert(rawTx != nullptr);
             // Execute processing step on rawTx, eg. calculateHashesFunc or connectUTXOsFunc
+            auto start = PipelineClock::now();
             func(*rawTx);
+            busyTime += PipelineClock::now() - start;
             // Check if advanceFunc is successful before further processing the pipeline
             if (nextQueue->write_available() == 0 || shouldDiscard(*rawTx)) {
                 delete rawTx;
@@ -600,18 +854,203 @@ public:
         }
     }
     
+    /** Passes all transactions that are available and fit into the next queue to the batch version of the sub-step */
+    bool processNextBatch() {
+        while (batch.size() < subStepBatchSize && inputQueue.read_available() && (discardIfFull || batch.size() < nextQueue->write_available())) {
+            batch.push_back(pop());
+        }
+        if (batch.empty()) {
+            return false;
+        }
+        auto start = PipelineClock::now();
+        batchFunc(batch);
+        busyTime += PipelineClock::now() - start;
+        for (auto rawTx : batch) {
+            if (nextQueue->write_available() == 0 || shouldDiscard(*rawTx)) {
+                delete rawTx;
+            } else {
+                push(rawTx);
+            }
+        }
+        batch.clear();
+        return true;
+    }
+    
     void complete() override {
         
     }
 };
 
+/** Runs a sub-step that only reads and writes the transaction it is given on several worker threads.
+ *
+ * The stage thread hands transactions to the workers round-robin and collects them again in the same
+ * round-robin order, so transactions leave this stage in the order they entered it. If the sub-step has a
+ * batch version, workers pass it all transactions they have available at once. */
+class ParallelProcessSubStep : public QueueStage {
+    struct Worker {
+        TxQueue inputQueue;
+        TxQueue outputQueue;
+        PipelineWaker waker;
+        PipelineClock::duration busyTime{0};
+        std::thread thread;
+    };
+
+    std::function<void(RawTransaction &)> func;
+    std::function<void(std::vector<RawTransaction *> &)> batchFunc;
+    DiscardCheckFunc shouldDiscard;
+    bool discardIfFull;
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::atomic<bool> stopping{false};
+    std::atomic<bool> failed{false};
+    std::exception_ptr workerError;
+
+    size_t dispatchIndex = 0;
+    size_t collectIndex = 0;
+    size_t inFlight = 0;
+
+    void runWorker(Worker &worker) {
+        try {
+            std::vector<RawTransaction *> batch;
+            size_t maxBatchSize = batchFunc ? subStepBatchSize : 1;
+            while (true) {
+                auto epoch = worker.waker.currentEpoch();
+                bool processedAny = false;
+                RawTransaction *rawTx = nullptr;
+                while (true) {
+                    while (batch.size() < maxBatchSize && batch.size() < worker.outputQueue.write_available() && worker.inputQueue.pop(rawTx)) {
+                        batch.push_back(rawTx);
+                    }
+                    if (batch.empty()) {
+                        break;
+                    }
+                    auto start = PipelineClock::now();
+                    if (batchFunc) {
+                        batchFunc(batch);
+                    } else {
+                        for (auto tx : batch) {
+                            func(*tx);
+                        }
+                    }
+                    worker.busyTime += PipelineClock::now() - start;
+                    for (auto tx : batch) {
+                        worker.outputQueue.push(tx);
+                    }
+                    batch.clear();
+                    wake(waker);
+                    processedAny = true;
+                }
+                if (!processedAny) {
+                    if (stopping) {
+                        break;
+                    }
+                    worker.waker.waitPast(epoch);
+                }
+            }
+        } catch (...) {
+            workerError = std::current_exception();
+            failed = true;
+            wake(waker);
+        }
+    }
+
+    void startWorkers() {
+        for (auto &worker : workers) {
+            auto &w = *worker;
+            w.thread = std::thread([this, &w]() { runWorker(w); });
+        }
+    }
+
+    void stopWorkers() {
+        stopping = true;
+        for (auto &worker : workers) {
+            if (worker->thread.joinable()) {
+                worker->waker.notify();
+                worker->thread.join();
+                busyTime += worker->busyTime;
+                worker->busyTime = PipelineClock::duration{0};
+            }
+        }
+    }
+
+public:
+    ParallelProcessSubStep(std::function<void(RawTransaction &)> func_, std::function<void(std::vector<RawTransaction *> &)> batchFunc_, const DiscardCheckFunc &shouldDiscard_, bool discardIfFull_, unsigned int workerCount) : func(std::move(func_)), batchFunc(std::move(batchFunc_)), shouldDiscard(shouldDiscard_), discardIfFull(discardIfFull_) {
+        for (unsigned int i = 0; i < workerCount; i++) {
+            workers.push_back(std::make_unique<Worker>());
+        }
+    }
+
+    ~ParallelProcessSubStep() override {
+        stopWorkers();
+    }
+
+    bool hasPending() const override {
+        return inFlight > 0;
+    }
+
+    bool processNext() override {
+        // Workers are started lazily on the stage thread, after the pipeline has been linked together
+        if (!workers.front()->thread.joinable() && !stopping) {
+            startWorkers();
+        }
+        if (failed) {
+            std::rethrow_exception(workerError);
+        }
+
+        bool processedAny = false;
+
+        // Pass on finished transactions in the order in which they were dispatched
+        while (inFlight > 0 && (discardIfFull || nextQueue->write_available() > 0)) {
+            auto &worker = *workers[collectIndex];
+            RawTransaction *rawTx = nullptr;
+            if (!worker.outputQueue.pop(rawTx)) {
+                break;
+            }
+            wake(&worker.waker);
+            collectIndex = (collectIndex + 1) % workers.size();
+            inFlight--;
+            if (nextQueue->write_available() == 0 || shouldDiscard(*rawTx)) {
+                delete rawTx;
+            } else {
+                push(rawTx);
+            }
+            processedAny = true;
+        }
+
+        // Hand new transactions to the workers
+        while (inputQueue.read_available()) {
+            auto &worker = *workers[dispatchIndex];
+            if (worker.inputQueue.write_available() == 0) {
+                break;
+            }
+            worker.inputQueue.push(pop());
+            wake(&worker.waker);
+            dispatchIndex = (dispatchIndex + 1) % workers.size();
+            inFlight++;
+            processedAny = true;
+        }
+        return processedAny;
+    }
+
+    void complete() override {
+        assert(inFlight == 0);
+        stopWorkers();
+    }
+};
+
 ProcessorStep::~ProcessorStep() = default;
 
+std::vector<size_t> ProcessorStep::parallelSteps() {
+    return {};
+}
+
+std::vector<std::function<void(std::vector<RawTransaction *> &txes)>> ProcessorStep::batchSteps() {
+    return {};
+}
+
 struct TxHoldSubStep : public QueueStage {
     std::vector<RawTransaction *> heldTransactions;
     
-    int64_t prevWaitCount = 0;
-    
     TxHoldSubStep() {}
     
     ~TxHoldSubStep() override {
@@ -619,7 +1058,6 @@ struct TxHoldSubStep : public QueueStage {
     }
     
     void emptyQueue() {
-        using namespace std::chrono_literals;
         for (auto tx : heldTransactions) {
             push(tx);
         }
@@ -627,8 +1065,7 @@ struct TxHoldSubStep : public QueueStage {
     }
     
     bool processNext() override {
-        RawTransaction *rawTx = nullptr;
-        inputQueue.pop(rawTx);
+        RawTransaction *rawTx = pop();
         if (rawTx) {
             if (heldTransactions.size() == 0 || heldTransactions.back()->blockHeight == rawTx->blockHeight) {
                 heldTransactions.push_back(rawTx);
@@ -647,101 +1084,233 @@ struct TxHoldSubStep : public QueueStage {
     }
 };
 
+/** Collects transactions into batches and runs func on each batch as a whole before passing them on.
+ * A batch ends with the last transaction of a block or once it holds maxBatchSize transactions. */
+struct TxBatchSubStep : public QueueStage {
+    std::function<void(std::vector<RawTransaction *> &)> func;
+    size_t maxBatchSize;
+    std::vector<RawTransaction *> batch;
+    
+    TxBatchSubStep(std::function<void(std::vector<RawTransaction *> &)> func_, size_t maxBatchSize_) : func(std::move(func_)), maxBatchSize(maxBatchSize_) {}
+    
+    ~TxBatchSubStep() override {
+        assert(batch.empty());
+    }
+    
+    void flush() {
+        if (batch.empty()) {
+            return;
+        }
+        auto start = PipelineClock::now();
+        func(batch);
+        busyTime += PipelineClock::now() - start;
+        for (auto tx : batch) {
+            push(tx);
+        }
+        batch.clear();
+    }
+    
+    bool processNext() override {
+        RawTransaction *rawTx = pop();
+        if (rawTx) {
+            if (!batch.empty() && batch.back()->blockHeight != rawTx->blockHeight) {
+                flush();
+            }
+            batch.push_back(rawTx);
+            if (batch.size() >= maxBatchSize) {
+                flush();
+            }
+            return true;
+        } else {
+            return false;
+        }
+    }
+    
+    void complete() override {
+        flush();
+    }
+};
+
 class ProcessStep {
 public:
+    std::string name;
     std::unique_ptr<ProcessorStep> func;
     std::vector<std::unique_ptr<QueueStage>> stages;
     
-    int64_t prevWaitCount = 0;
+    /** Heap allocated so that stages can keep pointing at it when the ProcessStep is moved */
+    std::unique_ptr<PipelineWaker> waker;
+
+    /** Time this thread spent parked because none of its stages had input or room in their next queue */
+    PipelineClock::duration waitTime{0};
     
     // AdvanceFunc
-    ProcessStep(std::unique_ptr<ProcessorStep> func_, std::vector<std::unique_ptr<QueueStage>> stages_) : func(std::move(func_)), stages(std::move(stages_)) {
+    ProcessStep(std::string name_, std::unique_ptr<ProcessorStep> func_, std::vector<std::unique_ptr<QueueStage>> stages_) : name(std::move(name_)), func(std::move(func_)), stages(std::move(stages_)), waker(std::make_unique<PipelineWaker>()) {
+        for (auto &stage : stages) {
+            stage->waker = waker.get();
+        }
     }
 
     bool anyNotDone() {
         for (auto &stage : stages) {
-            if (!stage->prevFinished() || !stage->inputQueue.empty()) {
+            if (!stage->prevFinished() || !stage->inputQueue.empty() || stage->hasPending()) {
                 return true;
             }
         }
         return false;
     }
     
-    void doAll() {
+    bool doAll() {
+        bool processedAny = false;
         bool success = true;
         while (success) {
             success = false;
             for (auto &stage : stages) {
                 success |= stage->processNext();
             }
+            processedAny |= success;
         }
         
         for (auto &stage : stages) {
-            if (stage->prevFinished() && stage->inputQueue.empty()) {
+            if (!stage->isDone && stage->prevFinished() && stage->inputQueue.empty() && !stage->hasPending()) {
                 stage->complete();
-                stage->isDone = true;
+                stage->markDone();
             }
         }
+        return processedAny;
     }
     // inputProcessingDone
     void run() {
-        using namespace std::chrono_literals;
-        // CompletionGuard sets isDone to true in its destructor that is called at the end of this operator() method
+        // CompletionGuard marks the stages as done in its destructor that is called at the end of this method
         std::list<CompletionGuard> guards;
         for (auto &stage : stages) {
-            guards.emplace_back(stage->isDone);
+            guards.emplace_back([&stage]() { stage->markDone(); });
         }
         
         // Consume queued items as long as the previous processing step has not finished
-        while (anyNotDone()) {
-            doAll();
-            prevWaitCount++;
-            std::this_thread::sleep_for(5ms);
+        while (true) {
+            // Read the epoch before looking at the queues so that a push or pop happening in between wakes us up
+            auto epoch = waker->currentEpoch();
+            bool finished = !anyNotDone();
+            bool processedAny = doAll();
+            if (finished) {
+                break;
+            }
+            if (!processedAny) {
+                auto start = PipelineClock::now();
+                waker->waitPast(epoch);
+                waitTime += PipelineClock::now() - start;
+            }
         }
 
-        // Last call to consume queued items to catch last items
-        doAll();
         for (auto &stage : stages) {
             stage->complete();
         }
     }
 };
 
-ProcessStep makeStandardProcessStep(std::unique_ptr<ProcessorStep> && func, const DiscardCheckFunc &advanceFuncFirst, const DiscardCheckFunc &advanceFuncSecond, bool discardIfFullFirst = false, bool discardIfFullSecond = false) {
+ProcessStep makeStandardProcessStep(std::string name, std::unique_ptr<ProcessorStep> && func, unsigned int workerCount, const DiscardCheckFunc &advanceFuncFirst, const DiscardCheckFunc &advanceFuncSecond, bool discardIfFullFirst = false, bool discardIfFullSecond = false) {
     std::vector<std::unique_ptr<QueueStage>> subSteps;
     auto steps = func->steps();
+    auto parallelSteps = func->parallelSteps();
+    auto batchSteps = func->batchSteps();
+    batchSteps.resize(steps.size());
     for (size_t i = 0; i < steps.size(); i++) {
-        if (i == steps.size() - 1) {
-            subSteps.push_back(std::make_unique<ProcessSubStep>(steps[i], advanceFuncSecond, discardIfFullSecond));
+        bool isLast = i == steps.size() - 1;
+        auto &advanceFunc = isLast ? advanceFuncSecond : advanceFuncFirst;
+        bool discardIfFull = isLast ? discardIfFullSecond : discardIfFullFirst;
+        bool isParallel = std::find(parallelSteps.begin(), parallelSteps.end(), i) != parallelSteps.end();
+        if (isParallel && workerCount > 1) {
+            subSteps.push_back(std::make_unique<ParallelProcessSubStep>(steps[i], batchSteps[i], advanceFunc, discardIfFull, workerCount));
         } else {
-            subSteps.push_back(std::make_unique<ProcessSubStep>(steps[i], advanceFuncFirst, discardIfFullFirst));
+            subSteps.push_back(std::make_unique<ProcessSubStep>(steps[i], batchSteps[i], advanceFunc, discardIfFull));
         }
     }
-    return {std::move(func), std::move(subSteps)};
+    return {std::move(name), std::move(func), std::move(subSteps)};
 }
 
-ProcessStep makeHoldTxStep() {
+ProcessStep makeHoldTxStep(std::string name) {
     std::vector<std::unique_ptr<QueueStage>> subSteps;
     subSteps.push_back(std::make_unique<TxHoldSubStep>());
     
     std::unique_ptr<ProcessorStep> emptyStep;
-    return {std::move(emptyStep), std::move(subSteps)};
+    return {std::move(name), std::move(emptyStep), std::move(subSteps)};
+}
+
+/** Upper bound on the number of transactions whose hash index lookups are combined into one MultiGet call */
+constexpr size_t addressLookupBatchSize = 1000;
+
+ProcessStep makeBatchTxStep(std::string name, std::function<void(std::vector<RawTransaction *> &)> func, size_t maxBatchSize) {
+    std::vector<std::unique_ptr<QueueStage>> subSteps;
+    subSteps.push_back(std::make_unique<TxBatchSubStep>(std::move(func), maxBatchSize));
+    
+    std::unique_ptr<ProcessorStep> emptyStep;
+    return {std::move(name), std::move(emptyStep), std::move(subSteps)};
 }
 
+/** Recycles RawTransaction objects that made it through the whole pipeline, together with the capacity of their
+ * input and output buffers, so that the importer only allocates new transactions while the pipeline fills up.
+ * The pool is owned by the BlockProcessor and therefore survives across addNewBlocks batches. */
+class RawTransactionPool {
+public:
+    /** Transactions whose buffers grew beyond this many inputs or outputs are freed instead of recycled to bound the memory held by the pool */
+    static constexpr size_t maxRecycledInouts = 16;
+
+    // Queue for RawTransaction objects that have gone through the entire processing pipeline
+    TxQueue finishedQueue;
+
+    uint64_t allocatedCount = 0;
+    uint64_t reusedCount = 0;
+
+    RawTransactionPool() = default;
+    RawTransactionPool(const RawTransactionPool &) = delete;
+    RawTransactionPool &operator=(const RawTransactionPool &) = delete;
+
+    ~RawTransactionPool() {
+        // free all RawTransaction memory slots
+        finishedQueue.consume_all([](RawTransaction *tx) {
+            delete tx;
+        });
+    }
+
+    /** Pop a finished transaction for reuse. Returns false if none is available and the caller has to allocate a new one */
+    bool reuse(RawTransaction *&tx) {
+        if (finishedQueue.pop(tx)) {
+            reusedCount++;
+            return true;
+        } else {
+            allocatedCount++;
+            return false;
+        }
+    }
+
+    static bool canRecycle(const RawTransaction &tx) {
+        return tx.inputs.capacity() <= maxRecycledInouts
+            && tx.outputs.capacity() <= maxRecycledInouts
+            && tx.scriptInputs.capacity() <= maxRecycledInouts
+            && tx.scriptOutputs.capacity() <= maxRecycledInouts
+            && tx.inputSpendData.capacity() <= maxRecycledInouts
+            && tx.addressLookups.capacity() <= maxRecycledInouts;
+    }
+};
+
 struct ProcessStepQueue {
     
     std::atomic<bool> importDone{false};
     std::atomic<bool> processingDone{false};
     
-    // Queue for RawTransaction objects that have gone through the entire processing pipeline
-    TxQueue finishedQueue;
+    // Queue for RawTransaction objects that have gone through the entire processing pipeline, owned by the RawTransactionPool
+    TxQueue &finishedQueue;
+
+    // Parks the importer thread while the input queue of the first stage is full
+    PipelineWaker importWaker;
+    PipelineClock::duration importWaitTime{0};
     
     QueueStage *firstStage;
     
     std::vector<ProcessStep> steps;
     std::vector<std::future<void>> futures;
     
-    ProcessStepQueue() {}
+    explicit ProcessStepQueue(TxQueue &finishedQueue_) : finishedQueue(finishedQueue_) {}
     
     void addStep(ProcessStep && step) {
         steps.emplace_back(std::move(step));
@@ -779,6 +1348,7 @@ struct ProcessStepQueue {
                 stage->linkBack(*prevStage);
             } else {
                 stage->prevDone = &importDone;
+                stage->prevWaker = &importWaker;
             }
             prevStage = stage.get();
         }
@@ -794,15 +1364,36 @@ struct ProcessStepQueue {
         firstStage = steps[firstStepNum.threadNum].stages[firstStepNum.subStepNum].get();
     }
     
-    TxQueue &inputQueue() {
-        assert(firstStage != nullptr);
-        return firstStage->inputQueue;
-    }
-    
     bool isRunning() {
         assert(firstStage != nullptr);
         return !firstStage->isDone;
     }
+
+    /** Add tx to the input queue of the first processing step, parking the importer while that queue is full */
+    void pushInput(RawTransaction *tx) {
+        assert(firstStage != nullptr);
+        if (!firstStage->inputQueue.push(tx)) {
+            auto start = PipelineClock::now();
+            while (true) {
+                auto epoch = importWaker.currentEpoch();
+                if (firstStage->inputQueue.push(tx)) {
+                    break;
+                }
+                if (!isRunning()) {
+                    // Error: calculateHashesStep() finished before all items were queued
+                    throw NextQueueFinishedEarlyException();
+                }
+                importWaker.waitPast(epoch);
+            }
+            importWaitTime += PipelineClock::now() - start;
+        }
+        wake(firstStage->waker);
+    }
+
+    void markImportDone() {
+        importDone = true;
+        wake(firstStage->waker);
+    }
     
     void run() {
         for (auto &step : steps) {
@@ -816,19 +1407,34 @@ struct ProcessStepQueue {
         for (auto &future : futures) {
             future.get();
         }
-        
-        // free all RawTransaction memory slots
-        finishedQueue.consume_all([](RawTransaction *tx) {
-            delete tx;
-        });
+    }
+
+    /** Print how long each step was busy, blocked on its next queue and parked waiting for work */
+    void printStageTimes() {
+        std::cout << "\nPipeline stage times in seconds (busy / blocked on next queue, waiting for work)\n";
+        std::cout << "  Importer: blocked " << seconds(importWaitTime) << "\n";
+        for (auto &step : steps) {
+            std::cout << "  " << step.name << ":";
+            for (auto &stage : step.stages) {
+                std::cout << " " << stage->stepNum << " " << seconds(stage->busyTime) << " / " << seconds(stage->blockedTime) << ",";
+            }
+            std::cout << " waiting " << seconds(step.waitTime) << "\n";
+        }
     }
 };
 
+BlockProcessor::BlockProcessor(uint32_t startingTxCount_, uint64_t startingInputCount, uint64_t startingOutputCount, uint32_t totalTxCount_, blocksci::BlockHeight maxBlockHeight_, unsigned int workerThreadCount_) : startingTxCount(startingTxCount_), currentTxNum(startingTxCount_), currentInputNum(startingInputCount), currentOutputNum(startingOutputCount), totalTxCount(totalTxCount_), maxBlockHeight(maxBlockHeight_), workerThreadCount(workerThreadCount_), txPool(std::make_unique<RawTransactionPool>()) {
+    
+}
+
+BlockProcessor::~BlockProcessor() = default;
+
 NewBlocksFiles::NewBlocksFiles(const ParserConfigurationBase &config) :
     blockCoinbaseFile(blocksci::ChainAccess::blockCoinbaseFilePath(config.dataConfig.chainDirectory())),
     txFirstInput(blocksci::ChainAccess::firstInputFilePath(config.dataConfig.chainDirectory())),
     txFirstOutput(blocksci::ChainAccess::firstOutputFilePath(config.dataConfig.chainDirectory())),
     txVersionFile(blocksci::ChainAccess::txVersionFilePath((config.dataConfig.chainDirectory()))),
+    txBlockHeightFile(blocksci::ChainAccess::txBlockHeightFilePath(config.dataConfig.chainDirectory())),
     inputSpentOutNumFile(blocksci::ChainAccess::inputSpentOutNumFilePath(config.dataConfig.chainDirectory())),
     inputSequenceFile(blocksci::ChainAccess::sequenceFilePath(config.dataConfig.chainDirectory())) {}
 
@@ -847,57 +1453,73 @@ std::vector<blocksci::RawBlock> BlockProcessor::addNewBlocks(const ParserConfigu
     });
     
     /* Advance function of the last step
-     * Optimization: Only push tx to finished_transaction_queue if it meets certain conditions, otherwise de-allocate it */
+     * Optimization: Only push tx to the finishedQueue of the RawTransactionPool if its buffers are small enough to be worth keeping, otherwise de-allocate it */
     
     auto serializeAddressDiscardFunc = [&](RawTransaction &tx) {
         progressBar.update(tx.txNum - startingTxCount, tx);
-        return tx.realSize >= 800;
+        return !RawTransactionPool::canRecycle(tx);
     };
     
     // Definition of all ProcessStep objects for the processing pipeline
-    ProcessStepQueue processQueue;
+    ProcessStepQueue processQueue{txPool->finishedQueue};
     
     // 0. Step: Calculate hash of transaction and write it to the hash file (chain/tx_hashes.dat)
-    processQueue.addStep(makeStandardProcessStep(std::make_unique<CalculateTxHashStep>(txHashFile), discardFunc, discardFunc));
+    processQueue.addStep(makeStandardProcessStep("CalculateTxHash", std::make_unique<CalculateTxHashStep>(txHashFile), workerThreadCount, discardFunc, discardFunc));
 
     // 1. Step: Parse the output scripts (into CScriptView) of the transaction in order to identify address types and extract relevant information.
-    processQueue.addStep(makeStandardProcessStep(std::make_unique<GenerateScriptOutputsStep>(), discardFunc, discardFunc));
+    processQueue.addStep(makeStandardProcessStep("GenerateScriptOutputs", std::make_unique<GenerateScriptOutputsStep>(), workerThreadCount, discardFunc, discardFunc));
 
     // 2. Step: Store information about the spent output with each input of the transaction. Then store information about each output for future lookup.
-    processQueue.addStep(makeStandardProcessStep(std::make_unique<ConnectUTXOsStep>(utxoState), discardFunc, discardFunc));
+    processQueue.addStep(makeStandardProcessStep("ConnectUTXOs", std::make_unique<ConnectUTXOsStep>(utxoState), workerThreadCount, discardFunc, discardFunc));
 
     /* 3. Step: Parse the input script of each input based information about the associated output script.
      *    Then store information about each output address for future lookup. */
-    processQueue.addStep(makeStandardProcessStep(std::make_unique<GenerateScriptInputStep>(utxoAddressState), discardFunc, discardFunc));
+    processQueue.addStep(makeStandardProcessStep("GenerateScriptInput", std::make_unique<GenerateScriptInputStep>(utxoAddressState), workerThreadCount, discardFunc, discardFunc));
 
     /* 4. Step: Attach a scriptNum to each script in the transaction. For address types which are
           deduplicated (Pubkey, ScriptHash, Multisig and their varients) use the previously allocated
           scriptNum if the address was seen before. Increment the scriptNum counter for newly seen addresses. */
-    processQueue.addStep(makeStandardProcessStep(std::make_unique<ProcessAddressesStep>(addressState), discardFunc, discardFunc));
+    processQueue.addStep(makeStandardProcessStep("ProcessAddresses", std::make_unique<ProcessAddressesStep>(addressState), workerThreadCount, discardFunc, discardFunc));
 
     /* 5. Step: Record the scriptNum for each output for later reference. Assign each spent input with
      the scriptNum of the output its spending */
-    processQueue.addStep(makeStandardProcessStep(std::make_unique<RecordAddressesStep>(utxoScriptState), discardFunc, discardFunc));
+    processQueue.addStep(makeStandardProcessStep("RecordAddresses", std::make_unique<RecordAddressesStep>(utxoScriptState), workerThreadCount, discardFunc, discardFunc));
 
     // 6. Step: Serialize transaction data, inputs, and outputs and write them to the txFile
-    processQueue.addStep(makeStandardProcessStep(std::make_unique<SerializeTransactionStep>(txFile, linkDataFile), discardFunc, discardFunc));
+    processQueue.addStep(makeStandardProcessStep("SerializeTransaction", std::make_unique<SerializeTransactionStep>(txFile, linkDataFile), workerThreadCount, discardFunc, discardFunc));
 
     // 7. Step: Save address data into files for the analysis library
-    processQueue.addStep(makeStandardProcessStep(std::make_unique<SerializeAddressesStep>(addressWriter), discardFunc, serializeAddressDiscardFunc, false, true));
+    processQueue.addStep(makeStandardProcessStep("SerializeAddresses", std::make_unique<SerializeAddressesStep>(addressWriter), workerThreadCount, discardFunc, serializeAddressDiscardFunc, false, true));
     
     // Two hold stages for ATOR
-    processQueue.addStep(makeHoldTxStep()); // 8
-    processQueue.addStep(makeHoldTxStep()); // 9
+    processQueue.addStep(makeHoldTxStep("HoldBlockOutputs")); // 8
+    processQueue.addStep(makeHoldTxStep("HoldBlockScripts")); // 9
+    
+    /* 10. Step: Query the hash index for all addresses of a block (or batch of transactions) at once that step 4
+           could not find in memory. Runs in its own thread, ahead of step 4 assigning the scriptNums */
+    processQueue.addStep(makeBatchTxStep("LookupAddresses", [&](std::vector<RawTransaction *> &txes) {
+        std::vector<AddressLookupRequest *> requests;
+        for (auto tx : txes) {
+            for (auto &request : tx->addressLookups) {
+                requests.push_back(&request);
+            }
+        }
+        addressState.lookupBatch(requests);
+    }, addressLookupBatchSize));
     
     processQueue.setStepOrder({
         {0, 0}, // calculate tx hash
+        {0, 1}, // write tx hash
         {1, 0}, // parse outputs into CScriptView
         {2, 0}, // store UTXOs
         {3, 0}, // store scripts
         {8, 0}, // ---
         {2, 1}, // connect inputs to outputs
-        {3, 1}, // parse input scripts using output data
-        {4, 0}, // attach scriptNum to outputs and inputs
+        {3, 1}, // look up output data of spent outputs
+        {3, 2}, // parse input scripts using output data
+        {4, 0}, // look up previously seen addresses in memory
+        {10, 0}, // look up remaining addresses in the hash index
+        {4, 1}, // attach scriptNum to outputs and inputs
         {5, 0}, // store scriptNum of each output for lookup
         {7, 0}, // serialize new scripts in outputs and wrapped inputs
         {9, 0}, // ---
@@ -906,30 +1528,20 @@ std::vector<blocksci::RawBlock> BlockProcessor::addNewBlocks(const ParserConfigu
         {7, 1}  // update scripts
     });
     
-    int64_t nextWaitCount = 0;
-    
     std::vector<blocksci::RawBlock> blocksAdded;
     BlockFileReader<ParseTag> fileReader(config, blocks, currentTxNum);
 
     // Launch the importer in its own thread
     auto importer = std::async(std::launch::async, [&] {
-        CompletionGuard guard(processQueue.importDone);
+        CompletionGuard guard([&]() { processQueue.markImportDone(); });
         auto loadFinishedTx = [&](RawTransaction *&tx) {
-            return processQueue.finishedQueue.pop(tx);
+            return txPool->reuse(tx);
         };
         
         // Function that adds transaction to the first queue of the processing pipeline
         auto outFunc = [&](RawTransaction *tx) {
-            using namespace std::chrono_literals;
-            // Add tx to the inputQueue of the first processing step, if it fails (queue is full), wait 5ms and try again
-            while (!processQueue.inputQueue().push(tx)) {
-                if (!processQueue.isRunning()) {
-                    // Error: calculateHashesStep() finished before all items were queued
-                    throw NextQueueFinishedEarlyException();
-                }
-                nextWaitCount++;
-                std::this_thread::sleep_for(5ms);
-            }
+            // Add tx to the inputQueue of the first processing step, if it fails (queue is full), park until the first step pops
+            processQueue.pushInput(tx);
         };
         
         NewBlocksFiles files(config);
@@ -953,6 +1565,14 @@ std::vector<blocksci::RawBlock> BlockProcessor::addNewBlocks(const ParserConfigu
     // Wait for all processing step threads to complete
     importer.get();
     processQueue.waitForComplete();
+    processQueue.printStageTimes();
+    std::cout << "  Transactions allocated: " << txPool->allocatedCount << ", reused: " << txPool->reusedCount << "\n";
+
+    auto &lookupStats = addressState.lookupStats();
+    std::cout << "  Address lookups: bloom negative " << lookupStats.bloomNegativeCount << ", multi-use map " << lookupStats.multiCount;
+    std::cout << ", hash index " << lookupStats.dbCount << ", bloom false positive " << lookupStats.bloomFPCount << "\n";
+    std::cout << "  Batched hash index lookups: " << lookupStats.batchedLookupCount << " in " << lookupStats.batchCount << " batches, found " << lookupStats.batchedHitCount << "\n";
+    addressState.clearLookupStats();
 
     return blocksAdded;
 }
@@ -17,6 +17,8 @@
 #include <blocksci/core/inout_pointer.hpp>
 #include <blocksci/core/core_fwd.hpp>
 
+#include <memory>
+
 class BlockFileReaderBase {
 public:
     BlockFileReaderBase() = default;
@@ -33,6 +35,7 @@ struct NewBlocksFiles {
     FixedSizeFileWriter<uint64_t> txFirstInput;
     FixedSizeFileWriter<uint64_t> txFirstOutput;
     FixedSizeFileWriter<int32_t> txVersionFile;
+    FixedSizeFileWriter<blocksci::BlockHeight> txBlockHeightFile;
     FixedSizeFileWriter<uint16_t> inputSpentOutNumFile;
     FixedSizeFileWriter<uint32_t> inputSequenceFile;
     
@@ -42,12 +45,25 @@ struct NewBlocksFiles {
 struct OutputLinkData {
     blocksci::InoutPointer pointer;
     uint32_t txNum;
+    uint16_t inputNum;
 };
 
 blocksci::RawBlock readNewBlock(uint32_t firstTxNum, uint64_t firstInputNum, uint64_t firstOutputNum, const BlockInfoBase &block, BlockFileReaderBase &fileReader, NewBlocksFiles &files, const std::function<bool(RawTransaction *&tx)> &loadFunc, const std::function<void(RawTransaction *tx)> &outFunc, bool isSegwit);
 
 struct ProcessorStep {
     virtual std::vector<std::function<void(RawTransaction &tx)>> steps() = 0;
+
+    /** Indexes of the sub-steps returned by steps() that only read and write the transaction they are passed,
+     *  apart from shared state that is safe for concurrent use. These are run on several worker threads and merged
+     *  back in txNum order. */
+    virtual std::vector<size_t> parallelSteps();
+
+    /** Optional versions of the sub-steps that process several transactions at once, indexed like steps().
+     *  The stage, or each worker of a parallel sub-step, passes all transactions it has available, up to a limit, to
+     *  the batch version instead of calling the sub-step on each of them. Empty functions and missing entries mean
+     *  there is no batch version. */
+    virtual std::vector<std::function<void(std::vector<RawTransaction *> &txes)>> batchSteps();
+
     virtual ~ProcessorStep();
 };
 
@@ -57,10 +73,13 @@ struct CalculateTxHashStep : public ProcessorStep {
     CalculateTxHashStep(FixedSizeFileWriter<blocksci::uint256> &hashFile_) : hashFile(hashFile_) {}
     
     std::vector<std::function<void(RawTransaction &tx)>> steps() override;
+    std::vector<size_t> parallelSteps() override;
+    std::vector<std::function<void(std::vector<RawTransaction *> &txes)>> batchSteps() override;
 };
 
 struct GenerateScriptOutputsStep : public ProcessorStep {
     std::vector<std::function<void(RawTransaction &tx)>> steps() override;
+    std::vector<size_t> parallelSteps() override;
 };
 
 struct ConnectUTXOsStep : public ProcessorStep {
@@ -77,6 +96,7 @@ struct GenerateScriptInputStep : public ProcessorStep {
     GenerateScriptInputStep(UTXOAddressState &utxoAddressState_) : utxoAddressState(utxoAddressState_) {}
     
     std::vector<std::function<void(RawTransaction &tx)>> steps() override;
+    std::vector<size_t> parallelSteps() override;
 };
 
 struct ProcessAddressesStep : public ProcessorStep {
@@ -85,6 +105,7 @@ struct ProcessAddressesStep : public ProcessorStep {
     ProcessAddressesStep(AddressState &addressState_) : addressState(addressState_) {}
     
     std::vector<std::function<void(RawTransaction &tx)>> steps() override;
+    std::vector<size_t> parallelSteps() override;
 };
 
 struct RecordAddressesStep : public ProcessorStep {
@@ -114,6 +135,8 @@ struct SerializeAddressesStep : public ProcessorStep {
 
 void backUpdateTxes(const ParserConfigurationBase &config);
 
+class RawTransactionPool;
+
 
 /** BlockProcessor handles parsing blocks and their transactions, inputs, outputs etc. using a processing pipeline */
 class BlockProcessor {
@@ -128,9 +151,16 @@ class BlockProcessor {
     uint32_t totalTxCount = 0;
     blocksci::BlockHeight maxBlockHeight = 0;
 
+    /** Number of worker threads used by each of the pipeline steps that can process transactions in parallel */
+    unsigned int workerThreadCount = 1;
+
+    /** Recycles RawTransaction objects across the processing pipeline runs of all addNewBlocks calls */
+    std::unique_ptr<RawTransactionPool> txPool;
+
 public:
     
-    BlockProcessor(uint32_t startingTxCount, uint64_t startingInputCount, uint64_t startingOutputCount, uint32_t totalTxCount, blocksci::BlockHeight maxBlockHeight);
+    BlockProcessor(uint32_t startingTxCount, uint64_t startingInputCount, uint64_t startingOutputCount, uint32_t totalTxCount, blocksci::BlockHeight maxBlockHeight, unsigned int workerThreadCount);
+    ~BlockProcessor();
     
     template <typename ParseTag>
     std::vector<blocksci::RawBlock> addNewBlocks(const ParserConfiguration<ParseTag> &config, std::vector<BlockInfo<ParseTag>> nextBlocks, UTXOState &utxoState, UTXOAddressState &utxoAddressState, AddressState &addressState, UTXOScriptState &utxoScriptState);
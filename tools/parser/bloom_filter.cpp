@@ -9,7 +9,9 @@
 #include "bloom_filter.hpp"
 
 #include <cereal/archives/binary.hpp>
+#include <cereal/types/vector.hpp>
 
+#include <algorithm>
 #include <fstream>
 #include <array>
 #include <cmath>
@@ -18,53 +20,93 @@
 constexpr double Log2 = 0.69314718056;
 constexpr double Log2Squared = Log2 * Log2;
 
-BloomStore::BloomStore(const std::string &path_, int64_t length_) : bitMasks{}, backingFile(path_), length(length_) {
-    
-    for (size_t i = 0; i < BloomStore::BlockSize; ++i) {
-        bitMasks.at(i) = BloomStore::BlockType{1} << i;
+// Each layer holds twice as many items as the previous one with half its false positive rate
+constexpr int64_t LayerGrowthFactor = 2;
+constexpr double LayerTighteningRatio = 0.5;
+
+// Odd multipliers that derive the bit positions of the words of a block from a single 32 bit hash
+constexpr std::array<uint32_t, BloomBlock::wordCount> BitSalts = {{
+    0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU,
+    0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U
+}};
+
+namespace {
+    /** Bit masks selecting one bit in each word of a block. Written as plain loops over the words, which the compiler turns into vector instructions */
+    std::array<BloomBlock::WordType, BloomBlock::wordCount> blockMasks(uint32_t bitHash) {
+        std::array<BloomBlock::WordType, BloomBlock::wordCount> masks;
+        for (size_t i = 0; i < BloomBlock::wordCount; i++) {
+            masks[i] = BloomBlock::WordType{1} << ((bitHash * BitSalts[i]) >> 26);
+        }
+        return masks;
     }
-    
+}
+
+BloomStore::BloomStore(const std::string &path_, int64_t blockCount_) : backingFile(path_), blockCount(blockCount_) {
     if (backingFile.size() == 0) {
-        backingFile.truncate(blockCount());
+        backingFile.truncate(blockCount);
     }
     
-    if (backingFile.size() != blockCount()) {
+    if (backingFile.size() != blockCount) {
         throw std::runtime_error("Trying to open bloom filter of wrong size");
     }
 }
 
-int64_t BloomStore::blockCount() const {
-    return (length + BlockSize - 1) / BlockSize;
-}
-
-void BloomStore::setBit(int64_t bitPos) {
-    assert(bitPos < length);
-    BlockType mask = bitMasks[bitPos % BlockSize];
-    int64_t filePos = bitPos / BlockSize;
-    BlockType *fileEntry = backingFile[filePos];
-    *fileEntry |= mask;
+void BloomStore::add(uint64_t blockHash, uint32_t bitHash) {
+    auto masks = blockMasks(bitHash);
+    BloomBlock *block = backingFile[blockIndex(blockHash)];
+    for (size_t i = 0; i < BloomBlock::wordCount; i++) {
+        block->words[i] |= masks[i];
+    }
 }
 
-bool BloomStore::isSet(int64_t bitPos) const {
-    return !(((*backingFile[bitPos / BlockSize]) & bitMasks[bitPos % BlockSize]) == 0);
+bool BloomStore::possiblyContains(uint64_t blockHash, uint32_t bitHash) const {
+    auto masks = blockMasks(bitHash);
+    const BloomBlock *block = backingFile[blockIndex(blockHash)];
+    // Accumulate the missing bits of all words instead of returning early so that the loop has no branches
+    BloomBlock::WordType missing = 0;
+    for (size_t i = 0; i < BloomBlock::wordCount; i++) {
+        missing |= masks[i] & ~block->words[i];
+    }
+    return missing == 0;
 }
 
-void BloomStore::reset(int64_t newLength) {
+void BloomStore::reset(int64_t newBlockCount) {
     backingFile.truncate(0);
-    backingFile.truncate((newLength + BlockSize - 1) / BlockSize);
-    length = newLength;
+    backingFile.truncate(newBlockCount);
+    blockCount = newBlockCount;
 }
 
-int64_t calculateLength(int64_t maxItems, double fpRate) {
-    return static_cast<int64_t>(std::ceil(-(std::log(fpRate) * maxItems) / Log2Squared));
+/** False positive rate of a blocked filter with the given average number of items per block. The number of items
+ * that land in a block is Poisson distributed and each of them sets one bit in every word of the block. */
+double blockedFPRate(double itemsPerBlock) {
+    constexpr double bitsPerWord = sizeof(BloomBlock::WordType) * 8;
+    auto maxCount = static_cast<int64_t>(itemsPerBlock + 20 * std::sqrt(itemsPerBlock) + 20);
+    double probability = std::exp(-itemsPerBlock);
+    double fpRate = 0;
+    for (int64_t count = 0; count <= maxCount; count++) {
+        double wordFPRate = 1 - std::pow(1 - 1 / bitsPerWord, static_cast<double>(count));
+        fpRate += probability * std::pow(wordFPRate, static_cast<double>(BloomBlock::wordCount));
+        probability *= itemsPerBlock / static_cast<double>(count + 1);
+    }
+    return fpRate;
 }
 
-uint8_t calculateHashes(double fpRate) {
-    return static_cast<uint8_t>(std::round(-std::log(fpRate) / Log2));
+int64_t calculateBlockCount(int64_t maxItems, double fpRate) {
+    // Start from the size of a classic bloom filter, blocking needs somewhat more space for the same rate
+    constexpr double bitsPerBlock = sizeof(BloomBlock) * 8;
+    auto length = std::ceil(-(std::log(fpRate) * static_cast<double>(maxItems)) / Log2Squared);
+    auto blockCount = std::max(int64_t{1}, static_cast<int64_t>(std::ceil(length / bitsPerBlock)));
+    while (blockedFPRate(static_cast<double>(maxItems) / static_cast<double>(blockCount)) > fpRate) {
+        blockCount += blockCount / 20 + 1;
+    }
+    return blockCount;
 }
 
-BloomFilterData::BloomFilterData() : maxItems(0), fpRate(1), m_numHashes(0), length(0), addedCount(0) {}
-BloomFilterData::BloomFilterData(int64_t maxItems_, double fpRate_) : maxItems(maxItems_), fpRate(fpRate_), m_numHashes(calculateHashes(fpRate_)), length(calculateLength(maxItems_, fpRate_)), addedCount(0) {}
+BloomLayerData::BloomLayerData() : maxItems(0), fpRate(1), blockCount(0), addedCount(0) {}
+BloomLayerData::BloomLayerData(int64_t maxItems_, double fpRate_) : maxItems(maxItems_), fpRate(fpRate_), blockCount(calculateBlockCount(maxItems_, fpRate_)), addedCount(0) {}
+
+BloomFilterData::BloomFilterData() : maxItems(0), fpRate(1) {}
+BloomFilterData::BloomFilterData(int64_t maxItems_, double fpRate_) : maxItems(maxItems_), fpRate(fpRate_), layers{BloomLayerData{maxItems_, fpRate_ * (1 - LayerTighteningRatio)}} {}
 
 
 BloomFilterData loadData(const filesystem::path &path, int64_t maxItems, double fpRate) {
@@ -77,7 +119,11 @@ BloomFilterData loadData(const filesystem::path &path, int64_t maxItems, double
     return data;
 }
 
-BloomFilter::BloomFilter(const std::string &path_, int64_t maxItems, double fpRate) : path(path_), impData(loadData(metaPath(), maxItems, fpRate)), store(storePath().str(), impData.length) {}
+BloomFilter::BloomFilter(const std::string &path_, int64_t maxItems, double fpRate) : path(path_), impData(loadData(metaPath(), maxItems, fpRate)) {
+    for (size_t i = 0; i < impData.layers.size(); i++) {
+        stores.push_back(std::make_unique<BloomStore>(storePath(i).str(), impData.layers[i].blockCount));
+    }
+}
 
 BloomFilter::~BloomFilter() {
     std::ofstream file(metaPath().str(), std::ios::binary);
@@ -86,8 +132,29 @@ BloomFilter::~BloomFilter() {
 }
 
 void BloomFilter::reset(int64_t maxItems, double fpRate) {
+    for (size_t i = 1; i < stores.size(); i++) {
+        stores[i].reset();
+        filesystem::path{storePath(i).str() + ".dat"}.remove_file();
+    }
+    stores.resize(1);
     impData = BloomFilterData(maxItems, fpRate);
-    store.reset(impData.length);
+    stores.front()->reset(impData.layers.front().blockCount);
+}
+
+void BloomFilter::addLayer() {
+    auto &last = impData.layers.back();
+    impData.layers.emplace_back(last.maxItems * LayerGrowthFactor, last.fpRate * LayerTighteningRatio);
+    auto layer = impData.layers.size() - 1;
+    filesystem::path{storePath(layer).str() + ".dat"}.remove_file();
+    stores.push_back(std::make_unique<BloomStore>(storePath(layer).str(), impData.layers.back().blockCount));
+}
+
+int64_t BloomFilter::size() const {
+    int64_t count = 0;
+    for (auto &layer : impData.layers) {
+        count += layer.addedCount;
+    }
+    return count;
 }
 
 inline std::array<uint64_t, 2> hash(const uint8_t *data, int len) {
@@ -97,30 +164,25 @@ inline std::array<uint64_t, 2> hash(const uint8_t *data, int len) {
     return {{hashA, hashB}};
 }
 
-inline int64_t nthHash(uint8_t n, uint64_t hashA, uint64_t hashB, int64_t filterSize) {
-    return static_cast<int64_t>((hashA + n * hashB) % static_cast<uint64_t>(filterSize));
-}
-
 void BloomFilter::add(const uint8_t *item, int length) {
-    auto hashValues = hash(item, length);
-    
-    for (uint8_t n = 0; n < impData.m_numHashes; n++) {
-        auto bitPos = nthHash(n, hashValues[0], hashValues[1], impData.length);
-        store.setBit(bitPos);
+    if (impData.layers.back().addedCount >= impData.layers.back().maxItems) {
+        addLayer();
     }
     
-    impData.addedCount++;
+    auto hashValues = hash(item, length);
+    stores.back()->add(hashValues[0], static_cast<uint32_t>(hashValues[1]));
+    impData.layers.back().addedCount++;
 }
 
 bool BloomFilter::possiblyContains(const uint8_t *item, int length) const {
     auto hashValues = hash(item, length);
     
-    for (uint8_t n = 0; n < impData.m_numHashes; n++) {
-        auto bitPos = nthHash(n, hashValues[0], hashValues[1], impData.length);
-        if (!store.isSet(bitPos)) {
-            return false;
+    // Newer layers are larger and hold the most recently added keys, so check them first
+    for (auto it = stores.rbegin(); it != stores.rend(); ++it) {
+        if ((*it)->possiblyContains(hashValues[0], static_cast<uint32_t>(hashValues[1]))) {
+            return true;
         }
     }
     
-    return true;
+    return false;
 }
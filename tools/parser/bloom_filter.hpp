@@ -13,36 +13,64 @@
 
 #include <wjfilesystem/path.h>
 
+#include <array>
 #include <fstream>
+#include <memory>
 #include <vector>
 
+/** One cache line of a blocked bloom filter. Every key sets exactly one bit in each of the words */
+struct alignas(64) BloomBlock {
+    static constexpr size_t wordCount = 8;
+    using WordType = uint64_t;
+
+    std::array<WordType, wordCount> words;
+};
+
+static_assert(sizeof(BloomBlock) == 64, "A bloom filter block must fill exactly one cache line");
+
 struct BloomStore {
-    using BlockType = size_t;
-    static constexpr int64_t BlockSize = static_cast<int64_t>(sizeof(BlockType) * 8);
+    BloomStore(const std::string &path, int64_t blockCount);
 
-    BloomStore(const std::string &path, int64_t length);
+    void add(uint64_t blockHash, uint32_t bitHash);
+    bool possiblyContains(uint64_t blockHash, uint32_t bitHash) const;
     
-    void setBit(int64_t bitPos);
-    bool isSet(int64_t bitPos) const;
-    
-    void reset(int64_t length);
-    
-private:
-    std::array<BloomStore::BlockType, BloomStore::BlockSize> bitMasks;
+    void reset(int64_t blockCount);
     
 private:
-    blocksci::FixedSizeFileMapper<BlockType, mio::access_mode::write> backingFile;
-    int64_t length;
+    blocksci::FixedSizeFileMapper<BloomBlock, mio::access_mode::write> backingFile;
+    int64_t blockCount;
     
-    int64_t blockCount() const;
+    int64_t blockIndex(uint64_t blockHash) const {
+        return static_cast<int64_t>(blockHash % static_cast<uint64_t>(blockCount));
+    }
 };
 
-struct BloomFilterData {
+/** Sizing and fill level of one layer of a BloomFilter */
+struct BloomLayerData {
     int64_t maxItems;
     double fpRate;
-    uint8_t m_numHashes;
-    int64_t length;
+    int64_t blockCount;
     int64_t addedCount;
+
+    BloomLayerData();
+    BloomLayerData(int64_t maxItems_, double fpRate_);
+
+    template<class Archive>
+    void serialize(Archive & archive)
+    {
+        archive(
+                maxItems,
+                fpRate,
+                blockCount,
+                addedCount
+        );
+    }
+};
+
+struct BloomFilterData {
+    int64_t maxItems;
+    double fpRate;
+    std::vector<BloomLayerData> layers;
     
     BloomFilterData();
     BloomFilterData(int64_t maxItems_, double fpRate_);
@@ -53,13 +81,22 @@ struct BloomFilterData {
         archive(
                 maxItems,
                 fpRate,
-                m_numHashes,
-                length,
-                addedCount
+                layers
         );
     }
 };
 
+/** Scalable, cache-blocked bloom filter
+ *
+ * File(s): meta file and one store file per layer
+ *     - meta file: <path>Layers.dat, serialized BloomFilterData
+ *     - store files: <path>Store<n>.dat, BloomBlock entries of layer n implemented as FixedSizeFileMapper
+ *
+ * All bits of a key are set in a single 64 byte block, so a lookup touches one cache line per layer instead of
+ * one per hash. Instead of being rebuilt once it holds maxItems keys, the filter adds a new layer with twice the
+ * capacity and half the false positive rate of the previous one, which bounds the overall false positive rate
+ * by fpRate. Keys are assumed to be uniformly distributed hashes, like the address hashes it is used for.
+ */
 class BloomFilter {
 public:
     // Load or create
@@ -68,6 +105,7 @@ public:
     BloomFilter &operator=(const BloomFilter &) = delete;
     ~BloomFilter();
     
+    /** Clears the filter and drops all but a single layer sized for maxItems */
     void reset(int64_t maxItems, double fpRate);
     
     template<class Key>
@@ -84,12 +122,12 @@ public:
         return possiblyContains(item, len);
     }
     
-    bool isFull() const {
-        return impData.addedCount >= impData.maxItems;
+    int64_t size() const;
+
+    size_t layerCount() const {
+        return impData.layers.size();
     }
     
-    int64_t size() { return impData.addedCount; }
-    
     int64_t getMaxItems() const {
         return impData.maxItems;
     }
@@ -99,17 +137,19 @@ public:
     }
     
     filesystem::path metaPath() const {
-        return filesystem::path(path + "Meta.dat");
+        return filesystem::path(path + "Layers.dat");
     }
     
-    filesystem::path storePath() const {
-        return filesystem::path(path + "Store");
+    filesystem::path storePath(size_t layer) const {
+        return filesystem::path(path + "Store" + std::to_string(layer));
     }
     
 private:
     std::string path;
     BloomFilterData impData;
-    BloomStore store;
+    std::vector<std::unique_ptr<BloomStore>> stores;
+
+    void addLayer();
     
     void add(const uint8_t *item, int length);
     bool possiblyContains(const uint8_t *item, int length) const;
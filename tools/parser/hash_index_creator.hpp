@@ -185,6 +185,17 @@ public:
     void compact() {
         db.compactDB();
     }
+    
+    /** Only tx hashes and WITNESS_SCRIPTHASH addresses are added here, the other address columns are read while parsing */
+    void startBulkLoad() {
+        db.startBulkLoad({blocksci::AddressType::WITNESS_SCRIPTHASH}, true);
+    }
+    
+    void finishBulkLoad() {
+        clearTxCache();
+        clearAddressCache<blocksci::AddressType::WITNESS_SCRIPTHASH>();
+        db.finishBulkLoad();
+    }
 };
 
 #endif /* hash_index_creator_hpp */
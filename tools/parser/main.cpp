@@ -39,11 +39,13 @@
 
 #include <sys/resource.h>
 
+#include <algorithm>
 #include <fstream>
 #include <future>
 #include <iostream>
 #include <iomanip>
 #include <cassert>
+#include <thread>
 
 using json = nlohmann::json;
 
@@ -77,6 +79,51 @@ void unlockDataDirectory(const ParserConfigurationBase &config) {
     unlockDataDirectory(config.dataConfig);
 }
 
+/** Fills in chain/tx_block_height.dat for the transactions of a chain that was parsed before the file existed */
+void fillTxBlockHeights(const ParserConfigurationBase &config, const blocksci::ChainAccess &chain) {
+    FixedSizeFileWriter<blocksci::BlockHeight> txBlockHeightFile{blocksci::ChainAccess::txBlockHeightFilePath(config.dataConfig.chainDirectory())};
+    auto txCount = static_cast<uint32_t>(chain.txCount());
+    auto firstMissingTx = static_cast<uint32_t>(txBlockHeightFile.size());
+    if (firstMissingTx >= txCount) {
+        return;
+    }
+    
+    std::cout << "Filling in block heights of " << txCount - firstMissingTx << " transactions" << std::endl;
+    for (auto height = chain.getBlockHeight(firstMissingTx); height < chain.blockCount(); height++) {
+        auto block = chain.getBlock(height);
+        for (uint32_t txNum = std::max(block->firstTxIndex, firstMissingTx); txNum < block->firstTxIndex + block->txCount; txNum++) {
+            txBlockHeightFile.write(height);
+        }
+    }
+}
+
+void fillOutputSpendingInputs(const ParserConfigurationBase &config, const blocksci::ChainAccess &chain) {
+    blocksci::FixedSizeFileMapper<uint16_t, mio::access_mode::write> spendingInputFile{blocksci::ChainAccess::outputSpendingInputFilePath(config.dataConfig.chainDirectory())};
+    blocksci::FixedSizeFileMapper<uint64_t> firstOutputFile{blocksci::ChainAccess::firstOutputFilePath(config.dataConfig.chainDirectory())};
+    auto outputCount = chain.outputCount();
+    auto firstMissingOutput = static_cast<uint64_t>(spendingInputFile.size());
+    if (firstMissingOutput >= outputCount) {
+        return;
+    }
+    
+    std::cout << "Filling in spending inputs of " << outputCount - firstMissingOutput << " outputs" << std::endl;
+    spendingInputFile.truncate(static_cast<blocksci::OffsetType>(outputCount));
+    auto txCount = static_cast<uint32_t>(chain.txCount());
+    for (uint32_t txNum = 0; txNum < txCount; txNum++) {
+        auto rawTx = chain.getTx(txNum);
+        if (rawTx->inputCount == 0) {
+            continue;
+        }
+        auto spentOutNums = chain.getSpentOutputNumbers(txNum);
+        for (uint16_t i = 0; i < rawTx->inputCount; i++) {
+            auto outputNum = *firstOutputFile[rawTx->getInput(i).getLinkedTxNum()] + spentOutNums[i];
+            if (outputNum >= firstMissingOutput) {
+                *spendingInputFile[static_cast<blocksci::OffsetType>(outputNum)] = static_cast<uint16_t>(i + 1);
+            }
+        }
+    }
+}
+
 template <typename BlockType>
 struct ChainUpdateInfo {
     std::vector<BlockType> blocksToAdd;
@@ -84,7 +131,7 @@ struct ChainUpdateInfo {
 };
 
 template <typename ParserTag>
-std::vector<blocksci::RawBlock> updateChain(const ParserConfiguration<ParserTag> &config, blocksci::BlockHeight maxBlockNum, HashIndexCreator &hashDb) {
+std::vector<blocksci::RawBlock> updateChain(const ParserConfiguration<ParserTag> &config, blocksci::BlockHeight maxBlockNum, HashIndexCreator &hashDb, unsigned int workerThreadCount) {
     using namespace std::chrono_literals;
 
     /* Load and update the persisted (serialized) ChainIndex object that contains information about all blocks (without transaction data)
@@ -157,6 +204,8 @@ std::vector<blocksci::RawBlock> updateChain(const ParserConfiguration<ParserTag>
         startingTxCount = static_cast<uint32_t>(chain.txCount());
         startingInputCount = chain.inputCount();
         startingOutputCount = chain.outputCount();
+        fillTxBlockHeights(config, chain);
+        fillOutputSpendingInputs(config, chain);
     }
     
     auto maxBlockHeight = blocksToAdd.back().height;
@@ -170,15 +219,18 @@ std::vector<blocksci::RawBlock> updateChain(const ParserConfiguration<ParserTag>
         totalOutputCount += block.outputCount;
     }
 
-    BlockProcessor processor{startingTxCount, startingInputCount, startingOutputCount, totalTxCount, maxBlockHeight};
+    BlockProcessor processor{startingTxCount, startingInputCount, startingOutputCount, totalTxCount, maxBlockHeight, workerThreadCount};
     UTXOState utxoState;
     UTXOAddressState utxoAddressState;
     AddressState addressState{config.addressPath(), hashDb};
     UTXOScriptState utxoScriptState;
     
-    utxoAddressState.unserialize(config.utxoAddressStatePath().str());
-    utxoState.unserialize(config.utxoCacheFile().str());
-    utxoScriptState.unserialize(config.utxoScriptStatePath().str());
+    // The UTXO tables are mapped instead of loaded, and each one is stamped with the transaction count it was committed at
+    utxoAddressState.open(config.utxoAddressStatePath().str(), startingTxCount);
+    utxoState.open(config.utxoStateTablePath().str(), startingTxCount);
+    utxoState.importSerialized(config.utxoCacheFile().str());
+    utxoScriptState.open(config.utxoScriptStateTablePath().str(), startingTxCount);
+    utxoScriptState.importSerialized(config.utxoScriptStatePath().str());
     
     std::vector<blocksci::RawBlock> newBlocks;
     auto it = blocksToAdd.begin();
@@ -204,9 +256,10 @@ std::vector<blocksci::RawBlock> updateChain(const ParserConfiguration<ParserTag>
         backUpdateTxes(config);
     }
     
-    utxoAddressState.serialize(config.utxoAddressStatePath().str());
-    utxoState.serialize(config.utxoCacheFile().str());
-    utxoScriptState.serialize(config.utxoScriptStatePath().str());
+    auto finalTxCount = static_cast<int64_t>(startingTxCount) + totalTxCount;
+    utxoAddressState.flush(finalTxCount);
+    utxoState.flush(finalTxCount);
+    utxoScriptState.flush(finalTxCount);
     return newBlocks;
 }
 
@@ -239,7 +292,7 @@ ParserConfigurationBase getBaseConfig(const filesystem::path &configPath) {
     return {blocksci::loadBlockchainConfig(configPath.str(), true, 0)};
 }
 
-void updateChain(const filesystem::path &configFilePath, bool fullParse) {
+void updateChain(const filesystem::path &configFilePath, bool fullParse, unsigned int workerThreadCount) {
     auto jsonConf = blocksci::loadConfig(configFilePath.str());
     blocksci::checkVersion(jsonConf);
     
@@ -256,11 +309,11 @@ void updateChain(const filesystem::path &configFilePath, bool fullParse) {
     if (parserConf.find("disk") != parserConf.end()) {
         ChainDiskConfiguration diskConfig = parserConf.at("disk");
         ParserConfiguration<FileTag> config{dataConfig, diskConfig};
-        newBlocks = updateChain(config, blocksci::BlockHeight{maxBlock}, hashDb);
+        newBlocks = updateChain(config, blocksci::BlockHeight{maxBlock}, hashDb, workerThreadCount);
     } else if (parserConf.find("rpc") != parserConf.end()) {
         blocksci::ChainRPCConfiguration rpcConfig = parserConf.at("rpc");
         ParserConfiguration<RPCTag> config(dataConfig, rpcConfig);
-        newBlocks = updateChain(config, blocksci::BlockHeight{maxBlock}, hashDb);
+        newBlocks = updateChain(config, blocksci::BlockHeight{maxBlock}, hashDb, workerThreadCount);
     } else {
         throw std::runtime_error("Must provide either rpc or disk parsing settings");
     }
@@ -346,6 +399,9 @@ int main(int argc, char * argv[]) {
           rpcOptions
     ) % "Configuration options";
     
+    unsigned int workerThreadCount = std::max(std::thread::hardware_concurrency(), 1u);
+    auto threadsOption = (clipp::option("--threads", "-j") & clipp::value("threads", workerThreadCount)) % "Number of worker threads for each parallel parser step (default: number of cores)";
+    
     auto generateConfigCommand = clipp::command("generate-config").set(selected,mode::generateConfig) % "Create new BlockSci configuration";
     auto updateCommand = clipp::command("update").set(selected,mode::update) % "Update all BlockSci data";
     auto updateCoreCommand = clipp::command("core-update").set(selected,mode::updateCore) % "Update just the core BlockSci data (excluding indexes)";
@@ -358,7 +414,7 @@ int main(int argc, char * argv[]) {
     std::string configFilePathString;
     auto configFileOpt = clipp::value("config file", configFilePathString) % "Path to config file";
     
-    auto commands = (generateConfigCommand, configOptions) | updateCommand | updateCoreCommand | indexUpdateCommand | addressIndexUpdateCommand | hashIndexUpdateCommand | compactIndexesCommand | doctorCommand;
+    auto commands = (generateConfigCommand, configOptions) | (updateCommand, threadsOption) | (updateCoreCommand, threadsOption) | indexUpdateCommand | addressIndexUpdateCommand | hashIndexUpdateCommand | compactIndexesCommand | doctorCommand;
     
     auto cli = (configFileOpt, commands);
     
@@ -496,7 +552,7 @@ int main(int argc, char * argv[]) {
 
             auto config = getBaseConfig(configFilePath);
             lockDataDirectory(config);
-            updateChain(configFilePath, selected == mode::update);
+            updateChain(configFilePath, selected == mode::update, workerThreadCount);
             unlockDataDirectory(config);
             break;
         }
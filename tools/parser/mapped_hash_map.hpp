@@ -0,0 +1,518 @@
+//
+//  mapped_hash_map.hpp
+//  blocksci_parser
+//
+
+#ifndef mapped_hash_map_hpp
+#define mapped_hash_map_hpp
+
+#include "serializable_map.hpp"
+
+#include <internal/file_mapper.hpp>
+
+#include <cereal/archives/binary.hpp>
+
+#include <wjfilesystem/path.h>
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <unistd.h>
+
+struct MappedHashMapData {
+    int64_t commit;
+    int64_t table;
+    int64_t generation;
+    int64_t capacity;
+    int64_t size;
+    int64_t usedSlots;
+
+    MappedHashMapData() : commit(0), table(0), generation(0), capacity(0), size(0), usedSlots(0) {}
+
+    template<class Archive>
+    void serialize(Archive & archive)
+    {
+        archive(
+                commit,
+                table,
+                generation,
+                capacity,
+                size,
+                usedSlots
+        );
+    }
+};
+
+/** Open addressing hash table that lives in a memory-mapped file and is updated in place
+ *
+ * File(s): slot file, journal file and meta file
+ *     - slot file: <path>Table<table>.dat, capacity Slot entries implemented as FixedSizeFileMapper, last committed state
+ *     - journal file: <path>Journal.dat, pages of the slot file changed by the commit it names, only present while a flush applies them
+ *     - working file: <path>TableWork.dat, rebuilt table that replaces the slot file once it is committed
+ *     - meta file: <path>Meta.dat, serialized MappedHashMapData naming the commit and the slot file
+ *
+ * In contrast to SerializableMap, the table is never read or written as a whole. Opening it only maps the slot file
+ * and each lookup touches the pages it probes, so the resident memory follows the working set instead of the size
+ * of the map. Like google::dense_hash_map, empty and deleted slots are marked with sentinel keys. Collisions are
+ * resolved with linear probing and the table doubles in size once too many slots are in use.
+ *
+ * During an update the committed slot file is only read. The first change to a page copies it into memory and all
+ * further reads and writes of that page go to the copy. flush() writes the changed pages to the journal, commits by
+ * atomically replacing the meta file and only then copies the pages into the slot file, so it costs as much as the
+ * pages that changed. If a run dies before the meta file is replaced, the journal is ignored and the last commit
+ * stays untouched. If it dies afterwards, open() applies the journal again. A rehash writes the whole table anyway,
+ * so it builds the working file, which is modified directly from then on and renamed to a new slot file on commit.
+ * The same happens if so many pages change that keeping them in memory would cost more than a copy of the table.
+ *
+ * The meta file also records the generation (the transaction count of the chain) the table was committed at, which
+ * open() checks against the chain.
+ */
+template<typename Key, typename Value>
+class MappedHashMap {
+public:
+    struct Slot {
+        Key key;
+        Value value;
+    };
+
+    using size_type = int64_t;
+    using MissingKeyException = typename SerializableMap<Key, Value>::MissingKeyException;
+
+private:
+    using Table = blocksci::FixedSizeFileMapper<Slot, mio::access_mode::write>;
+
+    static constexpr size_type initialCapacity = size_type{1} << 16;
+
+    // Probe sequences get long quickly above this fill level, counting deleted slots as used
+    static constexpr double maxLoadFactor = 0.7;
+
+    // Unit of the copy-on-write tracking, roughly an OS page of slots
+    static constexpr size_type slotsPerPage = sizeof(Slot) >= 4096 ? 1 : 4096 / sizeof(Slot);
+
+    // Above this share of changed pages, copying the table is cheaper than holding and journaling the copies
+    static constexpr double maxDirtyShare = 0.25;
+
+    Key deletedKey;
+    Key emptyKey;
+    std::string path;
+    MappedHashMapData data;
+    std::unique_ptr<Table> table;
+
+    // Whether table is the working file, which is not committed yet and can be written directly
+    bool working = false;
+
+    // In-memory copies of the changed pages of the committed slot file, indexed by page number
+    std::vector<Slot *> pageCopies;
+    std::vector<std::pair<size_type, std::unique_ptr<Slot[]>>> dirtyPages;
+
+    filesystem::path metaPath() const {
+        return filesystem::path(path + "Meta.dat");
+    }
+
+    std::string tablePath(int64_t table) const {
+        return path + "Table" + std::to_string(table);
+    }
+
+    std::string journalPath() const {
+        return path + "Journal.dat";
+    }
+
+    std::string workPath() const {
+        return path + "TableWork";
+    }
+
+    std::string resizePath() const {
+        return path + "TableResize";
+    }
+
+    static size_type bucket(const Key &key, size_type capacity) {
+        // std::hash is the identity or a weak combine for most of our keys, so mix before masking off the low bits
+        uint64_t h = std::hash<Key>{}(key);
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ULL;
+        h ^= h >> 33;
+        return static_cast<size_type>(h & static_cast<uint64_t>(capacity - 1));
+    }
+
+    static size_type pageSlots(size_type page, size_type capacity) {
+        auto remaining = capacity - page * slotsPerPage;
+        return remaining < slotsPerPage ? remaining : slotsPerPage;
+    }
+
+    void clearSlots(Table &slots, size_type capacity) {
+        slots.truncate(capacity);
+        for (size_type i = 0; i < capacity; i++) {
+            auto slot = slots[i];
+            slot->key = emptyKey;
+            slot->value = Value{};
+        }
+    }
+
+    const Slot *slotAt(size_type pos) const {
+        auto copy = pageCopies.empty() ? nullptr : pageCopies[static_cast<size_t>(pos / slotsPerPage)];
+        if (copy != nullptr) {
+            return copy + pos % slotsPerPage;
+        }
+        return (*table)[pos];
+    }
+
+    Slot *writableSlotAt(size_type pos) {
+        if (working) {
+            return (*table)[pos];
+        }
+        auto page = pos / slotsPerPage;
+        auto &copy = pageCopies[static_cast<size_t>(page)];
+        if (copy == nullptr) {
+            if (static_cast<double>(dirtyPages.size() + 1) > static_cast<double>(pageCopies.size()) * maxDirtyShare) {
+                detach();
+                return (*table)[pos];
+            }
+            auto slotCount = pageSlots(page, data.capacity);
+            std::unique_ptr<Slot[]> pageCopy{new Slot[static_cast<size_t>(slotCount)]};
+            memcpy(pageCopy.get(), (*table)[page * slotsPerPage], static_cast<size_t>(slotCount) * sizeof(Slot));
+            copy = pageCopy.get();
+            dirtyPages.emplace_back(page, std::move(pageCopy));
+        }
+        return copy + pos % slotsPerPage;
+    }
+
+    void clearPageCopies() {
+        pageCopies.clear();
+        dirtyPages.clear();
+    }
+
+    /** Returns the position of the slot holding key or of the first empty slot in its probe sequence */
+    size_type probe(const Key &key) const {
+        auto mask = data.capacity - 1;
+        auto pos = bucket(key, data.capacity);
+        while (true) {
+            auto slot = slotAt(pos);
+            if (slot->key == key || slot->key == emptyKey) {
+                return pos;
+            }
+            pos = (pos + 1) & mask;
+        }
+    }
+
+    /** Switches to a working copy of the slot file with the changed pages applied */
+    void detach() {
+        table.reset();
+        copyFile(tablePath(data.table) + ".dat", workPath() + ".dat");
+        table = std::make_unique<Table>(workPath());
+        for (auto &page : dirtyPages) {
+            auto slotCount = pageSlots(page.first, data.capacity);
+            memcpy((*table)[page.first * slotsPerPage], page.second.get(), static_cast<size_t>(slotCount) * sizeof(Slot));
+        }
+        clearPageCopies();
+        working = true;
+    }
+
+    void rehash(size_type newCapacity) {
+        filesystem::path{resizePath() + ".dat"}.remove_file();
+        {
+            Table newTable{resizePath()};
+            clearSlots(newTable, newCapacity);
+            auto mask = newCapacity - 1;
+            for (size_type i = 0; i < data.capacity; i++) {
+                auto slot = slotAt(i);
+                if (slot->key == emptyKey || slot->key == deletedKey) {
+                    continue;
+                }
+                auto pos = bucket(slot->key, newCapacity);
+                while (!(newTable[pos]->key == emptyKey)) {
+                    pos = (pos + 1) & mask;
+                }
+                *newTable[pos] = *slot;
+            }
+        }
+        table.reset();
+        clearPageCopies();
+        if (std::rename((resizePath() + ".dat").c_str(), (workPath() + ".dat").c_str()) != 0) {
+            throw std::runtime_error("Failed to replace hash table at " + workPath() + ".dat");
+        }
+        table = std::make_unique<Table>(workPath());
+        working = true;
+        data.capacity = newCapacity;
+        data.usedSlots = data.size;
+    }
+
+    static void copyFile(const std::string &from, const std::string &to) {
+        std::ifstream in(from, std::ios::binary);
+        std::ofstream out(to, std::ios::binary | std::ios::trunc);
+        out << in.rdbuf();
+        out.flush();
+        if (!in.good() || !out.good()) {
+            throw std::runtime_error("Failed to copy hash table from " + from + " to " + to);
+        }
+    }
+
+    /** Writes contents to a temporary file, forces it to disk and renames it to filePath */
+    static void replaceFile(const std::string &filePath, const std::string &contents) {
+        auto tmpPath = filePath + ".tmp";
+        auto file = std::fopen(tmpPath.c_str(), "wb");
+        if (file == nullptr) {
+            throw std::runtime_error("Failed to open " + tmpPath);
+        }
+        bool written = std::fwrite(contents.data(), 1, contents.size(), file) == contents.size();
+        written = std::fflush(file) == 0 && written;
+        written = fsync(fileno(file)) == 0 && written;
+        written = std::fclose(file) == 0 && written;
+        if (!written) {
+            throw std::runtime_error("Failed to write " + tmpPath);
+        }
+        if (std::rename(tmpPath.c_str(), filePath.c_str()) != 0) {
+            throw std::runtime_error("Failed to replace " + filePath);
+        }
+    }
+
+    void writeMeta() {
+        std::ostringstream stream;
+        {
+            cereal::BinaryOutputArchive oa(stream);
+            oa(data);
+        }
+        replaceFile(metaPath().str(), stream.str());
+    }
+
+    void writeJournal() {
+        std::string contents;
+        auto append = [&](const void *bytes, size_t size) {
+            contents.append(reinterpret_cast<const char *>(bytes), size);
+        };
+        int64_t pageCount = static_cast<int64_t>(dirtyPages.size());
+        append(&data.commit, sizeof(data.commit));
+        append(&pageCount, sizeof(pageCount));
+        for (auto &page : dirtyPages) {
+            append(&page.first, sizeof(page.first));
+            append(page.second.get(), static_cast<size_t>(pageSlots(page.first, data.capacity)) * sizeof(Slot));
+        }
+        replaceFile(journalPath(), contents);
+    }
+
+    /** Copies the pages of a journal left by a flush that committed but didn't finish into the slot file, and removes any journal */
+    void replayJournal() {
+        filesystem::path journalFile{journalPath()};
+        if (!journalFile.exists()) {
+            return;
+        }
+        {
+            std::ifstream file(journalPath(), std::ios::binary);
+            int64_t commit = 0;
+            int64_t pageCount = 0;
+            file.read(reinterpret_cast<char *>(&commit), sizeof(commit));
+            file.read(reinterpret_cast<char *>(&pageCount), sizeof(pageCount));
+            if (!file.good()) {
+                throw std::runtime_error("Failed to read hash table journal at " + journalPath());
+            }
+            // A journal of any other commit was written by a flush that died before committing
+            if (commit == data.commit) {
+                Table slots{tablePath(data.table)};
+                for (int64_t i = 0; i < pageCount; i++) {
+                    size_type page = 0;
+                    file.read(reinterpret_cast<char *>(&page), sizeof(page));
+                    auto slotCount = pageSlots(page, data.capacity);
+                    file.read(reinterpret_cast<char *>(slots[page * slotsPerPage]), static_cast<std::streamsize>(slotCount) * static_cast<std::streamsize>(sizeof(Slot)));
+                    if (!file.good()) {
+                        throw std::runtime_error("Failed to read hash table journal at " + journalPath());
+                    }
+                }
+                slots.sync();
+            }
+        }
+        journalFile.remove_file();
+    }
+
+public:
+    MappedHashMap(const Key &deletedKey_, const Key &emptyKey_) : deletedKey(deletedKey_), emptyKey(emptyKey_) {}
+
+    MappedHashMap(const MappedHashMap &) = delete;
+    MappedHashMap &operator=(const MappedHashMap &) = delete;
+
+    ~MappedHashMap() {
+        // Changes that were never flushed must not survive, the committed table stays as it was
+        if (table) {
+            table.reset();
+            if (working) {
+                filesystem::path{workPath() + ".dat"}.remove_file();
+            }
+        }
+    }
+
+    /** Maps the table stored at path, creating an empty one if none exists yet. Returns whether an existing table was found
+     *
+     * generation is the state of the chain the table must have been committed at. A table committed at any other
+     * generation belongs to an update whose chain data was never written, which can only be fixed by a reparse.
+     */
+    bool open(const std::string &path_, int64_t generation) {
+        table.reset();
+        clearPageCopies();
+        working = false;
+        path = path_;
+        data = MappedHashMapData{};
+        filesystem::path{workPath() + ".dat"}.remove_file();
+        filesystem::path{resizePath() + ".dat"}.remove_file();
+        bool existing = metaPath().exists();
+        if (existing) {
+            {
+                std::ifstream file(metaPath().str(), std::ios::binary);
+                cereal::BinaryInputArchive ia(file);
+                ia(data);
+            }
+            // Left behind if a previous run died between renaming the slot file and committing the metadata, or before removing the replaced one
+            filesystem::path{tablePath(data.table + 1) + ".dat"}.remove_file();
+            filesystem::path{tablePath(data.table - 1) + ".dat"}.remove_file();
+            filesystem::path{metaPath().str() + ".tmp"}.remove_file();
+            filesystem::path{journalPath() + ".tmp"}.remove_file();
+            replayJournal();
+            if (data.generation != generation) {
+                throw std::runtime_error("Hash table at " + tablePath(data.table) + ".dat was committed at generation " + std::to_string(data.generation) + " but the chain is at generation " + std::to_string(generation) + ". A previous update did not finish, you need to reparse");
+            }
+            table = std::make_unique<Table>(tablePath(data.table));
+            pageCopies.resize(static_cast<size_t>((data.capacity + slotsPerPage - 1) / slotsPerPage), nullptr);
+        } else {
+            table = std::make_unique<Table>(workPath());
+            working = true;
+            data.generation = generation;
+            data.capacity = initialCapacity;
+            clearSlots(*table, data.capacity);
+        }
+        if (table->size() != data.capacity) {
+            throw std::runtime_error("Hash table at " + tablePath(data.table) + ".dat does not match its metadata");
+        }
+        return existing;
+    }
+
+    /** Moves all entries of a map stored by SerializableMap at legacyPath into this table and deletes the old file */
+    bool importSerialized(const std::string &legacyPath) {
+        filesystem::path legacyFile{legacyPath};
+        if (!legacyFile.exists()) {
+            return false;
+        }
+        SerializableMap<Key, Value> legacy{deletedKey, emptyKey};
+        legacy.unserialize(legacyPath);
+        reserve(size() + static_cast<size_type>(legacy.size()));
+        for (auto &entry : legacy) {
+            add(entry.first, entry.second);
+        }
+        auto generation = data.generation;
+        flush(generation);
+        legacyFile.remove_file();
+        open(path, generation);
+        return true;
+    }
+
+    /** Commits the changes as the state of the chain at generation and closes the table
+     *
+     * Until the metadata rename succeeds, the previous metadata and the slot file it names are left as they were.
+     */
+    void flush(int64_t generation) {
+        if (!table) {
+            return;
+        }
+        data.commit++;
+        data.generation = generation;
+        if (working) {
+            table->sync();
+            table.reset();
+            auto previousTable = data.table;
+            data.table++;
+            if (std::rename((workPath() + ".dat").c_str(), (tablePath(data.table) + ".dat").c_str()) != 0) {
+                throw std::runtime_error("Failed to commit hash table to " + tablePath(data.table) + ".dat");
+            }
+            writeMeta();
+            filesystem::path{tablePath(previousTable) + ".dat"}.remove_file();
+        } else if (dirtyPages.empty()) {
+            table.reset();
+            writeMeta();
+        } else {
+            writeJournal();
+            writeMeta();
+            for (auto &page : dirtyPages) {
+                auto slotCount = pageSlots(page.first, data.capacity);
+                memcpy((*table)[page.first * slotsPerPage], page.second.get(), static_cast<size_t>(slotCount) * sizeof(Slot));
+            }
+            table->sync();
+            table.reset();
+            filesystem::path{journalPath()}.remove_file();
+        }
+        clearPageCopies();
+        working = false;
+    }
+
+    size_type size() const {
+        return data.size;
+    }
+
+    size_type capacity() const {
+        return data.capacity;
+    }
+
+    /** Grows the table ahead of time so that count entries fit without further rehashing */
+    void reserve(size_type count) {
+        auto newCapacity = data.capacity;
+        while (static_cast<double>(count) > static_cast<double>(newCapacity) * maxLoadFactor) {
+            newCapacity *= 2;
+        }
+        if (newCapacity > data.capacity) {
+            rehash(newCapacity);
+        }
+    }
+
+    bool contains(const Key &key) const {
+        return slotAt(probe(key))->key == key;
+    }
+
+    void add(const Key &key, const Value &value) {
+        if (static_cast<double>(data.usedSlots + 1) > static_cast<double>(data.capacity) * maxLoadFactor) {
+            // Only double if live entries fill the table, otherwise rehashing at the same size clears out deleted slots
+            auto newCapacity = static_cast<double>(data.size + 1) > static_cast<double>(data.capacity) * maxLoadFactor / 2 ? data.capacity * 2 : data.capacity;
+            rehash(newCapacity);
+        }
+        auto mask = data.capacity - 1;
+        auto pos = bucket(key, data.capacity);
+        size_type reusable = -1;
+        while (true) {
+            auto slot = slotAt(pos);
+            if (slot->key == key) {
+                return;
+            } else if (slot->key == emptyKey) {
+                if (reusable == -1) {
+                    reusable = pos;
+                    data.usedSlots++;
+                }
+                break;
+            } else if (slot->key == deletedKey && reusable == -1) {
+                reusable = pos;
+            }
+            pos = (pos + 1) & mask;
+        }
+        auto slot = writableSlotAt(reusable);
+        slot->key = key;
+        slot->value = value;
+        data.size++;
+    }
+
+    Value erase(const Key &key) {
+        auto pos = probe(key);
+        if (!(slotAt(pos)->key == key)) {
+            throw MissingKeyException();
+        }
+        auto slot = writableSlotAt(pos);
+        Value value = slot->value;
+        slot->key = deletedKey;
+        data.size--;
+        return value;
+    }
+};
+
+#endif /* mapped_hash_map_hpp */
@@ -30,18 +30,28 @@ struct ParserConfigurationBase {
         return filesystem::path{dataConfig.chainConfig.dataDirectory}/"parser";
     }
 
-    // File that contains the serialization of the UTXOState class which maps raw output pointers to output data
+    // Prefix of the memory-mapped hash table (MappedHashMap) of the UTXOState class which maps raw output pointers to output data
+    filesystem::path utxoStateTablePath() const {
+        return parserDirectory()/"utxoState";
+    }
+
+    // Serialization of the UTXOState class written by older versions, imported into utxoStateTablePath() on the next update
     filesystem::path utxoCacheFile() const {
         return parserDirectory()/"utxoCache.dat";
     }
 
-    /* Directory that stores the serialization of the UTXOAddressState class. For each address type, this contains mapping from output
+    /* Directory that stores the tables of the UTXOAddressState class. For each address type, this contains mapping from output
        pointers to addresses of that type to data necessary to parse the input script spending an output of that type */
     filesystem::path utxoAddressStatePath() const {
         return parserDirectory()/"utxoAddressState";
     }
 
-    // File that contains the serialization of the UTXOScriptState class which maps output pointers to the scriptNum of the containted script
+    // Prefix of the memory-mapped hash table of the UTXOScriptState class which maps output pointers to the scriptNum of the containted script
+    filesystem::path utxoScriptStateTablePath() const {
+        return parserDirectory()/"utxoScriptState";
+    }
+
+    // Serialization of the UTXOScriptState class written by older versions, imported into utxoScriptStateTablePath() on the next update
     filesystem::path utxoScriptStatePath() const {
         return parserDirectory()/"utxoScriptState.dat";
     }
@@ -64,7 +74,7 @@ struct ParserConfigurationBase {
 
     /** Stores serialized OutputLinkData, memory-mapped as blocksci::FixedSizeFileMapper<OutputLinkData>
      *
-     * OutputLinkData links an output (InoutPointer) with the spending transaction (tx number)
+     * OutputLinkData links an output (InoutPointer) with the spending transaction (tx number) and the spending input's number in it
      */
     std::string txUpdatesFilePath() const {
         return (parserDirectory()/"txUpdates").str();
@@ -66,6 +66,9 @@ public:
     template<typename EquivType>
     void updateScript(std::false_type, EquivType, const blocksci::State &, const blocksci::ScriptAccess &) {}
     
+    /** Called at the end of every update before its progress is recorded, indexes that buffer writes persist them here */
+    void finishUpdate() {}
+    
     void runUpdate(const blocksci::State &state);
 };
 
@@ -88,6 +91,12 @@ void ParserIndex<T>::runUpdate(const blocksci::State &state) {
     blocksci::ChainAccess chain{config.dataConfig.chainDirectory(), config.dataConfig.blocksIgnored, config.dataConfig.errorOnReorg};
     blocksci::ScriptAccess scripts{config.dataConfig.scriptsDirectory()};
     
+    // A fresh index is written as sorted SST files that are ingested at the end, so it doesn't need to be compacted
+    bool initialBuild = latestState.txCount == 0 && latestState.txCount < state.txCount;
+    if (initialBuild) {
+        static_cast<T*>(this)->startBulkLoad();
+    }
+    
     if (latestState.txCount < state.txCount) {
         auto newCount = state.txCount - latestState.txCount;
         std::cout << "Updating index with " << newCount << " txes\n";
@@ -103,6 +112,10 @@ void ParserIndex<T>::runUpdate(const blocksci::State &state) {
         
     ParserScriptUpdater<T> updater(*this, state, scripts);
     blocksci::for_each(blocksci::DedupAddressType::all(), updater);
+    if (initialBuild) {
+        static_cast<T*>(this)->finishBulkLoad();
+    }
+    static_cast<T*>(this)->finishUpdate();
     latestState = state;
 }
 
@@ -162,7 +162,17 @@ TransactionHeader::TransactionHeader(SafeMemReader &reader) {
     realSize = static_cast<uint32_t>(reader.offset() - startOffset);
 }
 
+blocksci::HashInput RawTransaction::hashInput() const {
+    // The txid covers the serialization without the segwit marker, flag and witnesses
+    blocksci::HashInput input;
+    input.append(&version, sizeof(version));
+    input.append(txHashStart, txHashLength);
+    input.append(&locktime, sizeof(locktime));
+    return input;
+}
+
 void RawTransaction::calculateHash() {
+    // A single message would leave all but one lane of the batch implementation idle, OpenSSL is faster here
     if (hash.IsNull()) {
         SHA256_CTX sha256CTX;
         SHA256_Init(&sha256CTX);
@@ -174,6 +184,22 @@ void RawTransaction::calculateHash() {
     }
 }
 
+void calculateHashes(const std::vector<RawTransaction *> &txes) {
+    std::vector<RawTransaction *> unhashed;
+    std::vector<blocksci::HashInput> inputs;
+    for (auto tx : txes) {
+        if (tx->hash.IsNull()) {
+            unhashed.push_back(tx);
+            inputs.push_back(tx->hashInput());
+        }
+    }
+    std::vector<blocksci::uint256> hashes(inputs.size());
+    blocksci::doubleSha256Batch(inputs.data(), inputs.size(), hashes.data());
+    for (size_t i = 0; i < unhashed.size(); i++) {
+        unhashed[i]->hash = hashes[i];
+    }
+}
+
 #endif
 
 #ifdef BLOCKSCI_RPC_PARSER
@@ -12,10 +12,13 @@
 #include "config.hpp"
 #include "script_output.hpp"
 #include "script_input.hpp"
+#include "output_spend_data.hpp"
 #include "utxo.hpp"
 
 #include <blocksci/core/bitcoin_uint256.hpp>
 
+#include <internal/sha256_batch.hpp>
+
 #include <boost/container/small_vector.hpp>
 
 struct getrawtransaction_t;
@@ -150,6 +153,12 @@ struct RawTransaction {
     boost::container::small_vector<AnyScriptInput, 4> scriptInputs;
     boost::container::small_vector<AnyScriptOutput, 4> scriptOutputs;
     
+    /** Data about the outputs spent by each input, needed to parse the input scripts */
+    std::vector<AnySpendData> inputSpendData;
+    
+    /** Hash index lookups for the addresses of this transaction, resolved in batches ahead of assigning scriptNums */
+    std::vector<AddressLookupRequest> addressLookups;
+    
     
     RawTransaction() :
       txNum(0),
@@ -168,6 +177,9 @@ struct RawTransaction {
     void load(const getrawtransaction_t &txinfo, uint32_t txNum, blocksci::BlockHeight blockHeight, bool witnessActivated);
     #endif
     
+    /** The parts of the serialized transaction that its hash covers */
+    blocksci::HashInput hashInput() const;
+    
     void calculateHash();
     
     blocksci::uint256 getHash(const InputView &info, const blocksci::CScriptView &scriptView, int hashType) const;
@@ -177,4 +189,7 @@ struct RawTransaction {
 };
 
 
+/** Calculates the hashes of all given transactions that don't have one yet, hashing several of them at once */
+void calculateHashes(const std::vector<RawTransaction *> &txes);
+
 #endif /* preproccessed_block_hpp */
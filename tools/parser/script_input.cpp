@@ -30,6 +30,10 @@ struct ScriptInputGenerator {
 
 AnyScriptInput::AnyScriptInput(const InputView &inputView, const blocksci::CScriptView &scriptView, const RawTransaction &tx, const AnySpendData &spendData) : wrapped(mpark::visit(ScriptInputGenerator(inputView, scriptView, tx), spendData.wrapped)) {}
 
+void AnyScriptInput::prefetch(AddressState &state, std::vector<AddressLookupRequest> &lookups) {
+    mpark::visit([&](auto &scriptInput) { scriptInput.prefetch(state, lookups); }, wrapped);
+}
+
 void AnyScriptInput::process(AddressState &state) {
     mpark::visit([&](auto &scriptInput) { scriptInput.process(state); }, wrapped);
 }
@@ -73,6 +77,11 @@ ScriptInputData<blocksci::AddressType::Enum::SCRIPTHASH>::ScriptInputData(std::p
 
 ScriptInputData<blocksci::AddressType::Enum::SCRIPTHASH>::ScriptInputData(const InputView &inputView, const blocksci::CScriptView &scriptView, const RawTransaction &tx, const SpendData<blocksci::AddressType::Enum::SCRIPTHASH> &spendData) : ScriptInputData(p2shGenerate(inputView, scriptView, tx, spendData)) {}
 
+void ScriptInputData<blocksci::AddressType::Enum::SCRIPTHASH>::prefetch(AddressState &state, std::vector<AddressLookupRequest> &lookups) {
+    wrappedScriptOutput.prefetch(state, lookups);
+    wrappedScriptInput->prefetch(state, lookups);
+}
+
 void ScriptInputData<blocksci::AddressType::Enum::SCRIPTHASH>::process(AddressState &state) {
     uint32_t scriptNum = wrappedScriptOutput.resolve(state);
     wrappedScriptInput->process(state);
@@ -144,6 +153,11 @@ ScriptInputData<blocksci::AddressType::Enum::WITNESS_SCRIPTHASH>::ScriptInputDat
 
 ScriptInputData<blocksci::AddressType::Enum::WITNESS_SCRIPTHASH>::ScriptInputData(const InputView &inputView, const blocksci::CScriptView &scriptView, const RawTransaction &tx, const SpendData<blocksci::AddressType::Enum::WITNESS_SCRIPTHASH> &spendData) : ScriptInputData(p2shWitnessGenerate(inputView, scriptView, tx, spendData)) {}
 
+void ScriptInputData<blocksci::AddressType::Enum::WITNESS_SCRIPTHASH>::prefetch(AddressState &state, std::vector<AddressLookupRequest> &lookups) {
+    wrappedScriptOutput.prefetch(state, lookups);
+    wrappedScriptInput->prefetch(state, lookups);
+}
+
 void ScriptInputData<blocksci::AddressType::Enum::WITNESS_SCRIPTHASH>::process(AddressState &state) {
     uint32_t scriptNum = wrappedScriptOutput.resolve(state);
     wrappedScriptInput->process(state);
@@ -37,12 +37,17 @@ struct ScriptInput {
     
     ScriptInput(const InputView &inputView, const blocksci::CScriptView &scriptView, const RawTransaction &tx, const SpendData<type> &spendData) : data(inputView, scriptView, tx, spendData) {}
     
+    void prefetch(AddressState &state, std::vector<AddressLookupRequest> &lookups) {
+        data.prefetch(state, lookups);
+    }
+    
     void process(AddressState &state) {
         data.process(state);
     }
 };
 
 struct ScriptInputDataBase {
+    void prefetch(AddressState &, std::vector<AddressLookupRequest> &) {}
     void process(AddressState &) {}
 };
 
@@ -108,6 +113,7 @@ struct ScriptInputData<blocksci::AddressType::Enum::SCRIPTHASH> : public ScriptI
     
     ScriptInputData(const InputView &inputView, const blocksci::CScriptView &scriptView, const RawTransaction &tx, const SpendData<blocksci::AddressType::Enum::SCRIPTHASH> &);
     
+    void prefetch(AddressState &state, std::vector<AddressLookupRequest> &lookups);
     void process(AddressState &state);
 
 private:
@@ -121,6 +127,7 @@ struct ScriptInputData<blocksci::AddressType::Enum::WITNESS_SCRIPTHASH> : public
     
     ScriptInputData(const InputView &inputView, const blocksci::CScriptView &scriptView, const RawTransaction &tx, const SpendData<blocksci::AddressType::Enum::WITNESS_SCRIPTHASH> &);
     
+    void prefetch(AddressState &state, std::vector<AddressLookupRequest> &lookups);
     void process(AddressState &state);
 
 private:
@@ -136,6 +143,7 @@ public:
     AnyScriptInput() = default;
     AnyScriptInput(const InputView &inputView, const blocksci::CScriptView &scriptView, const RawTransaction &tx, const AnySpendData &spendData);
     
+    void prefetch(AddressState &state, std::vector<AddressLookupRequest> &lookups);
     void process(AddressState &state);
 
     void setScriptNum(uint32_t scriptNum);
@@ -165,6 +165,10 @@ blocksci::AddressType::Enum AnyScriptOutput::type() const {
     return mpark::visit([&](auto &output) { return output.address_v; }, wrapped);
 }
 
+void AnyScriptOutput::prefetch(AddressState &state, std::vector<AddressLookupRequest> &lookups) {
+    mpark::visit([&](auto &output) { output.prefetch(state, lookups); }, wrapped);
+}
+
 uint32_t AnyScriptOutput::resolve(AddressState &state) {
     return mpark::visit([&](auto &output) { return output.resolve(state); }, wrapped);
 }
@@ -23,13 +23,23 @@ struct ScriptOutput {
     ScriptOutputData<type> data;
     uint32_t scriptNum = 0;
     bool isNew = false;
+    bool prefetched = false;
+    RawAddressInfo<type> prefetchedInfo;
     
     ScriptOutput() = default;
     ScriptOutput(const ScriptOutputData<type> &data_) : data(data_) {}
     
+    void prefetch(AddressState &state, std::vector<AddressLookupRequest> &lookups) {
+        prefetched = state.prefetchAddress(data, prefetchedInfo, lookups);
+    }
+    
     uint32_t resolve(AddressState &state) {
-        auto addressInfo = state.findAddress(data);
-        std::tie(scriptNum, isNew) = state.resolveAddress(addressInfo);
+        if (prefetched) {
+            std::tie(scriptNum, isNew) = state.resolveAddress(state.confirmAddress(prefetchedInfo));
+        } else {
+            auto addressInfo = state.findAddress(data);
+            std::tie(scriptNum, isNew) = state.resolveAddress(addressInfo);
+        }
         assert(scriptNum > 0);
         if (isNew) {
             data.visitWrapped([&](auto &output) { output.resolve(state); });
@@ -212,6 +222,7 @@ public:
     AnyScriptOutput() = default;
     AnyScriptOutput(const blocksci::CScriptView &scriptPubKey, bool p2shActivated, bool witnessActivated);
 
+    void prefetch(AddressState &state, std::vector<AddressLookupRequest> &lookups);
     uint32_t resolve(AddressState &state);
     bool isValid() const;
 };
@@ -32,22 +32,15 @@ AnySpendData UTXOAddressState::spendOutput(const blocksci::InoutPointer &pointer
     return AnySpendData{spendOutputTable.at(index)(pointer, *this)};
 }
 
-void UTXOAddressState::unserialize(const std::string &path) {
+void UTXOAddressState::open(const std::string &path, int64_t generation) {
     blocksci::for_each(addressTypeStates, [&](auto &addressTypeState) {
-        std::stringstream ss;
-        ss << addressName(addressTypeState.type);
-        ss << ".dat";
-        auto fullPath = filesystem::path{path} / ss.str();
-        addressTypeState.unserialize(fullPath.str());
+        auto fullPath = filesystem::path{path} / addressName(addressTypeState.type);
+        addressTypeState.open(fullPath.str(), fullPath.str() + ".dat", generation);
     });
 }
 
-void UTXOAddressState::serialize(const std::string &path) {
+void UTXOAddressState::flush(int64_t generation) {
     blocksci::for_each(addressTypeStates, [&](auto &addressTypeState) {
-        std::stringstream ss;
-        ss << addressName(addressTypeState.type);
-        ss << ".dat";
-        auto fullPath = filesystem::path{path} / ss.str();
-        addressTypeState.serialize(fullPath.str());
+        addressTypeState.flush(generation);
     });
 }
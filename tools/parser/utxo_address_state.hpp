@@ -10,25 +10,29 @@
 
 #include "parser_fwd.hpp"
 #include "output_spend_data.hpp"
-#include "serializable_map.hpp"
+#include "mapped_hash_map.hpp"
 
 #include <blocksci/core/inout_pointer.hpp>
 
 template<blocksci::AddressType::Enum addressType>
 class UTXOAddressTypeState {
-    SerializableMap<blocksci::InoutPointer, SpendData<addressType>> map;
+    MappedHashMap<blocksci::InoutPointer, SpendData<addressType>> map;
 public:
     
     static constexpr auto type = addressType;
     
     UTXOAddressTypeState() : map({0, 0}, {0, 1}) {}
     
-    void unserialize(const std::string &path) {
-        map.unserialize(path);
+    // Types without spend data never touch the map, so don't create a table for them
+    void open(const std::string &path, const std::string &legacyPath, int64_t generation) {
+        if (!std::is_empty<SpendData<addressType>>::value) {
+            map.open(path, generation);
+            map.importSerialized(legacyPath);
+        }
     }
     
-    void serialize(const std::string &path) {
-        map.serialize(path);
+    void flush(int64_t generation) {
+        map.flush(generation);
     }
     
     template<typename T = SpendData<addressType>, std::enable_if_t<std::is_empty<T>::value, int> = 0>
@@ -61,8 +65,8 @@ private:
     
 public:
     
-    void unserialize(const std::string &path);
-    void serialize(const std::string &path);
+    void open(const std::string &path, int64_t generation);
+    void flush(int64_t generation);
     
     AnySpendData spendOutput(const blocksci::InoutPointer &outputPointer, blocksci::AddressType::Enum type);
     void addOutput(const AnySpendData &spendData, const blocksci::InoutPointer &outputPointer);